@@ -0,0 +1,201 @@
+/** @file
+*
+*  Dumps and resets the per-command SD/MMC counters kept by the host
+*  controller drivers.
+*
+*    MmcStats [-r]
+*
+*    -r  Reset the counters after printing them.
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/ShellLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/RaspberryPiMmcStats.h>
+
+STATIC CONST SHELL_PARAM_ITEM mParamList[] = {
+  { L"-r", TypeFlag },
+  { NULL,  TypeMax }
+};
+
+STATIC
+UINT64
+TicksToUs (
+  IN UINT64 Ticks,
+  IN UINT64 TimerFrequency
+  )
+{
+  return DivU64x64Remainder (MultU64x32 (Ticks, 1000000), TimerFrequency, NULL);
+}
+
+STATIC
+VOID
+PrintCommandStats (
+  IN UINTN                                Index,
+  IN CONST RASPBERRY_PI_MMC_COMMAND_STATS *Stats,
+  IN UINT64                               TimerFrequency
+  )
+{
+  UINTN Bucket;
+
+  Print (L"%a%-2u  %8lu %6lu %6lu %6lu %12lu %10lu %10lu\n",
+    Index >= MMC_STATS_APP_COMMAND_BASE ? "ACMD" : " CMD",
+    Index % MMC_STATS_APP_COMMAND_BASE,
+    Stats->Count,
+    Stats->Retries,
+    Stats->Timeouts,
+    Stats->Errors,
+    Stats->Bytes,
+    TicksToUs (DivU64x64Remainder (Stats->Ticks, Stats->Count, NULL), TimerFrequency),
+    TicksToUs (Stats->PollTicks, TimerFrequency));
+
+  if (Stats->MmioReads != 0 || Stats->MmioWrites != 0) {
+    Print (L"          MMIO: %lu reads, %lu writes\n", Stats->MmioReads, Stats->MmioWrites);
+  }
+
+  //
+  // Normalised to a MiB, so transfer paths can be compared whatever the
+  // request sizes were.
+  //
+  if (Stats->Bytes >= SIZE_1MB) {
+    Print (L"          per MiB: %lu reads, %lu writes, %lu us\n",
+      DivU64x64Remainder (MultU64x32 (Stats->MmioReads, SIZE_1MB), Stats->Bytes, NULL),
+      DivU64x64Remainder (MultU64x32 (Stats->MmioWrites, SIZE_1MB), Stats->Bytes, NULL),
+      DivU64x64Remainder (MultU64x32 (TicksToUs (Stats->Ticks, TimerFrequency), SIZE_1MB),
+        Stats->Bytes, NULL));
+  }
+
+  for (Bucket = 0; Bucket < MMC_STATS_HISTOGRAM_BUCKETS; Bucket++) {
+    if (Stats->Histogram[Bucket] == 0) {
+      continue;
+    }
+
+    Print (L"          < %10lu us: %u\n",
+      TicksToUs (LShiftU64 (1, Bucket + 1), TimerFrequency),
+      Stats->Histogram[Bucket]);
+  }
+}
+
+STATIC
+VOID
+PrintStats (
+  IN RASPBERRY_PI_MMC_STATS_PROTOCOL *MmcStats
+  )
+{
+  EFI_STATUS                    Status;
+  CONST RASPBERRY_PI_MMC_STATS  *Stats;
+  UINTN                         Index;
+  UINT64                        PioRate;
+
+  Status = MmcStats->GetStats (MmcStats, &Stats);
+  if (EFI_ERROR (Status) || Stats->TimerFrequency == 0) {
+    Print (L"%s: no statistics: %r\n", MmcStats->ControllerName, Status);
+    return;
+  }
+
+  Print (L"%s:\n", MmcStats->ControllerName);
+
+  //
+  // What the CPU manages when it moves the data itself, in hundredths of
+  // 32-bit words per microsecond.
+  //
+  if (Stats->PioTicks != 0) {
+    PioRate = DivU64x64Remainder (MultU64x32 (Stats->PioWords, 100),
+                TicksToUs (Stats->PioTicks, Stats->TimerFrequency) + 1, NULL);
+    Print (L"PIO: %lu words in %lu us, %lu.%02lu words/us\n",
+      Stats->PioWords, TicksToUs (Stats->PioTicks, Stats->TimerFrequency),
+      DivU64x32 (PioRate, 100), ModU64x32 (PioRate, 100));
+  }
+
+  //
+  // The cost of PIO is mostly register traffic: besides the data itself,
+  // every FIFO level or status check is another bus round trip.
+  //
+  if (Stats->PioWords != 0) {
+    PioRate = DivU64x64Remainder (MultU64x32 (Stats->PioMmioReads + Stats->PioMmioWrites, 100),
+                Stats->PioWords, NULL);
+    Print (L"PIO: %lu reads, %lu writes, %lu.%02lu accesses/word\n",
+      Stats->PioMmioReads, Stats->PioMmioWrites,
+      DivU64x32 (PioRate, 100), ModU64x32 (PioRate, 100));
+  }
+
+  Print (L"MMIO: %lu reads, %lu writes\n", Stats->MmioReads, Stats->MmioWrites);
+
+  Print (L"Command     Count  Retry  Tmout    Err        Bytes    Avg(us)   Poll(us)\n");
+
+  for (Index = 0; Index < MMC_STATS_NUM_COMMANDS; Index++) {
+    if (Stats->Commands[Index].Count != 0) {
+      PrintCommandStats (Index, &Stats->Commands[Index], Stats->TimerFrequency);
+    }
+  }
+}
+
+EFI_STATUS
+EFIAPI
+MmcStatsMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS                      Status;
+  LIST_ENTRY                      *Package;
+  CHAR16                          *ProblemParam;
+  EFI_HANDLE                      *Handles;
+  UINTN                           HandleCount;
+  UINTN                           Index;
+  RASPBERRY_PI_MMC_STATS_PROTOCOL *MmcStats;
+  BOOLEAN                         Reset;
+
+  Status = ShellCommandLineParse (mParamList, &Package, &ProblemParam, TRUE);
+  if (EFI_ERROR (Status)) {
+    if (Status == EFI_VOLUME_CORRUPTED && ProblemParam != NULL) {
+      Print (L"MmcStats: unknown option '%s'\n", ProblemParam);
+      FreePool (ProblemParam);
+    }
+    Print (L"Usage: MmcStats [-r]\n");
+    return Status;
+  }
+
+  Reset = ShellCommandLineGetFlag (Package, L"-r");
+  ShellCommandLineFreeVarList (Package);
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gRaspberryPiMmcStatsProtocolGuid,
+                  NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    Print (L"MmcStats: no SD/MMC host statistics available\n");
+    return Status;
+  }
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gRaspberryPiMmcStatsProtocolGuid,
+                    (VOID **)&MmcStats);
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    PrintStats (MmcStats);
+
+    if (Reset) {
+      Status = MmcStats->ResetStats (MmcStats);
+      Print (L"%s: counters reset: %r\n", MmcStats->ControllerName, Status);
+    }
+  }
+
+  FreePool (Handles);
+  return EFI_SUCCESS;
+}
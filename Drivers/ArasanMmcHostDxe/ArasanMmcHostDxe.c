@@ -19,41 +19,44 @@
 
 #define DEBUG_MMCHOST_SD DEBUG_VERBOSE
 
-BOOLEAN PreviousIsCardPresent = FALSE;
-UINT32 LastExecutedCommand = (UINT32) -1;
+STATIC UINT32 mPendingCommand = NO_PENDING_COMMAND;
+STATIC UINT32 mPendingArgument;
+
+// Set when the card takes CMD23 and the host can send it on its own (SDHCI 3.0).
+STATIC BOOLEAN mAutoCmd23;
+// Set once the card was given an explicit CMD23 for the pending transfer.
+STATIC BOOLEAN mBlockCountSet;
+// Set when the last multi-block transfer was stopped by the host itself.
+STATIC BOOLEAN mAutoStopped;
+// Set when the CMD12 that follows such a transfer was swallowed.
+STATIC BOOLEAN mAutoStopResponse;
+// Set when the SCR says the card can do a 4-bit bus.
+STATIC BOOLEAN mCardHas4BitBus;
+// Argument of the last CMD6, to tell a switch from a check.
+STATIC UINT32 mSwitchArgument;
+// Set once the card answered CMD1, i.e. it is (e)MMC rather than SD
+STATIC BOOLEAN mIsMmcCard;
+// EXT_CSD CARD_TYPE, 0 until MmcDxe has read the EXT_CSD
+STATIC UINT8 mMmcCardType;
+// Dual data rate (UHS mode DDR50) is selected
+STATIC BOOLEAN mDdr;
+// Relative card address, 0 until the card has one
+STATIC UINT32 mRca;
+// Set when the card is addressed in blocks rather than bytes (OCR CCS)
+STATIC BOOLEAN mHighCapacity;
+// Set when the eMMC can TRIM, i.e. erase single write blocks
+STATIC BOOLEAN mMmcTrim;
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL *mFwProtocol;
+STATIC EFI_EVENT mExitBootServicesEvent;
+STATIC EFI_EVENT mCardDetectEvent;
 
-typedef struct
-{
-  VENDOR_DEVICE_PATH  Mmc;
-  EFI_DEVICE_PATH     End;
-} MMCHS_DEVICE_PATH;
+// Card presence as last sampled by MMCCardDetect
+STATIC BOOLEAN mIsCardPresent;
 
-MMCHS_DEVICE_PATH gMMCDevicePath =
-  {
-    {
-      {
-        HARDWARE_DEVICE_PATH,
-        HW_VENDOR_DP,
-        {
-          (UINT8)(sizeof(VENDOR_DEVICE_PATH)),
-          (UINT8)((sizeof(VENDOR_DEVICE_PATH)) >> 8),
-        }
-      },
-      {
-        0xb615f1f5, 0x5088, 0x43cd, { 0x80, 0x9c, 0xa1, 0x6e, 0x52, 0x48, 0x7d, 0x00 }
-      }
-    },
-    {
-      END_DEVICE_PATH_TYPE,
-      END_ENTIRE_DEVICE_PATH_SUBTYPE,
-      {
-        sizeof(EFI_DEVICE_PATH_PROTOCOL),
-        0
-      }
-    }
-  };
+// Last computed SYSCTL divisor field and the SD clock it gives, for diagnostics
+STATIC UINT32 mLastDivisor;
+STATIC UINTN mLastClockFrequency;
 
 /**
    These SD commands are optional, according to the SD Spec
@@ -81,7 +84,7 @@ TranslateCommand(
 {
   UINT32 Translation = 0xffffffff;
 
-  if (LastExecutedCommand == CMD55) {
+  if (MmcHostIsAppCommand()) {
     switch (Command) {
     case MMC_CMD6:
       Translation = ACMD6;
@@ -116,14 +119,16 @@ TranslateCommand(
       Translation = CMD5;
       break;
     case MMC_CMD6:
-      Translation = CMD6;
+      // SWITCH on (e)MMC has no data phase and takes an R1b
+      Translation = mIsMmcCard ? CMD6_MMC : CMD6;
       DEBUG((DEBUG_MMCHOST_SD, "CMD6\n"));
       break;
     case MMC_CMD7:
       Translation = CMD7;
       break;
     case MMC_CMD8:
-      Translation = CMD8;
+      // SEND_IF_COND on SD, SEND_EXT_CSD on (e)MMC
+      Translation = mIsMmcCard ? CMD8_MMC : CMD8;
       break;
     case MMC_CMD9:
       Translation = CMD9;
@@ -152,6 +157,9 @@ TranslateCommand(
     case MMC_CMD24:
       Translation = CMD24;
       break;
+    case MMC_CMD25:
+      Translation = CMD25;
+      break;
     case MMC_CMD55:
       Translation = CMD55;
       DEBUG((DEBUG_MMCHOST_SD, "APP command NEXT\n"));
@@ -164,34 +172,6 @@ TranslateCommand(
   return Translation;
 }
 
-/**
-   Repeatedly polls a register until its value becomes correct, or until MAX_RETRY_COUNT polls is reached
-**/
-EFI_STATUS
-PollRegisterWithMask(
-                     IN UINTN Register,
-                     IN UINTN Mask,
-                     IN UINTN ExpectedValue
-                     )
-{
-  UINTN RetryCount = 0;
-
-  while (RetryCount < MAX_RETRY_COUNT) {
-    if ((MmioRead32(Register) & Mask) != ExpectedValue) {
-      RetryCount++;
-      gBS->Stall(STALL_AFTER_RETRY_US);
-    } else {
-      break;
-    }
-  }
-
-  if (RetryCount == MAX_RETRY_COUNT) {
-    return EFI_TIMEOUT;
-  }
-
-  return EFI_SUCCESS;
-}
-
 /**
    Calculate the clock divisor
 **/
@@ -206,23 +186,18 @@ CalculateClockFrequencyDivisor(
   UINT32 Divisor;
   UINT32 BaseFrequency = 0;
 
-  Status = mFwProtocol->GetClockRate(RPI_FW_CLOCK_RATE_EMMC, &BaseFrequency);
+  Status = MmcHostGetClockRate(RPI_FW_CLOCK_RATE_EMMC, &BaseFrequency);
   if (EFI_ERROR(Status)) {
     DEBUG((DEBUG_MMCHOST_SD, "Couldn't get RPI_FW_CLOCK_RATE_EMMC\n"));
     return Status;
   }
 
   ASSERT (BaseFrequency != 0);
-  Divisor = BaseFrequency / TargetFrequency;
 
   // Arasan controller is based on 3.0 spec so the div is multiple of 2
   // Actual Frequency = BaseFequency/(Div*2)
-  Divisor /= 2;
-
-  if ((TargetFrequency < BaseFrequency) &&
-      (TargetFrequency * 2 * Divisor != BaseFrequency)) {
-    Divisor += 1;
-  }
+  Divisor = MmcHostClockDivider(BaseFrequency, TargetFrequency);
+  Divisor = (Divisor <= 1) ? 0 : (Divisor + 1) / 2;
 
   if (Divisor > MAX_DIVISOR_VALUE) {
     Divisor = MAX_DIVISOR_VALUE;
@@ -230,17 +205,20 @@ CalculateClockFrequencyDivisor(
 
   DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: BaseFrequency 0x%x Divisor 0x%x\n", BaseFrequency, Divisor));
 
+  // Divisor 0 means the base clock is used undivided
+  if (Divisor == 0) {
+    mLastClockFrequency = BaseFrequency;
+  } else {
+    mLastClockFrequency = BaseFrequency / (Divisor * 2);
+  }
+
   *DivisorValue = (Divisor & 0xFF) << 8;
   Divisor >>= 8;
   *DivisorValue |= (Divisor & 0x03) << 6;
+  mLastDivisor = *DivisorValue;
 
   if (ActualFrequency) {
-    if (Divisor == 0) {
-      *ActualFrequency = BaseFrequency;
-    } else {
-      *ActualFrequency = BaseFrequency / Divisor;
-      *ActualFrequency >>= 1;
-    }
+    *ActualFrequency = mLastClockFrequency;
     DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: *ActualFrequency 0x%x\n", *ActualFrequency));
   }
 
@@ -249,25 +227,47 @@ CalculateClockFrequencyDivisor(
   return EFI_SUCCESS;
 }
 
-BOOLEAN
-MMCIsCardPresent(
-                 IN EFI_MMC_HOST_PROTOCOL *This
-                 )
+/**
+   Samples the card detect status into mIsCardPresent, from the periodic
+   timer. CARD_INS stays latched in MMCHS_INT_STAT while the card is in.
+   A removal latches CARD_REM: both bits are then cleared, so that the next
+   insertion shows up again, and PRES_STATE says whether a card has already
+   gone back in. These accesses go straight through IoLib, the timer
+   would otherwise charge them to whatever command it interrupts.
+**/
+STATIC
+VOID
+EFIAPI
+MMCCardDetect(
+              IN EFI_EVENT Event,
+              IN VOID *Context
+              )
 {
+  UINTN IntStat;
   BOOLEAN IsCardPresent;
 
-  // Enable all Interrupts ('Interrupts' is badly named, these are not ARM IRQ/FIQ Interrupts, but simply a register
-  // that is repeatedly polled)
-  MmioWrite32(MMCHS_IE, ALL_EN);
-  IsCardPresent = (MmioRead32(MMCHS_INT_STAT) & CARD_INS) == CARD_INS;
+  IntStat = MmioRead32(MMCHS_INT_STAT);
+  if ((IntStat & CARD_REM) != 0) {
+    MmioWrite32(MMCHS_INT_STAT, CARD_INS | CARD_REM);
+    IsCardPresent = (MmioRead32(MMCHS_PRES_STATE) & CARD_INSERTED) != 0;
+  } else {
+    IsCardPresent = (IntStat & CARD_INS) != 0;
+  }
 
-  // This function is called multiple times per second. To reduce the number of DebugPrints, only print if the card
-  // is NOT present, OR if the CardPresent state changes.
-  if (IsCardPresent == FALSE || IsCardPresent != PreviousIsCardPresent) {
-    DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCIsCardPresent(): %d\n", IsCardPresent));
+  if (IsCardPresent != mIsCardPresent) {
+    DEBUG((DEBUG_INFO, "ArasanMMCHost: card %a\n", IsCardPresent ? "inserted" : "removed"));
+    mIsCardPresent = IsCardPresent;
   }
-  PreviousIsCardPresent = IsCardPresent;
-  return IsCardPresent;
+}
+
+BOOLEAN
+MMCIsCardPresent(
+                 IN EFI_MMC_HOST_PROTOCOL *This
+                 )
+{
+  // This function is called multiple times per second (and before every
+  // block transfer), so it only returns what MMCCardDetect last latched.
+  return mIsCardPresent;
 }
 
 BOOLEAN
@@ -275,7 +275,7 @@ MMCIsReadOnly(
               IN EFI_MMC_HOST_PROTOCOL *This
               )
 {
-  BOOLEAN IsReadOnly = !((MmioRead32(MMCHS_PRES_STATE) & WRITE_PROTECT_OFF) == WRITE_PROTECT_OFF);
+  BOOLEAN IsReadOnly = !((MmcHostMmioRead32(MMCHS_PRES_STATE) & WRITE_PROTECT_OFF) == WRITE_PROTECT_OFF);
   DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCIsReadOnly(): %d\n", IsReadOnly));
   return IsReadOnly;
 }
@@ -287,41 +287,253 @@ MMCBuildDevicePath(
                    )
 {
   EFI_DEVICE_PATH_PROTOCOL *NewDevicePathNode;
-  EFI_GUID DevicePathGuid = EFI_CALLER_ID_GUID;
 
   DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCBuildDevicePath()\n"));
 
   NewDevicePathNode = CreateDeviceNode(HARDWARE_DEVICE_PATH, HW_VENDOR_DP, sizeof(VENDOR_DEVICE_PATH));
-  CopyGuid(&((VENDOR_DEVICE_PATH*)NewDevicePathNode)->Guid, &DevicePathGuid);
+  CopyGuid(&((VENDOR_DEVICE_PATH*)NewDevicePathNode)->Guid, &gRaspberryPiArasanMmcHostDevicePathGuid);
   *DevicePath = NewDevicePathNode;
 
   return EFI_SUCCESS;
 }
 
+/**
+   Block transfer commands are not issued by MMCSendCommand. The block count
+   and the DMA channel must be set up before the command goes out, and only
+   MMCReadBlockData/MMCWriteBlockData know the transfer length.
+**/
+STATIC
+BOOLEAN
+IsBlockTransferCommand(
+                       IN UINT32 Command
+                       )
+{
+  switch (Command) {
+  case CMD_READ_SINGLE_BLOCK:
+  case CMD_READ_MULTIPLE_BLOCK:
+  case CMD_WRITE_SINGLE_BLOCK:
+  case CMD_WRITE_MULTIPLE_BLOCK:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/**
+   Picks up the bits of the SCR the host cares about. The SCR arrives
+   most significant byte first.
+**/
+STATIC
+VOID
+MMCParseScr(
+            IN UINT8 *Scr
+            )
+{
+  MMC_HOST_SCR Info;
+
+  MmcHostParseScr(Scr, &Info);
+  mAutoCmd23 = Info.Cmd23 && (MmcHostMmioRead32(MMCHS_REV) & SREV_MASK) >= SREV_3_00;
+  mCardHas4BitBus = Info.BusWidth4;
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: SCR %02x%02x%02x%02x, auto-CMD23 %d, 4-bit %d\n",
+         Scr[0], Scr[1], Scr[2], Scr[3], mAutoCmd23, mCardHas4BitBus));
+}
+
+/**
+   Stops the SD clock, reprograms the divisor for Frequency and restarts it.
+**/
+STATIC
+EFI_STATUS
+MMCSetClock(
+            IN UINTN Frequency
+            )
+{
+  EFI_STATUS Status;
+  UINT32 Divisor;
+  UINTN ActualFrequency;
+
+  Status = CalculateClockFrequencyDivisor(Frequency, &Divisor, &ActualFrequency);
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSetClock(): Fail to set SD clock to %u Hz\n",
+           Frequency));
+    return Status;
+  }
+
+  // First turn off the clock
+  MmcHostMmioAnd32(MMCHS_SYSCTL, ~CEN);
+
+  // Setup new divisor
+  MmcHostMmioAndThenOr32(MMCHS_SYSCTL, (UINT32) ~CLKD_MASK, Divisor);
+
+  // Wait for the clock to stabilise
+  if (MmcHostPollRegister(MMCHS_SYSCTL, ICS_MASK, ICS, TIMEOUT_US) == EFI_TIMEOUT) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSetClock(): TIMEOUT: clock not stable\n"));
+    return EFI_TIMEOUT;
+  }
+
+  MmcHostMmioOr32(MMCHS_SYSCTL, CEN);
+
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: SD clock set to %u Hz\n", Frequency));
+  return EFI_SUCCESS;
+}
+
+/**
+   Switches the host data bus between 1 and 4 bits.
+**/
+STATIC
 EFI_STATUS
-MMCSendCommand(
-               IN EFI_MMC_HOST_PROTOCOL    *This,
-               IN MMC_CMD                  MmcCmd,
-               IN UINT32                   Argument
+MMCSetBusWidth(
+               IN UINT32 BusWidth
                )
 {
-  UINTN MmcStatus;
-  UINTN RetryCount = 0;
-  UINTN CmdSendOKMask;
-  EFI_STATUS Status = EFI_SUCCESS;
-  BOOLEAN IsAppCmd = (LastExecutedCommand == CMD55);
+  switch (BusWidth) {
+  case 1:
+    MmcHostMmioAnd32(MMCHS_HCTL, ~(DTW_4_BIT | DTW_8_BIT));
+    break;
+  case 4:
+    MmcHostMmioAndThenOr32(MMCHS_HCTL, ~DTW_8_BIT, DTW_4_BIT);
+    break;
+  case 8:
+    if (PcdGet32(PcdArasanMaxBusWidth) < 8) {
+      DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSetBusWidth(): only %u data lines wired\n",
+             PcdGet32(PcdArasanMaxBusWidth)));
+      return EFI_UNSUPPORTED;
+    }
+    MmcHostMmioOr32(MMCHS_HCTL, DTW_8_BIT);
+    break;
+  default:
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSetBusWidth(): unsupported width %u\n", BusWidth));
+    return EFI_UNSUPPORTED;
+  }
 
-  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCSendCommand(MmcCmd: %08x, Argument: %08x)\n", MmcCmd, Argument));
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: %u-bit bus\n", BusWidth));
+  return EFI_SUCCESS;
+}
 
-  if (IgnoreCommand(MmcCmd)) {
-    return EFI_SUCCESS;
+STATIC
+BOOLEAN
+MMCHostHasDdr(
+              VOID
+              )
+{
+  return (MmcHostMmioRead32(MMCHS_REV) & SREV_MASK) >= SREV_3_00 &&
+    (MmcHostMmioRead32(MMCHS_CAPA2) & DDR50_SUPPORT) != 0;
+}
+
+/**
+   Selects dual or single data rate. The UHS mode may only change with
+   the SD clock stopped.
+**/
+STATIC
+VOID
+MMCSetDdr(
+          IN BOOLEAN Ddr
+          )
+{
+  if (Ddr == mDdr) {
+    return;
   }
 
-  MmcCmd = TranslateCommand(MmcCmd);
-  if (MmcCmd == 0xffffffff) {
+  MmcHostMmioAnd32(MMCHS_SYSCTL, ~CEN);
+  MmcHostMmioAndThenOr32(MMCHS_AC12, (UINT32) ~UHS_MODE_MASK, Ddr ? UHS_MODE_DDR50 : 0);
+  MmcHostMmioOr32(MMCHS_SYSCTL, CEN);
+  mDdr = Ddr;
+
+  DEBUG((DEBUG_INFO, "ArasanMMCHost: %a data rate\n", Ddr ? "dual" : "single"));
+}
+
+/**
+   MmcDxe may ask an eMMC for an 8-bit bus whatever the board. Narrows
+   EXT_CSD BUS_WIDTH writes to the data lines that are wired up, so the
+   card and the host end up agreeing.
+**/
+STATIC
+UINT32
+MMCFilterMmcSwitch(
+                   IN UINT32 Argument
+                   )
+{
+  UINT32 Value = MMC_SWITCH_VALUE(Argument);
+
+  if (MMC_SWITCH_ACCESS(Argument) != MMC_SWITCH_ACCESS_WRITE_BYTE ||
+      MMC_SWITCH_INDEX(Argument) != EXT_CSD_BUS_WIDTH ||
+      PcdGet32(PcdArasanMaxBusWidth) >= 8) {
+    return Argument;
+  }
+
+  if (Value == EXT_CSD_BUS_WIDTH_8) {
+    Value = EXT_CSD_BUS_WIDTH_4;
+  } else if (Value == EXT_CSD_DDR_BUS_WIDTH_8) {
+    Value = EXT_CSD_DDR_BUS_WIDTH_4;
+  } else {
+    return Argument;
+  }
+
+  DEBUG((DEBUG_INFO, "ArasanMMCHost: eMMC bus width %u narrowed to %u\n",
+         MMC_SWITCH_VALUE(Argument), Value));
+  return MMC_SWITCH_ARGUMENT(EXT_CSD_BUS_WIDTH, Value);
+}
+
+/**
+   Follows an EXT_CSD BUS_WIDTH write the card has accepted.
+**/
+STATIC
+EFI_STATUS
+MMCSetMmcBusWidth(
+                  IN UINT32 Value
+                  )
+{
+  EFI_STATUS Status;
+
+  switch (Value) {
+  case EXT_CSD_BUS_WIDTH_1:
+    Status = MMCSetBusWidth(1);
+    break;
+  case EXT_CSD_BUS_WIDTH_4:
+  case EXT_CSD_DDR_BUS_WIDTH_4:
+    Status = MMCSetBusWidth(4);
+    break;
+  case EXT_CSD_BUS_WIDTH_8:
+  case EXT_CSD_DDR_BUS_WIDTH_8:
+    Status = MMCSetBusWidth(8);
+    break;
+  default:
     return EFI_UNSUPPORTED;
   }
 
+  if (!EFI_ERROR(Status)) {
+    MMCSetDdr(Value == EXT_CSD_DDR_BUS_WIDTH_4 || Value == EXT_CSD_DDR_BUS_WIDTH_8);
+  }
+  return Status;
+}
+
+/**
+   Writes a translated command to the controller and waits for it to complete.
+   BlockValue is the (Block Count << 16 | Block Size) value for MMCHS_BLK.
+**/
+STATIC
+EFI_STATUS
+MMCIssueCommand(
+                IN UINT32 MmcCmd,
+                IN UINT32 Argument,
+                IN UINT32 BlockValue
+                )
+{
+  UINTN MmcStatus;
+  UINTN CmdSendOKMask;
+  UINT64 Deadline;
+  UINT64 Start;
+  UINT64 Issued;
+  EFI_STATUS Status = EFI_SUCCESS;
+  UINT32 Slot = MmcHostCommandSlot(CMD_INDEX(MmcCmd));
+
+  // Block transfers are timed from MMCTransferBlocks, DMA set-up included.
+  if (IsBlockTransferCommand(MmcCmd & ~ACEN_MASK)) {
+    Start = MmcHostGetTicks();
+  } else {
+    Start = MmcHostStatsStart();
+  }
+  Issued = Start;
+
   // Check if command and data lines are in use or not. Poll till both lines are available
   // However, for CMD12 (Stop Transmission), no need to wait for data line to be available
   if (MmcCmd == CMD_STOP_TRANSMISSION) {
@@ -330,7 +542,7 @@ MMCSendCommand(
     CmdSendOKMask = CMDI_MASK | DATI_MASK;
   }
 
-  if (PollRegisterWithMask(MMCHS_PRES_STATE, CmdSendOKMask, 0) == EFI_TIMEOUT) {
+  if (MmcHostPollRegister(MMCHS_PRES_STATE, CmdSendOKMask, 0, TIMEOUT_US) == EFI_TIMEOUT) {
     // CMD13 COULD time out (especially if following a WRITE). The Port Driver will automatically call CMD13
     // again many times. If THAT also fails, then the Port Driver will also print out an error message.
     // So sporadic printouts of the message below for CMD13 shoud be fine.
@@ -344,50 +556,34 @@ MMCSendCommand(
     goto out;
   }
 
-  if (IsAppCmd) {
-    if (MmcCmd == ACMD51) {
-      MmioWrite32(MMCHS_BLK, 8);
-    } else {
-      MmioWrite32(MMCHS_BLK, BLEN_512BYTES);
-    }
-  } else {
-    // Provide (Block Count << 16 | Block Size)
-    // CMD23 (SET_BLOCK_COUNT) is sent before CMD18 (READ_MULTIPLE_BLOCK),
-    // and sets the number of blocks to read in CMD18
-    if (MmcCmd == CMD_SET_BLOCK_COUNT) {
-      MmioWrite32(MMCHS_BLK, Argument << BLOCK_COUNT_SHIFT | BLEN_512BYTES);
-    } else if (MmcCmd == CMD_READ_SINGLE_BLOCK || MmcCmd == CMD_WRITE_SINGLE_BLOCK) {
-      // For CMD17 and CMD24 (read and write single block), Block Count is 0
-      MmioWrite32(MMCHS_BLK, BLEN_512BYTES);
-    } else if (MmcCmd == CMD6) {
-      MmioWrite32(MMCHS_BLK, 64);
-    } else {
-      MmioWrite32(MMCHS_BLK, BLEN_512BYTES);
-    }
-  }
+  MmcHostMmioWrite32(MMCHS_BLK, BlockValue);
 
   // Set Data timeout counter value to max value.
-  MmioAndThenOr32(MMCHS_SYSCTL, (UINT32) ~DTO_MASK, DTO_VAL);
+  MmcHostMmioAndThenOr32(MMCHS_SYSCTL, (UINT32) ~DTO_MASK, DTO_VAL);
 
-  // Clear Interrupt Status Register, but not the Card Inserted bit, because the SD port driver polls
-  // the Card Inserted bit periodically and assumes card is removed if Card Inserted bit is cleared
-  MmioWrite32(MMCHS_INT_STAT, ALL_EN & (~CARD_INS));
+  // Clear Interrupt Status Register, but not the card detect bits, because MMCCardDetect samples
+  // them periodically and assumes the card is removed if Card Inserted bit is cleared
+  MmcHostMmioWrite32(MMCHS_INT_STAT, ALL_EN & ~(CARD_INS | CARD_REM));
 
   // Set command argument register
-  MmioWrite32(MMCHS_ARG, Argument);
+  MmcHostMmioWrite32(MMCHS_ARG, Argument);
 
   // Send the command
-  MmioWrite32(MMCHS_CMD, MmcCmd);
+  MmcHostMmioWrite32(MMCHS_CMD, MmcCmd);
 
   // Check for the command status.
-  while (RetryCount < MAX_RETRY_COUNT) {
-    MmcStatus = MmioRead32(MMCHS_INT_STAT);
+  Start = MmcHostGetTicks();
+  Deadline = MmcHostDeadline(TIMEOUT_US);
+  for (;;) {
+    MmcStatus = MmcHostMmioRead32(MMCHS_INT_STAT);
 
     // Read status of command response
     if ((MmcStatus & ERRI) != 0) {
+      MmcHostAccountPoll(Start);
+
       // Perform soft-reset for mmci_cmd line.
-      MmioOr32(MMCHS_SYSCTL, SRC);
-      while ((MmioRead32(MMCHS_SYSCTL) & SRC));
+      MmcHostMmioOr32(MMCHS_SYSCTL, SRC);
+      MmcHostPollRegister(MMCHS_SYSCTL, SRC, 0, TIMEOUT_US);
 
       // CMD5 (CMD_IO_SEND_OP_COND) is only valid for SDIO cards and thus expected to fail
       if (MmcCmd != CMD_IO_SEND_OP_COND) {
@@ -400,28 +596,150 @@ MMCSendCommand(
 
     // Check if command is completed.
     if ((MmcStatus & CC) == CC) {
-      MmioWrite32(MMCHS_INT_STAT, CC);
+      MmcHostMmioWrite32(MMCHS_INT_STAT, CC);
       break;
     }
 
-    RetryCount++;
-    gBS->Stall(STALL_AFTER_RETRY_US);
+    if (MmcHostDeadlinePassed(Deadline)) {
+      MmcHostAccountPoll(Start);
+      DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSendCommand(): TIMEOUT: No response for Send Command\n"));
+      Status = EFI_TIMEOUT;
+      goto out;
+    }
   }
 
-  gBS->Stall(STALL_AFTER_SEND_CMD_US);
+  MmcHostAccountPoll(Start);
 
-  if (RetryCount == MAX_RETRY_COUNT) {
-    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSendCommand(): TIMEOUT: No response for Send Command\n"));
-    Status = EFI_TIMEOUT;
-    goto out;
+ out:
+  //
+  // Block transfers are accounted as a whole by MMCTransferBlocks, other
+  // data commands once MMCReadBlockData has their data.
+  //
+  if (!IsBlockTransferCommand(MmcCmd & ~ACEN_MASK)) {
+    if ((MmcCmd & DP_ENABLE) != 0 && !EFI_ERROR(Status)) {
+      MmcHostStatsDeferData(MmcHostStatsEntry(Slot), Issued);
+    } else {
+      MmcHostStatsRecord(MmcHostStatsEntry(Slot), Issued, 0, Status);
+    }
   }
 
- out:
-  if (EFI_ERROR(Status)) {
-    LastExecutedCommand = (UINT32) -1;
+  MmcHostSetLastCommand(EFI_ERROR(Status) ? MMC_HOST_NO_COMMAND : Slot);
+  return Status;
+}
+
+EFI_STATUS
+MMCSendCommand(
+               IN EFI_MMC_HOST_PROTOCOL    *This,
+               IN MMC_CMD                  MmcCmd,
+               IN UINT32                   Argument
+               )
+{
+  EFI_STATUS Status;
+  UINT32 BlockValue;
+  BOOLEAN IsAppCmd = MmcHostIsAppCommand();
+
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCSendCommand(MmcCmd: %08x, Argument: %08x)\n", MmcCmd, Argument));
+
+  if (IgnoreCommand(MmcCmd)) {
+    return EFI_SUCCESS;
+  }
+
+  MmcCmd = TranslateCommand(MmcCmd);
+  if (MmcCmd == 0xffffffff) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (mPendingCommand != NO_PENDING_COMMAND) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSendCommand(): dropping unused block command %x\n",
+           mPendingCommand));
+    mPendingCommand = NO_PENDING_COMMAND;
+  }
+
+  //
+  // MmcDxe follows every multi-block transfer with CMD12. If the host
+  // already stopped the transfer, the card is back in tran state and would
+  // flag CMD12 as illegal, so just hand back the auto-CMD12 response.
+  // MmcDxe polls CMD13 until the card is ready before it sends CMD12, so
+  // status polls must not forget that the transfer was auto-stopped.
+  //
+  mAutoStopResponse = FALSE;
+  if (MmcCmd == CMD_STOP_TRANSMISSION && mAutoStopped) {
+    mAutoStopped = FALSE;
+    mAutoStopResponse = TRUE;
+    MmcHostSetLastCommand(CMD_INDEX(MmcCmd));
+    return EFI_SUCCESS;
+  }
+  if (MmcCmd != CMD13) {
+    mAutoStopped = FALSE;
+  }
+
+  if (IsBlockTransferCommand(MmcCmd)) {
+    mPendingCommand = MmcCmd;
+    mPendingArgument = Argument;
+    MmcHostSetLastCommand(CMD_INDEX(MmcCmd));
+    return EFI_SUCCESS;
+  }
+
+  if (IsAppCmd) {
+    if (MmcCmd == ACMD51) {
+      BlockValue = 8;
+    } else {
+      BlockValue = BLEN_512BYTES;
+    }
   } else {
-    LastExecutedCommand = MmcCmd;
+    // Provide (Block Count << 16 | Block Size)
+    // CMD23 (SET_BLOCK_COUNT) is sent before CMD18 (READ_MULTIPLE_BLOCK),
+    // and sets the number of blocks to read in CMD18
+    if (MmcCmd == CMD_SET_BLOCK_COUNT) {
+      BlockValue = Argument << BLOCK_COUNT_SHIFT | BLEN_512BYTES;
+    } else if (MmcCmd == CMD6) {
+      BlockValue = 64;
+    } else {
+      BlockValue = BLEN_512BYTES;
+    }
+  }
+
+  if (MmcCmd == CMD6) {
+    mSwitchArgument = Argument;
+  } else if (MmcCmd == CMD6_MMC) {
+    Argument = MMCFilterMmcSwitch(Argument);
+  }
+
+  Status = MMCIssueCommand(MmcCmd, Argument, BlockValue);
+  mBlockCountSet = (MmcCmd == CMD_SET_BLOCK_COUNT && !EFI_ERROR(Status));
+
+  if (MmcCmd == CMD1 && !EFI_ERROR(Status)) {
+    mIsMmcCard = TRUE;
+  }
+
+  // The host picks the eMMC's address, the SD card's comes back in R6.
+  if (MmcCmd == CMD3 && mIsMmcCard && !EFI_ERROR(Status)) {
+    mRca = Argument >> MMC_HOST_RCA_SHIFT;
+  }
+
+  // Same as ACMD6 below, for the eMMC way of changing the bus width.
+  if (MmcCmd == CMD6_MMC && !EFI_ERROR(Status) &&
+      MMC_SWITCH_ACCESS(Argument) == MMC_SWITCH_ACCESS_WRITE_BYTE &&
+      MMC_SWITCH_INDEX(Argument) == EXT_CSD_BUS_WIDTH) {
+    Status = MMCSetMmcBusWidth(MMC_SWITCH_VALUE(Argument));
   }
+
+  //
+  // The card takes the new bus width as soon as it answers ACMD6, so the
+  // host must follow right away, before MmcDxe gets around to SetIos (if
+  // it calls it at all).
+  //
+  if (MmcCmd == ACMD6 && !EFI_ERROR(Status)) {
+    if ((Argument & ACMD6_BUS_WIDTH_MASK) == ACMD6_BUS_WIDTH_4) {
+      if (!mCardHas4BitBus) {
+        DEBUG((DEBUG_INFO, "ArasanMMCHost: 4-bit bus requested but not in SCR\n"));
+      }
+      Status = MMCSetBusWidth(4);
+    } else {
+      Status = MMCSetBusWidth(1);
+    }
+  }
+
   return Status;
 }
 
@@ -439,24 +757,42 @@ MMCNotifyState(
       EFI_STATUS Status;
       UINT32 Divisor;
       // Soft reset for all
-      MmioOr32(MMCHS_SYSCTL, SRC);
-      if (PollRegisterWithMask(MMCHS_SYSCTL, SRA, 0) == EFI_TIMEOUT) {
+      MmcHostMmioOr32(MMCHS_SYSCTL, SRC);
+      if (MmcHostPollRegister(MMCHS_SYSCTL, SRA, 0, TIMEOUT_US) == EFI_TIMEOUT) {
         DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCNotifyState(): TIMEOUT: Soft reset for all\n"));
         return EFI_TIMEOUT;
       }
 
       // Attempt to set the clock to 400Khz which is the expected initialization speed
-      Status = CalculateClockFrequencyDivisor(400000, &Divisor, NULL);
+      Status = CalculateClockFrequencyDivisor(MMC_HOST_IDENT_CLOCK_HZ, &Divisor, NULL);
       if (EFI_ERROR(Status)) {
         DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCNotifyState(): Fail to initialize SD clock\n"));
         return Status;
       }
 
       // Set Data Timeout Counter value, set clock frequency, enable internal clock
-      MmioOr32(MMCHS_SYSCTL, DTO_VAL | Divisor | CEN | ICS | ICE);
+      MmcHostMmioOr32(MMCHS_SYSCTL, DTO_VAL | Divisor | CEN | ICS | ICE);
 
       // Enable interrupts
-      MmioWrite32(MMCHS_IE, ALL_EN);
+      MmcHostMmioWrite32(MMCHS_IE, ALL_EN);
+
+      // The card comes back in 1-bit mode
+      MMCSetBusWidth(1);
+
+      mAutoCmd23 = FALSE;
+      mBlockCountSet = FALSE;
+      mAutoStopped = FALSE;
+      mCardHas4BitBus = FALSE;
+      mIsMmcCard = FALSE;
+      mMmcCardType = 0;
+      mRca = 0;
+      mHighCapacity = FALSE;
+      mMmcTrim = FALSE;
+      MmcHostEraseReset();
+
+      // Back to single data rate, the clock is already stopped by the reset
+      MmcHostMmioAnd32(MMCHS_AC12, (UINT32) ~UHS_MODE_MASK);
+      mDdr = FALSE;
     }
     break;
   case MmcIdleState:
@@ -467,27 +803,12 @@ MMCNotifyState(
     break;
   case MmcStandByState: {
     EFI_STATUS Status;
-    UINTN ClockFrequency = 25000000;
-    UINT32 Divisor;
 
-    // First turn off the clock
-    MmioAnd32(MMCHS_SYSCTL, ~CEN);
-
-    Status = CalculateClockFrequencyDivisor(ClockFrequency, &Divisor, NULL);
+    Status = MMCSetClock(MMC_HOST_DEFAULT_SPEED_CLOCK_HZ);
     if (EFI_ERROR(Status)) {
-      DEBUG((DEBUG_ERROR, "ArasanMMCHost: MmcStandByState(): Fail to initialize SD clock to %u Hz\n",
-             ClockFrequency));
+      DEBUG((DEBUG_ERROR, "ArasanMMCHost: MmcStandByState(): Fail to initialize SD clock\n"));
       return Status;
     }
-
-    // Setup new divisor
-    MmioAndThenOr32(MMCHS_SYSCTL, (UINT32) ~CLKD_MASK, Divisor);
-
-    // Wait for the clock to stabilise
-    while ((MmioRead32(MMCHS_SYSCTL) & ICS_MASK) != ICS);
-
-    // Set Data Timeout Counter value, set clock frequency, enable internal clock
-    MmioOr32(MMCHS_SYSCTL, CEN);
   }
     break;
   case MmcTransferState:
@@ -520,44 +841,412 @@ MMCReceiveResponse(
   if (Type == MMC_RESPONSE_TYPE_R2) {
 
     // 16-byte response
-    Buffer[0] = MmioRead32(MMCHS_RSP10);
-    Buffer[1] = MmioRead32(MMCHS_RSP32);
-    Buffer[2] = MmioRead32(MMCHS_RSP54);
-    Buffer[3] = MmioRead32(MMCHS_RSP76);
-
-    Buffer[3] <<= 8;
-    Buffer[3] |= (Buffer[2] >> 24) & 0xFF;
-    Buffer[2] <<= 8;
-    Buffer[2] |= (Buffer[1] >> 24) & 0xFF;
-    Buffer[1] <<= 8;
-    Buffer[1] |= (Buffer[0] >> 24) & 0xFF;
-    Buffer[0] <<= 8;
+    Buffer[0] = MmcHostMmioRead32(MMCHS_RSP10);
+    Buffer[1] = MmcHostMmioRead32(MMCHS_RSP32);
+    Buffer[2] = MmcHostMmioRead32(MMCHS_RSP54);
+    Buffer[3] = MmcHostMmioRead32(MMCHS_RSP76);
+
+    MmcHostDecodeR2(Buffer, FALSE);
+
+    if (MmcHostLastCommand() == CMD_INDEX(CMD_SEND_CSD)) {
+      MmcHostEraseParseCsd(Buffer, mIsMmcCard);
+    }
 
     DEBUG((
            DEBUG_MMCHOST_SD,
            "ArasanMMCHost: MMCReceiveResponse(Type: %x), Buffer[0-3]: %08x, %08x, %08x, %08x\n",
            Type, Buffer[0], Buffer[1], Buffer[2], Buffer[3]));
+  } else if (mAutoStopResponse) {
+    // Response to the auto-CMD12/auto-CMD23 the host sent by itself
+    Buffer[0] = MmcHostMmioRead32(MMCHS_RSP76);
   } else {
     // 4-byte response
-    Buffer[0] = MmioRead32(MMCHS_RSP10);
+    Buffer[0] = MmcHostMmioRead32(MMCHS_RSP10);
     DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCReceiveResponse(Type: %08x), Buffer[0]: %08x\n", Type, Buffer[0]));
+
+    // Erase needs to know how the card is addressed and how to poll it.
+    if ((MmcHostLastCommand() == MMC_HOST_APP_COMMAND(CMD_INDEX(ACMD41)) ||
+         MmcHostLastCommand() == CMD_INDEX(CMD1)) &&
+        (Buffer[0] & MMC_HOST_OCR_POWER_UP) != 0) {
+      mHighCapacity = (Buffer[0] & MMC_HOST_OCR_HIGH_CAPACITY) != 0;
+    } else if (MmcHostLastCommand() == CMD_INDEX(CMD3) && !mIsMmcCard) {
+      mRca = Buffer[0] >> MMC_HOST_RCA_SHIFT;
+    }
   }
 
-  gBS->Stall(STALL_AFTER_REC_RESP_US);
   return EFI_SUCCESS;
 }
 
+/**
+   Waits for an INT_STAT bit, bailing out early on any error interrupt.
+**/
+STATIC
 EFI_STATUS
-MMCReadBlockData(
-                 IN EFI_MMC_HOST_PROTOCOL    *This,
-                 IN EFI_LBA                  Lba,
-                 IN UINTN                    Length,
-                 IN UINT32*                  Buffer
-                 )
+MMCWaitForInterrupt(
+                    IN UINT32 Mask,
+                    IN UINTN TimeoutUs
+                    )
 {
   UINTN MmcStatus;
-  UINTN Count;
-  UINTN RetryCount = 0;
+  UINT64 Start = MmcHostGetTicks();
+  UINT64 Deadline = MmcHostDeadline(TimeoutUs);
+
+  for (;;) {
+    MmcStatus = MmcHostMmioRead32(MMCHS_INT_STAT);
+
+    if ((MmcStatus & ERRI) != 0) {
+      MmcHostAccountPoll(Start);
+      DEBUG((DEBUG_ERROR, "ArasanMMCHost: data error, MMCHS_INT_STAT: %08x\n", MmcStatus));
+      return EFI_DEVICE_ERROR;
+    }
+
+    if ((MmcStatus & Mask) != 0) {
+      MmcHostMmioWrite32(MMCHS_INT_STAT, Mask);
+      MmcHostAccountPoll(Start);
+      return EFI_SUCCESS;
+    }
+
+    if (MmcHostDeadlinePassed(Deadline)) {
+      break;
+    }
+  }
+
+  MmcHostAccountPoll(Start);
+
+  DEBUG((DEBUG_ERROR, "ArasanMMCHost: TIMEOUT waiting for %08x, MMCHS_INT_STAT: %08x\n",
+         Mask, MmioRead32(MMCHS_INT_STAT)));
+  return EFI_TIMEOUT;
+}
+
+/**
+   Moves the data of a block transfer through the DMA engine. The control
+   block chain covers up to BCM2836_DMA_MAX_LENGTH, longer requests are
+   moved as several chains within the same command.
+**/
+STATIC
+EFI_STATUS
+MMCDmaTransfer(
+               IN UINT32 MmcCmd,
+               IN UINT32 Argument,
+               IN UINTN Length,
+               IN UINT32 *Buffer
+               )
+{
+  EFI_STATUS Status;
+  UINTN Channel = PcdGet32(PcdArasanDmaChannel);
+  BCM2836_DMA_DIRECTION Direction;
+  UINTN Offset = 0;
+  UINTN Chunk;
+  UINT64 Deadline;
+  UINT64 Start;
+
+  Direction = (MmcCmd & DDIR_READ) ? Bcm2836DmaFromDevice : Bcm2836DmaToDevice;
+
+  Chunk = MIN(Length, BCM2836_DMA_MAX_LENGTH);
+  Status = Bcm2836DmaStart(Channel, BCM2836_DMA_DREQ_EMMC, Direction,
+                           MMCHS_DATA, Buffer, Chunk);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  Status = MMCIssueCommand(MmcCmd, Argument,
+                           (Length / BLEN_512BYTES) << BLOCK_COUNT_SHIFT | BLEN_512BYTES);
+  if (EFI_ERROR(Status)) {
+    Bcm2836DmaAbort(Channel);
+    return Status;
+  }
+
+  for (;;) {
+    Start = MmcHostGetTicks();
+    Deadline = MmcHostDeadline(TIMEOUT_US + Chunk / MIN_BYTES_PER_US);
+    while ((Status = Bcm2836DmaPoll(Channel)) == EFI_NOT_READY) {
+      if ((MmcHostMmioRead32(MMCHS_INT_STAT) & ERRI) != 0 ||
+          MmcHostDeadlinePassed(Deadline)) {
+        MmcHostAccountPoll(Start);
+        DEBUG((DEBUG_ERROR, "ArasanMMCHost: DMA of %u bytes at %u failed, MMCHS_INT_STAT: %08x\n",
+               Chunk, Offset, MmioRead32(MMCHS_INT_STAT)));
+        Bcm2836DmaAbort(Channel);
+        return EFI_DEVICE_ERROR;
+      }
+    }
+    MmcHostAccountPoll(Start);
+
+    if (EFI_ERROR(Status)) {
+      return Status;
+    }
+
+    Offset += Chunk;
+    if (Offset == Length) {
+      break;
+    }
+
+    Chunk = MIN(Length - Offset, BCM2836_DMA_MAX_LENGTH);
+    Status = Bcm2836DmaStart(Channel, BCM2836_DMA_DREQ_EMMC, Direction, MMCHS_DATA,
+                             (UINT8 *) Buffer + Offset, Chunk);
+    if (EFI_ERROR(Status)) {
+      // The command is already out, so there's no falling back to PIO.
+      return EFI_DEVICE_ERROR;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+   Moves the data of a block transfer through MMCHS_DATA, one block per BRR/BWR.
+**/
+STATIC
+EFI_STATUS
+MMCPioTransfer(
+               IN UINT32 MmcCmd,
+               IN UINT32 Argument,
+               IN UINTN Length,
+               IN UINT32 *Buffer
+               )
+{
+  EFI_STATUS Status;
+  BOOLEAN IsRead = (MmcCmd & DDIR_READ) != 0;
+  UINTN BlockCount = Length / BLEN_512BYTES;
+  UINTN Block;
+  UINTN Count;
+  UINT64 Start;
+
+  Status = MMCIssueCommand(MmcCmd, Argument, BlockCount << BLOCK_COUNT_SHIFT | BLEN_512BYTES);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  Start = MmcHostStatsPioStart();
+  for (Block = 0; Block < BlockCount; Block++) {
+    Status = MMCWaitForInterrupt(IsRead ? BRR : BWR, TIMEOUT_US);
+    if (EFI_ERROR(Status)) {
+      break;
+    }
+
+    if (IsRead) {
+      for (Count = 0; Count < BLEN_512BYTES / 4; Count++) {
+        *Buffer++ = MmcHostMmioRead32(MMCHS_DATA);
+      }
+    } else {
+      for (Count = 0; Count < BLEN_512BYTES / 4; Count++) {
+        MmcHostMmioWrite32(MMCHS_DATA, *Buffer++);
+      }
+    }
+  }
+
+  MmcHostStatsPio(Block * (BLEN_512BYTES / 4), Start);
+  return Status;
+}
+
+/**
+   Issues the pending block transfer command and moves its data.
+**/
+STATIC
+EFI_STATUS
+MMCTransferBlocks(
+                  IN UINTN Length,
+                  IN UINT32 *Buffer
+                  )
+{
+  EFI_STATUS Status;
+  UINT32 MmcCmd = mPendingCommand;
+  UINTN BlockCount = Length / BLEN_512BYTES;
+  BOOLEAN IsMultiBlock;
+  UINT64 Start;
+  UINT64 Issued;
+  RASPBERRY_PI_MMC_COMMAND_STATS *Stats = MmcHostStatsEntry(CMD_INDEX(MmcCmd));
+
+  mPendingCommand = NO_PENDING_COMMAND;
+
+  if (Length % BLEN_512BYTES != 0 || BlockCount == 0 || BlockCount > MAX_BLOCK_COUNT) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCTransferBlocks(): bad Length 0x%x\n", Length));
+    mBlockCountSet = FALSE;
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Let the host close multi-block transfers: with auto-CMD23 the card
+  // is told the block count up front and can program whole erase units,
+  // otherwise the host sends CMD12 as soon as the last block is through.
+  // Neither is needed if MmcDxe already sent CMD23 itself.
+  //
+  IsMultiBlock = (MmcCmd == CMD_READ_MULTIPLE_BLOCK || MmcCmd == CMD_WRITE_MULTIPLE_BLOCK);
+  if (IsMultiBlock && !mBlockCountSet) {
+    if (mAutoCmd23) {
+      MmcHostMmioWrite32(MMCHS_ARG2, BlockCount);
+      MmcCmd |= ACEN_ACMD23;
+    } else {
+      MmcCmd |= ACEN_ACMD12;
+    }
+  }
+  mBlockCountSet = FALSE;
+
+  //
+  // Telling an SD card how long a write is going to be lets it erase
+  // the blocks up front instead of piecemeal. CMD23 already does that,
+  // so this is only for writes closed with CMD12. It is only a hint, so
+  // a card that refuses it still gets the write.
+  //
+  if ((MmcCmd & ~ACEN_MASK) == CMD_WRITE_MULTIPLE_BLOCK && (MmcCmd & ACEN_MASK) == ACEN_ACMD12 &&
+      BlockCount >= MMC_HOST_PRE_ERASE_MIN_BLOCKS && !mIsMmcCard && mRca != 0) {
+    Status = MMCIssueCommand(CMD55, mRca << MMC_HOST_RCA_SHIFT, BLEN_512BYTES);
+    if (!EFI_ERROR(Status)) {
+      Status = MMCIssueCommand(ACMD23, (UINT32) BlockCount, BLEN_512BYTES);
+    }
+    if (EFI_ERROR(Status)) {
+      DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: ACMD23 pre-erase hint failed: %r\n", Status));
+    }
+    MmcHostSetLastCommand(CMD_INDEX(CMD_WRITE_MULTIPLE_BLOCK));
+  }
+
+  //
+  // The DMA engine only does word accesses, so buffers that aren't
+  // 32-bit aligned go through the FIFO by hand.
+  //
+  Start = MmcHostStatsStart();
+  Issued = Start;
+  Status = EFI_UNSUPPORTED;
+  if (((UINTN) Buffer % 4) == 0) {
+    Status = MMCDmaTransfer(MmcCmd, mPendingArgument, Length, Buffer);
+  }
+
+  if (Status == EFI_UNSUPPORTED ||
+      Status == EFI_INVALID_PARAMETER ||
+      Status == EFI_OUT_OF_RESOURCES) {
+    // DMA was never started, nothing has gone out to the card yet.
+    if (((UINTN) Buffer % 4) == 0) {
+      Stats->Retries++;
+    }
+    Status = MMCPioTransfer(MmcCmd, mPendingArgument, Length, Buffer);
+  }
+
+  if (!EFI_ERROR(Status)) {
+    Status = MMCWaitForInterrupt(TC, TIMEOUT_US);
+  }
+
+  mAutoStopped = !EFI_ERROR(Status) && (MmcCmd & ACEN_MASK) != 0;
+
+  if (EFI_ERROR(Status)) {
+    // Reset the data line so the next command isn't blocked by DATI.
+    MmcHostMmioOr32(MMCHS_SYSCTL, SRD);
+    MmcHostPollRegister(MMCHS_SYSCTL, SRD, 0, TIMEOUT_US);
+  }
+
+  MmcHostStatsRecord(Stats, Issued, Length, Status);
+  return Status;
+}
+
+/**
+   Picks up what the host needs from the eMMC EXT_CSD, and makes sure the
+   user area is selected: the boot ROM or an earlier stage may have left a
+   boot partition selected, while MmcDxe only knows about the user area.
+**/
+STATIC
+EFI_STATUS
+MMCParseExtCsd(
+               IN OUT UINT8 *ExtCsd
+               )
+{
+  EFI_STATUS Status;
+  UINT32 Config = ExtCsd[EXT_CSD_PARTITION_CONFIG];
+  UINT32 LastCommand = MmcHostLastCommand();
+
+  mMmcCardType = ExtCsd[EXT_CSD_CARD_TYPE];
+
+  // With ERASE_GROUP_DEF set the high-capacity erase group applies, TRIM
+  // gets around erase groups altogether.
+  mMmcTrim = (ExtCsd[EXT_CSD_SEC_FEATURE_SUPPORT] & EXT_CSD_SEC_GB_CL_EN) != 0;
+  if (mMmcTrim) {
+    MmcHostEraseSetGranularity(1);
+  } else if ((ExtCsd[EXT_CSD_ERASE_GROUP_DEF] & BIT0) != 0 && ExtCsd[EXT_CSD_HC_ERASE_GRP_SIZE] != 0) {
+    MmcHostEraseSetGranularity(ExtCsd[EXT_CSD_HC_ERASE_GRP_SIZE] * 1024);
+  }
+  DEBUG((DEBUG_INFO, "ArasanMMCHost: eMMC EXT_CSD rev %u, card type 0x%x, 2 x %u KiB boot partitions, "
+         "boot partition enable %u, partition %u selected\n",
+         ExtCsd[EXT_CSD_REV], mMmcCardType, ExtCsd[EXT_CSD_BOOT_SIZE_MULT] * 128,
+         PARTITION_CONFIG_BOOT_ENABLE(Config), Config & PARTITION_CONFIG_ACCESS_MASK));
+
+  if ((Config & PARTITION_CONFIG_ACCESS_MASK) == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Config &= ~PARTITION_CONFIG_ACCESS_MASK;
+  Status = MMCIssueCommand(CMD6_MMC, MMC_SWITCH_ARGUMENT(EXT_CSD_PARTITION_CONFIG, Config),
+                           BLEN_512BYTES);
+  if (!EFI_ERROR(Status)) {
+    // Wait out the R1b busy here, MmcDxe doesn't know about this command.
+    Status = MmcHostPollRegister(MMCHS_PRES_STATE, DATI_MASK, 0, TIMEOUT_US);
+  }
+  MmcHostSetLastCommand(LastCommand);
+
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: failed to select the eMMC user area: %r\n", Status));
+    return Status;
+  }
+
+  // Keep MmcDxe's copy of the EXT_CSD in line with the card.
+  ExtCsd[EXT_CSD_PARTITION_CONFIG] = (UINT8) Config;
+  return EFI_SUCCESS;
+}
+
+/**
+   Reads the SD Status for its erase parameters. MmcDxe never asks for
+   it, so this follows the SCR read, when the card is known to be in the
+   transfer state. Failing is harmless, erase then goes by the CSD.
+**/
+STATIC
+VOID
+MMCReadSsr(
+           VOID
+           )
+{
+  EFI_STATUS Status;
+  UINT32 Ssr[MMC_HOST_SSR_LENGTH / 4];
+  UINT32 LastCommand = MmcHostLastCommand();
+  UINTN Count;
+
+  if (mRca == 0) {
+    return;
+  }
+
+  Status = MMCIssueCommand(CMD55, mRca << MMC_HOST_RCA_SHIFT, BLEN_512BYTES);
+  if (!EFI_ERROR(Status)) {
+    Status = MMCIssueCommand(ACMD13, 0, MMC_HOST_SSR_LENGTH);
+  }
+  if (!EFI_ERROR(Status)) {
+    Status = MMCWaitForInterrupt(BRR, TIMEOUT_US);
+    if (!EFI_ERROR(Status)) {
+      for (Count = 0; Count < MMC_HOST_SSR_LENGTH / 4; Count++) {
+        Ssr[Count] = MmcHostMmioRead32(MMCHS_DATA);
+      }
+      Status = MMCWaitForInterrupt(TC, TIMEOUT_US);
+    }
+    MmcHostStatsDataDone(MMC_HOST_SSR_LENGTH, Status);
+    if (EFI_ERROR(Status)) {
+      MmcHostMmioOr32(MMCHS_SYSCTL, SRD);
+      MmcHostPollRegister(MMCHS_SYSCTL, SRD, 0, TIMEOUT_US);
+    }
+  }
+  MmcHostSetLastCommand(LastCommand);
+
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: failed to read the SD Status: %r\n", Status));
+    return;
+  }
+
+  MmcHostEraseParseSsr((UINT8 *) Ssr);
+}
+
+EFI_STATUS
+MMCReadBlockData(
+                 IN EFI_MMC_HOST_PROTOCOL    *This,
+                 IN EFI_LBA                  Lba,
+                 IN UINTN                    Length,
+                 IN UINT32*                  Buffer
+                 )
+{
+  EFI_STATUS Status;
+  UINTN Count;
 
   // Make DebugPrints more manageable
   if (Lba % 2000 == 0) {
@@ -570,40 +1259,66 @@ MMCReadBlockData(
     return EFI_INVALID_PARAMETER;
   }
 
-  mFwProtocol->SetLed(TRUE);
-  {
-    while (RetryCount < MAX_RETRY_COUNT) {
-      // Read Status
-      MmcStatus = MmioRead32(MMCHS_INT_STAT);
+  if (mPendingCommand != NO_PENDING_COMMAND) {
+    mFwProtocol->NotifyLedActivity();
+    Status = MMCTransferBlocks(Length, Buffer);
+    return Status;
+  }
 
-      // Check if Buffer Read Ready (BRR) bit is set
-      if (MmcStatus & BRR) {
-        // Clear BRR bit
-        MmioWrite32(MMCHS_INT_STAT, BRR);
+  //
+  // Register-sized reads (SCR, switch status) for a command already
+  // issued by MMCSendCommand.
+  //
+  Status = MMCWaitForInterrupt(BRR, TIMEOUT_US);
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCReadBlockData(): no data: %r\n", Status));
+    MmcHostStatsDataDone(Length, Status);
+    return Status;
+  }
 
-        for (Count = 0; Count < Length / 4; Count++) {
-          UINT32 data = MmioRead32(MMCHS_DATA);
-          Buffer[Count] = data;
-        }
+  for (Count = 0; Count < Length / 4; Count++) {
+    Buffer[Count] = MmcHostMmioRead32(MMCHS_DATA);
+  }
 
-        break;
-      }
+  if (MmcHostLastCommand() == MMC_HOST_APP_COMMAND(CMD_INDEX(ACMD51)) &&
+      Length >= MMC_HOST_SCR_LENGTH) {
+    MMCParseScr((UINT8 *) Buffer);
+  }
 
-      gBS->Stall(STALL_AFTER_RETRY_US);
-      RetryCount++;
-    }
+  Status = MMCWaitForInterrupt(TC, TIMEOUT_US);
+  MmcHostStatsDataDone(Length, Status);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
 
-    gBS->Stall(STALL_AFTER_READ_US);
+  if (MmcHostLastCommand() == MMC_HOST_APP_COMMAND(CMD_INDEX(ACMD51)) &&
+      Length >= MMC_HOST_SCR_LENGTH) {
+    MMCReadSsr();
   }
-  mFwProtocol->SetLed(FALSE);
 
-  if (RetryCount == MAX_RETRY_COUNT) {
-    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCReadBlockData(): TIMEOUT waiting for BRR, MMCHS_INT_STAT: %08x\n",
-           MmcStatus));
-    return EFI_TIMEOUT;
+  if (mIsMmcCard && MmcHostLastCommand() == CMD_INDEX(CMD8_MMC) && Length >= EXT_CSD_LENGTH) {
+    return MMCParseExtCsd((UINT8 *) Buffer);
   }
 
-  return EFI_SUCCESS;
+  //
+  // A successful CMD6 switch to high speed takes effect right after the
+  // status block, so the clock can go up now. The BCM2835 Arasan block
+  // doesn't implement the HCTL high-speed enable bit (Linux flags it
+  // SDHCI_QUIRK_NO_HISPD_BIT), so only the divisor changes.
+  //
+  if (!mIsMmcCard && MmcHostLastCommand() == CMD_INDEX(CMD6) &&
+      Length >= MMC_HOST_SWITCH_STATUS_LENGTH &&
+      (mSwitchArgument & MMC_HOST_SWITCH_MODE_SET) != 0 &&
+      (mSwitchArgument & MMC_HOST_SWITCH_GROUP1_MASK) == MMC_HOST_SWITCH_HIGH_SPEED) {
+    if (!EFI_ERROR(MmcHostCheckSwitchStatus((UINT8 *) Buffer, TRUE))) {
+      DEBUG((DEBUG_INFO, "ArasanMMCHost: card switched to high speed\n"));
+      Status = MMCSetClock(MMC_HOST_HIGH_SPEED_CLOCK_HZ);
+    } else {
+      DEBUG((DEBUG_INFO, "ArasanMMCHost: card refused high speed\n"));
+    }
+  }
+
+  return Status;
 }
 
 EFI_STATUS
@@ -614,9 +1329,7 @@ MMCWriteBlockData(
                   IN UINT32*                  Buffer
                   )
 {
-  UINTN MmcStatus;
-  UINTN Count;
-  UINTN RetryCount = 0;
+  EFI_STATUS Status;
 
   DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCWriteBlockData(LBA: 0x%x, Length: 0x%x, Buffer: 0x%x)\n",
          Lba, Length, Buffer));
@@ -631,41 +1344,95 @@ MMCWriteBlockData(
     return EFI_INVALID_PARAMETER;
   }
 
-  mFwProtocol->SetLed(TRUE);
-  {
-    while (RetryCount < MAX_RETRY_COUNT) {
-      // Read Status
-      MmcStatus = MmioRead32(MMCHS_INT_STAT);
-
-      // Check if Buffer Write Ready (BWR) bit is set
-      if (MmcStatus & BWR) {
-        // Clear BWR bit
-        MmioWrite32(MMCHS_INT_STAT, BWR);
+  if (mPendingCommand == NO_PENDING_COMMAND) {
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCWriteBlockData(): no write command pending\n"));
+    return EFI_DEVICE_ERROR;
+  }
 
-        for (Count = 0; Count < Length / 4; Count++) {
-          MmioWrite32(MMCHS_DATA, Buffer[Count]);
-        }
+  mFwProtocol->NotifyLedActivity();
+  Status = MMCTransferBlocks(Length, Buffer);
 
-        break;
-      }
+  return Status;
+}
 
-      gBS->Stall(STALL_AFTER_RETRY_US);
-      RetryCount++;
+EFI_STATUS
+MMCSetIos(
+          IN EFI_MMC_HOST_PROTOCOL    *This,
+          IN UINT32                   BusClockFreq,
+          IN UINT32                   BusWidth,
+          IN UINT32                   TimingMode
+          )
+{
+  EFI_STATUS Status;
+  BOOLEAN Ddr = FALSE;
+  UINT8 CardTypeNeeded = 0;
+
+  DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCSetIos(BusClockFreq: %u, BusWidth: %u, TimingMode: %u)\n",
+         BusClockFreq, BusWidth, TimingMode));
+
+  //
+  // The card type is only known for eMMC, once the EXT_CSD has been read.
+  // DDR52 needs 1.8V or 3V I/O, the DDR50 UHS mode in the host and at
+  // least 4 data lines.
+  //
+  switch (TimingMode) {
+  case EMMCBACKWARD:
+    break;
+  case EMMCHS26:
+    CardTypeNeeded = EXT_CSD_CARD_TYPE_HS26;
+    break;
+  case EMMCHS52:
+    CardTypeNeeded = EXT_CSD_CARD_TYPE_HS52;
+    break;
+  case EMMCHS52DDR1V8:
+    CardTypeNeeded = EXT_CSD_CARD_TYPE_DDR52;
+    Ddr = TRUE;
+    if (!MMCHostHasDdr() || BusWidth == 1) {
+      return EFI_UNSUPPORTED;
     }
+    break;
+  default:
+    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCSetIos(): unsupported timing mode %u\n", TimingMode));
+    return EFI_UNSUPPORTED;
+  }
 
-    gBS->Stall(STALL_AFTER_WRITE_US);
+  if (mMmcCardType != 0 && (mMmcCardType & CardTypeNeeded) != CardTypeNeeded) {
+    DEBUG((DEBUG_INFO, "ArasanMMCHost: MMCSetIos(): eMMC card type 0x%x lacks timing mode %u\n",
+           mMmcCardType, TimingMode));
+    return EFI_UNSUPPORTED;
   }
-  mFwProtocol->SetLed(FALSE);
 
-  if (RetryCount == MAX_RETRY_COUNT) {
-    DEBUG((DEBUG_ERROR, "ArasanMMCHost: MMCWriteBlockData(): TIMEOUT waiting for BWR, MMCHS_INT_STAT: %08x\n",
-           MmcStatus));
-    return EFI_TIMEOUT;
+  // Same as MMCFilterMmcSwitch does for the card side.
+  if (BusWidth > PcdGet32(PcdArasanMaxBusWidth)) {
+    BusWidth = PcdGet32(PcdArasanMaxBusWidth);
   }
 
+  if (BusWidth != 0) {
+    Status = MMCSetBusWidth(BusWidth);
+    if (EFI_ERROR(Status)) {
+      return Status;
+    }
+  }
+
+  if (BusClockFreq != 0) {
+    Status = MMCSetClock(BusClockFreq);
+    if (EFI_ERROR(Status)) {
+      return Status;
+    }
+  }
+
+  MMCSetDdr(Ddr);
   return EFI_SUCCESS;
 }
 
+BOOLEAN
+MMCIsMultiBlock(
+                IN EFI_MMC_HOST_PROTOCOL *This
+                )
+{
+  return TRUE;
+}
+
 EFI_MMC_HOST_PROTOCOL gMMCHost =
   {
     MMC_HOST_PROTOCOL_REVISION,
@@ -676,9 +1443,122 @@ EFI_MMC_HOST_PROTOCOL gMMCHost =
     MMCSendCommand,
     MMCReceiveResponse,
     MMCReadBlockData,
-    MMCWriteBlockData
+    MMCWriteBlockData,
+    MMCSetIos,
+    MMCIsMultiBlock
   };
 
+/**
+   Polls CMD13 until the card is done erasing, i.e. back in the transfer
+   state and ready for data. An erase can run for minutes, far past
+   anything the data timeout counter covers, so the busy signal is not
+   left to the host.
+**/
+STATIC
+EFI_STATUS
+MMCWaitForErase(
+                IN UINT64 TimeoutUs
+                )
+{
+  EFI_STATUS Status;
+  UINT64 Deadline = MmcHostDeadline(TimeoutUs);
+  UINT32 Response;
+
+  for (;;) {
+    Status = MMCIssueCommand(CMD13, mRca << MMC_HOST_RCA_SHIFT, BLEN_512BYTES);
+    if (EFI_ERROR(Status)) {
+      return Status;
+    }
+
+    Response = MmcHostMmioRead32(MMCHS_RSP10);
+    if ((Response & MMC_HOST_R1_READY_FOR_DATA) != 0 &&
+        MMC_HOST_R1_CURRENT_STATE(Response) == MMC_HOST_R1_STATE_TRAN) {
+      return EFI_SUCCESS;
+    }
+
+    if (MmcHostDeadlinePassed(Deadline)) {
+      DEBUG((DEBUG_ERROR, "ArasanMMCHost: erase still busy, status %08x\n", Response));
+      return EFI_TIMEOUT;
+    }
+
+    gBS->Stall(ERASE_POLL_US);
+  }
+}
+
+/**
+   Erases Blocks blocks from Lba on: start and end address, then CMD38.
+   Called by MmcHostCommonLib at TPL_CALLBACK.
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MMCErase(
+         IN EFI_LBA Lba,
+         IN UINT64 Blocks
+         )
+{
+  EFI_STATUS Status;
+  EFI_LBA Last = Lba + Blocks - 1;
+  UINT64 TimeoutUs;
+
+  if (!mIsCardPresent) {
+    return EFI_NO_MEDIA;
+  }
+
+  // Plain eMMC erase works on whole erase groups only.
+  if (mIsMmcCard && !mMmcTrim &&
+      (ModU64x32(Lba, MmcHostEraseGranularity()) != 0 ||
+       ModU64x32(Blocks, MmcHostEraseGranularity()) != 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (mPendingCommand != NO_PENDING_COMMAND) {
+    // Only possible if called from within a BlockIo request.
+    return EFI_NOT_READY;
+  }
+
+  // Worked out before Lba turns into a byte address below.
+  TimeoutUs = MIN(MmcHostEraseTimeoutUs(Blocks), MAX_UINT32);
+
+  if (!mHighCapacity) {
+    Lba = MultU64x32(Lba, BLEN_512BYTES);
+    Last = MultU64x32(Last, BLEN_512BYTES);
+  }
+
+  if (Last > MAX_UINT32) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = MMCIssueCommand(mIsMmcCard ? CMD35 : CMD32, (UINT32) Lba, BLEN_512BYTES);
+  if (!EFI_ERROR(Status)) {
+    Status = MMCIssueCommand(mIsMmcCard ? CMD36 : CMD33, (UINT32) Last, BLEN_512BYTES);
+  }
+  if (!EFI_ERROR(Status)) {
+    Status = MMCIssueCommand(CMD38, mIsMmcCard && mMmcTrim ? MMC_TRIM_ARG : 0, BLEN_512BYTES);
+  }
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  return MMCWaitForErase(TimeoutUs);
+}
+
+/**
+   Logs the SD clock last programmed before the OS takes over. Command
+   timing is in the MmcStats counters.
+**/
+STATIC
+VOID
+EFIAPI
+MMCExitBootServices(
+                    IN EFI_EVENT Event,
+                    IN VOID *Context
+                    )
+{
+  DEBUG((DEBUG_INFO, "ArasanMMCHost: SD clock %u Hz, SYSCTL divisor 0x%x\n",
+         mLastClockFrequency, mLastDivisor));
+}
+
 EFI_STATUS
 MMCInitialize(
               IN EFI_HANDLE          ImageHandle,
@@ -690,6 +1570,11 @@ MMCInitialize(
 
   DEBUG((DEBUG_MMCHOST_SD, "ArasanMMCHost: MMCInitialize()\n"));
 
+  Status = MmcHostClaimSdSlot(MmcHostControllerArasan);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
   Status = gBS->LocateProtocol (&gRaspberryPiFirmwareProtocolGuid, NULL,
                                 (VOID **)&mFwProtocol);
   ASSERT_EFI_ERROR (Status);
@@ -697,9 +1582,40 @@ MMCInitialize(
     return Status;
   }
 
+  // SYSCTL is reprogrammed on every MMCSetClock, so a changed EMMC clock
+  // only needs the cached rate dropped.
+  Status = MmcHostCommonInit(L"Arasan", &gRaspberryPiArasanMmcHostDevicePathGuid,
+                             NULL, MMCErase);
+  ASSERT_EFI_ERROR (Status);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->CreateEvent(EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_NOTIFY,
+                            MMCExitBootServices, NULL, &mExitBootServicesEvent);
+  ASSERT_EFI_ERROR(Status);
+
+  // Enable all Interrupts ('Interrupts' is badly named, these are not ARM IRQ/FIQ Interrupts, but simply a register
+  // that is repeatedly polled). Without the status enables CARD_INS/CARD_REM never latch.
+  MmcHostMmioWrite32(MMCHS_IE, ALL_EN);
+  MMCCardDetect(NULL, NULL);
+
+  //
+  // Bcm2836InterruptDxe only dispatches the per-core local interrupts, not
+  // the GPU peripheral interrupt the controller raises, so card detect is
+  // sampled at a low rate instead.
+  //
+  Status = gBS->CreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                            MMCCardDetect, NULL, &mCardDetectEvent);
+  ASSERT_EFI_ERROR(Status);
+
+  Status = gBS->SetTimer(mCardDetectEvent, TimerPeriodic, CARD_DETECT_PERIOD);
+  ASSERT_EFI_ERROR(Status);
+
   Status = gBS->InstallMultipleProtocolInterfaces(
                                                   &Handle,
                                                   &gEfiMmcHostProtocolGuid, &gMMCHost,
+                                                  &gRaspberryPiMmcStatsProtocolGuid, MmcHostGetStatsProtocol(),
                                                   NULL
                                                   );
   ASSERT_EFI_ERROR(Status);
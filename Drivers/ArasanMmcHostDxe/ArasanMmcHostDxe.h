@@ -24,12 +24,13 @@
 #include <Library/IoLib.h>
 #include <Library/PcdLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DmaLib.h>
+#include <Library/Bcm2836DmaLib.h>
+#include <Library/MmcHostCommonLib.h>
 
 #include <Protocol/EmbeddedExternalDevice.h>
-#include <Protocol/BlockIo.h>
-#include <Protocol/DevicePath.h>
 #include <Protocol/MmcHost.h>
 #include <Protocol/RaspberryPiFirmware.h>
 
@@ -39,16 +40,64 @@
 
 // #include <LedLib.h>
 
-#define MAX_RETRY_COUNT (1000 * 20)
+// How long to wait on the controller for any single command or data step
+#define TIMEOUT_US (400 * 1000)
 
-#define STALL_AFTER_SEND_CMD_US (200) // in microseconds
-#define STALL_AFTER_REC_RESP_US (50)
-#define STALL_AFTER_WRITE_US (200)
-#define STALL_AFTER_READ_US (20)
-#define STALL_AFTER_RETRY_US (20)
+// Slowest data rate assumed when sizing DMA timeouts
+#define MIN_BYTES_PER_US 1
+
+// How often card insertion/removal is sampled for hotplug
+#define CARD_DETECT_PERIOD EFI_TIMER_PERIOD_MILLISECONDS(200)
 
 #define HC_MMC_CSD_GET_DEVICESIZE(Response)    ((Response[1] >> 16) | ((Response[2] & 0x3F) << 16));
 
 #define MAX_DIVISOR_VALUE 1023
 
+#define MAX_BLOCK_COUNT 0xFFFF
+
+#define ACMD6_BUS_WIDTH_MASK 0x3
+#define ACMD6_BUS_WIDTH_4 0x2
+
+#define NO_PENDING_COMMAND ((UINT32) -1)
+
+// eMMC CMD6 (SWITCH) argument: write one EXT_CSD byte
+#define MMC_SWITCH_ACCESS_WRITE_BYTE 0x3
+#define MMC_SWITCH_ACCESS(Arg) (((Arg) >> 24) & 0x3)
+#define MMC_SWITCH_INDEX(Arg) (((Arg) >> 16) & 0xFF)
+#define MMC_SWITCH_VALUE(Arg) (((Arg) >> 8) & 0xFF)
+#define MMC_SWITCH_ARGUMENT(Index, Value) \
+  ((MMC_SWITCH_ACCESS_WRITE_BYTE << 24) | ((Index) << 16) | ((Value) << 8))
+
+// EXT_CSD byte offsets and fields (JESD84-B51)
+#define EXT_CSD_LENGTH 512
+#define EXT_CSD_ERASE_GROUP_DEF 175
+#define EXT_CSD_PARTITION_CONFIG 179
+#define EXT_CSD_BUS_WIDTH 183
+#define EXT_CSD_HS_TIMING 185
+#define EXT_CSD_REV 192
+#define EXT_CSD_CARD_TYPE 196
+#define EXT_CSD_HC_ERASE_GRP_SIZE 224 // In 512 KiB units
+#define EXT_CSD_BOOT_SIZE_MULT 226 // In 128 KiB units
+#define EXT_CSD_SEC_FEATURE_SUPPORT 231
+#define EXT_CSD_SEC_GB_CL_EN BIT4 // TRIM supported
+
+#define EXT_CSD_CARD_TYPE_HS26 BIT0
+#define EXT_CSD_CARD_TYPE_HS52 BIT1
+#define EXT_CSD_CARD_TYPE_DDR52 BIT2 // 1.8V or 3V I/O
+
+#define PARTITION_CONFIG_ACCESS_MASK 0x7 // 0 = user area, 1/2 = boot partitions
+#define PARTITION_CONFIG_BOOT_ENABLE(Config) (((Config) >> 3) & 0x7)
+
+#define EXT_CSD_BUS_WIDTH_1 0
+#define EXT_CSD_BUS_WIDTH_4 1
+#define EXT_CSD_BUS_WIDTH_8 2
+#define EXT_CSD_DDR_BUS_WIDTH_4 5
+#define EXT_CSD_DDR_BUS_WIDTH_8 6
+
+// CMD38 argument selecting TRIM (write block granularity) on eMMC
+#define MMC_TRIM_ARG 0x1
+
+// How often to ask the card whether an erase is done
+#define ERASE_POLL_US 1000
+
 #endif
@@ -0,0 +1,765 @@
+/** @file
+*
+*  Boot-time read cache for the SD card and USB mass storage.
+*
+*  FAT, partition and loader code re-read the same metadata blocks over
+*  and over during boot. This driver sits between them and the device:
+*  it opens the raw device BlockIo BY_DRIVER and publishes a child with
+*  a cached BlockIo, which MmcBlockIo2Dxe or DiskIoDxe then bind to, so
+*  partitions and everything above them are covered.
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include "BlockCacheDxe.h"
+
+//
+// Vendor device path GUIDs of the MMC host drivers, which MmcDxe uses
+// for the device path of the card's BlockIo handle.
+//
+STATIC CONST EFI_GUID *mMmcHostDevicePathGuids[] = {
+  &gRaspberryPiArasanMmcHostDevicePathGuid,
+  &gRaspberryPiSdHostDevicePathGuid,
+};
+
+STATIC LIST_ENTRY         mLru = INITIALIZE_LIST_HEAD_VARIABLE (mLru);
+STATIC BLOCK_CACHE_EXTENT mExtents[BLOCK_CACHE_EXTENTS];
+STATIC UINT8              *mReadAheadBuffer;
+STATIC EFI_EVENT          mExitBootServicesEvent;
+STATIC BOOLEAN            mDisabled;
+
+STATIC UINT64             mHits;
+STATIC UINT64             mMisses;
+STATIC UINT64             mReadAheads;
+STATIC UINT64             mBypasses;
+STATIC UINT64             mInvalidations;
+
+STATIC
+EFI_LBA
+ExtentStart (
+  IN  BLOCK_CACHE_DEV *Dev,
+  IN  EFI_LBA         Lba
+  )
+{
+  return MultU64x32 (DivU64x32 (Lba, (UINT32) Dev->ExtentBlocks),
+           (UINT32) Dev->ExtentBlocks);
+}
+
+STATIC
+BLOCK_CACHE_EXTENT *
+LookupExtent (
+  IN  BLOCK_CACHE_DEV *Dev,
+  IN  EFI_LBA         Lba
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < BLOCK_CACHE_EXTENTS; Index++) {
+    if (mExtents[Index].Dev == Dev && mExtents[Index].Lba == Lba) {
+      return &mExtents[Index];
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+VOID
+DropExtent (
+  IN  BLOCK_CACHE_EXTENT  *Extent
+  )
+{
+  Extent->Dev = NULL;
+  RemoveEntryList (&Extent->Link);
+  InsertTailList (&mLru, &Extent->Link);
+  mInvalidations++;
+}
+
+STATIC
+VOID
+InvalidateRange (
+  IN  BLOCK_CACHE_DEV *Dev,
+  IN  EFI_LBA         Lba,
+  IN  EFI_LBA         EndLba
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < BLOCK_CACHE_EXTENTS; Index++) {
+    if (mExtents[Index].Dev == Dev &&
+        mExtents[Index].Lba < EndLba &&
+        mExtents[Index].Lba + mExtents[Index].Blocks > Lba) {
+      DropExtent (&mExtents[Index]);
+    }
+  }
+}
+
+STATIC
+VOID
+InvalidateDevice (
+  IN  BLOCK_CACHE_DEV *Dev
+  )
+{
+  InvalidateRange (Dev, 0, MAX_UINT64);
+  Dev->SequentialRun = 0;
+  Dev->NextLba = 0;
+}
+
+/**
+  Recycle the least recently used extent for Lba on Dev.
+
+**/
+STATIC
+BLOCK_CACHE_EXTENT *
+ClaimExtent (
+  IN  BLOCK_CACHE_DEV *Dev,
+  IN  EFI_LBA         Lba,
+  IN  UINTN           Blocks
+  )
+{
+  BLOCK_CACHE_EXTENT  *Extent;
+
+  Extent = BASE_CR (mLru.BackLink, BLOCK_CACHE_EXTENT, Link);
+  Extent->Dev = Dev;
+  Extent->Lba = Lba;
+  Extent->Blocks = Blocks;
+  RemoveEntryList (&Extent->Link);
+  InsertHeadList (&mLru, &Extent->Link);
+  return Extent;
+}
+
+/**
+  Load the extent starting at Lba, and when Dev is being read
+  sequentially, the uncached extents after it in the same transfer.
+
+**/
+STATIC
+EFI_STATUS
+FillExtent (
+  IN  BLOCK_CACHE_DEV     *Dev,
+  IN  EFI_LBA             Lba,
+  OUT BLOCK_CACHE_EXTENT  **Result
+  )
+{
+  EFI_BLOCK_IO_MEDIA  *Media;
+  BLOCK_CACHE_EXTENT  *Extent;
+  EFI_LBA             EndLba;
+  UINTN               Count;
+  UINTN               Blocks;
+  UINTN               Index;
+  UINTN               BlockSize;
+  EFI_STATUS          Status;
+
+  Media = Dev->ParentBlockIo->Media;
+  BlockSize = Media->BlockSize;
+
+  Count = 1;
+  if (Dev->SequentialRun >= BLOCK_CACHE_SEQUENTIAL_RUN) {
+    while (Count < BLOCK_CACHE_READ_AHEAD &&
+           Lba + Count * Dev->ExtentBlocks <= Media->LastBlock &&
+           LookupExtent (Dev, Lba + Count * Dev->ExtentBlocks) == NULL) {
+      Count++;
+    }
+  }
+
+  EndLba = MIN (Lba + Count * Dev->ExtentBlocks, Media->LastBlock + 1);
+  Blocks = (UINTN) (EndLba - Lba);
+
+  if (Count == 1) {
+    Extent = ClaimExtent (Dev, Lba, Blocks);
+    Status = Dev->ParentBlockIo->ReadBlocks (Dev->ParentBlockIo, Dev->MediaId,
+                                  Lba, Blocks * BlockSize, Extent->Data);
+    if (EFI_ERROR (Status)) {
+      DropExtent (Extent);
+      return Status;
+    }
+    *Result = Extent;
+    return EFI_SUCCESS;
+  }
+
+  Status = Dev->ParentBlockIo->ReadBlocks (Dev->ParentBlockIo, Dev->MediaId,
+                                Lba, Blocks * BlockSize, mReadAheadBuffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mReadAheads += Count - 1;
+
+  //
+  // Claim in reverse so the extent being read now ends up most recent.
+  //
+  for (Index = Count; Index > 0; Index--) {
+    Blocks = MIN (Dev->ExtentBlocks,
+               (UINTN) (EndLba - Lba - (Index - 1) * Dev->ExtentBlocks));
+    Extent = ClaimExtent (Dev, Lba + (Index - 1) * Dev->ExtentBlocks, Blocks);
+    CopyMem (Extent->Data,
+      mReadAheadBuffer + (Index - 1) * BLOCK_CACHE_EXTENT_SIZE,
+      Blocks * BlockSize);
+  }
+
+  *Result = Extent;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+CacheReadBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  BLOCK_CACHE_DEV     *Dev;
+  BLOCK_CACHE_EXTENT  *Extent;
+  EFI_BLOCK_IO_MEDIA  *Media;
+  EFI_LBA             ExtentLba;
+  UINTN               Blocks;
+  UINTN               Offset;
+  UINTN               Count;
+  UINT8               *Data;
+  EFI_STATUS          Status;
+  EFI_TPL             OldTpl;
+
+  Dev = BLOCK_CACHE_DEV_FROM_BLOCK_IO (This);
+  Media = This->Media;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  //
+  // A swapped medium normally comes with the device's BlockIo being
+  // reinstalled, which restarts us with nothing cached. Catch a device
+  // that only bumped MediaId as well.
+  //
+  if (Media->MediaId != Dev->MediaId) {
+    InvalidateDevice (Dev);
+    Dev->MediaId = Media->MediaId;
+  }
+
+  //
+  // Let the device sort out anything out of the ordinary, and stream
+  // large reads past the cache.
+  //
+  if (mDisabled ||
+      MediaId != Media->MediaId || !Media->MediaPresent ||
+      Buffer == NULL || BufferSize == 0 ||
+      Media->BlockSize * Dev->ExtentBlocks != BLOCK_CACHE_EXTENT_SIZE ||
+      (BufferSize % Media->BlockSize) != 0 ||
+      Lba > Media->LastBlock ||
+      BufferSize / Media->BlockSize > Media->LastBlock - Lba + 1 ||
+      BufferSize >= BLOCK_CACHE_BYPASS_SIZE) {
+    mBypasses++;
+    Status = Dev->ParentBlockIo->ReadBlocks (Dev->ParentBlockIo, MediaId, Lba,
+                                  BufferSize, Buffer);
+    goto Done;
+  }
+
+  Blocks = BufferSize / Media->BlockSize;
+  if (Lba == Dev->NextLba) {
+    Dev->SequentialRun++;
+  } else {
+    Dev->SequentialRun = 0;
+  }
+  Dev->NextLba = Lba + Blocks;
+
+  Data = Buffer;
+  Status = EFI_SUCCESS;
+  while (Blocks > 0) {
+    ExtentLba = ExtentStart (Dev, Lba);
+    Extent = LookupExtent (Dev, ExtentLba);
+    if (Extent != NULL) {
+      mHits++;
+      RemoveEntryList (&Extent->Link);
+      InsertHeadList (&mLru, &Extent->Link);
+    } else {
+      mMisses++;
+      Status = FillExtent (Dev, ExtentLba, &Extent);
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+    }
+
+    Offset = (UINTN) (Lba - ExtentLba);
+    ASSERT (Offset < Extent->Blocks);
+    Count = MIN (Blocks, Extent->Blocks - Offset);
+    CopyMem (Data, Extent->Data + Offset * Media->BlockSize,
+      Count * Media->BlockSize);
+
+    Data += Count * Media->BlockSize;
+    Lba += Count;
+    Blocks -= Count;
+  }
+
+Done:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+CacheWriteBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  IN  VOID                  *Buffer
+  )
+{
+  BLOCK_CACHE_DEV *Dev;
+  EFI_STATUS      Status;
+  EFI_TPL         OldTpl;
+
+  Dev = BLOCK_CACHE_DEV_FROM_BLOCK_IO (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  InvalidateRange (Dev, Lba,
+    Lba + (BufferSize + This->Media->BlockSize - 1) / This->Media->BlockSize);
+  Status = Dev->ParentBlockIo->WriteBlocks (Dev->ParentBlockIo, MediaId, Lba,
+                                BufferSize, Buffer);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+CacheReset (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  BOOLEAN               ExtendedVerification
+  )
+{
+  BLOCK_CACHE_DEV *Dev;
+  EFI_TPL         OldTpl;
+
+  Dev = BLOCK_CACHE_DEV_FROM_BLOCK_IO (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  InvalidateDevice (Dev);
+  gBS->RestoreTPL (OldTpl);
+
+  return Dev->ParentBlockIo->Reset (Dev->ParentBlockIo, ExtendedVerification);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+CacheFlushBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This
+  )
+{
+  BLOCK_CACHE_DEV *Dev;
+
+  Dev = BLOCK_CACHE_DEV_FROM_BLOCK_IO (This);
+  return Dev->ParentBlockIo->FlushBlocks (Dev->ParentBlockIo);
+}
+
+/**
+  Erased blocks read back as all zeroes or all ones, so the range is
+  dropped before the device is asked to erase it.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+CacheEraseBlocks (
+  IN     EFI_ERASE_BLOCK_PROTOCOL *This,
+  IN     UINT32                   MediaId,
+  IN     EFI_LBA                  Lba,
+  IN OUT EFI_ERASE_BLOCK_TOKEN    *Token,
+  IN     UINTN                    Size
+  )
+{
+  BLOCK_CACHE_DEV *Dev;
+  UINT32          BlockSize;
+  EFI_STATUS      Status;
+  EFI_TPL         OldTpl;
+
+  Dev = BLOCK_CACHE_DEV_FROM_ERASE_BLOCK (This);
+  BlockSize = Dev->ParentBlockIo->Media->BlockSize;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  InvalidateRange (Dev, Lba, Lba + (Size + BlockSize - 1) / BlockSize);
+  Status = Dev->ParentEraseBlock->EraseBlocks (Dev->ParentEraseBlock, MediaId,
+                                    Lba, Token, Size);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+STATIC
+BOOLEAN
+IsMmcHostDevicePath (
+  IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
+  )
+{
+  UINTN Index;
+
+  if (DevicePathType (DevicePath) == HARDWARE_DEVICE_PATH &&
+      DevicePathSubType (DevicePath) == HW_VENDOR_DP) {
+    for (Index = 0; Index < ARRAY_SIZE (mMmcHostDevicePathGuids); Index++) {
+      if (CompareGuid (&((VENDOR_DEVICE_PATH *) DevicePath)->Guid,
+            mMmcHostDevicePathGuids[Index])) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+IsUsbDevicePath (
+  IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
+  )
+{
+  for (; !IsDevicePathEnd (DevicePath);
+       DevicePath = NextDevicePathNode (DevicePath)) {
+    if (DevicePathType (DevicePath) == MESSAGING_DEVICE_PATH &&
+        DevicePathSubType (DevicePath) == MSG_USB_DP) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+HasCacheNode (
+  IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
+  )
+{
+  for (; !IsDevicePathEnd (DevicePath);
+       DevicePath = NextDevicePathNode (DevicePath)) {
+    if (DevicePathType (DevicePath) == HARDWARE_DEVICE_PATH &&
+        DevicePathSubType (DevicePath) == HW_VENDOR_DP &&
+        CompareGuid (&((VENDOR_DEVICE_PATH *) DevicePath)->Guid,
+          &gRaspberryPiBlockCacheDevicePathGuid)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BlockCacheDriverBindingSupported (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL    *RemainingDevicePath OPTIONAL
+  )
+{
+  EFI_STATUS                Status;
+  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  UINT32                    BlockSize;
+
+  Status = gBS->OpenProtocol (Controller, &gEfiDevicePathProtocolGuid,
+                  (VOID **) &DevicePath, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (HasCacheNode (DevicePath) ||
+      (!IsUsbDevicePath (DevicePath) && !IsMmcHostDevicePath (DevicePath))) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_BY_DRIVER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  BlockSize = BlockIo->Media->BlockSize;
+  if (BlockIo->Media->LogicalPartition || BlockSize == 0 ||
+      BlockSize > BLOCK_CACHE_EXTENT_SIZE ||
+      (BLOCK_CACHE_EXTENT_SIZE % BlockSize) != 0) {
+    Status = EFI_UNSUPPORTED;
+  }
+
+  gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+         This->DriverBindingHandle, Controller);
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BlockCacheDriverBindingStart (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL    *RemainingDevicePath OPTIONAL
+  )
+{
+  EFI_STATUS                Status;
+  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+  BLOCK_CACHE_DEV           *Dev;
+
+  Status = gBS->OpenProtocol (Controller, &gEfiDevicePathProtocolGuid,
+                  (VOID **) &DevicePath, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_BY_DRIVER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Dev = AllocateZeroPool (sizeof (*Dev));
+  if (Dev == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto CloseBlockIo;
+  }
+
+  Node = CreateDeviceNode (HARDWARE_DEVICE_PATH, HW_VENDOR_DP,
+           sizeof (VENDOR_DEVICE_PATH));
+  if (Node == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeDev;
+  }
+  CopyGuid (&((VENDOR_DEVICE_PATH *) Node)->Guid,
+    &gRaspberryPiBlockCacheDevicePathGuid);
+  Dev->DevicePath = AppendDevicePathNode (DevicePath, Node);
+  FreePool (Node);
+  if (Dev->DevicePath == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeDev;
+  }
+
+  Dev->Signature = BLOCK_CACHE_DEV_SIGNATURE;
+  Dev->ParentBlockIo = BlockIo;
+  Dev->MediaId = BlockIo->Media->MediaId;
+  Dev->ExtentBlocks = BLOCK_CACHE_EXTENT_SIZE / BlockIo->Media->BlockSize;
+
+  Dev->BlockIo.Revision = BlockIo->Revision;
+  Dev->BlockIo.Media = BlockIo->Media;
+  Dev->BlockIo.Reset = CacheReset;
+  Dev->BlockIo.ReadBlocks = CacheReadBlocks;
+  Dev->BlockIo.WriteBlocks = CacheWriteBlocks;
+  Dev->BlockIo.FlushBlocks = CacheFlushBlocks;
+
+  Status = gBS->InstallMultipleProtocolInterfaces (&Dev->Handle,
+                  &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+                  &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                  NULL);
+  if (EFI_ERROR (Status)) {
+    goto FreeDevicePath;
+  }
+
+  //
+  // The SD card can erase, and erasing through the child keeps the cache
+  // in step with the card.
+  //
+  Status = gBS->OpenProtocol (Controller, &gEfiEraseBlockProtocolGuid,
+                  (VOID **) &Dev->ParentEraseBlock, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (EFI_ERROR (Status)) {
+    Dev->ParentEraseBlock = NULL;
+  } else {
+    Dev->EraseBlock.Revision = Dev->ParentEraseBlock->Revision;
+    Dev->EraseBlock.EraseLengthGranularity =
+      Dev->ParentEraseBlock->EraseLengthGranularity;
+    Dev->EraseBlock.EraseBlocks = CacheEraseBlocks;
+    Status = gBS->InstallProtocolInterface (&Dev->Handle,
+                    &gEfiEraseBlockProtocolGuid, EFI_NATIVE_INTERFACE,
+                    &Dev->EraseBlock);
+    if (EFI_ERROR (Status)) {
+      goto Uninstall;
+    }
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Dev->Handle, EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER);
+  if (EFI_ERROR (Status)) {
+    goto UninstallEraseBlock;
+  }
+
+  DEBUG ((DEBUG_INFO, "%a: caching %p on %p\n", __FUNCTION__, Controller,
+    Dev->Handle));
+  return EFI_SUCCESS;
+
+UninstallEraseBlock:
+  if (Dev->ParentEraseBlock != NULL) {
+    gBS->UninstallProtocolInterface (Dev->Handle, &gEfiEraseBlockProtocolGuid,
+           &Dev->EraseBlock);
+  }
+Uninstall:
+  gBS->UninstallMultipleProtocolInterfaces (Dev->Handle,
+         &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+         &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+         NULL);
+FreeDevicePath:
+  FreePool (Dev->DevicePath);
+FreeDev:
+  FreePool (Dev);
+CloseBlockIo:
+  gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+         This->DriverBindingHandle, Controller);
+  return Status;
+}
+
+/**
+  Runs when the device goes away or its BlockIo is reinstalled for a
+  new medium. Whatever was cached for it is dropped with the child.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+BlockCacheDriverBindingStop (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  UINTN                       NumberOfChildren,
+  IN  EFI_HANDLE                  *ChildHandleBuffer OPTIONAL
+  )
+{
+  EFI_STATUS              Status;
+  EFI_BLOCK_IO_PROTOCOL   *BlockIo;
+  BLOCK_CACHE_DEV         *Dev;
+  EFI_TPL                 OldTpl;
+  UINTN                   Index;
+  BOOLEAN                 AllStopped;
+
+  if (NumberOfChildren == 0) {
+    return gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  This->DriverBindingHandle, Controller);
+  }
+
+  AllStopped = TRUE;
+  for (Index = 0; Index < NumberOfChildren; Index++) {
+    Status = gBS->OpenProtocol (ChildHandleBuffer[Index],
+                    &gEfiBlockIoProtocolGuid, (VOID **) &BlockIo,
+                    This->DriverBindingHandle, Controller,
+                    EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (EFI_ERROR (Status)) {
+      AllStopped = FALSE;
+      continue;
+    }
+
+    Dev = BLOCK_CACHE_DEV_FROM_BLOCK_IO (BlockIo);
+
+    gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+           This->DriverBindingHandle, Dev->Handle);
+
+    if (Dev->ParentEraseBlock != NULL) {
+      Status = gBS->UninstallProtocolInterface (Dev->Handle,
+                      &gEfiEraseBlockProtocolGuid, &Dev->EraseBlock);
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = gBS->UninstallMultipleProtocolInterfaces (Dev->Handle,
+                      &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+                      &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                      NULL);
+      if (EFI_ERROR (Status) && Dev->ParentEraseBlock != NULL) {
+        gBS->InstallProtocolInterface (&Dev->Handle,
+               &gEfiEraseBlockProtocolGuid, EFI_NATIVE_INTERFACE,
+               &Dev->EraseBlock);
+      }
+    }
+    if (EFI_ERROR (Status)) {
+      gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+             (VOID **) &BlockIo, This->DriverBindingHandle,
+             Dev->Handle, EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER);
+      AllStopped = FALSE;
+      continue;
+    }
+
+    OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+    InvalidateDevice (Dev);
+    gBS->RestoreTPL (OldTpl);
+
+    FreePool (Dev->DevicePath);
+    FreePool (Dev);
+  }
+
+  return AllStopped ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+STATIC EFI_DRIVER_BINDING_PROTOCOL mBlockCacheDriverBinding = {
+  BlockCacheDriverBindingSupported,
+  BlockCacheDriverBindingStart,
+  BlockCacheDriverBindingStop,
+  BLOCK_CACHE_DRIVER_VERSION,
+  NULL,
+  NULL
+};
+
+/**
+  The OS gets the devices as they are: from here on every read goes
+  straight through. Nothing is freed or closed, since the devices and
+  their children stay installed and memory services are off limits.
+
+**/
+STATIC
+VOID
+EFIAPI
+OnExitBootServices (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  mDisabled = TRUE;
+
+  DEBUG ((DEBUG_INFO,
+    "BlockCache: %lu hits, %lu misses, %lu extents read ahead, %lu bypassed, %lu invalidated\n",
+    mHits, mMisses, mReadAheads, mBypasses, mInvalidations));
+}
+
+EFI_STATUS
+EFIAPI
+BlockCacheDxeInitialize (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINT8       *Data;
+
+  Data = AllocatePages (EFI_SIZE_TO_PAGES (BLOCK_CACHE_EXTENTS * BLOCK_CACHE_EXTENT_SIZE));
+  mReadAheadBuffer = AllocatePages (EFI_SIZE_TO_PAGES (BLOCK_CACHE_READ_AHEAD * BLOCK_CACHE_EXTENT_SIZE));
+  if (Data == NULL || mReadAheadBuffer == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: out of memory\n", __FUNCTION__));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < BLOCK_CACHE_EXTENTS; Index++) {
+    mExtents[Index].Data = Data + Index * BLOCK_CACHE_EXTENT_SIZE;
+    InsertTailList (&mLru, &mExtents[Index].Link);
+  }
+
+  Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_NOTIFY,
+                  OnExitBootServices, NULL, &mExitBootServicesEvent);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return EfiLibInstallDriverBinding (ImageHandle, SystemTable,
+           &mBlockCacheDriverBinding, ImageHandle);
+}
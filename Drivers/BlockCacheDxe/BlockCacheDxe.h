@@ -0,0 +1,90 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BLOCK_CACHE_DXE_H__
+#define __BLOCK_CACHE_DXE_H__
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/DriverBinding.h>
+#include <Protocol/EraseBlock.h>
+
+//
+// Must bind before MmcBlockIo2Dxe (0x20) and DiskIoDxe (0xa): the cache
+// opens the device's BlockIo BY_DRIVER, and they bind to its child.
+//
+#define BLOCK_CACHE_DRIVER_VERSION  0x30
+
+//
+// The cache is BLOCK_CACHE_EXTENTS extents of BLOCK_CACHE_EXTENT_SIZE
+// bytes each, shared by all devices and recycled least recently used
+// first. Reads at least BLOCK_CACHE_BYPASS_SIZE long (kernel, initrd)
+// go straight to the device and are not cached.
+//
+#define BLOCK_CACHE_EXTENT_SIZE     SIZE_32KB
+#define BLOCK_CACHE_EXTENTS         64
+#define BLOCK_CACHE_BYPASS_SIZE     SIZE_128KB
+
+//
+// After this many back-to-back reads, a miss loads this many extents
+// in a single transfer.
+//
+#define BLOCK_CACHE_SEQUENTIAL_RUN  2
+#define BLOCK_CACHE_READ_AHEAD      4
+
+#define BLOCK_CACHE_DEV_SIGNATURE   SIGNATURE_32 ('b', 'c', 'a', 'c')
+
+//
+// One per cached device. The device's BlockIo is opened BY_DRIVER, and
+// a child handle gets a BlockIo, and an EraseBlock when the device has
+// one, that go through the cache.
+//
+typedef struct {
+  UINT32                    Signature;
+  EFI_HANDLE                Handle;         // The child
+  EFI_BLOCK_IO_PROTOCOL     *ParentBlockIo;
+  EFI_ERASE_BLOCK_PROTOCOL  *ParentEraseBlock;  // NULL when the device has none
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_ERASE_BLOCK_PROTOCOL  EraseBlock;
+  UINT32                    MediaId;
+  UINTN                     ExtentBlocks;
+  EFI_LBA                   NextLba;        // Where a sequential read would start
+  UINTN                     SequentialRun;
+} BLOCK_CACHE_DEV;
+
+#define BLOCK_CACHE_DEV_FROM_BLOCK_IO(a) \
+  CR (a, BLOCK_CACHE_DEV, BlockIo, BLOCK_CACHE_DEV_SIGNATURE)
+
+#define BLOCK_CACHE_DEV_FROM_ERASE_BLOCK(a) \
+  CR (a, BLOCK_CACHE_DEV, EraseBlock, BLOCK_CACHE_DEV_SIGNATURE)
+
+typedef struct {
+  LIST_ENTRY              Link;           // In mLru, most recent first
+  BLOCK_CACHE_DEV         *Dev;           // NULL when unused
+  EFI_LBA                 Lba;            // First block, extent aligned
+  UINTN                   Blocks;         // Fewer than ExtentBlocks at the end of the media
+  UINT8                   *Data;
+} BLOCK_CACHE_EXTENT;
+
+#endif /* __BLOCK_CACHE_DXE_H__ */
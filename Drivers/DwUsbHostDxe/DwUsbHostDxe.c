@@ -41,11 +41,6 @@ typedef enum {
   XFER_RESTART
 } CHANNEL_HALT_REASON;
 
-typedef struct {
-  BOOLEAN Splitting;
-  BOOLEAN SplitStart;
-} SPLIT_CONTROL;
-
 VOID DwHcInit (IN DWUSB_OTGHC_DEV *DwHc);
 VOID DwCoreInit (IN DWUSB_OTGHC_DEV *DwHc);
 
@@ -75,30 +70,22 @@ Wait4Bit (
   return 1;
 }
 
+STATIC
 CHANNEL_HALT_REASON
-Wait4Chhltd (
-             IN DWUSB_OTGHC_DEV    *DwHc,
-             IN UINT32             Channel,
-             IN UINT32             *Sub,
-             IN UINT32             *Toggle,
-             IN BOOLEAN            IgnoreAck,
-             IN SPLIT_CONTROL     *Split
-             )
+DwHcChannelHalted (
+                   IN DWUSB_OTGHC_DEV    *DwHc,
+                   IN UINT32             Channel,
+                   IN UINT32             Hcint,
+                   IN UINT32             *Sub,
+                   IN UINT32             *Toggle,
+                   IN BOOLEAN            IgnoreAck,
+                   IN SPLIT_CONTROL     *Split
+                   )
 {
   UINT32  HcintCompHltAck = DWC2_HCINT_XFERCOMP | DWC2_HCINT_CHHLTD;
   UINT32  HcintSplitStartAck = DWC2_HCINT_CHHLTD;
   UINT32  HcintSplitNyet = DWC2_HCINT_CHHLTD | DWC2_HCINT_NYET;
-  INT32   Ret;
-  UINT32  Hcint, Hctsiz;
-
-  MicroSecondDelay (100);
-  Ret = Wait4Bit (DwHc->DwUsbBase + HCINT(Channel), DWC2_HCINT_CHHLTD, 1);
-  if (Ret) {
-    return XFER_ERROR;
-  }
-
-  MicroSecondDelay (100);
-  Hcint = MmioRead32 (DwHc->DwUsbBase + HCINT(Channel));
+  UINT32  Hctsiz;
 
   if ((Hcint & DWC2_HCINT_NAK) != 0) {
     return XFER_NAK;
@@ -134,7 +121,7 @@ Wait4Chhltd (
   }
 
   if (Hcint != HcintCompHltAck) {
-    DEBUG ((EFI_D_ERROR, "Wait4Chhltd: HCINT Error 0x%x %a\n", Hcint,
+    DEBUG ((EFI_D_ERROR, "DwHcChannelHalted: HCINT Error 0x%x %a\n", Hcint,
             Split->SplitStart ? "split start" :
             (Split->Splitting ? "split complete" : "")));
     return XFER_ERROR;
@@ -147,6 +134,65 @@ Wait4Chhltd (
   return XFER_DONE;
 }
 
+STATIC
+UINT64
+DwHcDeadline (
+              IN UINT32             TimeoutUs
+              )
+{
+  return GetPerformanceCounter () +
+    DivU64x32 (MultU64x32 (GetPerformanceCounterProperties (NULL, NULL),
+                           TimeoutUs), 1000000);
+}
+
+/*
+ * Most transactions complete within a few microframes, so spin on
+ * HCINT without stalling in between: the latency of a CBW or CSW is
+ * then down to the bus. CHHLTD is the last bit the core sets, so the
+ * HCINT value that shows it is complete.
+ */
+STATIC
+BOOLEAN
+DwHcSpinChhltd (
+                IN  DWUSB_OTGHC_DEV    *DwHc,
+                IN  UINT32             Channel,
+                IN  UINT64             Deadline,
+                OUT UINT32             *Hcint
+                )
+{
+  for (;;) {
+    *Hcint = MmioRead32 (DwHc->DwUsbBase + HCINT(Channel));
+    if ((*Hcint & DWC2_HCINT_CHHLTD) != 0) {
+      return TRUE;
+    }
+
+    if (GetPerformanceCounter () > Deadline) {
+      return FALSE;
+    }
+  }
+}
+
+CHANNEL_HALT_REASON
+Wait4Chhltd (
+             IN DWUSB_OTGHC_DEV    *DwHc,
+             IN UINT32             Channel,
+             IN UINT32             *Sub,
+             IN UINT32             *Toggle,
+             IN BOOLEAN            IgnoreAck,
+             IN SPLIT_CONTROL     *Split
+             )
+{
+  UINT32  Hcint;
+
+  if (!DwHcSpinChhltd (DwHc, Channel,
+                       DwHcDeadline (DWC2_HC_HALT_TIMEOUT_MS * 1000), &Hcint)) {
+    DEBUG ((EFI_D_ERROR, "Wait4Chhltd: Timeout (HCINT:0x%x)\n", Hcint));
+    return XFER_ERROR;
+  }
+
+  return DwHcChannelHalted (DwHc, Channel, Hcint, Sub, Toggle, IgnoreAck, Split);
+}
+
 VOID
 DwOtgHcInit (
              IN DWUSB_OTGHC_DEV    *DwHc,
@@ -206,6 +252,138 @@ DwCoreReset (
   MicroSecondDelay (100000);
 }
 
+/*
+ * Periodic transfers run from timer events at TPL_NOTIFY and can
+ * preempt a control or bulk transfer half way through, so every
+ * transfer claims a free channel (and with it, its own bounce
+ * buffer) rather than sharing a fixed one. Interrupt endpoints only
+ * hold one for the length of a poll.
+ */
+STATIC
+BOOLEAN
+DwHcTakeChannel (
+                 IN  DWUSB_OTGHC_DEV *DwHc,
+                 OUT UINT32          *Channel
+                 )
+{
+  EFI_TPL PreviousTpl;
+  UINT32  Free;
+
+  PreviousTpl = gBS->RaiseTPL(TPL_NOTIFY);
+  Free = ~DwHc->ChannelsInUse & ((1U << DwHc->NumChannels) - 1);
+  if (Free != 0) {
+    *Channel = (UINT32)LowBitSet32 (Free);
+    DwHc->ChannelsInUse |= 1U << *Channel;
+  }
+  gBS->RestoreTPL(PreviousTpl);
+
+  return Free != 0;
+}
+
+STATIC
+EFI_STATUS
+DwHcAllocateChannel (
+                     IN  DWUSB_OTGHC_DEV *DwHc,
+                     OUT UINT32          *Channel
+                     )
+{
+  if (!DwHcTakeChannel (DwHc, Channel)) {
+    DEBUG ((EFI_D_ERROR, "DwHcAllocateChannel: all %u channels busy\n",
+            DwHc->NumChannels));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+DwHcFreeChannel (
+                 IN DWUSB_OTGHC_DEV *DwHc,
+                 IN UINT32          Channel
+                 )
+{
+  EFI_TPL PreviousTpl;
+
+  PreviousTpl = gBS->RaiseTPL(TPL_NOTIFY);
+  DwHc->ChannelsInUse &= ~(1U << Channel);
+  gBS->RestoreTPL(PreviousTpl);
+}
+
+/*
+ * Point the channel straight at the caller's buffer when DmaMap can
+ * do so without bouncing it itself. HCDMA only needs 4-byte alignment,
+ * which is all OUT data needs, as mapping it merely cleans the cache.
+ * IN data is invalidated afterwards, so it must own whole cache lines
+ * and have room for the NumPackets * MPS bytes the core may write.
+ */
+STATIC
+BOOLEAN
+DwHcMapDirect (
+               IN  UINT32                 TransferDirection,
+               IN  VOID                   *Data,
+               IN  UINTN                  Length,
+               IN  UINTN                  Available,
+               OUT UINTN                  *BusAddress,
+               OUT VOID                   **Mapping
+               )
+{
+  EFI_PHYSICAL_ADDRESS  DeviceAddress;
+  UINTN                 Alignment;
+  UINTN                 Mapped;
+  EFI_STATUS            Status;
+
+  if (Length == 0 || Length > Available) {
+    return FALSE;
+  }
+
+  if (TransferDirection) {
+    Alignment = MAX (ArmCacheWritebackGranule (), 4);
+    if (((UINTN)Data & (Alignment - 1)) != 0 ||
+        (Length & (Alignment - 1)) != 0) {
+      return FALSE;
+    }
+  } else if (((UINTN)Data & 3) != 0) {
+    return FALSE;
+  }
+
+  Mapped = Length;
+  Status = DmaMap (TransferDirection ? MapOperationBusMasterWrite :
+                   MapOperationBusMasterRead,
+                   Data, &Mapped, &DeviceAddress, Mapping);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  if (Mapped != Length) {
+    DmaUnmap (*Mapping);
+    return FALSE;
+  }
+
+  *BusAddress = (UINTN)DeviceAddress;
+  return TRUE;
+}
+
+STATIC
+VOID
+DwHcHaltChannel (
+                 IN DWUSB_OTGHC_DEV *DwHc,
+                 IN UINT32          Channel
+                 )
+{
+  UINT32 Status;
+
+  if ((MmioRead32 (DwHc->DwUsbBase + HCCHAR(Channel)) & DWC2_HCCHAR_CHEN) == 0) {
+    return;
+  }
+
+  MmioOr32 (DwHc->DwUsbBase + HCCHAR(Channel),
+            DWC2_HCCHAR_CHEN | DWC2_HCCHAR_CHDIS);
+  Status = Wait4Bit (DwHc->DwUsbBase + HCINT(Channel), DWC2_HCINT_CHHLTD, 1);
+  if (Status)
+    DEBUG ((EFI_D_ERROR, "DwHcHaltChannel: Timeout!\n"));
+}
+
 STATIC
 EFI_STATUS
 DwHcTransfer (
@@ -233,6 +411,14 @@ DwHcTransfer (
   UINT32                          StopTransfer = 0;
   EFI_STATUS                      Status = EFI_SUCCESS;
   SPLIT_CONTROL                   Split = { 0 };
+  UINT8                           *Buffer;
+  UINTN                           BufferBusAddress;
+  UINTN                           BusAddress;
+  VOID                            *Mapping;
+  BOOLEAN                         Direct;
+
+  Buffer = DwHc->AlignedBuffer + Channel * DWC2_DATA_BUF_SIZE;
+  BufferBusAddress = DwHc->AlignedBufferBusAddress + Channel * DWC2_DATA_BUF_SIZE;
 
   /* DEBUG((DEBUG_ERROR, "%u:%u> Transfer of size %u, MPL = %u\n", */
   /*        DeviceAddress, */
@@ -249,12 +435,8 @@ DwHcTransfer (
 
     TxferLen = *DataLength - Done;
 
-    if (TxferLen > DWC2_MAX_TRANSFER_SIZE) {
-      TxferLen = DWC2_MAX_TRANSFER_SIZE - MaximumPacketLength + 1;
-    }
-
-    if (TxferLen > DWC2_DATA_BUF_SIZE) {
-      TxferLen = DWC2_DATA_BUF_SIZE - MaximumPacketLength + 1;
+    if (TxferLen > DwHc->MaxTransferSize) {
+      TxferLen = DwHc->MaxTransferSize - MaximumPacketLength + 1;
     }
 
     if (Split.Splitting ||
@@ -262,8 +444,8 @@ DwHcTransfer (
       NumPackets = 1;
     } else {
       NumPackets = (TxferLen + MaximumPacketLength - 1) / MaximumPacketLength;
-      if (NumPackets > DWC2_MAX_PACKET_COUNT) {
-        NumPackets = DWC2_MAX_PACKET_COUNT;
+      if (NumPackets > DwHc->MaxPacketCount) {
+        NumPackets = DwHc->MaxPacketCount;
         TxferLen = NumPackets * MaximumPacketLength;
       }
     }
@@ -272,18 +454,34 @@ DwHcTransfer (
       TxferLen = NumPackets * MaximumPacketLength;
     }
 
+    /*
+     * Only the bounce buffer limits a chunk to DWC2_DATA_BUF_SIZE. When
+     * the caller's buffer can be used directly, the channel is given as
+     * many packets as it can count.
+     */
+    Direct = DwHcMapDirect (TransferDirection, Data+Done, TxferLen,
+                            *DataLength - Done, &BusAddress, &Mapping);
+    if (!Direct && TxferLen > DWC2_DATA_BUF_SIZE) {
+      TxferLen = DWC2_DATA_BUF_SIZE - (DWC2_DATA_BUF_SIZE % MaximumPacketLength);
+      if (!Split.Splitting) {
+        NumPackets = TxferLen / MaximumPacketLength;
+      }
+    }
+
     MmioWrite32 (DwHc->DwUsbBase + HCTSIZ(Channel),
                  (TxferLen << DWC2_HCTSIZ_XFERSIZE_OFFSET) |
                  (NumPackets << DWC2_HCTSIZ_PKTCNT_OFFSET) |
                  (*Pid << DWC2_HCTSIZ_PID_OFFSET));
 
-    if (!TransferDirection) {
-      CopyMem (DwHc->AlignedBuffer, Data+Done, TxferLen);
-      ArmDataSynchronizationBarrier();
+    if (!Direct) {
+      if (!TransferDirection) {
+        CopyMem (Buffer, Data+Done, TxferLen);
+        ArmDataSynchronizationBarrier();
+      }
+      BusAddress = BufferBusAddress;
     }
 
-    MmioWrite32 (DwHc->DwUsbBase + HCDMA(Channel),
-                 (UINTN)DwHc->AlignedBufferBusAddress);
+    MmioWrite32 (DwHc->DwUsbBase + HCDMA(Channel), BusAddress);
 
 restart_channel:
     DwOtgHcInit (DwHc, Channel, Translator, DeviceSpeed,
@@ -301,7 +499,21 @@ restart_channel:
     Ret = Wait4Chhltd (DwHc, Channel, &Sub, Pid, IgnoreAck, &Split);
     if (Ret == XFER_RESTART) {
       goto restart_channel;
-    } else if (Ret == XFER_STALL) {
+    }
+
+    /*
+     * A channel that never halted may still be moving data: stop it
+     * before its buffer is unmapped and the channel handed out again.
+     */
+    if (Ret == XFER_ERROR) {
+      DwHcHaltChannel (DwHc, Channel);
+    }
+
+    if (Direct) {
+      DmaUnmap (Mapping);
+    }
+
+    if (Ret == XFER_STALL) {
       *TransferResult = EFI_USB_ERR_STALL;
       Status = EFI_DEVICE_ERROR;
       break;
@@ -318,7 +530,9 @@ restart_channel:
     if (TransferDirection) { // out or none
       ArmDataSynchronizationBarrier();
       TxferLen -= Sub;
-      CopyMem (Data+Done, DwHc->AlignedBuffer, TxferLen);
+      if (!Direct) {
+        CopyMem (Data+Done, Buffer, TxferLen);
+      }
       if (Sub) {
         StopTransfer = 1;
       }
@@ -359,6 +573,25 @@ DwHcFindDeferredTransfer (
   return NULL;
 }
 
+STATIC
+VOID
+DwHcRemoveDeferredTransfer (
+                            IN DWUSB_DEFERRED_REQ *Req
+                            )
+{
+  DEBUG ((DEBUG_INFO, "Periodic 0x%x:0x%x: %u transfers, %u missed intervals\n",
+          Req->DeviceAddress, Req->EpAddress, Req->Transfers,
+          Req->MissedIntervals));
+
+  if (Req->InFlight) {
+    DwHcHaltChannel (Req->DwHc, Req->Channel);
+    DwHcFreeChannel (Req->DwHc, Req->Channel);
+  }
+  RemoveEntryList (&Req->List);
+  FreePool (Req->Data);
+  FreePool (Req);
+}
+
 STATIC
 VOID
 DwHcCancelDeferredTransfers (
@@ -369,6 +602,9 @@ DwHcCancelDeferredTransfers (
   EFI_TPL PreviousTpl;
 
   PreviousTpl = gBS->RaiseTPL(TPL_NOTIFY);
+  gBS->CloseEvent (DwHc->PeriodicEvent);
+  DEBUG ((DEBUG_INFO, "Periodic schedule missed %lu intervals in all\n",
+          DwHc->PeriodicMissed));
   EFI_LIST_FOR_EACH (Entry, &DwHc->DeferredList) {
     DWUSB_DEFERRED_REQ *Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ,
                                                   List);
@@ -379,40 +615,299 @@ DwHcCancelDeferredTransfers (
      */
     DEBUG((EFI_D_ERROR, "Cancelling periodic access to 0x%x:0x%x\n",
            Req->DeviceAddress, Req->EpAddress));
-    gBS->CloseEvent (Req->Event);
+    if (Req->InFlight) {
+      DwHcHaltChannel (DwHc, Req->Channel);
+    }
   }
   gBS->RestoreTPL(PreviousTpl);
 }
 
+/*
+ * The periodic schedule. One timer tick services every interrupt
+ * endpoint: it reaps the channels that have halted and starts those
+ * whose next frame has come, each on a channel taken for that one
+ * poll. The frame number in HFNUM (microframes on a high-speed port)
+ * says when an endpoint is due and how many polling intervals went by
+ * unserviced.
+ *
+ * A high-speed endpoint is never waited for. A low- or full-speed one
+ * behind a hub's transaction translator has its complete-splits due
+ * within microframes of the start-split, far sooner than the next
+ * tick. So after starting endpoints, the tick keeps moving the splits
+ * it has in flight from phase to phase as their channels halt, for as
+ * long as HFNUM says the TT still holds their result. A split that
+ * runs out of microframes is dropped and counted as a missed interval.
+ */
+
+STATIC
+UINT32
+DwHcFrameNumber (
+                 IN DWUSB_OTGHC_DEV *DwHc
+                 )
+{
+  UINT32 Hfnum;
+
+  Hfnum = MmioRead32 (DwHc->DwUsbBase + HFNUM);
+  return ((Hfnum & DWC2_HFNUM_FRNUM_MASK) >> DWC2_HFNUM_FRNUM_OFFSET) &
+    DWC2_HFNUM_MAX_FRNUM;
+}
+
+STATIC
+UINT32
+DwHcFramesPerMs (
+                 IN DWUSB_OTGHC_DEV *DwHc
+                 )
+{
+  UINT32 Hprt0;
+
+  Hprt0 = MmioRead32 (DwHc->DwUsbBase + HPRT0);
+  if (((Hprt0 & DWC2_HPRT0_PRTSPD_MASK) >> DWC2_HPRT0_PRTSPD_OFFSET) ==
+      DWC2_HPRT0_PRTSPD_HIGH) {
+    return 8;
+  }
+
+  return 1;
+}
+
+STATIC
+VOID
+DwHcPeriodicEnable (
+                    IN DWUSB_DEFERRED_REQ *Req,
+                    IN UINT32             Frame
+                    )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+
+  DwOtgHcInit (DwHc, Req->Channel, Req->Translator, Req->DeviceSpeed,
+               Req->DeviceAddress, Req->EpAddress,
+               Req->TransferDirection, Req->EpType,
+               Req->MaximumPacketLength, &Req->Split);
+
+  /*
+   * A periodic channel only goes out in frames whose parity matches
+   * ODDFRM, so aim for the next one.
+   */
+  MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(Req->Channel),
+                   ~(DWC2_HCCHAR_MULTICNT_MASK |
+                     DWC2_HCCHAR_CHEN |
+                     DWC2_HCCHAR_CHDIS |
+                     DWC2_HCCHAR_ODDFRM),
+                   ((1 << DWC2_HCCHAR_MULTICNT_OFFSET) |
+                    DWC2_HCCHAR_CHEN |
+                    (((Frame + 1) & 1) ? DWC2_HCCHAR_ODDFRM : 0)));
+}
+
 STATIC
 VOID
-DwHcDeferredTransfer (
-                      IN EFI_EVENT Event,
-                      IN VOID      *Context
+DwHcPeriodicMissed (
+                    IN DWUSB_DEFERRED_REQ *Req,
+                    IN UINT32             Missed
+                    )
+{
+  Req->MissedIntervals += Missed;
+  Req->DwHc->PeriodicMissed += Missed;
+}
+
+STATIC
+VOID
+DwHcPeriodicComplete (
+                      IN DWUSB_DEFERRED_REQ   *Req,
+                      IN CHANNEL_HALT_REASON  Ret,
+                      IN UINT32               Sub
                       )
 {
-  EFI_STATUS Status;
-  DWUSB_DEFERRED_REQ *Req = Context;
-
-  Req->TransferResult = EFI_USB_NOERROR;
-  Status = DwHcTransfer (Req->DwHc, Req->Channel, Req->Translator,
-                         Req->DeviceSpeed, Req->DeviceAddress,
-                         Req->MaximumPacketLength, &Req->Pid,
-                         Req->TransferDirection, Req->Data, &Req->DataLength,
-                         Req->EpAddress, Req->EpType, &Req->TransferResult,
-                         Req->IgnoreAck);
-
-  if (Req->EpType == DWC2_HCCHAR_EPTYPE_INTR &&
-      Status == EFI_DEVICE_ERROR &&
-      Req->TransferResult == EFI_USB_ERR_NAK) {
+  DWUSB_OTGHC_DEV     *DwHc = Req->DwHc;
+  UINTN               Length = 0;
+  UINT32              TransferResult;
+
+  if (Ret == XFER_DONE) {
+    ArmDataSynchronizationBarrier();
+    Length = MIN (Req->TxferLen - Sub, Req->DataLength);
+    CopyMem (Req->Data, DwHc->AlignedBuffer + Req->Channel * DWC2_DATA_BUF_SIZE,
+             Length);
+  }
+
+  Req->InFlight = FALSE;
+  DwHcFreeChannel (DwHc, Req->Channel);
+
+  if (Ret == XFER_NAK) {
     /*
      * Swallow the NAK, the upper layer expects us to resubmit automatically.
      */
     return;
   }
 
-  Req->CallbackFunction (Req->Data, Req->DataLength, Req->CallbackContext,
-                         Req->TransferResult);
+  if (Ret == XFER_DONE) {
+    TransferResult = EFI_USB_NOERROR;
+  } else if (Ret == XFER_STALL) {
+    TransferResult = EFI_USB_ERR_STALL;
+  } else {
+    TransferResult = EFI_USB_ERR_SYSTEM;
+  }
+
+  Req->Transfers++;
+
+  /*
+   * The callback may well end this very transfer, so Req is not
+   * to be touched afterwards.
+   */
+  Req->CallbackFunction (Req->Data, Length, Req->CallbackContext,
+                         TransferResult);
+}
+
+STATIC
+VOID
+DwHcPeriodicStart (
+                   IN DWUSB_DEFERRED_REQ *Req,
+                   IN UINT32             Frame
+                   )
+{
+  DWUSB_OTGHC_DEV *DwHc = Req->DwHc;
+  UINT32          Missed;
+  UINT32          NumPackets;
+
+  /*
+   * With every channel busy the poll waits for a later tick, which
+   * then finds it late.
+   */
+  if (!DwHcTakeChannel (DwHc, &Req->Channel)) {
+    return;
+  }
+
+  /*
+   * Polls stay on the slots the endpoint was first started on: the
+   * next one is the first slot after this frame, and any passed over
+   * on the way count as missed.
+   */
+  Missed = ((Frame - Req->NextFrame) & DWC2_HFNUM_MAX_FRNUM) / Req->Interval;
+  DwHcPeriodicMissed (Req, Missed);
+  Req->NextFrame = (Req->NextFrame + Req->Interval * (Missed + 1)) &
+    DWC2_HFNUM_MAX_FRNUM;
+
+  Req->Split.Splitting = (Req->DeviceSpeed == EFI_USB_SPEED_LOW ||
+                          Req->DeviceSpeed == EFI_USB_SPEED_FULL);
+  Req->Split.SplitStart = Req->Split.Splitting;
+  Req->SplitFrame = Frame;
+
+  if (Req->Split.Splitting) {
+    NumPackets = 1;
+  } else {
+    NumPackets = (Req->DataLength + Req->MaximumPacketLength - 1) /
+      Req->MaximumPacketLength;
+  }
+  Req->TxferLen = NumPackets * Req->MaximumPacketLength;
+
+  MmioWrite32 (DwHc->DwUsbBase + HCTSIZ(Req->Channel),
+               (Req->TxferLen << DWC2_HCTSIZ_XFERSIZE_OFFSET) |
+               (NumPackets << DWC2_HCTSIZ_PKTCNT_OFFSET) |
+               (Req->Pid << DWC2_HCTSIZ_PID_OFFSET));
+  MmioWrite32 (DwHc->DwUsbBase + HCDMA(Req->Channel),
+               DwHc->AlignedBufferBusAddress +
+               Req->Channel * DWC2_DATA_BUF_SIZE);
+
+  DwHcPeriodicEnable (Req, Frame);
+  Req->InFlight = TRUE;
+}
+
+/*
+ * Moves an endpoint on if its channel halted: the next split phase,
+ * or completion. Returns TRUE while it is still part way through a
+ * split that the TT can answer.
+ */
+STATIC
+BOOLEAN
+DwHcPeriodicPoll (
+                  IN DWUSB_DEFERRED_REQ *Req,
+                  IN UINT32             Frame
+                  )
+{
+  DWUSB_OTGHC_DEV     *DwHc = Req->DwHc;
+  CHANNEL_HALT_REASON Ret;
+  UINT32              Hcint;
+  UINT32              Sub = 0;
+
+  Hcint = MmioRead32 (DwHc->DwUsbBase + HCINT(Req->Channel));
+  if ((Hcint & DWC2_HCINT_CHHLTD) != 0) {
+    Ret = DwHcChannelHalted (DwHc, Req->Channel, Hcint, &Sub, &Req->Pid,
+                             Req->IgnoreAck, &Req->Split);
+    if (Ret != XFER_RESTART) {
+      DwHcPeriodicComplete (Req, Ret, Sub);
+      return FALSE;
+    }
+  }
+
+  if (!Req->Split.Splitting) {
+    if ((Hcint & DWC2_HCINT_CHHLTD) != 0) {
+      DwHcPeriodicEnable (Req, Frame);
+    }
+    return FALSE;
+  }
+
+  if (((Frame - Req->SplitFrame) & DWC2_HFNUM_MAX_FRNUM) > DWC2_HC_SPLIT_FRAMES) {
+    DEBUG ((DEBUG_INFO, "Periodic 0x%x:0x%x: split dropped (HCINT:0x%x)\n",
+            Req->DeviceAddress, Req->EpAddress, Hcint));
+    DwHcHaltChannel (DwHc, Req->Channel);
+    Req->InFlight = FALSE;
+    DwHcFreeChannel (DwHc, Req->Channel);
+    DwHcPeriodicMissed (Req, 1);
+    return FALSE;
+  }
+
+  if ((Hcint & DWC2_HCINT_CHHLTD) != 0) {
+    DwHcPeriodicEnable (Req, Frame);
+  }
+  return TRUE;
+}
+
+STATIC
+VOID
+EFIAPI
+DwHcPeriodicTick (
+                  IN EFI_EVENT Event,
+                  IN VOID      *Context
+                  )
+{
+  DWUSB_OTGHC_DEV    *DwHc = Context;
+  DWUSB_DEFERRED_REQ *Req;
+  LIST_ENTRY         *Entry;
+  LIST_ENTRY         *NextEntry;
+  UINT32             Frame;
+  BOOLEAN            Splitting;
+  UINT64             Deadline;
+
+  Frame = DwHcFrameNumber (DwHc);
+  Splitting = FALSE;
+
+  EFI_LIST_FOR_EACH_SAFE (Entry, NextEntry, &DwHc->DeferredList) {
+    Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ, List);
+
+    if (Req->InFlight) {
+      Splitting |= DwHcPeriodicPoll (Req, Frame);
+    } else if (((Frame - Req->NextFrame) & DWC2_HFNUM_MAX_FRNUM) <=
+               DWC2_HFNUM_MAX_FRNUM / 2) {
+      DwHcPeriodicStart (Req, Frame);
+      Splitting |= Req->InFlight && Req->Split.Splitting;
+    }
+  }
+
+  /*
+   * The splits started above all share the few microframes the TT
+   * gives them. HFNUM ends each one, the deadline only guards against
+   * a port that stopped counting frames.
+   */
+  Deadline = DwHcDeadline (DWC2_HC_SPLIT_TIMEOUT_US);
+  while (Splitting && GetPerformanceCounter () <= Deadline) {
+    Frame = DwHcFrameNumber (DwHc);
+    Splitting = FALSE;
+
+    EFI_LIST_FOR_EACH_SAFE (Entry, NextEntry, &DwHc->DeferredList) {
+      Req = EFI_LIST_CONTAINER (Entry, DWUSB_DEFERRED_REQ, List);
+
+      if (Req->InFlight && Req->Split.Splitting) {
+        Splitting |= DwHcPeriodicPoll (Req, Frame);
+      }
+    }
+  }
 }
 
 /**
@@ -726,6 +1221,7 @@ DwHcControlTransfer (
   UINTN                   Length;
   EFI_USB_DATA_DIRECTION  StatusDirection;
   UINT32                  Direction;
+  UINT32                  Channel;
 
   if ((Request == NULL) || (TransferResult == NULL)) {
     return EFI_INVALID_PARAMETER;
@@ -761,9 +1257,14 @@ DwHcControlTransfer (
   *TransferResult = EFI_USB_ERR_SYSTEM;
   Status          = EFI_DEVICE_ERROR;
 
+  Status = DwHcAllocateChannel (DwHc, &Channel);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
   Pid = DWC2_HC_PID_SETUP;
   Length = 8;
-  Status = DwHcTransfer (DwHc, DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+  Status = DwHcTransfer (DwHc, Channel, Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid, 0,
                          Request, &Length, 0, DWC2_HCCHAR_EPTYPE_CONTROL,
                          TransferResult, 1);
@@ -781,7 +1282,7 @@ DwHcControlTransfer (
     else
       Direction = 0;
 
-    Status = DwHcTransfer (DwHc, DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+    Status = DwHcTransfer (DwHc, Channel, Translator, DeviceSpeed,
                            DeviceAddress, MaximumPacketLength, &Pid,
                            Direction, Data, DataLength, 0,
                            DWC2_HCCHAR_EPTYPE_CONTROL,
@@ -800,7 +1301,7 @@ DwHcControlTransfer (
 
   Pid = DWC2_HC_PID_DATA1;
   Length = 0;
-  Status = DwHcTransfer (DwHc, DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+  Status = DwHcTransfer (DwHc, Channel, Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid,
                          StatusDirection, DwHc->StatusBuffer, &Length, 0,
                          DWC2_HCCHAR_EPTYPE_CONTROL, TransferResult, 0);
@@ -811,6 +1312,7 @@ DwHcControlTransfer (
   }
 
  EXIT:
+  DwHcFreeChannel (DwHc, Channel);
   return Status;
 }
 
@@ -836,6 +1338,7 @@ DwHcBulkTransfer (
   UINT8                   TransferDirection;
   UINT8                   EpAddress;
   UINT32                  Pid;
+  UINT32                  Channel;
 
   if ((Data == NULL) || (Data[0] == NULL) ||
       (DataLength == NULL) || (*DataLength == 0) ||
@@ -843,6 +1346,17 @@ DwHcBulkTransfer (
     return EFI_INVALID_PARAMETER;
   }
 
+  /*
+   * As with the other USB2 host controllers, the Data[] entries all
+   * describe the one transfer: Data[0] holds all *DataLength bytes,
+   * and the rest only matter to controllers that need per-page
+   * mappings.
+   */
+  if ((DataBuffersNumber == 0) ||
+      (DataBuffersNumber > EFI_USB_MAX_BULK_BUFFER_NUM)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
   if ((*DataToggle != 0) && (*DataToggle != 1))
     return EFI_INVALID_PARAMETER;
 
@@ -861,10 +1375,16 @@ DwHcBulkTransfer (
   EpAddress               = EndPointAddress & 0x0F;
   Pid                     = (*DataToggle << 1);
 
-  Status = DwHcTransfer (DwHc, DWC2_HC_CHANNEL, Translator, DeviceSpeed,
+  Status = DwHcAllocateChannel (DwHc, &Channel);
+  if (EFI_ERROR(Status)) {
+    return Status;
+  }
+
+  Status = DwHcTransfer (DwHc, Channel, Translator, DeviceSpeed,
                          DeviceAddress, MaximumPacketLength, &Pid,
                          TransferDirection, Data[0], DataLength, EpAddress,
                          DWC2_HCCHAR_EPTYPE_BULK, TransferResult, 1);
+  DwHcFreeChannel (DwHc, Channel);
 
   *DataToggle = (Pid >> 1);
 
@@ -910,7 +1430,7 @@ DwHcAsyncInterruptTransfer (
       goto done;
     }
 
-    if (DataLength == 0) {
+    if (DataLength == 0 || DataLength > DWC2_DATA_BUF_SIZE) {
       Status = EFI_INVALID_PARAMETER;
       goto done;
     }
@@ -938,12 +1458,12 @@ DwHcAsyncInterruptTransfer (
       goto done;
     }
 
-    gBS->CloseEvent (FoundReq->Event);
     *DataToggle = FoundReq->Pid >> 1;
-    FreePool (FoundReq->Data);
+    DwHcRemoveDeferredTransfer (FoundReq);
 
-    RemoveEntryList (&FoundReq->List);
-    FreePool (FoundReq);
+    if (IsListEmpty (&DwHc->DeferredList)) {
+      gBS->SetTimer (DwHc->PeriodicEvent, TimerCancel, 0);
+    }
 
     Status = EFI_SUCCESS;
     goto done;
@@ -964,26 +1484,8 @@ DwHcAsyncInterruptTransfer (
   }
 
   InitializeListHead (&NewReq->List);
-  Status = gBS->CreateEvent (
-                             EVT_TIMER | EVT_NOTIFY_SIGNAL,
-                             TPL_NOTIFY,
-                             DwHcDeferredTransfer,
-                             NewReq, &NewReq->Event
-                             );
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((EFI_D_ERROR, "DwHcAsyncInterruptTransfer: failed to create event: %r\n", Status));
-    goto done;
-  }
-
-  Status = gBS->SetTimer (NewReq->Event, TimerPeriodic,
-                          EFI_TIMER_PERIOD_MILLISECONDS(PollingInterval));
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((EFI_D_ERROR, "DwHcAsyncInterruptTransfer: failed to set timer: %r\n", Status));
-    goto done;
-  }
 
   NewReq->DwHc = DwHc;
-  NewReq->Channel = DWC2_HC_CHANNEL_PERIODIC;
   NewReq->Translator = Translator;
   NewReq->DeviceSpeed = DeviceSpeed;
   NewReq->DeviceAddress = DeviceAddress;
@@ -997,9 +1499,23 @@ DwHcAsyncInterruptTransfer (
   NewReq->IgnoreAck = TRUE;
   NewReq->CallbackFunction = CallbackFunction;
   NewReq->CallbackContext = Context;
+  NewReq->Interval = PollingInterval * DwHcFramesPerMs (DwHc);
+  NewReq->NextFrame = DwHcFrameNumber (DwHc);
+
+  /*
+   * The tick asks for every millisecond, and gets what the timer
+   * granularity allows. HFNUM keeps the polls on their intervals
+   * regardless, and counts the ones that were missed.
+   */
+  Status = gBS->SetTimer (DwHc->PeriodicEvent, TimerPeriodic,
+                          EFI_TIMER_PERIOD_MILLISECONDS(1));
+  if (Status != EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR, "DwHcAsyncInterruptTransfer: failed to set timer: %r\n", Status));
+    goto done;
+  }
 
   InsertTailList (&DwHc->DeferredList, &NewReq->List);
-  gBS->SignalEvent (NewReq->Event);
+  gBS->SignalEvent (DwHc->PeriodicEvent);
 
  done:
   gBS->RestoreTPL(PreviousTpl);
@@ -1132,7 +1648,7 @@ DwHcInit (
   UINT32 NpTxFifoSz = 0;
   UINT32 pTxFifoSz = 0;
   UINT32 Hprt0 = 0;
-  INT32  i, Status, NumChannels;
+  INT32  i, Status;
 
   MmioWrite32 (DwHc->DwUsbBase + PCGCCTL, 0);
 
@@ -1154,18 +1670,12 @@ DwHcInit (
   DwFlushTxFifo (DwHc, 0x10);
   DwFlushRxFifo (DwHc);
 
-  NumChannels = MmioRead32 (DwHc->DwUsbBase + GHWCFG2);
-  NumChannels &= DWC2_HWCFG2_NUM_HOST_CHAN_MASK;
-  NumChannels >>= DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
-  NumChannels += 1;
-  DEBUG ((DEBUG_INFO, "Host has %u channels\n", NumChannels));
-
-  for (i=0; i<NumChannels; i++)
+  for (i=0; i<DwHc->NumChannels; i++)
     MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(i),
                      ~(DWC2_HCCHAR_CHEN | DWC2_HCCHAR_EPDIR),
                      DWC2_HCCHAR_CHDIS);
 
-  for (i=0; i<NumChannels; i++) {
+  for (i=0; i<DwHc->NumChannels; i++) {
     MmioAndThenOr32 (DwHc->DwUsbBase + HCCHAR(i),
                      ~DWC2_HCCHAR_EPDIR,
                      (DWC2_HCCHAR_CHEN | DWC2_HCCHAR_CHDIS));
@@ -1232,6 +1742,7 @@ CreateDwUsbHc (
   UINT32          Pages;
   UINTN           BufferSize;
   EFI_STATUS      Status;
+  UINT32          Hwcfg3;
 
   DwHc = AllocateZeroPool (sizeof(DWUSB_OTGHC_DEV));
 
@@ -1259,6 +1770,22 @@ CreateDwUsbHc (
 
   CopyMem (&DwHc->DevicePath, &DwHcDevicePath, sizeof(DwHcDevicePath));
 
+  DwHc->NumChannels = MmioRead32 (DwHc->DwUsbBase + GHWCFG2);
+  DwHc->NumChannels &= DWC2_HWCFG2_NUM_HOST_CHAN_MASK;
+  DwHc->NumChannels >>= DWC2_HWCFG2_NUM_HOST_CHAN_OFFSET;
+  DwHc->NumChannels += 1;
+  DEBUG ((DEBUG_INFO, "Host has %u channels\n", DwHc->NumChannels));
+
+  Hwcfg3 = MmioRead32 (DwHc->DwUsbBase + GHWCFG3);
+  DwHc->MaxTransferSize = (1U << (((Hwcfg3 & DWC2_HWCFG3_XFER_SIZE_CNTR_WIDTH_MASK) >>
+                                   DWC2_HWCFG3_XFER_SIZE_CNTR_WIDTH_OFFSET) + 11)) - 1;
+  DwHc->MaxTransferSize = MIN (DwHc->MaxTransferSize, DWC2_HCTSIZ_XFERSIZE_MASK);
+  DwHc->MaxPacketCount = (1U << (((Hwcfg3 & DWC2_HWCFG3_PACKET_SIZE_CNTR_WIDTH_MASK) >>
+                                  DWC2_HWCFG3_PACKET_SIZE_CNTR_WIDTH_OFFSET) + 4)) - 1;
+  DwHc->MaxPacketCount = MIN (DwHc->MaxPacketCount, DWC2_MAX_PACKET_COUNT);
+  DEBUG ((DEBUG_INFO, "Host channels take up to %u bytes in %u packets\n",
+          DwHc->MaxTransferSize, DwHc->MaxPacketCount));
+
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   DwHc->StatusBuffer = AllocatePages(Pages);
   if (DwHc->StatusBuffer == NULL) {
@@ -1266,7 +1793,7 @@ CreateDwUsbHc (
     return NULL;
   }
 
-  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
+  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE * DwHc->NumChannels);
   Status = DmaAllocateBuffer (EfiBootServicesData, Pages, (VOID **) &DwHc->AlignedBuffer);
   if (EFI_ERROR (Status)) {
     DEBUG ((EFI_D_ERROR, "CreateDwUsbHc: No pages available for AlignedBuffer\n"));
@@ -1282,6 +1809,13 @@ CreateDwUsbHc (
 
   InitializeListHead (&DwHc->DeferredList);
 
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                             DwHcPeriodicTick, DwHc, &DwHc->PeriodicEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "CreateDwUsbHc: failed to create periodic event: %r\n", Status));
+    return NULL;
+  }
+
   return DwHc;
 }
 
@@ -1388,9 +1922,10 @@ DwUsbHostEntryPoint (
                                             NULL
                                             );
  FREE_DWUSBHC:
+  gBS->CloseEvent (DwHc->PeriodicEvent);
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   FreePages (DwHc->StatusBuffer, Pages);
-  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
+  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE * DwHc->NumChannels);
   DmaUnmap (DwHc->AlignedBufferMapping);
   DmaFreeBuffer (Pages, DwHc->AlignedBuffer);
   gBS->FreePool (DwHc);
@@ -1423,6 +1958,8 @@ DwUsbHostExitPoint (
     gBS->CloseEvent (DwHc->ExitBootServiceEvent);
   }
 
+  DwHcCancelDeferredTransfers (DwHc);
+
   gBS->UninstallMultipleProtocolInterfaces (
                                             &DwHc->DeviceHandle,
                                             &gEfiUsb2HcProtocolGuid,        &DwHc->DwUsbOtgHc,
@@ -1436,7 +1973,7 @@ DwUsbHostExitPoint (
 
   Pages = EFI_SIZE_TO_PAGES (DWC2_STATUS_BUF_SIZE);
   FreePages (DwHc->StatusBuffer, Pages);
-  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE);
+  Pages = EFI_SIZE_TO_PAGES (DWC2_DATA_BUF_SIZE * DwHc->NumChannels);
   DmaUnmap (DwHc->AlignedBufferMapping);
   DmaFreeBuffer (Pages, DwHc->AlignedBuffer);
   FreePool (DwHc);
@@ -74,9 +74,18 @@ typedef struct {
   EFI_DEVICE_PATH_PROTOCOL      EndDevicePath;
 } EFI_USB_PCIIO_DEVICE_PATH;
 
+typedef struct {
+  BOOLEAN Splitting;
+  BOOLEAN SplitStart;
+} SPLIT_CONTROL;
+
+//
+// A periodic (interrupt IN) endpoint. It takes a channel for each poll
+// and gives it back when the poll ends, and is started and reaped from
+// the one scheduler tick.
+//
 typedef struct _DWUSB_DEFERRED_REQ {
   IN OUT LIST_ENTRY                         List;
-  IN OUT EFI_EVENT                          Event;
   IN     struct _DWUSB_OTGHC_DEV            *DwHc;
   IN     UINT32                             Channel;
   IN     EFI_USB2_HC_TRANSACTION_TRANSLATOR *Translator;
@@ -89,10 +98,19 @@ typedef struct _DWUSB_DEFERRED_REQ {
   IN OUT UINT32                             Pid;
   IN     UINT32                             EpAddress;
   IN     UINT32                             EpType;
-  OUT    UINT32                             TransferResult;
   IN     BOOLEAN                            IgnoreAck;
   IN     EFI_ASYNC_USB_TRANSFER_CALLBACK    CallbackFunction;
   IN     VOID                               *CallbackContext;
+
+  IN     UINT32                             Interval;       // In (micro)frames
+  IN OUT UINT32                             NextFrame;
+  IN OUT UINT32                             SplitFrame;     // Start-split went out
+  IN OUT BOOLEAN                            InFlight;
+  IN OUT SPLIT_CONTROL                      Split;
+  IN OUT UINT32                             TxferLen;
+
+  OUT    UINT32                             Transfers;
+  OUT    UINT32                             MissedIntervals;
 } DWUSB_DEFERRED_REQ;
 
 typedef struct _DWUSB_OTGHC_DEV {
@@ -110,6 +128,21 @@ typedef struct _DWUSB_OTGHC_DEV {
   EFI_PHYSICAL_ADDRESS            DwUsbBase;
   UINT8                           *StatusBuffer;
 
+  //
+  // Host channels, as reported by GHWCFG2. Each has its own
+  // DWC2_DATA_BUF_SIZE slice of AlignedBuffer, so transfers on
+  // different channels never share a bounce buffer.
+  //
+  UINT32                          NumChannels;
+  UINT32                          ChannelsInUse;
+
+  //
+  // Most a channel can be programmed for at once, from the HCTSIZ
+  // counter widths in GHWCFG3.
+  //
+  UINT32                          MaxTransferSize;
+  UINT32                          MaxPacketCount;
+
   UINT8                           *AlignedBuffer;
   VOID *                          AlignedBufferMapping;
   UINTN                           AlignedBufferBusAddress;
@@ -118,6 +151,8 @@ typedef struct _DWUSB_OTGHC_DEV {
   UINT16                          PortChangeStatus;
 
   LIST_ENTRY                      DeferredList;
+  EFI_EVENT                       PeriodicEvent;
+  UINT64                          PeriodicMissed;
 } DWUSB_OTGHC_DEV;
 
 #endif //_DWUSBHOSTDXE_H_
@@ -487,6 +487,7 @@
 #define DWC2_HFNUM_FRNUM_OFFSET                         0
 #define DWC2_HFNUM_FRREM_MASK                           (0xFFFF << 16)
 #define DWC2_HFNUM_FRREM_OFFSET                         16
+#define DWC2_HFNUM_MAX_FRNUM                            0x3FFF
 #define DWC2_HPTXSTS_PTXFSPCAVAIL_MASK                  (0xFFFF << 0)
 #define DWC2_HPTXSTS_PTXFSPCAVAIL_OFFSET                0
 #define DWC2_HPTXSTS_PTXQSPCAVAIL_MASK                  (0xFF << 16)
@@ -525,6 +526,9 @@
 #define DWC2_HPRT0_PRTTSTCTL_OFFSET                     13
 #define DWC2_HPRT0_PRTSPD_MASK                          (0x3 << 17)
 #define DWC2_HPRT0_PRTSPD_OFFSET                        17
+#define DWC2_HPRT0_PRTSPD_HIGH                          0
+#define DWC2_HPRT0_PRTSPD_FULL                          1
+#define DWC2_HPRT0_PRTSPD_LOW                           2
 #define DWC2_HAINT_CH0                                  (1 << 0)
 #define DWC2_HAINT_CH0_OFFSET                           0
 #define DWC2_HAINT_CH1                                  (1 << 1)
@@ -751,15 +755,21 @@
 #define DWC2_HOST_RX_FIFO_SIZE           (516 + DWC2_MAX_CHANNELS)
 #define DWC2_HOST_NPERIO_TX_FIFO_SIZE    0x100   /* nPeriodic TX FIFO */
 #define DWC2_HOST_PERIO_TX_FIFO_SIZE     0x200   /* Periodic TX FIFO */
-#define DWC2_MAX_TRANSFER_SIZE           65535
 #define DWC2_MAX_PACKET_COUNT            511
 
-#define DWC2_HC_CHANNEL                 0
-#define DWC2_HC_CHANNEL_PERIODIC        1
 #define DWC2_HC_PORT                    0
 
 #define DWC2_STATUS_BUF_SIZE            64
 #define DWC2_DATA_BUF_SIZE              (64 * 1024)
+#define DWC2_HC_HALT_TIMEOUT_MS         1000
+/*
+ * A periodic split is over within the full-speed frame after its
+ * start-split: the TT answers the complete-splits in the microframes
+ * that follow, and has dropped the result by the end of the next.
+ * The timeout only backs up HFNUM, should the port stop counting.
+ */
+#define DWC2_HC_SPLIT_FRAMES            16
+#define DWC2_HC_SPLIT_TIMEOUT_US        2000
 
 
 #define USB_PORT_FEAT_CONNECTION     0
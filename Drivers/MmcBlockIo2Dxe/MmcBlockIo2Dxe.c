@@ -0,0 +1,765 @@
+/** @file
+*
+*  EFI_BLOCK_IO2_PROTOCOL for the SD card, layered over the synchronous
+*  BlockIo that MmcDxe produces for the Arasan and SdHost controllers.
+*  The card's BlockIo is opened BY_DRIVER and a child handle carries a
+*  BlockIo and BlockIo2 of its own, which DiskIoDxe binds to.
+*
+*  Requests are queued and serviced from a timer, one bounded slice per
+*  tick, so a caller can keep the CPU busy while its reads complete.
+*  Queued requests that are contiguous on the card are merged into a
+*  single multi-block transfer.
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include "MmcBlockIo2Dxe.h"
+
+//
+// Vendor device path GUIDs the MMC host drivers report, which MmcDxe
+// uses for the device path of the BlockIo handle.
+//
+STATIC CONST EFI_GUID *mMmcHostDevicePathGuids[] = {
+  &gRaspberryPiArasanMmcHostDevicePathGuid,
+  &gRaspberryPiSdHostDevicePathGuid,
+};
+
+STATIC
+EFI_STATUS
+DoIo (
+  IN  MMC_BLOCK_IO2_DEV *Dev,
+  IN  BOOLEAN           Write,
+  IN  UINT32            MediaId,
+  IN  EFI_LBA           Lba,
+  IN  UINTN             BufferSize,
+  IN  VOID              *Buffer
+  )
+{
+  if (Write) {
+    return Dev->ParentBlockIo->WriteBlocks (Dev->ParentBlockIo, MediaId, Lba,
+                                BufferSize, Buffer);
+  }
+  return Dev->ParentBlockIo->ReadBlocks (Dev->ParentBlockIo, MediaId, Lba,
+                              BufferSize, Buffer);
+}
+
+STATIC
+VOID
+CompleteRequest (
+  IN  MMC_BLOCK_IO2_DEV     *Dev,
+  IN  MMC_BLOCK_IO2_REQUEST *Req,
+  IN  EFI_STATUS            Status
+  )
+{
+  RemoveEntryList (&Req->Link);
+  if (Req->Write) {
+    Dev->QueuedWrites--;
+  }
+
+  Req->Token->TransactionStatus = Status;
+  gBS->SignalEvent (Req->Token->Event);
+  FreePool (Req);
+}
+
+/**
+  Service the request at the head of the queue, merging in the ones
+  that follow it on the card, for at most MMC_BLOCK_IO2_SLICE_SIZE bytes.
+
+  Must be called at TPL_CALLBACK.
+
+  @return The number of bytes moved.
+
+**/
+STATIC
+UINTN
+ServiceSlice (
+  IN  MMC_BLOCK_IO2_DEV *Dev
+  )
+{
+  MMC_BLOCK_IO2_REQUEST *First;
+  MMC_BLOCK_IO2_REQUEST *Req;
+  MMC_BLOCK_IO2_REQUEST *Next;
+  LIST_ENTRY            *Entry;
+  UINTN                 BlockSize;
+  UINTN                 Remaining;
+  UINTN                 Chunk;
+  UINTN                 Total;
+  UINTN                 Count;
+  UINTN                 Offset;
+  EFI_LBA               EndLba;
+  EFI_STATUS            Status;
+
+  BlockSize = Dev->ParentBlockIo->Media->BlockSize;
+  First = BASE_CR (GetFirstNode (&Dev->Queue), MMC_BLOCK_IO2_REQUEST, Link);
+  Remaining = First->BufferSize - First->Done;
+
+  //
+  // Gather the requests that continue where the previous one ends.
+  //
+  Total = Remaining;
+  Count = 1;
+  EndLba = First->Lba + First->BufferSize / BlockSize;
+  Req = First;
+  for (Entry = GetNextNode (&Dev->Queue, &First->Link);
+       !IsNull (&Dev->Queue, Entry);
+       Entry = GetNextNode (&Dev->Queue, Entry)) {
+    Next = BASE_CR (Entry, MMC_BLOCK_IO2_REQUEST, Link);
+    if (Next->Write != First->Write || Next->MediaId != First->MediaId ||
+        Next->Lba != EndLba ||
+        Total + Next->BufferSize > MMC_BLOCK_IO2_SLICE_SIZE) {
+      break;
+    }
+    Total += Next->BufferSize;
+    EndLba += Next->BufferSize / BlockSize;
+    Count++;
+  }
+
+  if (Count == 1) {
+    Chunk = MIN (Remaining, MMC_BLOCK_IO2_SLICE_SIZE);
+    Status = DoIo (Dev, First->Write, First->MediaId,
+               First->Lba + First->Done / BlockSize, Chunk,
+               First->Buffer + First->Done);
+    First->Done += Chunk;
+    if (EFI_ERROR (Status) || First->Done == First->BufferSize) {
+      CompleteRequest (Dev, First, Status);
+    }
+    return Chunk;
+  }
+
+  DEBUG ((DEBUG_VERBOSE, "%a: merged %u requests, %u bytes at LBA 0x%lx\n",
+    __FUNCTION__, Count, Total, First->Lba + First->Done / BlockSize));
+
+  if (First->Write) {
+    for (Req = First, Offset = 0; Offset < Total; Offset += Remaining) {
+      Remaining = Req->BufferSize - Req->Done;
+      CopyMem ((UINT8 *) Dev->Bounce + Offset, Req->Buffer + Req->Done, Remaining);
+      Req = BASE_CR (GetNextNode (&Dev->Queue, &Req->Link),
+              MMC_BLOCK_IO2_REQUEST, Link);
+    }
+  }
+
+  Status = DoIo (Dev, First->Write, First->MediaId,
+             First->Lba + First->Done / BlockSize, Total, Dev->Bounce);
+
+  for (Offset = 0; Count > 0; Count--, Offset += Remaining) {
+    Req = BASE_CR (GetFirstNode (&Dev->Queue), MMC_BLOCK_IO2_REQUEST, Link);
+    Remaining = Req->BufferSize - Req->Done;
+    if (!Req->Write && !EFI_ERROR (Status)) {
+      CopyMem (Req->Buffer + Req->Done, (UINT8 *) Dev->Bounce + Offset, Remaining);
+    }
+    CompleteRequest (Dev, Req, Status);
+  }
+
+  return Total;
+}
+
+STATIC
+VOID
+DrainQueue (
+  IN  MMC_BLOCK_IO2_DEV *Dev
+  )
+{
+  while (!IsListEmpty (&Dev->Queue)) {
+    ServiceSlice (Dev);
+  }
+}
+
+STATIC
+VOID
+AbortQueue (
+  IN  MMC_BLOCK_IO2_DEV *Dev
+  )
+{
+  while (!IsListEmpty (&Dev->Queue)) {
+    CompleteRequest (Dev, BASE_CR (GetFirstNode (&Dev->Queue),
+                            MMC_BLOCK_IO2_REQUEST, Link), EFI_ABORTED);
+  }
+}
+
+STATIC
+VOID
+UpdateTimer (
+  IN  MMC_BLOCK_IO2_DEV *Dev
+  )
+{
+  BOOLEAN Busy;
+
+  Busy = !IsListEmpty (&Dev->Queue);
+  if (Busy == Dev->TimerArmed) {
+    return;
+  }
+
+  gBS->SetTimer (Dev->TimerEvent, Busy ? TimerPeriodic : TimerCancel,
+         MMC_BLOCK_IO2_TIMER_PERIOD);
+  Dev->TimerArmed = Busy;
+}
+
+STATIC
+VOID
+EFIAPI
+QueueTimerHandler (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  MMC_BLOCK_IO2_DEV *Dev;
+
+  Dev = Context;
+  if (!IsListEmpty (&Dev->Queue)) {
+    ServiceSlice (Dev);
+  }
+  UpdateTimer (Dev);
+}
+
+//
+// The child's BlockIo. Raising to TPL_CALLBACK keeps the queue timer off
+// the controller while the synchronous request runs. Outstanding writes
+// are flushed out first, so a synchronous read never sees data older
+// than what was queued before it.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+SyncReadBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  MMC_BLOCK_IO2_DEV *Dev;
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+
+  Dev = MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  if (Dev->QueuedWrites != 0) {
+    DrainQueue (Dev);
+    UpdateTimer (Dev);
+  }
+  Status = DoIo (Dev, FALSE, MediaId, Lba, BufferSize, Buffer);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+SyncWriteBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  IN  VOID                  *Buffer
+  )
+{
+  MMC_BLOCK_IO2_DEV *Dev;
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+
+  Dev = MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  DrainQueue (Dev);
+  UpdateTimer (Dev);
+  Status = DoIo (Dev, TRUE, MediaId, Lba, BufferSize, Buffer);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+QueueRequest (
+  IN      MMC_BLOCK_IO2_DEV   *Dev,
+  IN      BOOLEAN             Write,
+  IN      UINT32              MediaId,
+  IN      EFI_LBA             Lba,
+  IN OUT  EFI_BLOCK_IO2_TOKEN *Token,
+  IN      UINTN               BufferSize,
+  IN      VOID                *Buffer
+  )
+{
+  EFI_BLOCK_IO_MEDIA    *Media;
+  MMC_BLOCK_IO2_REQUEST *Req;
+  EFI_TPL               OldTpl;
+
+  Media = Dev->ParentBlockIo->Media;
+
+  if (Token == NULL || Token->Event == NULL) {
+    if (Write) {
+      return SyncWriteBlocks (&Dev->BlockIo, MediaId, Lba, BufferSize, Buffer);
+    }
+    return SyncReadBlocks (&Dev->BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  if (!Media->MediaPresent) {
+    return EFI_NO_MEDIA;
+  }
+  if (MediaId != Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+  if (Write && Media->ReadOnly) {
+    return EFI_WRITE_PROTECTED;
+  }
+  if (Buffer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if ((BufferSize % Media->BlockSize) != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  if (Lba > Media->LastBlock ||
+      BufferSize / Media->BlockSize > Media->LastBlock - Lba + 1) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Media->IoAlign > 1 && ((UINTN) Buffer % Media->IoAlign) != 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (BufferSize == 0) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  Req = AllocatePool (sizeof (*Req));
+  if (Req == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Req->Write = Write;
+  Req->MediaId = MediaId;
+  Req->Lba = Lba;
+  Req->Buffer = Buffer;
+  Req->BufferSize = BufferSize;
+  Req->Done = 0;
+  Req->Token = Token;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  InsertTailList (&Dev->Queue, &Req->Link);
+  if (Write) {
+    Dev->QueuedWrites++;
+  }
+  UpdateTimer (Dev);
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2Reset (
+  IN  EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN  BOOLEAN                 ExtendedVerification
+  )
+{
+  MMC_BLOCK_IO2_DEV *Dev;
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+
+  Dev = MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO2 (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  AbortQueue (Dev);
+  UpdateTimer (Dev);
+  Status = Dev->ParentBlockIo->Reset (Dev->ParentBlockIo, ExtendedVerification);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2ReadBlocksEx (
+  IN      EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN      UINT32                  MediaId,
+  IN      EFI_LBA                 Lba,
+  IN OUT  EFI_BLOCK_IO2_TOKEN     *Token,
+  IN      UINTN                   BufferSize,
+  OUT     VOID                    *Buffer
+  )
+{
+  return QueueRequest (MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO2 (This), FALSE,
+           MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2WriteBlocksEx (
+  IN      EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN      UINT32                  MediaId,
+  IN      EFI_LBA                 Lba,
+  IN OUT  EFI_BLOCK_IO2_TOKEN     *Token,
+  IN      UINTN                   BufferSize,
+  IN      VOID                    *Buffer
+  )
+{
+  return QueueRequest (MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO2 (This), TRUE,
+           MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2FlushBlocksEx (
+  IN      EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN OUT  EFI_BLOCK_IO2_TOKEN     *Token
+  )
+{
+  MMC_BLOCK_IO2_DEV *Dev;
+  EFI_STATUS        Status;
+  EFI_TPL           OldTpl;
+
+  Dev = MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO2 (This);
+
+  //
+  // Everything queued so far has to reach the card before the flush
+  // completes, so just run the queue dry.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  DrainQueue (Dev);
+  UpdateTimer (Dev);
+  Status = Dev->ParentBlockIo->FlushBlocks (Dev->ParentBlockIo);
+  gBS->RestoreTPL (OldTpl);
+
+  if (Token != NULL && Token->Event != NULL) {
+    Token->TransactionStatus = Status;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+SyncReset (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  BOOLEAN               ExtendedVerification
+  )
+{
+  return MmcBlockIo2Reset (&MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO (This)->BlockIo2,
+           ExtendedVerification);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+SyncFlushBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This
+  )
+{
+  return MmcBlockIo2FlushBlocksEx (&MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO (This)->BlockIo2,
+           NULL);
+}
+
+//
+// The card's handle, or one a filter such as BlockCacheDxe stacked on
+// it: the device path starts with the host's vendor node. Handles we
+// made ourselves have our own node further down.
+//
+STATIC
+BOOLEAN
+IsMmcHostDevicePath (
+  IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+  UINTN                     Index;
+
+  if (DevicePathType (DevicePath) != HARDWARE_DEVICE_PATH ||
+      DevicePathSubType (DevicePath) != HW_VENDOR_DP) {
+    return FALSE;
+  }
+
+  for (Node = DevicePath; !IsDevicePathEnd (Node); Node = NextDevicePathNode (Node)) {
+    if (DevicePathType (Node) == HARDWARE_DEVICE_PATH &&
+        DevicePathSubType (Node) == HW_VENDOR_DP &&
+        CompareGuid (&((VENDOR_DEVICE_PATH *) Node)->Guid,
+          &gRaspberryPiMmcBlockIo2DevicePathGuid)) {
+      return FALSE;
+    }
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mMmcHostDevicePathGuids); Index++) {
+    if (CompareGuid (&((VENDOR_DEVICE_PATH *) DevicePath)->Guid,
+          mMmcHostDevicePathGuids[Index])) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2DriverBindingSupported (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL    *RemainingDevicePath OPTIONAL
+  )
+{
+  EFI_STATUS                Status;
+  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+
+  Status = gBS->OpenProtocol (Controller, &gEfiDevicePathProtocolGuid,
+                  (VOID **) &DevicePath, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (!IsMmcHostDevicePath (DevicePath)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIo2ProtocolGuid, NULL,
+                  This->DriverBindingHandle, Controller,
+                  EFI_OPEN_PROTOCOL_TEST_PROTOCOL);
+  if (!EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_BY_DRIVER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (BlockIo->Media->LogicalPartition) {
+    Status = EFI_UNSUPPORTED;
+  }
+
+  gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+         This->DriverBindingHandle, Controller);
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2DriverBindingStart (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  EFI_DEVICE_PATH_PROTOCOL    *RemainingDevicePath OPTIONAL
+  )
+{
+  EFI_STATUS                Status;
+  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+  MMC_BLOCK_IO2_DEV         *Dev;
+
+  Status = gBS->OpenProtocol (Controller, &gEfiDevicePathProtocolGuid,
+                  (VOID **) &DevicePath, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Controller, EFI_OPEN_PROTOCOL_BY_DRIVER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Dev = AllocateZeroPool (sizeof (*Dev));
+  if (Dev == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto CloseBlockIo;
+  }
+
+  Dev->Bounce = AllocatePages (EFI_SIZE_TO_PAGES (MMC_BLOCK_IO2_SLICE_SIZE));
+  if (Dev->Bounce == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeDev;
+  }
+
+  Node = CreateDeviceNode (HARDWARE_DEVICE_PATH, HW_VENDOR_DP,
+           sizeof (VENDOR_DEVICE_PATH));
+  if (Node == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeBounce;
+  }
+  CopyGuid (&((VENDOR_DEVICE_PATH *) Node)->Guid,
+    &gRaspberryPiMmcBlockIo2DevicePathGuid);
+  Dev->DevicePath = AppendDevicePathNode (DevicePath, Node);
+  FreePool (Node);
+  if (Dev->DevicePath == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeBounce;
+  }
+
+  Dev->Signature = MMC_BLOCK_IO2_DEV_SIGNATURE;
+  Dev->Controller = Controller;
+  Dev->ParentBlockIo = BlockIo;
+  InitializeListHead (&Dev->Queue);
+
+  Dev->BlockIo.Revision = BlockIo->Revision;
+  Dev->BlockIo.Media = BlockIo->Media;
+  Dev->BlockIo.Reset = SyncReset;
+  Dev->BlockIo.ReadBlocks = SyncReadBlocks;
+  Dev->BlockIo.WriteBlocks = SyncWriteBlocks;
+  Dev->BlockIo.FlushBlocks = SyncFlushBlocks;
+
+  Dev->BlockIo2.Media = BlockIo->Media;
+  Dev->BlockIo2.Reset = MmcBlockIo2Reset;
+  Dev->BlockIo2.ReadBlocksEx = MmcBlockIo2ReadBlocksEx;
+  Dev->BlockIo2.WriteBlocksEx = MmcBlockIo2WriteBlocksEx;
+  Dev->BlockIo2.FlushBlocksEx = MmcBlockIo2FlushBlocksEx;
+
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                  QueueTimerHandler, Dev, &Dev->TimerEvent);
+  if (EFI_ERROR (Status)) {
+    goto FreeDevicePath;
+  }
+
+  Status = gBS->InstallMultipleProtocolInterfaces (&Dev->Handle,
+                  &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+                  &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid, &Dev->BlockIo2,
+                  NULL);
+  if (EFI_ERROR (Status)) {
+    goto CloseTimer;
+  }
+
+  Status = gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  (VOID **) &BlockIo, This->DriverBindingHandle,
+                  Dev->Handle, EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER);
+  if (EFI_ERROR (Status)) {
+    goto Uninstall;
+  }
+
+  DEBUG ((DEBUG_INFO, "%a: BlockIo2 on %p for %p, %lu blocks of %u bytes\n",
+    __FUNCTION__, Dev->Handle, Controller, BlockIo->Media->LastBlock + 1,
+    BlockIo->Media->BlockSize));
+  return EFI_SUCCESS;
+
+Uninstall:
+  gBS->UninstallMultipleProtocolInterfaces (Dev->Handle,
+         &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+         &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+         &gEfiBlockIo2ProtocolGuid, &Dev->BlockIo2,
+         NULL);
+CloseTimer:
+  gBS->CloseEvent (Dev->TimerEvent);
+FreeDevicePath:
+  FreePool (Dev->DevicePath);
+FreeBounce:
+  FreePages (Dev->Bounce, EFI_SIZE_TO_PAGES (MMC_BLOCK_IO2_SLICE_SIZE));
+FreeDev:
+  FreePool (Dev);
+CloseBlockIo:
+  gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+         This->DriverBindingHandle, Controller);
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBlockIo2DriverBindingStop (
+  IN  EFI_DRIVER_BINDING_PROTOCOL *This,
+  IN  EFI_HANDLE                  Controller,
+  IN  UINTN                       NumberOfChildren,
+  IN  EFI_HANDLE                  *ChildHandleBuffer OPTIONAL
+  )
+{
+  EFI_STATUS              Status;
+  EFI_BLOCK_IO_PROTOCOL   *BlockIo;
+  MMC_BLOCK_IO2_DEV       *Dev;
+  EFI_TPL                 OldTpl;
+  UINTN                   Index;
+  BOOLEAN                 AllStopped;
+
+  if (NumberOfChildren == 0) {
+    return gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+                  This->DriverBindingHandle, Controller);
+  }
+
+  AllStopped = TRUE;
+  for (Index = 0; Index < NumberOfChildren; Index++) {
+    Status = gBS->OpenProtocol (ChildHandleBuffer[Index],
+                    &gEfiBlockIoProtocolGuid, (VOID **) &BlockIo,
+                    This->DriverBindingHandle, Controller,
+                    EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (EFI_ERROR (Status)) {
+      AllStopped = FALSE;
+      continue;
+    }
+
+    Dev = MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO (BlockIo);
+
+    //
+    // Anything still queued belongs to the consumers being stopped, who
+    // get told so before the interfaces go away.
+    //
+    OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+    AbortQueue (Dev);
+    UpdateTimer (Dev);
+    gBS->RestoreTPL (OldTpl);
+
+    gBS->CloseProtocol (Controller, &gEfiBlockIoProtocolGuid,
+           This->DriverBindingHandle, Dev->Handle);
+
+    Status = gBS->UninstallMultipleProtocolInterfaces (Dev->Handle,
+                    &gEfiDevicePathProtocolGuid, Dev->DevicePath,
+                    &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                    &gEfiBlockIo2ProtocolGuid, &Dev->BlockIo2,
+                    NULL);
+    if (EFI_ERROR (Status)) {
+      gBS->OpenProtocol (Controller, &gEfiBlockIoProtocolGuid,
+             (VOID **) &BlockIo, This->DriverBindingHandle,
+             Dev->Handle, EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER);
+      AllStopped = FALSE;
+      continue;
+    }
+
+    gBS->CloseEvent (Dev->TimerEvent);
+    FreePool (Dev->DevicePath);
+    FreePages (Dev->Bounce, EFI_SIZE_TO_PAGES (MMC_BLOCK_IO2_SLICE_SIZE));
+    FreePool (Dev);
+  }
+
+  return AllStopped ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+STATIC EFI_DRIVER_BINDING_PROTOCOL mMmcBlockIo2DriverBinding = {
+  MmcBlockIo2DriverBindingSupported,
+  MmcBlockIo2DriverBindingStart,
+  MmcBlockIo2DriverBindingStop,
+  MMC_BLOCK_IO2_DRIVER_VERSION,
+  NULL,
+  NULL
+};
+
+EFI_STATUS
+EFIAPI
+MmcBlockIo2DxeInitialize (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  )
+{
+  return EfiLibInstallDriverBinding (ImageHandle, SystemTable,
+           &mMmcBlockIo2DriverBinding, ImageHandle);
+}
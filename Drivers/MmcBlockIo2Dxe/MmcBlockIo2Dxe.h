@@ -0,0 +1,85 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __MMC_BLOCK_IO2_DXE_H__
+#define __MMC_BLOCK_IO2_DXE_H__
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/DriverBinding.h>
+
+//
+// Must bind before DiskIoDxe (0xa) and PartitionDxe (0xb): the card's
+// BlockIo is opened BY_DRIVER, and they bind to the child instead.
+//
+#define MMC_BLOCK_IO2_DRIVER_VERSION  0x20
+
+//
+// Most data moved per timer tick, and the largest merged transfer.
+// Bigger requests are split into slices of this size.
+//
+#define MMC_BLOCK_IO2_SLICE_SIZE      SIZE_128KB
+
+#define MMC_BLOCK_IO2_TIMER_PERIOD    EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+#define MMC_BLOCK_IO2_DEV_SIGNATURE   SIGNATURE_32 ('m', 'b', 'i', '2')
+
+typedef struct {
+  LIST_ENTRY            Link;
+  BOOLEAN               Write;
+  UINT32                MediaId;
+  EFI_LBA               Lba;
+  UINT8                 *Buffer;
+  UINTN                 BufferSize;
+  UINTN                 Done;         // Bytes already transferred
+  EFI_BLOCK_IO2_TOKEN   *Token;
+} MMC_BLOCK_IO2_REQUEST;
+
+//
+// One per card. MmcDxe's BlockIo is opened BY_DRIVER on the controller,
+// and a child handle gets a BlockIo and a BlockIo2 of its own, both
+// ordered through the same queue.
+//
+typedef struct {
+  UINT32                    Signature;
+  EFI_HANDLE                Controller;
+  EFI_HANDLE                Handle;     // The child
+  EFI_BLOCK_IO_PROTOCOL     *ParentBlockIo;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL    BlockIo2;
+  LIST_ENTRY                Queue;
+  UINTN                     QueuedWrites;
+  EFI_EVENT                 TimerEvent;
+  BOOLEAN                   TimerArmed;
+  VOID                      *Bounce;
+} MMC_BLOCK_IO2_DEV;
+
+#define MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO(a) \
+  CR (a, MMC_BLOCK_IO2_DEV, BlockIo, MMC_BLOCK_IO2_DEV_SIGNATURE)
+
+#define MMC_BLOCK_IO2_DEV_FROM_BLOCK_IO2(a) \
+  CR (a, MMC_BLOCK_IO2_DEV, BlockIo2, MMC_BLOCK_IO2_DEV_SIGNATURE)
+
+#endif /* __MMC_BLOCK_IO2_DXE_H__ */
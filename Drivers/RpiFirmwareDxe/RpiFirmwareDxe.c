@@ -38,12 +38,23 @@
 //
 #define MAX_TRIES   0x100000
 
+//
+// How often the activity LED follows NotifyLedActivity. The LED changes
+// at most once per period, which bounds the mailbox traffic it causes.
+//
+#define LED_UPDATE_PERIOD   EFI_TIMER_PERIOD_MILLISECONDS (200)
+
 STATIC VOID  *mDmaBuffer;
 STATIC VOID  *mDmaBufferMapping;
 STATIC UINTN mDmaBufferBusAddress;
 
 STATIC SPIN_LOCK mMailboxLock;
 
+STATIC EFI_EVENT mLedTimerEvent;
+STATIC EFI_EVENT mLedExitBootServicesEvent;
+STATIC BOOLEAN   mLedOn;
+STATIC volatile BOOLEAN mLedActivity;
+
 STATIC
 BOOLEAN
 DrainMailbox (
@@ -764,6 +775,71 @@ RpiFirmwareGetMinClockRate (
   return RpiFirmwareGetClockRate(ClockId, RPI_FW_GET_MIN_CLOCK_RATE, ClockRate);
 }
 
+#pragma pack()
+typedef struct {
+  UINT32                    ClockId;
+  UINT32                    ClockRate;
+  UINT32                    SkipTurbo;
+} RPI_FW_SET_CLOCK_RATE_TAG;
+
+typedef struct {
+  RPI_FW_BUFFER_HEAD        BufferHead;
+  RPI_FW_TAG_HEAD           TagHead;
+  RPI_FW_SET_CLOCK_RATE_TAG TagBody;
+  UINT32                    EndTag;
+} RPI_FW_SET_CLOCK_RATE_CMD;
+#pragma pack()
+
+STATIC
+EFI_STATUS
+EFIAPI
+RpiFirmwareSetClockRate (
+  IN  UINT32    ClockId,
+  IN  UINT32    ClockRate
+  )
+{
+  RPI_FW_SET_CLOCK_RATE_CMD   *Cmd;
+  EFI_STATUS                  Status;
+  UINT32                      Result;
+
+  if (!AcquireSpinLockOrFail (&mMailboxLock)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+    return EFI_DEVICE_ERROR;
+  }
+
+  Cmd = mDmaBuffer;
+  ZeroMem (Cmd, sizeof *Cmd);
+
+  Cmd->BufferHead.BufferSize  = sizeof *Cmd;
+  Cmd->BufferHead.Response    = 0;
+  Cmd->TagHead.TagId          = RPI_FW_SET_CLOCK_RATE;
+  Cmd->TagHead.TagSize        = sizeof Cmd->TagBody;
+  Cmd->TagHead.TagValueSize   = 0;
+  Cmd->TagBody.ClockId        = ClockId;
+  Cmd->TagBody.ClockRate      = ClockRate;
+  Cmd->TagBody.SkipTurbo      = 0;
+  Cmd->EndTag                 = 0;
+
+  Status = MailboxTransaction (Cmd->BufferHead.BufferSize, RPI_FW_MBOX_CHANNEL, &Result);
+
+  ReleaseSpinLock (&mMailboxLock);
+
+  if (EFI_ERROR (Status) ||
+      Cmd->BufferHead.Response != RPI_FW_RESP_SUCCESS) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: mailbox transaction error: Status == %r, Response == 0x%x\n",
+      __FUNCTION__, Status, Cmd->BufferHead.Response));
+    return EFI_DEVICE_ERROR;
+  }
+
+  //
+  // Setting the ARM clock can move the core clock with it (turbo), so
+  // whoever caches any rate is told, whichever clock was set.
+  //
+  EfiEventGroupSignal (&gRaspberryPiClockRateChangedGuid);
+  return EFI_SUCCESS;
+}
+
 #pragma pack()
 typedef struct {
   UINT32 Pin;
@@ -779,8 +855,8 @@ typedef struct {
 #pragma pack()
 
 STATIC
-VOID
-RpiFirmwareLedSet (
+EFI_STATUS
+SetActivityLed (
   IN  BOOLEAN On
   )
 {
@@ -789,8 +865,7 @@ RpiFirmwareLedSet (
   UINT32              Result;
 
   if (!AcquireSpinLockOrFail (&mMailboxLock)) {
-    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
-    return;
+    return EFI_NOT_READY;
   }
 
   Cmd = mDmaBuffer;
@@ -821,6 +896,71 @@ RpiFirmwareLedSet (
     DEBUG ((DEBUG_ERROR,
       "%a: mailbox  transaction error: Status == %r, Response == 0x%x\n",
       __FUNCTION__, Status, Cmd->BufferHead.Response));
+    return EFI_DEVICE_ERROR;
+  }
+
+  mLedOn = On;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+RpiFirmwareLedSet (
+  IN  BOOLEAN On
+  )
+{
+  if (SetActivityLed (On) == EFI_NOT_READY) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to acquire spinlock\n", __FUNCTION__));
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+RpiFirmwareNotifyLedActivity (
+  VOID
+  )
+{
+  mLedActivity = TRUE;
+}
+
+STATIC
+VOID
+EFIAPI
+LedTimerHandler (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  BOOLEAN On;
+
+  //
+  // Light the LED for any period that saw I/O. A caller racing with the
+  // clear below just gets its activity counted in the next period.
+  //
+  On = mLedActivity;
+  mLedActivity = FALSE;
+
+  if (On != mLedOn && EFI_ERROR (SetActivityLed (On)) && On) {
+    //
+    // If the mailbox is busy this timer interrupted a firmware call.
+    // Keep the activity pending and try again next period rather than
+    // spin at raised TPL.
+    //
+    mLedActivity = TRUE;
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+LedExitBootServices (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  if (mLedOn) {
+    SetActivityLed (FALSE);
   }
 }
 
@@ -836,7 +976,9 @@ STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mRpiFirmwareProtocol = {
   RpiFirmwareGetFbSize,
   RpiFirmwareLedSet,
   RpiFirmwareGetSerial,
-  RpiFirmwareGetArmMemory
+  RpiFirmwareGetArmMemory,
+  RpiFirmwareNotifyLedActivity,
+  RpiFirmwareSetClockRate
 };
 
 /**
@@ -888,6 +1030,26 @@ RpiFirmwareDxeInitialize (
   //
   ASSERT (!(mDmaBufferBusAddress & (BCM2836_MBOX_NUM_CHANNELS - 1)));
 
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                  LedTimerHandler, NULL, &mLedTimerEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to create LED timer (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto UnmapBuffer;
+  }
+
+  Status = gBS->SetTimer (mLedTimerEvent, TimerPeriodic, LED_UPDATE_PERIOD);
+  ASSERT_EFI_ERROR (Status);
+
+  Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_NOTIFY,
+                  LedExitBootServices, NULL, &mLedExitBootServicesEvent);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR,
+      "%a: failed to create ExitBootServices event (Status == %r)\n",
+      __FUNCTION__, Status));
+    goto CloseTimer;
+  }
+
   Status = gBS->InstallProtocolInterface (&ImageHandle,
                   &gRaspberryPiFirmwareProtocolGuid, EFI_NATIVE_INTERFACE,
                   &mRpiFirmwareProtocol);
@@ -895,11 +1057,15 @@ RpiFirmwareDxeInitialize (
     DEBUG ((DEBUG_ERROR,
       "%a: failed to install RPI firmware protocol (Status == %r)\n",
       __FUNCTION__, Status));
-    goto UnmapBuffer;
+    goto CloseExitBootServicesEvent;
   }
 
   return EFI_SUCCESS;
 
+CloseExitBootServicesEvent:
+  gBS->CloseEvent (mLedExitBootServicesEvent);
+CloseTimer:
+  gBS->CloseEvent (mLedTimerEvent);
 UnmapBuffer:
   DmaUnmap (mDmaBufferMapping);
 FreeBuffer:
@@ -21,64 +21,106 @@
 #include <Library/IoLib.h>
 #include <Library/PcdLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DmaLib.h>
-#include <Library/TimerLib.h>
+#include <Library/Bcm2836DmaLib.h>
+#include <Library/MmcHostCommonLib.h>
 
 #include <Protocol/EmbeddedExternalDevice.h>
-#include <Protocol/BlockIo.h>
-#include <Protocol/DevicePath.h>
 #include <Protocol/MmcHost.h>
 #include <Protocol/RaspberryPiFirmware.h>
+#include <Protocol/RaspberryPiMmcStats.h>
 
 // #include <LedLib.h>
 #include <IndustryStandard/Bcm2836.h>
 #include <IndustryStandard/RpiFirmware.h>
 #include <IndustryStandard/Bcm2836SdHost.h>
 
-#define SDHOST_BLOCK_BYTE_LENGTH            512
+#define SDHOST_BLOCK_BYTE_LENGTH            MMC_HOST_BLOCK_SIZE
 
 // Driver Timing Parameters
-#define CMD_STALL_AFTER_POLL_US             1
-#define CMD_MIN_POLL_TOTAL_TIME_US          100000 // 100ms
-#define CMD_MAX_POLL_COUNT                  (CMD_MIN_POLL_TOTAL_TIME_US / CMD_STALL_AFTER_POLL_US)
+#define CMD_TIMEOUT_US                      100000 // 100ms, for all tries together
 #define CMD_MAX_RETRY_COUNT                 3
 #define CMD_STALL_AFTER_RETRY_US            20 // 20us
-#define FIFO_MAX_POLL_COUNT                 1000000
+#define FIFO_TIMEOUT_US                     100000 // 100ms without the FIFO moving
+#define FIFO_READ_THRESHOLD                 4 // DREQ thresholds in words, as Linux programs them
+#define FIFO_WRITE_THRESHOLD                4
+#define DMA_TIMEOUT_US                      400000 // 400ms, on top of the time the data takes
+#define DMA_MIN_BYTES_PER_US                1 // Slowest data rate assumed when sizing DMA timeouts
+#define TRANSFER_COMPLETE_TIMEOUT_US        500000 // 500ms, for the card to take the last block
 #define STALL_TO_STABILIZE_US               10000 // 10ms
 
-#define IDENT_MODE_SD_CLOCK_FREQ_HZ         400000 // 400KHz
+#define IDENT_MODE_SD_CLOCK_FREQ_HZ         MMC_HOST_IDENT_CLOCK_HZ
+#define HIGH_SPEED_SD_CLOCK_FREQ_HZ         MMC_HOST_HIGH_SPEED_CLOCK_HZ
 
 // Macros adopted from MmcDxe internal header
-#define SDHOST_CSD_GET_TRANSPEED(Response)  ((Response[2] >> 24)& 0xFF)
-#define SDHOST_R0_READY_FOR_DATA            BIT8
-#define SDHOST_R0_CURRENTSTATE(Response)    ((Response >> 9) & 0xF)
-#define SDHOST_RCA_SHIFT                    16
+// CSD[103:96], with the response decoded to the full 128-bit layout
+#define SDHOST_CSD_GET_TRANSPEED(Response)  (Response[3] & 0xFF)
+#define SDHOST_MAX_BLOCK_COUNT              0xFFFF
+#define SDHOST_NO_PENDING_CMD               ((MMC_CMD) -1)
+
+// An erase is polled with CMD13 for as long as it takes, within reason
+#define ERASE_POLL_US                       1000
 
 #ifndef MMC_ACMD6
 #define MMC_ACMD6 (MMC_INDX(6) | MMC_CMD_WAIT_RESPONSE | MMC_CMD_NO_CRC_RESPONSE)
 #endif
 
+#ifndef MMC_ACMD23
+#define MMC_ACMD23 (MMC_INDX(23) | MMC_CMD_WAIT_RESPONSE)
+#endif
+
+#ifndef MMC_CMD32
+#define MMC_CMD32 (MMC_INDX(32) | MMC_CMD_WAIT_RESPONSE)
+#endif
+
+#ifndef MMC_CMD33
+#define MMC_CMD33 (MMC_INDX(33) | MMC_CMD_WAIT_RESPONSE)
+#endif
+
+#ifndef MMC_CMD38
+#define MMC_CMD38 (MMC_INDX(38) | MMC_CMD_WAIT_RESPONSE)
+#endif
+
 #define DEBUG_MMCHOST_SD DEBUG_ERROR
 
 STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL   *mFwProtocol;
 
+// Last programmed CDIV and the SD clock it gives, for diagnostics
+UINT32 mLastClockDiv = 0;
+UINT32 mLastSdClockFreqHz = 0;
+
 // Per Physical Layer Simplified Specs
 CONST CHAR8* mStrSdState[] = { "idle", "ready", "ident", "stby", "tran", "data", "rcv", "prg", "dis", "ina" };
 UINT8 mMaxDataTransferRate = 0;
 UINT32 mReconfigSdClock = FALSE;
 UINT32 mRca = 0;
-UINT32 mLastExecutedMmcCmd = MMC_GET_INDX(MMC_CMD0);
 BOOLEAN mIsSdBusSwitched4BitMode = FALSE;
+BOOLEAN mIsSdHighSpeedChecked = FALSE;
+// SD clock asked for last, kept to re-derive CDIV when the core clock changes
+UINT32 mTargetSdFreqHz = 0;
 UINT64 mScr = 0;
+BOOLEAN mHighCapacity = FALSE;
+
+// Data command waiting for SdReadBlockData/SdWriteBlockData to give its length
+MMC_CMD mPendingCmd = SDHOST_NO_PENDING_CMD;
+UINT32 mPendingArg = 0;
+// Set when the SCR says the card takes CMD23
+BOOLEAN mCardHasCmd23 = FALSE;
+// Set once the last multi-block transfer went out with CMD23, or was
+// stopped after an error, so the card needs no CMD12 from MmcDxe
+BOOLEAN mBlockCountSet = FALSE;
 
 EFI_STATUS SdHostGetSdStatus(UINT32* StatusR0);
 
-BOOLEAN IsAppCmd() { return mLastExecutedMmcCmd == MMC_CMD55; }
+BOOLEAN IsAppCmd() { return MmcHostIsAppCommand(); }
 
 BOOLEAN IsBusyCmd(UINT32 MmcCmd) { return ((MmcCmd == MMC_CMD7 || MmcCmd == MMC_CMD12) && !IsAppCmd()); }
 
-BOOLEAN IsWriteCmd(UINT32 MmcCmd) { return (MmcCmd == MMC_CMD24 && !IsAppCmd()); }
+BOOLEAN IsWriteCmd(UINT32 MmcCmd) { return ((MmcCmd == MMC_CMD24 || MmcCmd == MMC_CMD25) && !IsAppCmd()); }
+
+BOOLEAN IsMultiBlockCmd(UINT32 MmcCmd) { return ((MmcCmd == MMC_CMD18 || MmcCmd == MMC_CMD25) && !IsAppCmd()); }
 
 BOOLEAN IsReadCmd(UINT32 MmcCmd)
 {
@@ -87,7 +129,8 @@ BOOLEAN IsReadCmd(UINT32 MmcCmd)
         (MmcCmd == MMC_CMD6 && !CmdIsAppCmd) ||
         (MmcCmd == MMC_CMD17 && !CmdIsAppCmd) ||
         (MmcCmd == MMC_CMD18 && !CmdIsAppCmd) ||
-        (MmcCmd == MMC_CMD13 && CmdIsAppCmd);
+        (MmcCmd == MMC_CMD13 && CmdIsAppCmd) ||
+        (MmcCmd == MMC_ACMD51 && CmdIsAppCmd);
 }
 
 VOID
@@ -118,14 +161,20 @@ SdHostDumpSdCardStatus(
     )
 {
     UINT32 SdCardStatus;
+
+    // Nothing to ask before the card has an address
+    if (mRca == 0) {
+        return;
+    }
+
     EFI_STATUS Status = SdHostGetSdStatus(&SdCardStatus);
     if (!EFI_ERROR(Status)) {
-        UINT32 CurrState = SDHOST_R0_CURRENTSTATE(SdCardStatus);
+        UINT32 CurrState = MMC_HOST_R1_CURRENT_STATE(SdCardStatus);
         DEBUG((
             DEBUG_MMCHOST_SD,
             "SdHost: SdCardStatus 0x%8.8X: ReadyForData?%d, State[%d]: %a\n",
             SdCardStatus,
-            ((SdCardStatus & SDHOST_R0_READY_FOR_DATA) ? 1 : 0),
+            ((SdCardStatus & MMC_HOST_R1_READY_FOR_DATA) ? 1 : 0),
             CurrState,
             ((CurrState < (sizeof(mStrSdState) / sizeof(*mStrSdState))) ?
                 mStrSdState[CurrState] : "UNDEF")));
@@ -139,7 +188,7 @@ SdHostDumpStatus(
 {
     SdHostDumpRegisters();
 
-    UINT32 Hsts = MmioRead32(SDHOST_HSTS);
+    UINT32 Hsts = MmcHostMmioRead32(SDHOST_HSTS);
 
     if (Hsts & SDHOST_HSTS_ERROR) {
         DEBUG((DEBUG_MMCHOST_SD, "SdHost: Diagnose HSTS: 0x%8.8X\n", Hsts));
@@ -156,7 +205,7 @@ SdHostDumpStatus(
             DEBUG((DEBUG_MMCHOST_SD, "  - Read/Erase/Write Transfer Timeout\n"));
     }
 
-    UINT32 Edm = MmioRead32(SDHOST_EDM);
+    UINT32 Edm = MmcHostMmioRead32(SDHOST_EDM);
     DEBUG((DEBUG_MMCHOST_SD, "SdHost: Diagnose EDM: 0x%8.8X\n", Edm));
     DEBUG((DEBUG_MMCHOST_SD, "  - FSM: 0x%x\n", (Edm & 0xF)));
     DEBUG((DEBUG_MMCHOST_SD, "  - Fifo Count: %d\n", ((Edm >> 4) & 0x1F)));
@@ -178,8 +227,9 @@ SdHostSetClockFrequency(
     EFI_STATUS Status;
     UINT32 CoreClockFreqHz = 0;
 
-    // First figure out the core clock
-    Status = mFwProtocol->GetClockRate(RPI_FW_CLOCK_RATE_CORE, &CoreClockFreqHz);
+    // First figure out the core clock. A signalled clock change drops the
+    // cached rate and comes back here through SdHostClockRateChanged
+    Status = MmcHostGetClockRate(RPI_FW_CLOCK_RATE_CORE, &CoreClockFreqHz);
     if (EFI_ERROR(Status)) {
       return Status;
     }
@@ -187,7 +237,9 @@ SdHostSetClockFrequency(
     ASSERT (CoreClockFreqHz != 0);
 
     // fSDCLK = fcore_pclk/(ClockDiv+2)
-    UINT32 ClockDiv = (CoreClockFreqHz - (2 * TargetSdFreqHz)) / TargetSdFreqHz;
+    UINT32 Divider = MmcHostClockDivider(CoreClockFreqHz, TargetSdFreqHz);
+    UINT32 ClockDiv = (Divider > 2) ? Divider - 2 : 0;
+    ClockDiv = MIN(ClockDiv, SDHOST_CDIV_MAX);
     UINT32 ActualSdFreqHz = CoreClockFreqHz / (ClockDiv + 2);
 
     DEBUG((
@@ -198,13 +250,29 @@ SdHostSetClockFrequency(
         TargetSdFreqHz,
         ActualSdFreqHz));
 
-    MmioWrite32(SDHOST_CDIV, ClockDiv);
+    MmcHostMmioWrite32(SDHOST_CDIV, ClockDiv);
     // Set timeout after 1 second, i.e ActualSdFreqHz SD clock cycles
-    MmioWrite32(SDHOST_TOUT, ActualSdFreqHz);
+    MmcHostMmioWrite32(SDHOST_TOUT, ActualSdFreqHz);
+
+    mLastClockDiv = ClockDiv;
+    mLastSdClockFreqHz = ActualSdFreqHz;
+    mTargetSdFreqHz = (UINT32)TargetSdFreqHz;
 
     return Status;
 }
 
+VOID
+EFIAPI
+SdHostClockRateChanged(
+    VOID
+    )
+{
+    // The SD clock is derived from the core clock, so CDIV has to follow it
+    if (mTargetSdFreqHz != 0) {
+        SdHostSetClockFrequency(mTargetSdFreqHz);
+    }
+}
+
 BOOLEAN
 SdIsCardPresent(
     IN EFI_MMC_HOST_PROTOCOL *This
@@ -232,20 +300,18 @@ SdBuildDevicePath(
     )
 {
     EFI_DEVICE_PATH_PROTOCOL *NewDevicePathNode;
-    EFI_GUID DevicePathGuid = EFI_CALLER_ID_GUID;
 
     DEBUG((DEBUG_MMCHOST_SD, "SdHost: SdBuildDevicePath()\n"));
 
     NewDevicePathNode = CreateDeviceNode(HARDWARE_DEVICE_PATH, HW_VENDOR_DP, sizeof(VENDOR_DEVICE_PATH));
-    CopyGuid(&((VENDOR_DEVICE_PATH*)NewDevicePathNode)->Guid, &DevicePathGuid);
+    CopyGuid(&((VENDOR_DEVICE_PATH*)NewDevicePathNode)->Guid, &gRaspberryPiSdHostDevicePathGuid);
     *DevicePath = NewDevicePathNode;
 
     return EFI_SUCCESS;
 }
 
 EFI_STATUS
-SdSendCommand(
-    IN EFI_MMC_HOST_PROTOCOL    *This,
+SdHostIssueCommand(
     IN MMC_CMD                  MmcCmd,
     IN UINT32                   Argument
     )
@@ -255,23 +321,27 @@ SdSendCommand(
     {
         DEBUG((
             DEBUG_MMCHOST_SD,
-            "SdHost: SdSendCommand(CMD%d, Argument: %08x) ignored\n",
+            "SdHost: SdHostIssueCommand(CMD%d, Argument: %08x) ignored\n",
             MMC_GET_INDX(MmcCmd),
             Argument));
         return EFI_UNSUPPORTED;
     }
 
-    if (MmioRead32(SDHOST_CMD) & SDHOST_CMD_NEW_FLAG) {
+    if (MmcHostMmioRead32(SDHOST_CMD) & SDHOST_CMD_NEW_FLAG) {
         DEBUG((
             DEBUG_ERROR,
-            "SdHost: SdSendCommand(): Failed to execute CMD%d, a CMD is already being executed.\n",
+            "SdHost: SdHostIssueCommand(): Failed to execute CMD%d, a CMD is already being executed.\n",
             MMC_GET_INDX(MmcCmd)));
         SdHostDumpStatus();
         return EFI_DEVICE_ERROR;
     }
 
+    UINT32 Slot = MmcHostCommandSlot(MMC_GET_INDX(MmcCmd));
+    RASPBERRY_PI_MMC_COMMAND_STATS *Stats = MmcHostStatsEntry(Slot);
+    UINT64 Start = MmcHostStatsStart();
+
     // Write command argument
-    MmioWrite32(SDHOST_ARG, Argument);
+    MmcHostMmioWrite32(SDHOST_ARG, Argument);
 
     UINT32 SdCmd = 0;
     {
@@ -298,7 +368,7 @@ SdSendCommand(
 
     DEBUG((
         DEBUG_MMCHOST_SD,
-        "SdHost: SdSendCommand(CMD%d, Argument: %08x): BUSY=%d, RESP=%d, WRITE=%d, READ=%d\n",
+        "SdHost: SdHostIssueCommand(CMD%d, Argument: %08x): BUSY=%d, RESP=%d, WRITE=%d, READ=%d\n",
         MMC_GET_INDX(MmcCmd),
         Argument,
         ((SdCmd & SDHOST_CMD_BUSY_CMD) ? 1 : 0),
@@ -306,7 +376,7 @@ SdSendCommand(
         ((SdCmd & SDHOST_CMD_WRITE_CMD) ? 1 : 0),
         ((SdCmd & SDHOST_CMD_READ_CMD) ? 1 : 0)));
 
-    UINT32 PollCount = 0;
+    UINT64 Deadline = MmcHostDeadline(CMD_TIMEOUT_US);
     UINT32 RetryCount = 0;
     BOOLEAN IsCmdExecuted = FALSE;
     EFI_STATUS Status = EFI_SUCCESS;
@@ -314,20 +384,21 @@ SdSendCommand(
     // Keep retrying the command untill it succeed
     while ((RetryCount < CMD_MAX_RETRY_COUNT) && !IsCmdExecuted) {
         // Clear prev cmd status
-        MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+        MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
 
         if (IsReadCmd(MmcCmd) || IsWriteCmd(MmcCmd)) {
             // Flush Fifo if this cmd will start a new transfer in case
             // there is stale bytes in the Fifo
-            MmioOr32(SDHOST_EDM, SDHOST_EDM_FIFO_CLEAR);
+            MmcHostMmioOr32(SDHOST_EDM, SDHOST_EDM_FIFO_CLEAR);
         }
 
         // Write command and set it to start execution
-        MmioWrite32(SDHOST_CMD, SDHOST_CMD_NEW_FLAG | SdCmd);
+        MmcHostMmioWrite32(SDHOST_CMD, SDHOST_CMD_NEW_FLAG | SdCmd);
 
         // Poll for the command status untill it finishes execution
-        while (PollCount < CMD_MAX_POLL_COUNT) {
-            UINT32 CmdReg = MmioRead32(SDHOST_CMD);
+        UINT64 PollStart = MmcHostGetTicks();
+        while (!MmcHostDeadlinePassed(Deadline)) {
+            UINT32 CmdReg = MmcHostMmioRead32(SDHOST_CMD);
 
             // Read status of command response
             if (CmdReg & SDHOST_CMD_FAIL_FLAG) {
@@ -340,10 +411,8 @@ SdSendCommand(
                 IsCmdExecuted = TRUE;
                 break;
             }
-
-            ++PollCount;
-            gBS->Stall(CMD_STALL_AFTER_POLL_US);
         }
+        MmcHostAccountPoll(PollStart);
 
         if (!IsCmdExecuted) {
             ++RetryCount;
@@ -354,11 +423,12 @@ SdSendCommand(
     if (RetryCount == CMD_MAX_RETRY_COUNT) {
         Status = EFI_TIMEOUT;
     }
+    Stats->Retries += RetryCount;
 
 
 
     if (EFI_ERROR(Status) ||
-        (MmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR)) {
+        (MmcHostMmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR)) {
         // Deselecting the SDCard with CMD7 and RCA=0x0 always timeout on SDHost
         if (MmcCmd == MMC_CMD7 &&
             Argument == 0) {
@@ -367,26 +437,74 @@ SdSendCommand(
         } else {
             DEBUG((
                 DEBUG_ERROR,
-                "SdHost: SdSendCommand(): CMD%d execution failed after %d trial(s)\n",
+                "SdHost: SdHostIssueCommand(): CMD%d execution failed after %d trial(s)\n",
                 MMC_GET_INDX(MmcCmd),
                 RetryCount));
             SdHostDumpStatus();
         }
 
-        MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+        MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+        MmcHostStatsRecord(Stats, Start, 0, Status);
+        MmcHostSetLastCommand(MMC_HOST_NO_COMMAND);
 
     } else if (IsCmdExecuted) {
         ASSERT(!(MmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR));
-        mLastExecutedMmcCmd = MmcCmd;
+
+        // Data commands are accounted once their data has gone through the FIFO
+        if (IsReadCmd(MmcCmd) || IsWriteCmd(MmcCmd)) {
+            MmcHostStatsDeferData(Stats, Start);
+        } else {
+            MmcHostStatsRecord(Stats, Start, 0, Status);
+        }
+
+        MmcHostSetLastCommand(Slot);
 
     } else {
-        ASSERT("SdHost: SdSendCommand(): Unexpected State");
+        ASSERT("SdHost: SdHostIssueCommand(): Unexpected State");
         SdHostDumpStatus();
     }
 
     return Status;
 }
 
+EFI_STATUS
+SdSendCommand(
+    IN EFI_MMC_HOST_PROTOCOL    *This,
+    IN MMC_CMD                  MmcCmd,
+    IN UINT32                   Argument
+    )
+{
+    if (mPendingCmd != SDHOST_NO_PENDING_CMD) {
+        DEBUG((
+            DEBUG_ERROR,
+            "SdHost: SdSendCommand(): dropping unused data command CMD%d\n",
+            MMC_GET_INDX(mPendingCmd)));
+        mPendingCmd = SDHOST_NO_PENDING_CMD;
+    }
+
+    // A transfer the card was given the block count of with CMD23 ends
+    // by itself, and the card would flag the CMD12 MmcDxe follows it
+    // with as illegal. MmcDxe polls CMD13 before that CMD12, so a status
+    // poll must leave the flag alone
+    if (MmcCmd == MMC_CMD12 && mBlockCountSet) {
+        mBlockCountSet = FALSE;
+        return EFI_SUCCESS;
+    }
+    if (MmcCmd != MMC_CMD13 || IsAppCmd()) {
+        mBlockCountSet = FALSE;
+    }
+
+    // HBCT/HBLC must be set up before a data command goes out, and only
+    // SdReadBlockData/SdWriteBlockData know the transfer length
+    if (IsReadCmd(MmcCmd) || IsWriteCmd(MmcCmd)) {
+        mPendingCmd = MmcCmd;
+        mPendingArg = Argument;
+        return EFI_SUCCESS;
+    }
+
+    return SdHostIssueCommand(MmcCmd, Argument);
+}
+
 EFI_STATUS
 SdReceiveResponse(
     IN EFI_MMC_HOST_PROTOCOL    *This,
@@ -404,30 +522,24 @@ SdReceiveResponse(
         (Type == MMC_RESPONSE_TYPE_R3) ||
         (Type == MMC_RESPONSE_TYPE_R6) ||
         (Type == MMC_RESPONSE_TYPE_R7)) {
-        Buffer[0] = MmioRead32(SDHOST_RSP0);
+        Buffer[0] = MmcHostMmioRead32(SDHOST_RSP0);
         DEBUG((
             DEBUG_MMCHOST_SD,
             "SdHost: SdReceiveResponse(Type: %x), Buffer[0]: %08x\n",
             Type, Buffer[0]));
 
     } else if (Type == MMC_RESPONSE_TYPE_R2) {
-        Buffer[0] = MmioRead32(SDHOST_RSP0);
-        Buffer[1] = MmioRead32(SDHOST_RSP1);
-        Buffer[2] = MmioRead32(SDHOST_RSP2);
-        Buffer[3] = MmioRead32(SDHOST_RSP3);
+        Buffer[0] = MmcHostMmioRead32(SDHOST_RSP0);
+        Buffer[1] = MmcHostMmioRead32(SDHOST_RSP1);
+        Buffer[2] = MmcHostMmioRead32(SDHOST_RSP2);
+        Buffer[3] = MmcHostMmioRead32(SDHOST_RSP3);
 
         //
         // Shift the whole response right 8-bits to strip down CRC. It is common for standard
         // SDHCs to not store in the RSP registers the first 8-bits for R2 responses CID[0:7]
         // and CSD[0:7] since those 8-bits contain the CRC which is already handled by the SDHC HW FSM
         //
-        UINT8 *BufferAsBytes = (UINT8*)Buffer;
-        const UINT32 BufferSizeMax = sizeof(UINT32) * 4;
-        UINT32 ByteIdx;
-        for (ByteIdx = 0; ByteIdx < BufferSizeMax - 1; ++ByteIdx) {
-            BufferAsBytes[ByteIdx] = BufferAsBytes[ByteIdx + 1];
-        }
-        BufferAsBytes[BufferSizeMax - 1] = 0;
+        MmcHostDecodeR2(Buffer, TRUE);
 
         DEBUG((
             DEBUG_MMCHOST_SD,
@@ -437,13 +549,21 @@ SdReceiveResponse(
 
     // During initialization per Specs, MmcDxe will select the SDCard
     // and ask it to publish an RCA address for further commands
-    if (mLastExecutedMmcCmd == MMC_CMD3) {
-        mRca = Buffer[0] >> SDHOST_RCA_SHIFT;
+    UINT32 LastCmd = MmcHostLastCommand();
+    if (LastCmd == MMC_GET_INDX(MMC_CMD3)) {
+        mRca = Buffer[0] >> MMC_HOST_RCA_SHIFT;
+    }
+
+    // Once the card has powered up, the OCR says whether it is addressed
+    // in blocks (SDHC/SDXC) or in bytes (SDSC), which erase needs to know
+    if (LastCmd == MMC_HOST_APP_COMMAND(MMC_GET_INDX(MMC_ACMD41)) &&
+        (Buffer[0] & MMC_HOST_OCR_POWER_UP)) {
+        mHighCapacity = (Buffer[0] & MMC_HOST_OCR_HIGH_CAPACITY) ? TRUE : FALSE;
     }
 
     // MmcDxe will be querying for CSD register during initialization,
     // this is a good place to capture the SDCard transfer rate fields
-    if (mLastExecutedMmcCmd == MMC_CMD9) {
+    if (LastCmd == MMC_GET_INDX(MMC_CMD9)) {
         UINT32 NewMaxDataTransferRate = SDHOST_CSD_GET_TRANSPEED(Buffer);
         if (NewMaxDataTransferRate != mMaxDataTransferRate) {
             DEBUG((
@@ -456,6 +576,8 @@ SdReceiveResponse(
             mReconfigSdClock = TRUE;
             mMaxDataTransferRate = NewMaxDataTransferRate;
         }
+
+        MmcHostEraseParseCsd(Buffer, FALSE);
     }
 
     return EFI_SUCCESS;
@@ -471,7 +593,7 @@ SdHostGetSdStatus(
 
     // On command completion with R1 or R1b response type
     // the SDCard status will be in RSP0
-    UINT32 Rsp0 = MmioRead32(SDHOST_RSP0);
+    UINT32 Rsp0 = MmcHostMmioRead32(SDHOST_RSP0);
     if (Rsp0 != 0xFFFFFFFF) {
         *SdStatus = Rsp0;
         return EFI_SUCCESS;
@@ -485,138 +607,406 @@ CalculateSdCardMaxFreq(
     UINT32* SdClkFreqHz
     )
 {
-    UINT32 TransferRateBitPerSecond = 0;
-    UINT32 TimeValue = 0;
-
     ASSERT(SdClkFreqHz != NULL);
     ASSERT(mMaxDataTransferRate != 0);
 
-    // Calculate Transfer rate unit (Bits 2:0 of TRAN_SPEED)
-    switch (mMaxDataTransferRate & 0x7) { // 2
-    case 0: // 100kbit/s
-        TransferRateBitPerSecond = 100 * 1000;
-        break;
+    *SdClkFreqHz = MmcHostTranSpeedToHz(mMaxDataTransferRate);
+    if (*SdClkFreqHz == 0) {
+        DEBUG((DEBUG_ERROR, "SdHost: CalculateSdCardMaxFreq(): Invalid TRAN_SPEED 0x%x\n", mMaxDataTransferRate));
+        ASSERT(FALSE);
+        return EFI_INVALID_PARAMETER;
+    }
 
-    case 1: // 1Mbit/s
-        TransferRateBitPerSecond = 1 * 1000 * 1000;
-        break;
+    DEBUG((
+        DEBUG_MMCHOST_SD,
+        "SdHost: TRAN_SPEED=0x%x, SdCardFrequency=%dKHz\n",
+        mMaxDataTransferRate,
+        *SdClkFreqHz / 1000));
 
-    case 2: // 10Mbit/s
-        TransferRateBitPerSecond = 10 * 1000 * 1000;
-        break;
+    return EFI_SUCCESS;
+}
 
-    case 3: // 100Mbit/s
-        TransferRateBitPerSecond = 100 * 1000 * 1000;
-        break;
+EFI_STATUS
+SdHostSwitch4BitBusWidth(
+    VOID
+    )
+{
+    ASSERT(mRca != 0);
 
-    default:
-        DEBUG((DEBUG_ERROR, "SdHost: CalculateSdCardMaxFreq(): Invalid parameter\n"));
-        ASSERT(FALSE);
-        return EFI_INVALID_PARAMETER;
+    // Tell the SDCard to interpret the next command as an application
+    // specific command
+    UINT32 CmdArg = mRca << MMC_HOST_RCA_SHIFT;
+    EFI_STATUS Status = SdSendCommand(NULL, MMC_CMD55, CmdArg);
+    if (EFI_ERROR(Status)) {
+        return Status;
     }
 
-    //Calculate Time value (Bits 6:3 of TRAN_SPEED)
-    switch ((mMaxDataTransferRate >> 3) & 0xF) { // 6
-    case 0x1:
-        TimeValue = 10;
-        break;
+    CmdArg = 0x2; // 4-Bit Bus Width Flag
+    Status = SdSendCommand(NULL, MMC_ACMD6, CmdArg);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
 
-    case 0x2:
-        TimeValue = 12;
-        break;
+    MmcHostMmioOr32(SDHOST_HCFG, SDHOST_HCFG_WIDE_EXT_BUS);
 
-    case 0x3:
-        TimeValue = 13;
-        break;
+    return Status;
+}
 
-    case 0x4:
-        TimeValue = 15;
-        break;
+// Moves NumWords words between Buffer and the FIFO by hand. Rather than
+// checking HSTS before every word, the EDM FIFO level says how many words
+// can be moved in one go, and errors are checked once per such burst.
+EFI_STATUS
+SdHostPioTransfer(
+    IN BOOLEAN  IsWrite,
+    IN UINT32*  Buffer,
+    IN UINTN    NumWords
+    )
+{
+    UINT32 MaxBurst = MAX(1, MIN(PcdGet32(PcdSdHostPioBurstWords), SDHOST_FIFO_WORDS));
+    UINT64 Start = MmcHostStatsPioStart();
+    UINT64 Deadline = MmcHostDeadline(FIFO_TIMEOUT_US);
+    EFI_STATUS Status = EFI_SUCCESS;
+    UINTN WordIdx = 0;
 
-    case 0x5:
-        TimeValue = 20;
-        break;
+    while (WordIdx < NumWords) {
+        if (MmcHostMmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR) {
+            Status = EFI_DEVICE_ERROR;
+            break;
+        }
 
-    case 0x6:
-        TimeValue = 25;
-        break;
+        // Words waiting in the FIFO for a read, free slots for a write
+        UINT32 Level = SDHOST_EDM_FIFO_LEVEL(MmcHostMmioRead32(SDHOST_EDM));
+        UINT32 Burst;
+        if (IsWrite) {
+            Burst = (Level < SDHOST_FIFO_WORDS) ? SDHOST_FIFO_WORDS - Level : 0;
+        } else {
+            Burst = Level;
+        }
+        Burst = (UINT32)MIN(MIN(Burst, MaxBurst), NumWords - WordIdx);
 
-    case 0x7:
-        TimeValue = 30;
-        break;
+        if (Burst == 0) {
+            if (MmcHostDeadlinePassed(Deadline)) {
+                Status = EFI_TIMEOUT;
+                break;
+            }
+            continue;
+        }
 
-    case 0x8:
-        TimeValue = 35;
-        break;
+        Deadline = MmcHostDeadline(FIFO_TIMEOUT_US);
+        if (IsWrite) {
+            for (; Burst != 0; --Burst) {
+                MmcHostMmioWrite32(SDHOST_DATA, Buffer[WordIdx++]);
+            }
+        } else {
+            for (; Burst != 0; --Burst) {
+                Buffer[WordIdx++] = MmcHostMmioRead32(SDHOST_DATA);
+            }
+        }
+    }
 
-    case 0x9:
-        TimeValue = 40;
-        break;
+    MmcHostStatsPio(WordIdx, Start);
 
-    case 0xA:
-        TimeValue = 45;
-        break;
+    if (EFI_ERROR(Status)) {
+        DEBUG((
+            DEBUG_ERROR,
+            "SdHost: SdHostPioTransfer(): %a failed at Word%d of %d: %r\n",
+            IsWrite ? "write" : "read",
+            WordIdx,
+            NumWords,
+            Status));
+        SdHostDumpStatus();
+        MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+    }
 
-    case 0xB:
-        TimeValue = 50;
-        break;
+    return Status;
+}
 
-    case 0xC:
-        TimeValue = 55;
-        break;
+// Moves Length bytes between Buffer and the FIFO with the system DMA
+// engine, paced by the SDHOST DREQ. Returns EFI_UNSUPPORTED when DMA
+// could not be started, in which case no data has moved yet.
+EFI_STATUS
+SdHostDmaTransfer(
+    IN BCM2836_DMA_DIRECTION    Direction,
+    IN UINTN                    Length,
+    IN UINT32*                  Buffer
+    )
+{
+    UINTN Channel = PcdGet32(PcdSdHostDmaChannel);
+    UINTN DmaLength = Length;
+    UINTN Offset = 0;
+    EFI_STATUS Status = EFI_SUCCESS;
 
-    case 0xD:
-        TimeValue = 60;
-        break;
+    if (Channel >= BCM2836_DMA_NUM_FULL_CHANNELS) {
+        return EFI_UNSUPPORTED;
+    }
 
-    case 0xE:
-        TimeValue = 70;
-        break;
+    if ((UINTN)Buffer % 4 != 0 || Length < SDHOST_BLOCK_BYTE_LENGTH) {
+        return EFI_UNSUPPORTED;
+    }
 
-    case 0xF:
-        TimeValue = 80;
-        break;
+    // SDHOST stops raising DREQ for the tail of a multi-block read, with
+    // fewer words left than the read threshold, so those are left to the CPU
+    if (Direction == Bcm2836DmaFromDevice && Length > SDHOST_BLOCK_BYTE_LENGTH) {
+        DmaLength -= (FIFO_READ_THRESHOLD - 1) * 4;
+    }
 
-    default:
-        DEBUG((DEBUG_ERROR, "SdHost: CalculateSdCardMaxFreq(): Invalid parameter\n"));
-        ASSERT(FALSE);
-        return EFI_INVALID_PARAMETER;
+    while (Offset < DmaLength) {
+        UINTN Chunk = MIN(DmaLength - Offset, BCM2836_DMA_MAX_LENGTH);
+
+        Status = Bcm2836DmaStart(
+            Channel,
+            BCM2836_DMA_DREQ_SDHOST,
+            Direction,
+            SDHOST_DATA,
+            (UINT8*)Buffer + Offset,
+            Chunk);
+        if (EFI_ERROR(Status)) {
+            DEBUG((DEBUG_MMCHOST_SD, "SdHost: SdHostDmaTransfer(): DMA not started: %r\n", Status));
+            // Past the first chunk the data is already flowing, no going back to PIO
+            return (Offset == 0) ? EFI_UNSUPPORTED : EFI_DEVICE_ERROR;
+        }
+
+        UINT64 Deadline = MmcHostDeadline(DMA_TIMEOUT_US + Chunk / DMA_MIN_BYTES_PER_US);
+        while ((Status = Bcm2836DmaPoll(Channel)) == EFI_NOT_READY) {
+            if ((MmcHostMmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR) ||
+                MmcHostDeadlinePassed(Deadline)) {
+                DEBUG((
+                    DEBUG_ERROR,
+                    "SdHost: SdHostDmaTransfer(): DMA of %d bytes at %d failed, HSTS: 0x%x\n",
+                    Chunk,
+                    Offset,
+                    MmioRead32(SDHOST_HSTS)));
+                Bcm2836DmaAbort(Channel);
+                SdHostDumpStatus();
+                MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+                return EFI_DEVICE_ERROR;
+            }
+        }
+
+        if (EFI_ERROR(Status)) {
+            return EFI_DEVICE_ERROR;
+        }
+
+        Offset += Chunk;
     }
 
-    *SdClkFreqHz = (TransferRateBitPerSecond * TimeValue) / 10;
+    return SdHostPioTransfer(
+        FALSE,
+        Buffer + DmaLength / 4,
+        (Length - DmaLength) / 4);
+}
 
-    DEBUG((
-        DEBUG_MMCHOST_SD,
-        "SdHost: TransferRateUnitId=%d TimeValue*10=%d, SdCardFrequency=%dKHz\n",
-        (mMaxDataTransferRate & 0x7),
-        TimeValue,
-        *SdClkFreqHz / 1000));
+// Waits for the data state machine to settle after the last block, as
+// Linux does for transfers not followed by CMD12
+EFI_STATUS
+SdHostWaitTransferComplete(
+    IN BOOLEAN  IsWrite
+    )
+{
+    UINT32 AlternateIdle = IsWrite ? SDHOST_EDM_FSM_WRITESTART1 : SDHOST_EDM_FSM_READWAIT;
+    UINT64 Deadline = MmcHostDeadline(TRANSFER_COMPLETE_TIMEOUT_US);
 
-    return EFI_SUCCESS;
+    for (;;) {
+        UINT32 Edm = MmcHostMmioRead32(SDHOST_EDM);
+        UINT32 Fsm = Edm & SDHOST_EDM_FSM_MASK;
+
+        if (Fsm == SDHOST_EDM_FSM_IDENTMODE || Fsm == SDHOST_EDM_FSM_DATAMODE) {
+            return EFI_SUCCESS;
+        }
+
+        if (Fsm == AlternateIdle) {
+            MmcHostMmioWrite32(SDHOST_EDM, Edm | SDHOST_EDM_FORCE_DATA_MODE);
+            return EFI_SUCCESS;
+        }
+
+        if (MmcHostDeadlinePassed(Deadline)) {
+            DEBUG((DEBUG_ERROR, "SdHost: SdHostWaitTransferComplete(): stuck, EDM: 0x%x\n", Edm));
+            SdHostDumpStatus();
+            return EFI_TIMEOUT;
+        }
+    }
 }
 
+// Waits for the last written word to leave the FIFO and the data state
+// machine to be done with the block, so a CMD12 cannot cut it short.
+// Open-ended writes otherwise return as soon as the data is in the FIFO.
 EFI_STATUS
-SdHostSwitch4BitBusWidth(
+SdHostWaitWriteDrained(
     VOID
     )
 {
-    ASSERT(mRca != 0);
+    UINT64 Deadline = MmcHostDeadline(TRANSFER_COMPLETE_TIMEOUT_US);
 
-    // Tell the SDCard to interpret the next command as an application
-    // specific command
-    UINT32 CmdArg = mRca << SDHOST_RCA_SHIFT;
-    EFI_STATUS Status = SdSendCommand(NULL, MMC_CMD55, CmdArg);
+    for (;;) {
+        UINT32 Edm = MmcHostMmioRead32(SDHOST_EDM);
+        UINT32 Fsm = Edm & SDHOST_EDM_FSM_MASK;
+
+        if (MmcHostMmioRead32(SDHOST_HSTS) & SDHOST_HSTS_ERROR) {
+            DEBUG((DEBUG_ERROR, "SdHost: SdHostWaitWriteDrained(): error, EDM: 0x%x\n", Edm));
+            SdHostDumpStatus();
+            MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
+            return EFI_DEVICE_ERROR;
+        }
+
+        if (SDHOST_EDM_FIFO_LEVEL(Edm) == 0 &&
+            (Fsm == SDHOST_EDM_FSM_IDENTMODE || Fsm == SDHOST_EDM_FSM_DATAMODE ||
+             Fsm == SDHOST_EDM_FSM_WRITEWAIT1 || Fsm == SDHOST_EDM_FSM_WRITEWAIT2 ||
+             Fsm == SDHOST_EDM_FSM_WRITESTART1)) {
+            return EFI_SUCCESS;
+        }
+
+        if (MmcHostDeadlinePassed(Deadline)) {
+            DEBUG((DEBUG_ERROR, "SdHost: SdHostWaitWriteDrained(): stuck, EDM: 0x%x\n", Edm));
+            SdHostDumpStatus();
+            return EFI_TIMEOUT;
+        }
+    }
+}
+
+EFI_STATUS
+SdHostTransferBlockData(
+    IN BOOLEAN  IsWrite,
+    IN UINTN    Length,
+    IN UINT32*  Buffer
+    )
+{
+    MMC_CMD MmcCmd = mPendingCmd;
+    UINT32 Argument = mPendingArg;
+
+    mPendingCmd = SDHOST_NO_PENDING_CMD;
+    if (MmcCmd == SDHOST_NO_PENDING_CMD) {
+        DEBUG((DEBUG_ERROR, "SdHost: SdHostTransferBlockData(): no data command pending\n"));
+        return EFI_NOT_READY;
+    }
+
+    // Register-sized reads (SCR, switch status) are a single short block
+    UINT32 BlockSize = (UINT32)MIN(Length, SDHOST_BLOCK_BYTE_LENGTH);
+    UINTN BlockCount = (BlockSize != 0) ? Length / BlockSize : 0;
+    if (BlockCount == 0 || Length % BlockSize != 0 || BlockCount > SDHOST_MAX_BLOCK_COUNT) {
+        DEBUG((DEBUG_ERROR, "SdHost: SdHostTransferBlockData(): bad Length 0x%x\n", Length));
+        return EFI_INVALID_PARAMETER;
+    }
+
+    BOOLEAN IsMultiBlock = IsMultiBlockCmd(MmcCmd);
+    BOOLEAN UseCmd23 = IsMultiBlock && mCardHasCmd23;
+    EFI_STATUS Status;
+
+    MmcHostMmioWrite32(SDHOST_HBCT, BlockSize);
+    MmcHostMmioWrite32(SDHOST_HBLC, (UINT32)BlockCount);
+
+    // Telling the card the block count up front saves the CMD12 and lets
+    // it program whole erase units while the data comes in
+    if (UseCmd23) {
+        Status = SdHostIssueCommand(MMC_CMD23, (UINT32)BlockCount);
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+    }
+
+    // Telling the card how long a write closed by CMD12 is going to be
+    // lets it pre-erase too. It is only a hint, so a card that refuses it
+    // still gets the write
+    if (IsWrite && IsMultiBlock && !UseCmd23 &&
+        BlockCount >= MMC_HOST_PRE_ERASE_MIN_BLOCKS && mRca != 0) {
+        Status = SdHostIssueCommand(MMC_CMD55, mRca << MMC_HOST_RCA_SHIFT);
+        if (!EFI_ERROR(Status)) {
+            Status = SdHostIssueCommand(MMC_ACMD23, (UINT32)BlockCount);
+        }
+        if (EFI_ERROR(Status)) {
+            DEBUG((DEBUG_MMCHOST_SD, "SdHost: ACMD23 pre-erase hint failed: %r\n", Status));
+        }
+        // CMD25 must not be taken for an ACMD if only the CMD55 went through
+        MmcHostSetLastCommand(MMC_HOST_NO_COMMAND);
+    }
+
+    Status = SdHostIssueCommand(MmcCmd, Argument);
     if (EFI_ERROR(Status)) {
         return Status;
     }
 
-    CmdArg = 0x2; // 4-Bit Bus Width Flag
-    Status = SdSendCommand(NULL, MMC_ACMD6, CmdArg);
+    UINT64 PollStart = MmcHostGetTicks();
+
+    mFwProtocol->NotifyLedActivity();
+
+    Status = SdHostDmaTransfer(
+        IsWrite ? Bcm2836DmaToDevice : Bcm2836DmaFromDevice,
+        Length,
+        Buffer);
+    if (Status == EFI_UNSUPPORTED) {
+        // Unaligned buffers can't be DMAed, anything else is a DMA setup failure
+        RASPBERRY_PI_MMC_COMMAND_STATS *DataStats = MmcHostStatsData();
+        if (((UINTN)Buffer % 4) == 0 && Length >= SDHOST_BLOCK_BYTE_LENGTH && DataStats != NULL &&
+            PcdGet32(PcdSdHostDmaChannel) < BCM2836_DMA_NUM_FULL_CHANNELS) {
+            DataStats->Retries++;
+        }
+        Status = SdHostPioTransfer(IsWrite, Buffer, Length / 4);
+    }
+
+    // Every write has to be out of the FIFO before returning, open-ended
+    // ones included, as MmcDxe may send CMD12 right after
+    if (!EFI_ERROR(Status) && IsWrite) {
+        Status = SdHostWaitWriteDrained();
+    }
+
+    // Open-ended transfers are finished by the CMD12 MmcDxe sends next
+    if (!EFI_ERROR(Status) && (!IsMultiBlock || UseCmd23)) {
+        Status = SdHostWaitTransferComplete(IsWrite);
+    }
+
+    // The data phase is all spent waiting on the FIFO or the DMA engine
+    MmcHostAccountPoll(PollStart);
+    MmcHostStatsDataDone(Length, Status);
+
+    if (EFI_ERROR(Status)) {
+        // Stop the card right away. MmcDxe follows up with a CMD12 of its
+        // own, which the card would take as illegal once stopped
+        if (IsMultiBlock) {
+            mBlockCountSet = !EFI_ERROR(SdHostIssueCommand(MMC_CMD12, 0));
+        }
+        return Status;
+    }
+
+    if (MmcHostLastCommand() == MMC_HOST_APP_COMMAND(MMC_GET_INDX(MMC_ACMD51)) &&
+        Length >= MMC_HOST_SCR_LENGTH) {
+        MMC_HOST_SCR Scr;
+
+        CopyMem(&mScr, Buffer, sizeof(mScr));
+        MmcHostParseScr((UINT8*)Buffer, &Scr);
+        mCardHasCmd23 = Scr.Cmd23;
+        DEBUG((DEBUG_MMCHOST_SD, "SdHost: SCR %lx, CMD23 %d\n", mScr, mCardHasCmd23));
+    }
+
+    mBlockCountSet = UseCmd23;
+    return EFI_SUCCESS;
+}
+
+// Asks the card to go to high speed (50MHz) with CMD6, checking first
+// that it has that function. SD 1.0 cards don't know CMD6 at all.
+EFI_STATUS
+SdHostSwitchHighSpeed(
+    VOID
+    )
+{
+    UINT32 SwitchStatus[MMC_HOST_SWITCH_STATUS_LENGTH / 4];
+
+    EFI_STATUS Status = SdSendCommand(NULL, MMC_CMD6, MmcHostSwitchArgument(FALSE));
+    if (!EFI_ERROR(Status)) {
+        Status = SdHostTransferBlockData(FALSE, sizeof(SwitchStatus), SwitchStatus);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = MmcHostCheckSwitchStatus((UINT8*)SwitchStatus, FALSE);
+    }
     if (EFI_ERROR(Status)) {
         return Status;
     }
 
-    MmioOr32(SDHOST_HCFG, SDHOST_HCFG_WIDE_EXT_BUS);
+    Status = SdSendCommand(NULL, MMC_CMD6, MmcHostSwitchArgument(TRUE));
+    if (!EFI_ERROR(Status)) {
+        Status = SdHostTransferBlockData(FALSE, sizeof(SwitchStatus), SwitchStatus);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = MmcHostCheckSwitchStatus((UINT8*)SwitchStatus, TRUE);
+    }
 
     return Status;
 }
@@ -635,41 +1025,8 @@ SdReadBlockData(
         (UINT32)Lba, Length, Buffer));
 
     ASSERT(Buffer != NULL);
-    ASSERT(Length % SDHOST_BLOCK_BYTE_LENGTH == 0);
-
-    EFI_STATUS Status = EFI_SUCCESS;
-
-    mFwProtocol->SetLed(TRUE);
-    {
-        UINT32 NumWords = Length / 4;
-        UINT32 WordIdx;
-
-        for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-            UINT32 PollCount = 0;
-            while (PollCount < FIFO_MAX_POLL_COUNT) {
-                if (MmioRead32(SDHOST_HSTS) & SDHOST_HSTS_DATA_FLAG) {
-                    Buffer[WordIdx] = MmioRead32(SDHOST_DATA);
-                    break;
-                }
-
-                ++PollCount;
-            }
-
-            if (PollCount == FIFO_MAX_POLL_COUNT) {
-                DEBUG(
-                    (DEBUG_ERROR,
-                        "SdHost: SdReadBlockData(): Block Word%d read poll timed-out\n",
-                        WordIdx));
-                SdHostDumpStatus();
-                MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-                Status = EFI_TIMEOUT;
-                break;
-            }
-        }
-    }
-    mFwProtocol->SetLed(FALSE);
 
-    return Status;
+    return SdHostTransferBlockData(FALSE, Length, Buffer);
 }
 
 EFI_STATUS
@@ -688,39 +1045,7 @@ SdWriteBlockData(
     ASSERT(Buffer != NULL);
     ASSERT(Length % SDHOST_BLOCK_BYTE_LENGTH == 0);
 
-    EFI_STATUS Status = EFI_SUCCESS;
-
-    //    LedSetOk(TRUE);
-    {
-        UINT32 NumWords = Length / 4;
-        UINT32 WordIdx;
-
-        for (WordIdx = 0; WordIdx < NumWords; ++WordIdx) {
-            UINT32 PollCount = 0;
-            while (PollCount < FIFO_MAX_POLL_COUNT) {
-                if (MmioRead32(SDHOST_HSTS) & SDHOST_HSTS_DATA_FLAG) {
-                    MmioWrite32(SDHOST_DATA, Buffer[WordIdx]);
-                    break;
-                }
-
-                ++PollCount;
-            }
-
-            if (PollCount == FIFO_MAX_POLL_COUNT) {
-                DEBUG((
-                    DEBUG_ERROR,
-                    "SdHost: SdWriteBlockData(): Block Word%d write poll timed-out\n",
-                    WordIdx));
-                SdHostDumpStatus();
-                MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);
-                Status = EFI_TIMEOUT;
-                break;
-            }
-        }
-    }
-    mFwProtocol->SetLed(FALSE);
-
-    return Status;
+    return SdHostTransferBlockData(TRUE, Length, Buffer);
 }
 
 EFI_STATUS
@@ -737,24 +1062,37 @@ SdNotifyState(
         DEBUG((DEBUG_MMCHOST_SD, "MmcHwInitializationState\n", State));
 
         // Turn-off SD Card power
-        MmioWrite32(SDHOST_VDD, 0);
+        MmcHostMmioWrite32(SDHOST_VDD, 0);
         {
             // Reset command and arg
-            MmioWrite32(SDHOST_CMD, 0);
-            MmioWrite32(SDHOST_ARG, 0);
+            MmcHostMmioWrite32(SDHOST_CMD, 0);
+            MmcHostMmioWrite32(SDHOST_ARG, 0);
             // Reset clock divider
-            MmioWrite32(SDHOST_CDIV, 0);
+            MmcHostMmioWrite32(SDHOST_CDIV, 0);
             // Clear status flags
-            MmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);;
+            MmcHostMmioWrite32(SDHOST_HSTS, SDHOST_HSTS_CLEAR);;
             // Reset controller configs
-            MmioWrite32(SDHOST_HCFG, 0);
-            MmioWrite32(SDHOST_HBCT, 0);
-            MmioWrite32(SDHOST_HBLC, 0);
+            MmcHostMmioWrite32(SDHOST_HCFG, 0);
+            MmcHostMmioWrite32(SDHOST_HBCT, 0);
+            MmcHostMmioWrite32(SDHOST_HBLC, 0);
 
             gBS->Stall(STALL_TO_STABILIZE_US);
         }
         // Turn-on SD Card power
-        MmioWrite32(SDHOST_VDD, 1);
+        MmcHostMmioWrite32(SDHOST_VDD, 1);
+
+        mRca = 0;
+        mHighCapacity = FALSE;
+        // The clock starts over at 400KHz, so the next card's TRAN_SPEED
+        // has to reprogram it even if it is the same as the last one's
+        mMaxDataTransferRate = 0;
+        mReconfigSdClock = FALSE;
+        MmcHostEraseReset();
+        mPendingCmd = SDHOST_NO_PENDING_CMD;
+        mCardHasCmd23 = FALSE;
+        mBlockCountSet = FALSE;
+        mIsSdBusSwitched4BitMode = FALSE;
+        mIsSdHighSpeedChecked = FALSE;
 
         gBS->Stall(STALL_TO_STABILIZE_US);
 
@@ -762,7 +1100,15 @@ SdNotifyState(
         UINT32 Hcfg = 0;
         Hcfg |= SDHOST_HCFG_WIDE_INT_BUS;
         Hcfg |= SDHOST_HCFG_SLOW_CARD; // Use all bits of CDIV in DataMode
-        MmioWrite32(SDHOST_HCFG, Hcfg);
+        MmcHostMmioWrite32(SDHOST_HCFG, Hcfg);
+
+        // FIFO levels at which DREQ is raised for the DMA engine
+        MmcHostMmioAndThenOr32(
+            SDHOST_EDM,
+            (UINT32)~(SDHOST_EDM_READ_THRESHOLD(SDHOST_EDM_THRESHOLD_MASK) |
+                      SDHOST_EDM_WRITE_THRESHOLD(SDHOST_EDM_THRESHOLD_MASK)),
+            SDHOST_EDM_READ_THRESHOLD(FIFO_READ_THRESHOLD) |
+            SDHOST_EDM_WRITE_THRESHOLD(FIFO_WRITE_THRESHOLD));
 
         // Set default clock frequency
         EFI_STATUS Status = SdHostSetClockFrequency(IDENT_MODE_SD_CLOCK_FREQ_HZ);
@@ -809,6 +1155,27 @@ SdNotifyState(
             mIsSdBusSwitched4BitMode = TRUE;
         }
 
+        // TRAN_SPEED says 25MHz for practically every card, high speed
+        // has to be asked for. The new timing applies right after the
+        // switch status block.
+        if (!mIsSdHighSpeedChecked) {
+            mIsSdHighSpeedChecked = TRUE;
+
+            EFI_STATUS Status = SdHostSwitchHighSpeed();
+            if (!EFI_ERROR(Status)) {
+                Status = SdHostSetClockFrequency(HIGH_SPEED_SD_CLOCK_FREQ_HZ);
+                if (EFI_ERROR(Status)) {
+                    SdHostDumpStatus();
+                    return Status;
+                }
+
+                DEBUG((DEBUG_INIT, "SdHost: Switched SDCard to High Speed\n"));
+                mReconfigSdClock = FALSE;
+            } else {
+                DEBUG((DEBUG_INIT, "SdHost: SDCard stays at default speed: %r\n", Status));
+            }
+        }
+
         if (mReconfigSdClock) {
 
             UINT32 sdCardMaxClockFreqHz;
@@ -856,6 +1223,14 @@ SdNotifyState(
     return EFI_SUCCESS;
 }
 
+BOOLEAN
+SdIsMultiBlock(
+    IN EFI_MMC_HOST_PROTOCOL *This
+    )
+{
+    return TRUE;
+}
+
 EFI_MMC_HOST_PROTOCOL gMmcHost =
 {
     MMC_HOST_PROTOCOL_REVISION,
@@ -866,9 +1241,91 @@ EFI_MMC_HOST_PROTOCOL gMmcHost =
     SdSendCommand,
     SdReceiveResponse,
     SdReadBlockData,
-    SdWriteBlockData
+    SdWriteBlockData,
+    NULL,
+    SdIsMultiBlock
 };
 
+EFI_STATUS
+SdHostWaitForErase(
+    IN UINT64   TimeoutUs
+    )
+{
+    UINT64 Deadline = MmcHostDeadline(TimeoutUs);
+
+    // CMD38 is not sent as a busy command, the erase can easily outlast
+    // the SDHost busy timeout, so wait for the card to come back to the
+    // transfer state instead
+    for (;;) {
+        UINT32 SdStatus;
+        EFI_STATUS Status = SdSendCommand(NULL, MMC_CMD13, mRca << MMC_HOST_RCA_SHIFT);
+        if (!EFI_ERROR(Status)) {
+            Status = SdHostGetSdStatus(&SdStatus);
+        }
+        if (EFI_ERROR(Status)) {
+            return Status;
+        }
+
+        if ((SdStatus & MMC_HOST_R1_READY_FOR_DATA) &&
+            MMC_HOST_R1_CURRENT_STATE(SdStatus) == MMC_HOST_R1_STATE_TRAN) {
+            return EFI_SUCCESS;
+        }
+
+        if (MmcHostDeadlinePassed(Deadline)) {
+            DEBUG((DEBUG_ERROR, "SdHost: SdHostWaitForErase(): still busy, status %08x\n", SdStatus));
+            return EFI_TIMEOUT;
+        }
+
+        gBS->Stall(ERASE_POLL_US);
+    }
+}
+
+EFI_STATUS
+EFIAPI
+SdHostErase(
+    IN EFI_LBA  Lba,
+    IN UINT64   Blocks
+    )
+{
+    EFI_LBA Last = Lba + Blocks - 1;
+
+    // No card identified, or the last one failed to be
+    if (!SdIsCardPresent(NULL) || mRca == 0) {
+        return EFI_NO_MEDIA;
+    }
+
+    if (mPendingCmd != SDHOST_NO_PENDING_CMD) {
+        // Only possible if called from within a BlockIo request
+        return EFI_NOT_READY;
+    }
+
+    if (!mHighCapacity) {
+        Lba = MultU64x32(Lba, SDHOST_BLOCK_BYTE_LENGTH);
+        Last = MultU64x32(Last, SDHOST_BLOCK_BYTE_LENGTH);
+    }
+
+    if (Last > MAX_UINT32) {
+        return EFI_INVALID_PARAMETER;
+    }
+
+    EFI_STATUS Status = SdSendCommand(NULL, MMC_CMD32, (UINT32)Lba);
+    if (!EFI_ERROR(Status)) {
+        Status = SdSendCommand(NULL, MMC_CMD33, (UINT32)Last);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = SdSendCommand(NULL, MMC_CMD38, 0);
+    }
+    if (!EFI_ERROR(Status)) {
+        Status = SdHostWaitForErase(MmcHostEraseTimeoutUs(Blocks));
+    }
+
+    if (EFI_ERROR(Status)) {
+        SdHostDumpStatus();
+    }
+
+    return Status;
+}
+
 EFI_STATUS
 SdHostInitialize(
     IN EFI_HANDLE          ImageHandle,
@@ -878,6 +1335,11 @@ SdHostInitialize(
     EFI_STATUS Status;
     EFI_HANDLE Handle = NULL;
 
+    Status = MmcHostClaimSdSlot(MmcHostControllerSdHost);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
+
     Status = gBS->LocateProtocol (&gRaspberryPiFirmwareProtocolGuid, NULL,
                                   (VOID **)&mFwProtocol);
     ASSERT_EFI_ERROR (Status);
@@ -887,16 +1349,24 @@ SdHostInitialize(
 
     DEBUG((DEBUG_MMCHOST_SD, "SdHost: Initialize\n"));
     DEBUG((DEBUG_MMCHOST_SD, "Config:\n"));
-    DEBUG((DEBUG_MMCHOST_SD, " - FIFO_MAX_POLL_COUNT=%d\n", FIFO_MAX_POLL_COUNT));
-    DEBUG((DEBUG_MMCHOST_SD, " - CMD_STALL_AFTER_POLL_US=%dus\n", CMD_STALL_AFTER_POLL_US));
-    DEBUG((DEBUG_MMCHOST_SD, " - CMD_MIN_POLL_TOTAL_TIME_US=%dms\n", CMD_MIN_POLL_TOTAL_TIME_US / 1000));
-    DEBUG((DEBUG_MMCHOST_SD, " - CMD_MAX_POLL_COUNT=%d\n", CMD_MAX_POLL_COUNT));
+    DEBUG((DEBUG_MMCHOST_SD, " - FIFO_TIMEOUT_US=%dms\n", FIFO_TIMEOUT_US / 1000));
+    DEBUG((DEBUG_MMCHOST_SD, " - CMD_TIMEOUT_US=%dms\n", CMD_TIMEOUT_US / 1000));
     DEBUG((DEBUG_MMCHOST_SD, " - CMD_MAX_RETRY_COUNT=%d\n", CMD_MAX_RETRY_COUNT));
     DEBUG((DEBUG_MMCHOST_SD, " - CMD_STALL_AFTER_RETRY_US=%dus\n", CMD_STALL_AFTER_RETRY_US));
+    DEBUG((DEBUG_MMCHOST_SD, " - DMA channel %d\n", PcdGet32(PcdSdHostDmaChannel)));
+    DEBUG((DEBUG_MMCHOST_SD, " - PIO burst %d words\n", PcdGet32(PcdSdHostPioBurstWords)));
+
+    Status = MmcHostCommonInit(L"SdHost", &gRaspberryPiSdHostDevicePathGuid,
+                               SdHostClockRateChanged, SdHostErase);
+    ASSERT_EFI_ERROR(Status);
+    if (EFI_ERROR(Status)) {
+        return Status;
+    }
 
     Status = gBS->InstallMultipleProtocolInterfaces(
         &Handle,
         &gEfiMmcHostProtocolGuid, &gMmcHost,
+        &gRaspberryPiMmcStatsProtocolGuid, MmcHostGetStatsProtocol(),
         NULL
         );
     ASSERT_EFI_ERROR(Status);
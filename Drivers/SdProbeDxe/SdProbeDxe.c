@@ -0,0 +1,393 @@
+/** @file
+*
+*  Picks the SD slot controller when PcdSdController asks for probing.
+*
+*  Both MMC host drivers load and publish EFI_MMC_HOST_PROTOCOL. At end
+*  of DXE, before BDS connects MmcDxe to either, the slot pins are muxed
+*  to each controller in turn, the card is brought up the way MmcDxe
+*  would and a short multi-block read is timed. The slower controller's
+*  protocols are then uninstalled, so MmcDxe only ever sees the faster.
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/MmcHostCommonLib.h>
+#include <Library/PcdLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Guid/EventGroup.h>
+#include <Protocol/MmcHost.h>
+#include <Protocol/RaspberryPiMmcStats.h>
+
+//
+// The read timed on each controller: long enough for the data phase to
+// dominate, short enough not to be noticed at boot.
+//
+#define SD_PROBE_READ_LENGTH      (256 * 1024)
+#define SD_PROBE_READ_ROUNDS      4
+
+#define SD_PROBE_OCR_TIMEOUT_US   (1000 * 1000)
+#define SD_PROBE_OCR_POLL_US      10000
+
+// SEND_IF_COND: 2.7-3.6V, check pattern 0xAA
+#define SD_PROBE_CMD8_ARG         0x1AA
+// SD_SEND_OP_COND: HCS and 2.7-3.6V
+#define SD_PROBE_ACMD41_ARG       (MMC_HOST_OCR_HIGH_CAPACITY | 0x00FF8000)
+// SET_BUS_WIDTH to 4 bits
+#define SD_PROBE_ACMD6_ARG        0x2
+
+typedef struct {
+  EFI_HANDLE              Handle;
+  EFI_MMC_HOST_PROTOCOL   *Host;
+  MMC_HOST_CONTROLLER     Controller;
+  UINT64                  Nanoseconds;      // Best read time, 0 if the probe failed
+} SD_PROBE_HOST;
+
+STATIC EFI_EVENT mEndOfDxeEvent;
+
+STATIC
+EFI_STATUS
+SdProbeSendCommand (
+  IN  EFI_MMC_HOST_PROTOCOL *Host,
+  IN  MMC_CMD               Cmd,
+  IN  UINT32                Argument,
+  IN  MMC_RESPONSE_TYPE     Type,
+  OUT UINT32                *Response OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Buffer[4];
+
+  Status = Host->SendCommand (Host, Cmd, Argument);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Host->ReceiveResponse (Host, Type, Buffer);
+  if (!EFI_ERROR (Status) && Response != NULL) {
+    *Response = Buffer[0];
+  }
+  return Status;
+}
+
+/**
+  Bring the card to the transfer state with a 4-bit bus at high speed,
+  going through the same host calls as MmcDxe. Only SD cards are
+  handled, that is all the slot takes.
+
+**/
+STATIC
+EFI_STATUS
+SdProbeInitCard (
+  IN  EFI_MMC_HOST_PROTOCOL *Host
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Response;
+  UINT32      Rca;
+  UINT32      Ocr;
+  UINT32      SwitchStatus[MMC_HOST_SWITCH_STATUS_LENGTH / 4];
+  UINTN       Waited;
+
+  Status = Host->NotifyState (Host, MmcHwInitializationState);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (!Host->IsCardPresent (Host)) {
+    return EFI_NO_MEDIA;
+  }
+
+  Host->NotifyState (Host, MmcIdleState);
+  Status = Host->SendCommand (Host, MMC_CMD0, 0);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // SD 1.x cards don't know CMD8 and don't get HCS.
+  Ocr = SD_PROBE_ACMD41_ARG;
+  Status = SdProbeSendCommand (Host, MMC_CMD8, SD_PROBE_CMD8_ARG, MMC_RESPONSE_TYPE_R7, NULL);
+  if (EFI_ERROR (Status)) {
+    Ocr &= ~MMC_HOST_OCR_HIGH_CAPACITY;
+  }
+
+  for (Waited = 0; ; Waited += SD_PROBE_OCR_POLL_US) {
+    Status = SdProbeSendCommand (Host, MMC_CMD55, 0, MMC_RESPONSE_TYPE_R1, NULL);
+    if (!EFI_ERROR (Status)) {
+      Status = SdProbeSendCommand (Host, MMC_ACMD41, Ocr, MMC_RESPONSE_TYPE_R3, &Response);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if ((Response & MMC_HOST_OCR_POWER_UP) != 0) {
+      break;
+    }
+    if (Waited >= SD_PROBE_OCR_TIMEOUT_US) {
+      return EFI_TIMEOUT;
+    }
+    gBS->Stall (SD_PROBE_OCR_POLL_US);
+  }
+
+  Host->NotifyState (Host, MmcReadyState);
+  Status = SdProbeSendCommand (Host, MMC_CMD2, 0, MMC_RESPONSE_TYPE_R2, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Host->NotifyState (Host, MmcIdentificationState);
+  Status = SdProbeSendCommand (Host, MMC_CMD3, 0, MMC_RESPONSE_TYPE_R6, &Response);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Rca = Response >> MMC_HOST_RCA_SHIFT;
+
+  Status = Host->NotifyState (Host, MmcStandByState);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = SdProbeSendCommand (Host, MMC_CMD7, Rca << MMC_HOST_RCA_SHIFT, MMC_RESPONSE_TYPE_R1b, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Host->NotifyState (Host, MmcTransferState);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // A card that doesn't do high speed is left at default speed, which
+  // is the same handicap on both controllers.
+  //
+  Status = Host->SendCommand (Host, MMC_CMD6, MmcHostSwitchArgument (TRUE));
+  if (!EFI_ERROR (Status)) {
+    Status = Host->ReadBlockData (Host, 0, sizeof (SwitchStatus), SwitchStatus);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = SdProbeSendCommand (Host, MMC_CMD55, Rca << MMC_HOST_RCA_SHIFT, MMC_RESPONSE_TYPE_R1, NULL);
+  if (!EFI_ERROR (Status)) {
+    Status = SdProbeSendCommand (Host, MMC_CMD6, SD_PROBE_ACMD6_ARG, MMC_RESPONSE_TYPE_R1, NULL);
+  }
+  return Status;
+}
+
+/**
+  @return The best time in nanoseconds for reading SD_PROBE_READ_LENGTH
+          bytes from the start of the card, 0 if it couldn't be read.
+
+**/
+STATIC
+UINT64
+SdProbeTimeRead (
+  IN  EFI_MMC_HOST_PROTOCOL *Host,
+  IN  UINT32                *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      Start;
+  UINT64      Nanoseconds;
+  UINT64      Best;
+  UINTN       Round;
+
+  Best = 0;
+  for (Round = 0; Round < SD_PROBE_READ_ROUNDS; Round++) {
+    Start = GetPerformanceCounter ();
+    Status = Host->SendCommand (Host, MMC_CMD18, 0);
+    if (!EFI_ERROR (Status)) {
+      Status = Host->ReadBlockData (Host, 0, SD_PROBE_READ_LENGTH, Buffer);
+    }
+    if (!EFI_ERROR (Status)) {
+      Status = SdProbeSendCommand (Host, MMC_CMD12, 0, MMC_RESPONSE_TYPE_R1b, NULL);
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: read failed: %r\n", __FUNCTION__, Status));
+      return 0;
+    }
+
+    Nanoseconds = GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+    if (Best == 0 || Nanoseconds < Best) {
+      Best = MAX (Nanoseconds, 1);
+    }
+  }
+
+  return Best;
+}
+
+STATIC
+VOID
+SdProbeHost (
+  IN OUT SD_PROBE_HOST  *Probe,
+  IN     UINT32         *Buffer
+  )
+{
+  EFI_STATUS  Status;
+
+  MmcHostMuxSdSlot (Probe->Controller);
+
+  Status = SdProbeInitCard (Probe->Host);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: controller %u: card init failed: %r\n",
+      __FUNCTION__, Probe->Controller, Status));
+    Probe->Nanoseconds = 0;
+    return;
+  }
+
+  Probe->Nanoseconds = SdProbeTimeRead (Probe->Host, Buffer);
+  if (Probe->Nanoseconds != 0) {
+    DEBUG ((DEBUG_INFO, "%a: controller %u: %u KiB in %lu us, %lu KiB/s\n",
+      __FUNCTION__, Probe->Controller, SD_PROBE_READ_LENGTH / 1024,
+      DivU64x32 (Probe->Nanoseconds, 1000),
+      DivU64x64Remainder (MultU64x32 (SD_PROBE_READ_LENGTH / 1024, 1000000000),
+        Probe->Nanoseconds, NULL)));
+  }
+}
+
+/**
+  Find the host of each controller by the name it publishes its stats
+  under, which sits on the same handle as EFI_MMC_HOST_PROTOCOL.
+
+**/
+STATIC
+VOID
+SdProbeFindHosts (
+  OUT SD_PROBE_HOST   *Arasan,
+  OUT SD_PROBE_HOST   *SdHost
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_HANDLE                      *Handles;
+  UINTN                           HandleCount;
+  UINTN                           Index;
+  EFI_MMC_HOST_PROTOCOL           *Host;
+  RASPBERRY_PI_MMC_STATS_PROTOCOL *Stats;
+  SD_PROBE_HOST                   *Probe;
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gEfiMmcHostProtocolGuid,
+                  NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gRaspberryPiMmcStatsProtocolGuid,
+                    (VOID **) &Stats);
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    if (StrCmp (Stats->ControllerName, L"Arasan") == 0) {
+      Probe = Arasan;
+    } else if (StrCmp (Stats->ControllerName, L"SdHost") == 0) {
+      Probe = SdHost;
+    } else {
+      continue;
+    }
+
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiMmcHostProtocolGuid, (VOID **) &Host);
+    if (!EFI_ERROR (Status)) {
+      Probe->Handle = Handles[Index];
+      Probe->Host = Host;
+    }
+  }
+
+  FreePool (Handles);
+}
+
+STATIC
+VOID
+EFIAPI
+SdProbeOnEndOfDxe (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS      Status;
+  SD_PROBE_HOST   Arasan;
+  SD_PROBE_HOST   SdHost;
+  SD_PROBE_HOST   *Winner;
+  SD_PROBE_HOST   *Loser;
+  UINT32          *Buffer;
+
+  gBS->CloseEvent (Event);
+
+  ZeroMem (&Arasan, sizeof (Arasan));
+  ZeroMem (&SdHost, sizeof (SdHost));
+  Arasan.Controller = MmcHostControllerArasan;
+  SdHost.Controller = MmcHostControllerSdHost;
+  SdProbeFindHosts (&Arasan, &SdHost);
+
+  if (Arasan.Host == NULL || SdHost.Host == NULL) {
+    // Nothing to choose from, leave the slot with whoever is there.
+    Winner = (Arasan.Host != NULL) ? &Arasan : &SdHost;
+    DEBUG ((DEBUG_WARN, "%a: only controller %u loaded\n", __FUNCTION__, Winner->Controller));
+    MmcHostMuxSdSlot (Winner->Controller);
+    return;
+  }
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (SD_PROBE_READ_LENGTH));
+  if (Buffer != NULL) {
+    SdProbeHost (&Arasan, Buffer);
+    SdProbeHost (&SdHost, Buffer);
+    FreePages (Buffer, EFI_SIZE_TO_PAGES (SD_PROBE_READ_LENGTH));
+  }
+
+  //
+  // Arasan has been the default all along, so it wins ties and the case
+  // where neither could read (no card yet, say).
+  //
+  if (SdHost.Nanoseconds != 0 &&
+      (Arasan.Nanoseconds == 0 || SdHost.Nanoseconds < Arasan.Nanoseconds)) {
+    Winner = &SdHost;
+    Loser = &Arasan;
+  } else {
+    Winner = &Arasan;
+    Loser = &SdHost;
+  }
+
+  MmcHostMuxSdSlot (Winner->Controller);
+
+  Status = gBS->UninstallMultipleProtocolInterfaces (Loser->Handle,
+                  &gEfiMmcHostProtocolGuid, Loser->Host,
+                  NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: failed to retire controller %u: %r\n",
+      __FUNCTION__, Loser->Controller, Status));
+    return;
+  }
+
+  DEBUG ((DEBUG_INFO, "%a: SD slot served by controller %u\n", __FUNCTION__, Winner->Controller));
+}
+
+EFI_STATUS
+EFIAPI
+SdProbeDxeInitialize (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  )
+{
+  if (PcdGet32 (PcdSdController) != MmcHostControllerProbe) {
+    return EFI_UNSUPPORTED;
+  }
+
+  return gBS->CreateEventEx (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, SdProbeOnEndOfDxe,
+                NULL, &gEfiEndOfDxeEventGroupGuid, &mEndOfDxeEvent);
+}
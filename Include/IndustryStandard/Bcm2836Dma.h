@@ -0,0 +1,108 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BCM2836DMA_H__
+#define __BCM2836DMA_H__
+
+//
+// System DMA controller. Channels 0-14 live in one 4K page, channel 15
+// is elsewhere and is not used here. Channels 7 and above are "lite"
+// channels, limited to 64K transfers, so DMA users should stay below 7.
+//
+#define BCM2836_DMA_BASE_ADDRESS            (BCM2836_SOC_REGISTERS + 0x00007000)
+#define BCM2836_DMA_NUM_CHANNELS            15
+#define BCM2836_DMA_NUM_FULL_CHANNELS       7
+#define BCM2836_DMA_CHANNEL_REG(Ch, X)      (BCM2836_DMA_BASE_ADDRESS + ((Ch) * 0x100) + (X))
+#define BCM2836_DMA_CS(Ch)                  BCM2836_DMA_CHANNEL_REG(Ch, 0x0)
+#define BCM2836_DMA_CONBLK_AD(Ch)           BCM2836_DMA_CHANNEL_REG(Ch, 0x4)
+#define BCM2836_DMA_TI(Ch)                  BCM2836_DMA_CHANNEL_REG(Ch, 0x8)
+#define BCM2836_DMA_SOURCE_AD(Ch)           BCM2836_DMA_CHANNEL_REG(Ch, 0xC)
+#define BCM2836_DMA_DEST_AD(Ch)             BCM2836_DMA_CHANNEL_REG(Ch, 0x10)
+#define BCM2836_DMA_TXFR_LEN(Ch)            BCM2836_DMA_CHANNEL_REG(Ch, 0x14)
+#define BCM2836_DMA_STRIDE(Ch)              BCM2836_DMA_CHANNEL_REG(Ch, 0x18)
+#define BCM2836_DMA_NEXTCONBK(Ch)           BCM2836_DMA_CHANNEL_REG(Ch, 0x1C)
+#define BCM2836_DMA_DEBUG(Ch)               BCM2836_DMA_CHANNEL_REG(Ch, 0x20)
+#define BCM2836_DMA_INT_STATUS              (BCM2836_DMA_BASE_ADDRESS + 0xFE0)
+#define BCM2836_DMA_ENABLE                  (BCM2836_DMA_BASE_ADDRESS + 0xFF0)
+
+//
+// CS
+//
+#define BCM2836_DMA_CS_ACTIVE               BIT0
+#define BCM2836_DMA_CS_END                  BIT1
+#define BCM2836_DMA_CS_INT                  BIT2
+#define BCM2836_DMA_CS_DREQ                 BIT3
+#define BCM2836_DMA_CS_PAUSED               BIT4
+#define BCM2836_DMA_CS_WAITING_FOR_WRITES   BIT6
+#define BCM2836_DMA_CS_ERROR                BIT8
+#define BCM2836_DMA_CS_PRIORITY(X)          (((X) & 0xF) << 16)
+#define BCM2836_DMA_CS_PANIC_PRIORITY(X)    (((X) & 0xF) << 20)
+#define BCM2836_DMA_CS_WAIT_FOR_WRITES      BIT28
+#define BCM2836_DMA_CS_DISDEBUG             BIT29
+#define BCM2836_DMA_CS_ABORT                BIT30
+#define BCM2836_DMA_CS_RESET                BIT31
+
+//
+// TI (also the first word of a control block)
+//
+#define BCM2836_DMA_TI_INTEN                BIT0
+#define BCM2836_DMA_TI_WAIT_RESP            BIT3
+#define BCM2836_DMA_TI_DEST_INC             BIT4
+#define BCM2836_DMA_TI_DEST_WIDTH_128       BIT5
+#define BCM2836_DMA_TI_DEST_DREQ            BIT6
+#define BCM2836_DMA_TI_SRC_INC              BIT8
+#define BCM2836_DMA_TI_SRC_WIDTH_128        BIT9
+#define BCM2836_DMA_TI_SRC_DREQ             BIT10
+#define BCM2836_DMA_TI_BURST_LENGTH(X)      (((X) & 0xF) << 12)
+#define BCM2836_DMA_TI_PERMAP(X)            (((X) & 0x1F) << 16)
+#define BCM2836_DMA_TI_WAITS(X)             (((X) & 0x1F) << 21)
+#define BCM2836_DMA_TI_NO_WIDE_BURSTS       BIT26
+
+//
+// DEBUG
+//
+#define BCM2836_DMA_DEBUG_READ_LAST_NOT_SET BIT0
+#define BCM2836_DMA_DEBUG_FIFO_ERROR        BIT1
+#define BCM2836_DMA_DEBUG_READ_ERROR        BIT2
+#define BCM2836_DMA_DEBUG_ERRORS            (BCM2836_DMA_DEBUG_READ_LAST_NOT_SET | \
+                                             BCM2836_DMA_DEBUG_FIFO_ERROR | \
+                                             BCM2836_DMA_DEBUG_READ_ERROR)
+
+//
+// Peripheral DREQ lines, for BCM2836_DMA_TI_PERMAP.
+//
+#define BCM2836_DMA_DREQ_EMMC               11
+#define BCM2836_DMA_DREQ_SDHOST             13
+
+//
+// The DMA engine sees peripherals at their VC bus addresses.
+//
+#define BCM2836_PERIPHERAL_BUS_ADDRESS(X)   ((X) - BCM2836_SOC_REGISTERS + 0x7E000000)
+
+//
+// Control blocks must be 32-byte aligned.
+//
+#define BCM2836_DMA_CB_ALIGNMENT            32
+
+typedef struct {
+  UINT32 TransferInformation;
+  UINT32 SourceAddress;
+  UINT32 DestinationAddress;
+  UINT32 TransferLength;
+  UINT32 Stride;
+  UINT32 NextControlBlock;
+  UINT32 Reserved[2];
+} BCM2836_DMA_CONTROL_BLOCK;
+
+#endif //__BCM2836DMA_H__
@@ -0,0 +1,45 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BCM2836GPIO_H__
+#define __BCM2836GPIO_H__
+
+//
+// GPIO function select. Each GPFSELn register holds the 3-bit functions
+// of ten pins, starting with pin n * 10.
+//
+#define BCM2836_GPIO_BASE_ADDRESS           (BCM2836_SOC_REGISTERS + 0x00200000)
+#define BCM2836_GPIO_GPFSEL(Pin)            (BCM2836_GPIO_BASE_ADDRESS + ((Pin) / 10) * 4)
+#define BCM2836_GPIO_GPFSEL_SHIFT(Pin)      (((Pin) % 10) * 3)
+#define BCM2836_GPIO_GPFSEL_MASK            0x7
+
+#define BCM2836_GPIO_FSEL_INPUT             0x0
+#define BCM2836_GPIO_FSEL_OUTPUT            0x1
+#define BCM2836_GPIO_FSEL_ALT0              0x4
+#define BCM2836_GPIO_FSEL_ALT1              0x5
+#define BCM2836_GPIO_FSEL_ALT2              0x6
+#define BCM2836_GPIO_FSEL_ALT3              0x7
+#define BCM2836_GPIO_FSEL_ALT4              0x3
+#define BCM2836_GPIO_FSEL_ALT5              0x2
+
+//
+// The SD slot: CLK, CMD and DAT0-3 on GPIO 48-53. ALT0 routes them to
+// SdHost, ALT3 to the Arasan controller.
+//
+#define BCM2836_GPIO_SD_SLOT_FIRST_PIN      48
+#define BCM2836_GPIO_SD_SLOT_LAST_PIN       53
+#define BCM2836_GPIO_SD_SLOT_FSEL_SDHOST    BCM2836_GPIO_FSEL_ALT0
+#define BCM2836_GPIO_SD_SLOT_FSEL_ARASAN    BCM2836_GPIO_FSEL_ALT3
+
+#endif //__BCM2836GPIO_H__
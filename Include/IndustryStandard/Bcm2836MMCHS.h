@@ -18,6 +18,8 @@
 //MMC/SD/SDIO1 register definitions.
 #define MMCHS1BASE        0x3F300000
 
+#define MMCHS_ARG2        (MMCHS1BASE + 0x0)
+
 #define MMCHS_BLK         (MMCHS1BASE + 0x4)
 #define BLEN_512BYTES     (0x200UL << 0)
 
@@ -25,6 +27,9 @@
 
 #define MMCHS_CMD         (MMCHS1BASE + 0xC)
 #define BCE_ENABLE        BIT1
+#define ACEN_ACMD12       BIT2
+#define ACEN_ACMD23       BIT3
+#define ACEN_MASK         (0x3UL << 2)
 #define DDIR_READ         BIT4
 #define DDIR_WRITE        (0x0UL << 4)
 #define MSBS_SGLEBLK      (0x0UL << 5)
@@ -37,6 +42,7 @@
 #define CICE_ENABLE       BIT20
 #define DP_ENABLE         BIT21
 #define INDX(CMD_INDX)    ((CMD_INDX & 0x3F) << 24)
+#define CMD_INDEX(Cmd)    (((Cmd) >> 24) & 0x3F)
 
 #define MMCHS_RSP10       (MMCHS1BASE + 0x10)
 #define MMCHS_RSP32       (MMCHS1BASE + 0x14)
@@ -51,11 +57,13 @@
 #define DATI_MASK         BIT1
 #define DATI_ALLOWED      (0x0UL << 1)
 #define DATI_NOT_ALLOWED  BIT1
+#define CARD_INSERTED     BIT16
 #define WRITE_PROTECT_OFF BIT19
 
 #define MMCHS_HCTL        (MMCHS1BASE + 0x28)
 #define DTW_1_BIT         (0x0UL << 1)
 #define DTW_4_BIT         BIT1
+#define DTW_8_BIT         BIT5
 #define SDBP_MASK         BIT8
 #define SDBP_OFF          (0x0UL << 8)
 #define SDBP_ON           BIT8
@@ -85,6 +93,7 @@
 #define BWR               BIT4
 #define BRR               BIT5
 #define CARD_INS          BIT6
+#define CARD_REM          BIT7
 #define ERRI              BIT15
 #define CTO               BIT16
 #define DTO               BIT20
@@ -123,13 +132,20 @@
 #define BADA_SIGEN        BIT29
 
 #define MMCHS_AC12        (MMCHS1BASE + 0x3C)
+#define UHS_MODE_MASK     (0x7UL << 16)
+#define UHS_MODE_DDR50    (0x4UL << 16)
 
 #define MMCHS_CAPA        (MMCHS1BASE + 0x40)
 #define VS30              BIT25
 #define VS18              BIT26
 
+#define MMCHS_CAPA2       (MMCHS1BASE + 0x44)
+#define DDR50_SUPPORT     BIT2
+
 #define MMCHS_CUR_CAPA    (MMCHS1BASE + 0x48)
 #define MMCHS_REV         (MMCHS1BASE + 0xFC)
+#define SREV_MASK         (0xFFUL << 16)
+#define SREV_3_00         (0x2UL << 16)
 
 #define BLOCK_COUNT_SHIFT 16
 #define RCA_SHIFT         16
@@ -153,9 +169,11 @@
 #define CMD4              (INDX(4)) // Set DSR
 #define CMD5              (INDX(5) | CMD_R1B) // SDIO: Sleep/Awake
 #define CMD6              (INDX(6) | CMD_R1_ADTC_READ) // Switch
+#define CMD6_MMC          (INDX(6) | CMD_R1B) // MMC: Switch (EXT_CSD write)
 #define CMD7              (INDX(7) | CMD_R1B) // Select/Deselect
 #define CMD8              (INDX(8) | CMD_R7) // Send If Cond
 #define CMD8_ARG          (0x0UL << 12 | BIT8 | 0xCEUL << 0)
+#define CMD8_MMC          (INDX(8) | CMD_R1_ADTC_READ) // MMC: Send EXT_CSD
 #define CMD9              (INDX(9) | CMD_R2) // Send CSD
 #define CMD10             (INDX(10) | CMD_R2) // Send CID
 #define CMD11             (INDX(11) | CMD_R1) // Voltage Switch
@@ -170,9 +188,16 @@
 #define CMD23             (INDX(23) | CMD_R1) // Set Block Count for CMD18 and CMD25
 #define CMD24             (INDX(24) | CMD_R1_ADTC_WRITE) // Write Block
 #define CMD25             (INDX(25) | CMD_R1_ADTC_WRITE | MSBS_MULTBLK | BCE_ENABLE) // Write Multiple Blocks
+#define CMD32             (INDX(32) | CMD_R1) // SD: Erase Write Block Start
+#define CMD33             (INDX(33) | CMD_R1) // SD: Erase Write Block End
+#define CMD35             (INDX(35) | CMD_R1) // MMC: Erase Group Start
+#define CMD36             (INDX(36) | CMD_R1) // MMC: Erase Group End
+#define CMD38             (INDX(38) | CMD_R1) // Erase (busy is polled with CMD13, it can outlast any data timeout)
 #define CMD55             (INDX(55) | CMD_R1) // App Cmd
 
 #define ACMD6             (INDX(6) | CMD_R1) // Set Bus Width
+#define ACMD13            (INDX(13) | CMD_R1_ADTC_READ) // Send SD Status (SSR)
+#define ACMD23            (INDX(23) | CMD_R1) // Set Write Block Erase Count
 #define ACMD41            (INDX(41) | CMD_R3) // Send Op Cond
 #define ACMD51            (INDX(51) | CMD_R1_ADTC_READ) // Send SCR
 
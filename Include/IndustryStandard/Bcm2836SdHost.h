@@ -45,6 +45,11 @@
 #define SDHOST_CMD_FAIL_FLAG                    BIT14
 #define SDHOST_CMD_NEW_FLAG                     BIT15
 
+//
+// CDIV
+//
+#define SDHOST_CDIV_MAX             0x7FF
+
 //
 // VDD
 //
@@ -79,7 +84,17 @@
 //
 // EDM
 //
+#define SDHOST_EDM_FORCE_DATA_MODE          BIT19
 #define SDHOST_EDM_FIFO_CLEAR               BIT21
+#define SDHOST_EDM_FSM_MASK                 0xF
+#define SDHOST_EDM_FSM_IDENTMODE            0x0
+#define SDHOST_EDM_FSM_DATAMODE             0x1
+#define SDHOST_EDM_FSM_READWAIT             0x4
+#define SDHOST_EDM_FSM_WRITEWAIT1           0x7
+#define SDHOST_EDM_FSM_WRITESTART1          0xA
+#define SDHOST_EDM_FSM_WRITEWAIT2           0xD
+#define SDHOST_EDM_FIFO_LEVEL(Edm)          (((Edm) >> 4) & 0x1F)
+#define SDHOST_FIFO_WORDS                   16
 #define SDHOST_EDM_WRITE_THRESHOLD_SHIFT    9
 #define SDHOST_EDM_READ_THRESHOLD_SHIFT     14
 #define SDHOST_EDM_THRESHOLD_MASK           0x1F
@@ -57,6 +57,7 @@
 #define RPI_FW_GET_CLOCK_RATE                               0x00030002
 #define RPI_FW_GET_MAX_CLOCK_RATE                           0x00030004
 #define RPI_FW_GET_MIN_CLOCK_RATE                           0x00030007
+#define RPI_FW_SET_CLOCK_RATE                               0x00038002
 
 #define RPI_FW_GET_FB_GEOMETRY                              0x00040003
 #define RPI_FW_GET_FB_LINELENGTH                            0x00040008
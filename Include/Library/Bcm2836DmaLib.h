@@ -0,0 +1,93 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BCM2836_DMA_LIB_H__
+#define __BCM2836_DMA_LIB_H__
+
+#include <IndustryStandard/Bcm2836Dma.h>
+
+//
+// Each control block moves at most this many bytes; a transfer is
+// split into a chain of control blocks, up to one page worth of them.
+//
+#define BCM2836_DMA_CB_MAX_LENGTH     SIZE_64KB
+#define BCM2836_DMA_MAX_CBS           (EFI_PAGE_SIZE / sizeof (BCM2836_DMA_CONTROL_BLOCK))
+#define BCM2836_DMA_MAX_LENGTH        (BCM2836_DMA_MAX_CBS * BCM2836_DMA_CB_MAX_LENGTH)
+
+typedef enum {
+  Bcm2836DmaToDevice,
+  Bcm2836DmaFromDevice
+} BCM2836_DMA_DIRECTION;
+
+/**
+  Map Buffer for DMA and start a DREQ-paced transfer between it and a
+  32-bit peripheral FIFO register.
+
+  @param[in]  Channel        DMA channel to use (0-6).
+  @param[in]  Dreq           Peripheral DREQ line pacing the transfer.
+  @param[in]  Direction      Whether Buffer is the source or the destination.
+  @param[in]  FifoAddress    CPU address of the peripheral FIFO register.
+  @param[in]  Buffer         Memory buffer, 32-bit aligned.
+  @param[in]  Length         Transfer length in bytes, multiple of 4.
+
+  @retval EFI_SUCCESS            Transfer started.
+  @retval EFI_INVALID_PARAMETER  Bad channel, alignment or length.
+  @retval EFI_BAD_BUFFER_SIZE    Length exceeds BCM2836_DMA_MAX_LENGTH.
+  @retval EFI_OUT_OF_RESOURCES   Buffer could not be mapped.
+  @retval EFI_ALREADY_STARTED    A transfer is already in flight on Channel.
+
+**/
+EFI_STATUS
+EFIAPI
+Bcm2836DmaStart (
+  IN  UINTN                 Channel,
+  IN  UINTN                 Dreq,
+  IN  BCM2836_DMA_DIRECTION Direction,
+  IN  UINTN                 FifoAddress,
+  IN  VOID                  *Buffer,
+  IN  UINTN                 Length
+  );
+
+/**
+  Check on a transfer started with Bcm2836DmaStart. Once it returns
+  anything but EFI_NOT_READY, the buffer has been unmapped and the
+  channel is free for the next transfer.
+
+  @param[in]  Channel        DMA channel.
+
+  @retval EFI_SUCCESS        Transfer done.
+  @retval EFI_NOT_READY      Transfer still in progress.
+  @retval EFI_DEVICE_ERROR   The DMA engine reported an error.
+  @retval EFI_NOT_STARTED    No transfer was started on Channel.
+
+**/
+EFI_STATUS
+EFIAPI
+Bcm2836DmaPoll (
+  IN  UINTN                 Channel
+  );
+
+/**
+  Abort a transfer started with Bcm2836DmaStart and unmap its buffer.
+
+  @param[in]  Channel        DMA channel.
+
+**/
+VOID
+EFIAPI
+Bcm2836DmaAbort (
+  IN  UINTN                 Channel
+  );
+
+#endif /* __BCM2836_DMA_LIB_H__ */
@@ -0,0 +1,548 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __MMC_HOST_COMMON_LIB_H__
+#define __MMC_HOST_COMMON_LIB_H__
+
+#include <Protocol/EraseBlock.h>
+#include <Protocol/RaspberryPiMmcStats.h>
+
+#define MMC_HOST_BLOCK_SIZE             512
+
+//
+// Commands are tracked by their stats slot: the command index for CMDn,
+// MMC_HOST_APP_COMMAND (n) for ACMDn.
+//
+#define MMC_HOST_APP_COMMAND(Index)     ((Index) + MMC_STATS_APP_COMMAND_BASE)
+#define MMC_HOST_NO_COMMAND             MAX_UINT32
+
+//
+// Card register fields both hosts care about.
+//
+#define MMC_HOST_RCA_SHIFT              16
+#define MMC_HOST_OCR_POWER_UP           BIT31
+#define MMC_HOST_OCR_HIGH_CAPACITY      BIT30 // SD CCS, or eMMC sector addressing
+#define MMC_HOST_R1_READY_FOR_DATA      BIT8
+#define MMC_HOST_R1_CURRENT_STATE(R1)   (((R1) >> 9) & 0xF)
+#define MMC_HOST_R1_STATE_TRAN          4
+
+#define MMC_HOST_SCR_LENGTH             8
+#define MMC_HOST_SSR_LENGTH             64
+
+//
+// SD CMD6 on function group 1 (access mode), and the 512-bit switch
+// status it returns.
+//
+#define MMC_HOST_SWITCH_MODE_SET        BIT31
+#define MMC_HOST_SWITCH_GROUP1_MASK     0xF
+#define MMC_HOST_SWITCH_HIGH_SPEED      0x1
+#define MMC_HOST_SWITCH_ARGUMENT(Mode, Group1) ((Mode) | 0x00FFFFF0 | (Group1))
+#define MMC_HOST_SWITCH_STATUS_LENGTH   64
+
+#define MMC_HOST_IDENT_CLOCK_HZ         (400 * 1000)
+#define MMC_HOST_DEFAULT_SPEED_CLOCK_HZ (25 * 1000 * 1000)
+#define MMC_HOST_HIGH_SPEED_CLOCK_HZ    (50 * 1000 * 1000)
+
+// SD writes closed by CMD12 this long are announced with ACMD23, so the
+// card can pre-erase
+#define MMC_HOST_PRE_ERASE_MIN_BLOCKS   128
+
+typedef struct {
+  BOOLEAN   Cmd23;                      // SET_BLOCK_COUNT supported
+  BOOLEAN   BusWidth4;                  // 4-bit data bus supported
+} MMC_HOST_SCR;
+
+//
+// Controllers that can be muxed to the SD slot, numbered as in
+// PcdSdController.
+//
+typedef enum {
+  MmcHostControllerArasan = 0,
+  MmcHostControllerSdHost = 1,
+  MmcHostControllerProbe  = 2           // Policy only: both load, SdProbeDxe picks
+} MMC_HOST_CONTROLLER;
+
+/**
+  Called after a signalled clock rate change has dropped the cached
+  firmware clock rates, so the host can reprogram its divisor.
+
+**/
+typedef
+VOID
+(EFIAPI *MMC_HOST_CLOCK_CHANGED) (
+  VOID
+  );
+
+/**
+  Erases Blocks blocks from Lba on. Called at TPL_CALLBACK once the
+  request has been checked against the media.
+
+  @retval EFI_NO_MEDIA           The card is gone.
+  @retval EFI_INVALID_PARAMETER  The host can't erase that range.
+  @retval EFI_NOT_READY          A transfer is in flight.
+  @retval Others                 The erase failed.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *MMC_HOST_ERASE) (
+  IN  EFI_LBA               Lba,
+  IN  UINT64                Blocks
+  );
+
+/**
+  Set up the timer, stats, firmware clock cache and erase support of
+  an SD host driver.
+
+  @param[in]  ControllerName  Name published with the stats.
+  @param[in]  DevicePathGuid  Vendor GUID of the card device path the
+                              host builds, where erase support goes.
+  @param[in]  ClockChanged    Called when the firmware changes a clock.
+  @param[in]  Erase           Issues an erase, NULL if the host can't.
+
+  @retval EFI_SUCCESS         Ready to go.
+  @retval Others              The firmware protocol could not be found.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcHostCommonInit (
+  IN  CONST CHAR16            *ControllerName,
+  IN  CONST EFI_GUID          *DevicePathGuid,
+  IN  MMC_HOST_CLOCK_CHANGED  ClockChanged OPTIONAL,
+  IN  MMC_HOST_ERASE          Erase OPTIONAL
+  );
+
+/**
+  Apply PcdSdController on behalf of a host driver, before it touches
+  the controller. The controller picked gets the SD slot pins; in probe
+  mode the pins are left to SdProbeDxe.
+
+  @param[in]  Controller      The controller the caller drives.
+
+  @retval EFI_SUCCESS         The caller serves (or may serve) the SD slot.
+  @retval EFI_UNSUPPORTED     The policy picked the other controller.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcHostClaimSdSlot (
+  IN  MMC_HOST_CONTROLLER     Controller
+  );
+
+/**
+  Route the SD slot pins (GPIO 48-53) to Controller.
+
+**/
+VOID
+EFIAPI
+MmcHostMuxSdSlot (
+  IN  MMC_HOST_CONTROLLER     Controller
+  );
+
+/**
+  Stats protocol to be installed next to EFI_MMC_HOST_PROTOCOL.
+
+**/
+RASPBERRY_PI_MMC_STATS_PROTOCOL *
+EFIAPI
+MmcHostGetStatsProtocol (
+  VOID
+  );
+
+//
+// Generic timer deadlines. Polling loops spin on the register and only
+// read the counter, there is no stalling between polls.
+//
+
+UINT64
+EFIAPI
+MmcHostGetTicks (
+  VOID
+  );
+
+UINT64
+EFIAPI
+MmcHostTicksToUs (
+  IN  UINT64                Ticks
+  );
+
+/**
+  @return The timer count TimeoutUs microseconds from now.
+
+**/
+UINT64
+EFIAPI
+MmcHostDeadline (
+  IN  UINT64                TimeoutUs
+  );
+
+BOOLEAN
+EFIAPI
+MmcHostDeadlinePassed (
+  IN  UINT64                Deadline
+  );
+
+/**
+  Spin until (Register & Mask) == Value. The time spent and the reads
+  made are charged to the operation in flight.
+
+  @retval EFI_SUCCESS        The register has the value.
+  @retval EFI_TIMEOUT        It didn't within TimeoutUs.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcHostPollRegister (
+  IN  UINTN                 Register,
+  IN  UINT32                Mask,
+  IN  UINT32                Value,
+  IN  UINT64                TimeoutUs
+  );
+
+/**
+  Charge the time since Start to the poll time of the operation in flight.
+
+**/
+VOID
+EFIAPI
+MmcHostAccountPoll (
+  IN  UINT64                Start
+  );
+
+//
+// Controller register accessors. They are IoLib's, except that every
+// access is counted, in total and against the operation in flight.
+//
+
+UINT32
+EFIAPI
+MmcHostMmioRead32 (
+  IN  UINTN                 Register
+  );
+
+VOID
+EFIAPI
+MmcHostMmioWrite32 (
+  IN  UINTN                 Register,
+  IN  UINT32                Value
+  );
+
+VOID
+EFIAPI
+MmcHostMmioAndThenOr32 (
+  IN  UINTN                 Register,
+  IN  UINT32                AndData,
+  IN  UINT32                OrData
+  );
+
+VOID
+EFIAPI
+MmcHostMmioOr32 (
+  IN  UINTN                 Register,
+  IN  UINT32                OrData
+  );
+
+VOID
+EFIAPI
+MmcHostMmioAnd32 (
+  IN  UINTN                 Register,
+  IN  UINT32                AndData
+  );
+
+//
+// Command tracking and stats.
+//
+
+/**
+  @return TRUE if the last command completed was CMD55, i.e. the next
+          one is an application command.
+
+**/
+BOOLEAN
+EFIAPI
+MmcHostIsAppCommand (
+  VOID
+  );
+
+/**
+  @return The slot of command Index if it was issued now.
+
+**/
+UINT32
+EFIAPI
+MmcHostCommandSlot (
+  IN  UINT32                Index
+  );
+
+/**
+  @return The slot of the last command completed, or MMC_HOST_NO_COMMAND.
+
+**/
+UINT32
+EFIAPI
+MmcHostLastCommand (
+  VOID
+  );
+
+/**
+  Record the command in Slot as the last one, for commands the host
+  handles without the card, or to restore the last command seen by
+  MmcDxe after the host issued commands of its own.
+
+**/
+VOID
+EFIAPI
+MmcHostSetLastCommand (
+  IN  UINT32                Slot
+  );
+
+/**
+  Start accounting an operation: clears the poll time and register
+  access counts and returns the timer count to pass to MmcHostStatsRecord.
+
+**/
+UINT64
+EFIAPI
+MmcHostStatsStart (
+  VOID
+  );
+
+RASPBERRY_PI_MMC_COMMAND_STATS *
+EFIAPI
+MmcHostStatsEntry (
+  IN  UINT32                Slot
+  );
+
+/**
+  Account one completed (or failed) operation started at Start,
+  along with the poll time and register accesses gathered since.
+
+**/
+VOID
+EFIAPI
+MmcHostStatsRecord (
+  IN  RASPBERRY_PI_MMC_COMMAND_STATS  *Stats,
+  IN  UINT64                          Start,
+  IN  UINTN                           Bytes,
+  IN  EFI_STATUS                      Status
+  );
+
+/**
+  Leave a data command's stats open until its data has moved.
+
+**/
+VOID
+EFIAPI
+MmcHostStatsDeferData (
+  IN  RASPBERRY_PI_MMC_COMMAND_STATS  *Stats,
+  IN  UINT64                          Start
+  );
+
+/**
+  Account the data command left open by MmcHostStatsDeferData, if any.
+
+**/
+VOID
+EFIAPI
+MmcHostStatsDataDone (
+  IN  UINTN                 Bytes,
+  IN  EFI_STATUS            Status
+  );
+
+/**
+  @return The stats of the data command left open, or NULL.
+
+**/
+RASPBERRY_PI_MMC_COMMAND_STATS *
+EFIAPI
+MmcHostStatsData (
+  VOID
+  );
+
+/**
+  Start timing a PIO transfer.
+
+  @return The Start to hand to MmcHostStatsPio.
+
+**/
+UINT64
+EFIAPI
+MmcHostStatsPioStart (
+  VOID
+  );
+
+/**
+  Account Words words moved through a data FIFO by the CPU since Start,
+  along with the register accesses made meanwhile.
+
+**/
+VOID
+EFIAPI
+MmcHostStatsPio (
+  IN  UINTN                 Words,
+  IN  UINT64                Start
+  );
+
+//
+// Clocks.
+//
+
+/**
+  Return a firmware clock rate, only asking the VideoCore the first
+  time or after a clock change was signalled.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcHostGetClockRate (
+  IN  UINT32                ClockId,
+  OUT UINT32                *Rate
+  );
+
+/**
+  @return The smallest divider of BaseHz that doesn't exceed TargetHz,
+          at least 1.
+
+**/
+UINT32
+EFIAPI
+MmcHostClockDivider (
+  IN  UINT32                BaseHz,
+  IN  UINTN                 TargetHz
+  );
+
+//
+// Card registers.
+//
+
+/**
+  Line up a long response read from the four response registers so
+  that CID/CSD bit N is bit N of Response, as MmcDxe expects.
+
+  @param[in, out]  Response   The four registers, least significant first.
+  @param[in]       ShiftDown  TRUE if the registers hold the response a byte
+                              higher than that, FALSE if a byte lower (the
+                              CRC is left out, as on SDHCI).
+
+**/
+VOID
+EFIAPI
+MmcHostDecodeR2 (
+  IN OUT UINT32             *Response,
+  IN     BOOLEAN            ShiftDown
+  );
+
+/**
+  @return The clock the CSD TRAN_SPEED field allows, 0 if it is invalid.
+
+**/
+UINT32
+EFIAPI
+MmcHostTranSpeedToHz (
+  IN  UINT8                 TranSpeed
+  );
+
+VOID
+EFIAPI
+MmcHostParseScr (
+  IN  CONST UINT8           *Scr,
+  OUT MMC_HOST_SCR          *Info
+  );
+
+/**
+  Build the CMD6 argument checking for, or switching to, high speed.
+
+**/
+UINT32
+EFIAPI
+MmcHostSwitchArgument (
+  IN  BOOLEAN               Set
+  );
+
+/**
+  Check the switch status returned for MmcHostSwitchArgument (Set).
+
+  @retval EFI_SUCCESS        The card supports (check) or switched to
+                             (set) high speed.
+  @retval EFI_UNSUPPORTED    It doesn't or didn't.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcHostCheckSwitchStatus (
+  IN  CONST UINT8           *SwitchStatus,
+  IN  BOOLEAN               Set
+  );
+
+//
+// Erase. EFI_ERASE_BLOCK_PROTOCOL goes on MmcDxe's card handle once it
+// shows up; requests end up in the MMC_HOST_ERASE given at init.
+//
+
+/**
+  Forget what is known about the card's erase unit, on card init.
+
+**/
+VOID
+EFIAPI
+MmcHostEraseReset (
+  VOID
+  );
+
+/**
+  Erase granularity from the CSD: SDSC cards erase whole sectors unless
+  ERASE_BLK_EN is set, MMC erases whole erase groups.
+
+**/
+VOID
+EFIAPI
+MmcHostEraseParseCsd (
+  IN  CONST UINT32          *Csd,
+  IN  BOOLEAN               IsMmc
+  );
+
+/**
+  Allocation unit and erase timing from the SD Status.
+
+**/
+VOID
+EFIAPI
+MmcHostEraseParseSsr (
+  IN  CONST UINT8           *Ssr
+  );
+
+VOID
+EFIAPI
+MmcHostEraseSetGranularity (
+  IN  UINT32                Blocks
+  );
+
+UINT32
+EFIAPI
+MmcHostEraseGranularity (
+  VOID
+  );
+
+/**
+  @return How long to let an erase of Blocks blocks run.
+
+**/
+UINT64
+EFIAPI
+MmcHostEraseTimeoutUs (
+  IN  UINT64                Blocks
+  );
+
+#endif /* __MMC_HOST_COMMON_LIB_H__ */
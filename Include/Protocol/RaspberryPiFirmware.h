@@ -37,6 +37,10 @@ EFI_STATUS
   OUT CHAR8     CommandLine[]
   );
 
+//
+// Callers may cache clock rates: SetClockRate signals the
+// gRaspberryPiClockRateChangedGuid event group once a rate changed.
+//
 typedef
 EFI_STATUS
 (EFIAPI *GET_CLOCK_RATE) (
@@ -44,6 +48,13 @@ EFI_STATUS
   OUT UINT32    *ClockRate
   );
 
+typedef
+EFI_STATUS
+(EFIAPI *SET_CLOCK_RATE) (
+  IN  UINT32    ClockId,
+  IN  UINT32    ClockRate
+  );
+
 typedef
 EFI_STATUS
 (EFIAPI *GET_FB) (
@@ -74,6 +85,16 @@ VOID
   BOOLEAN On
   );
 
+//
+// Record that I/O happened. The activity LED is updated from a timer,
+// so this is cheap enough to call for every block.
+//
+typedef
+VOID
+(EFIAPI *NOTIFY_LED_ACTIVITY) (
+  VOID
+  );
+
 typedef
 EFI_STATUS
 (EFIAPI *GET_SERIAL) (
@@ -100,6 +121,8 @@ typedef struct {
   SET_LED           SetLed;
   GET_SERIAL        GetSerial;
   GET_ARM_MEM       GetArmMem;
+  NOTIFY_LED_ACTIVITY NotifyLedActivity;
+  SET_CLOCK_RATE    SetClockRate;
 } RASPBERRY_PI_FIRMWARE_PROTOCOL;
 
 extern EFI_GUID gRaspberryPiFirmwareProtocolGuid;
@@ -0,0 +1,79 @@
+//
+// Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+//
+// This program and the accompanying materials
+// are licensed and made available under the terms and conditions of the BSD License
+// which accompanies this distribution.  The full text of the license may be found at
+// http://opensource.org/licenses/bsd-license.php
+//
+// THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+// WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+//
+
+#ifndef __RASPBERRY_PI_MMC_STATS_PROTOCOL_H__
+#define __RASPBERRY_PI_MMC_STATS_PROTOCOL_H__
+
+#define RASPBERRY_PI_MMC_STATS_PROTOCOL_GUID \
+  { 0xE58E8AE3, 0x73B3, 0x4F63, { 0xA7, 0x30, 0x89, 0x4E, 0x39, 0xAD, 0x2B, 0x51 } }
+
+//
+// Commands are indexed by their SD command number; application
+// commands (ACMDn) live at MMC_STATS_APP_COMMAND_BASE + n.
+//
+#define MMC_STATS_APP_COMMAND_BASE  64
+#define MMC_STATS_NUM_COMMANDS      128
+
+//
+// Latency histogram bucket N counts operations that took
+// [2^N, 2^(N+1)) timer ticks; bucket 0 also takes 0 and 1 tick.
+//
+#define MMC_STATS_HISTOGRAM_BUCKETS 32
+
+typedef struct {
+  UINT64    Count;
+  UINT64    Retries;
+  UINT64    Timeouts;
+  UINT64    Errors;
+  UINT64    Bytes;
+  UINT64    Ticks;          // Total time from issue to completion
+  UINT64    PollTicks;      // Part of Ticks spent busy-waiting on the controller
+  UINT64    MmioReads;      // Controller register accesses made on its behalf
+  UINT64    MmioWrites;
+  UINT32    Histogram[MMC_STATS_HISTOGRAM_BUCKETS];
+} RASPBERRY_PI_MMC_COMMAND_STATS;
+
+typedef struct {
+  UINT64                          TimerFrequency; // Ticks per second
+  UINT64                          PioWords;       // 32-bit words moved through the data FIFO by the CPU
+  UINT64                          PioTicks;       // and the time spent doing so
+  UINT64                          PioMmioReads;   // Register accesses made while moving them,
+  UINT64                          PioMmioWrites;  // data and FIFO status alike
+  UINT64                          MmioReads;      // All controller register accesses,
+  UINT64                          MmioWrites;     // including those between commands
+  RASPBERRY_PI_MMC_COMMAND_STATS  Commands[MMC_STATS_NUM_COMMANDS];
+} RASPBERRY_PI_MMC_STATS;
+
+typedef struct _RASPBERRY_PI_MMC_STATS_PROTOCOL RASPBERRY_PI_MMC_STATS_PROTOCOL;
+
+typedef
+EFI_STATUS
+(EFIAPI *MMC_STATS_GET) (
+  IN  RASPBERRY_PI_MMC_STATS_PROTOCOL *This,
+  OUT CONST RASPBERRY_PI_MMC_STATS    **Stats
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *MMC_STATS_RESET) (
+  IN  RASPBERRY_PI_MMC_STATS_PROTOCOL *This
+  );
+
+struct _RASPBERRY_PI_MMC_STATS_PROTOCOL {
+  CONST CHAR16      *ControllerName;
+  MMC_STATS_GET     GetStats;
+  MMC_STATS_RESET   ResetStats;
+};
+
+extern EFI_GUID gRaspberryPiMmcStatsProtocolGuid;
+
+#endif
@@ -0,0 +1,237 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DmaLib.h>
+#include <Library/IoLib.h>
+#include <Library/Bcm2836DmaLib.h>
+#include <IndustryStandard/Bcm2836.h>
+
+#define MAX_ABORT_POLL_COUNT 100000
+
+typedef struct {
+  BCM2836_DMA_CONTROL_BLOCK *Cbs;
+  EFI_PHYSICAL_ADDRESS      CbsBusAddress;
+  VOID                      *CbsMapping;
+  VOID                      *BufferMapping;
+} DMA_CHANNEL;
+
+STATIC DMA_CHANNEL mChannels[BCM2836_DMA_NUM_FULL_CHANNELS];
+
+STATIC
+EFI_STATUS
+AllocateControlBlocks (
+  IN  DMA_CHANNEL *Chan
+  )
+{
+  EFI_STATUS Status;
+  VOID       *Cbs;
+  UINTN      Size;
+
+  Status = DmaAllocateBuffer (EfiBootServicesData, 1, &Cbs);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Size = EFI_PAGE_SIZE;
+  Status = DmaMap (MapOperationBusMasterCommonBuffer, Cbs, &Size,
+             &Chan->CbsBusAddress, &Chan->CbsMapping);
+  if (EFI_ERROR (Status)) {
+    DmaFreeBuffer (1, Cbs);
+    return Status;
+  }
+
+  ASSERT ((Chan->CbsBusAddress % BCM2836_DMA_CB_ALIGNMENT) == 0);
+  Chan->Cbs = Cbs;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Bcm2836DmaStart (
+  IN  UINTN                 Channel,
+  IN  UINTN                 Dreq,
+  IN  BCM2836_DMA_DIRECTION Direction,
+  IN  UINTN                 FifoAddress,
+  IN  VOID                  *Buffer,
+  IN  UINTN                 Length
+  )
+{
+  EFI_STATUS                Status;
+  DMA_CHANNEL               *Chan;
+  BCM2836_DMA_CONTROL_BLOCK *Cb;
+  EFI_PHYSICAL_ADDRESS      BusAddress;
+  UINTN                     Mapped;
+  UINTN                     Offset;
+  UINTN                     Chunk;
+  UINTN                     Index;
+  UINT32                    FifoBusAddress;
+  UINT32                    TransferInfo;
+
+  if (Channel >= BCM2836_DMA_NUM_FULL_CHANNELS ||
+      Length == 0 || (Length % 4) != 0 ||
+      ((UINTN) Buffer % 4) != 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Length > BCM2836_DMA_MAX_LENGTH) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  Chan = &mChannels[Channel];
+  if (Chan->BufferMapping != NULL) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  if (Chan->Cbs == NULL) {
+    Status = AllocateControlBlocks (Chan);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: couldn't allocate control blocks: %r\n",
+        __FUNCTION__, Status));
+      return EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  Mapped = Length;
+  Status = DmaMap (Direction == Bcm2836DmaToDevice ?
+             MapOperationBusMasterRead : MapOperationBusMasterWrite,
+             Buffer, &Mapped, &BusAddress, &Chan->BufferMapping);
+  if (EFI_ERROR (Status)) {
+    Chan->BufferMapping = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (Mapped != Length) {
+    DmaUnmap (Chan->BufferMapping);
+    Chan->BufferMapping = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  FifoBusAddress = BCM2836_PERIPHERAL_BUS_ADDRESS (FifoAddress);
+  TransferInfo = BCM2836_DMA_TI_WAIT_RESP |
+                 BCM2836_DMA_TI_NO_WIDE_BURSTS |
+                 BCM2836_DMA_TI_PERMAP (Dreq);
+  if (Direction == Bcm2836DmaToDevice) {
+    TransferInfo |= BCM2836_DMA_TI_SRC_INC | BCM2836_DMA_TI_DEST_DREQ;
+  } else {
+    TransferInfo |= BCM2836_DMA_TI_DEST_INC | BCM2836_DMA_TI_SRC_DREQ;
+  }
+
+  //
+  // One control block per BCM2836_DMA_CB_MAX_LENGTH chunk, chained so the
+  // whole request runs without CPU involvement.
+  //
+  for (Index = 0, Offset = 0; Offset < Length; Index++) {
+    Chunk = MIN (Length - Offset, BCM2836_DMA_CB_MAX_LENGTH);
+    Cb = &Chan->Cbs[Index];
+
+    Cb->TransferInformation = TransferInfo;
+    if (Direction == Bcm2836DmaToDevice) {
+      Cb->SourceAddress = (UINT32) (BusAddress + Offset);
+      Cb->DestinationAddress = FifoBusAddress;
+    } else {
+      Cb->SourceAddress = FifoBusAddress;
+      Cb->DestinationAddress = (UINT32) (BusAddress + Offset);
+    }
+    Cb->TransferLength = (UINT32) Chunk;
+    Cb->Stride = 0;
+
+    Offset += Chunk;
+    if (Offset < Length) {
+      Cb->NextControlBlock = (UINT32) (Chan->CbsBusAddress +
+                                       (Index + 1) * sizeof (*Cb));
+    } else {
+      Cb->NextControlBlock = 0;
+    }
+  }
+
+  MemoryFence ();
+
+  MmioOr32 (BCM2836_DMA_ENABLE, 1 << Channel);
+  MmioWrite32 (BCM2836_DMA_CS (Channel), BCM2836_DMA_CS_END | BCM2836_DMA_CS_INT);
+  MmioWrite32 (BCM2836_DMA_DEBUG (Channel), BCM2836_DMA_DEBUG_ERRORS);
+  MmioWrite32 (BCM2836_DMA_CONBLK_AD (Channel), (UINT32) Chan->CbsBusAddress);
+  MmioWrite32 (BCM2836_DMA_CS (Channel), BCM2836_DMA_CS_ACTIVE |
+               BCM2836_DMA_CS_PRIORITY (8) |
+               BCM2836_DMA_CS_PANIC_PRIORITY (8) |
+               BCM2836_DMA_CS_WAIT_FOR_WRITES);
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Bcm2836DmaPoll (
+  IN  UINTN                 Channel
+  )
+{
+  DMA_CHANNEL *Chan;
+  UINT32      Cs;
+
+  ASSERT (Channel < BCM2836_DMA_NUM_FULL_CHANNELS);
+  Chan = &mChannels[Channel];
+  if (Chan->BufferMapping == NULL) {
+    return EFI_NOT_STARTED;
+  }
+
+  Cs = MmioRead32 (BCM2836_DMA_CS (Channel));
+  if ((Cs & BCM2836_DMA_CS_ERROR) != 0 ||
+      (MmioRead32 (BCM2836_DMA_DEBUG (Channel)) & BCM2836_DMA_DEBUG_ERRORS) != 0) {
+    DEBUG ((DEBUG_ERROR, "%a: channel %u CS 0x%x DEBUG 0x%x\n", __FUNCTION__,
+      Channel, Cs, MmioRead32 (BCM2836_DMA_DEBUG (Channel))));
+    Bcm2836DmaAbort (Channel);
+    return EFI_DEVICE_ERROR;
+  }
+
+  if ((Cs & BCM2836_DMA_CS_ACTIVE) != 0) {
+    return EFI_NOT_READY;
+  }
+
+  MmioWrite32 (BCM2836_DMA_CS (Channel), BCM2836_DMA_CS_END | BCM2836_DMA_CS_INT);
+  DmaUnmap (Chan->BufferMapping);
+  Chan->BufferMapping = NULL;
+  return EFI_SUCCESS;
+}
+
+VOID
+EFIAPI
+Bcm2836DmaAbort (
+  IN  UINTN                 Channel
+  )
+{
+  DMA_CHANNEL *Chan;
+  UINTN       Count;
+
+  ASSERT (Channel < BCM2836_DMA_NUM_FULL_CHANNELS);
+  Chan = &mChannels[Channel];
+
+  //
+  // Pause the channel, let outstanding AXI writes drain, then reset it.
+  //
+  MmioWrite32 (BCM2836_DMA_CS (Channel), 0);
+  for (Count = 0; Count < MAX_ABORT_POLL_COUNT; Count++) {
+    if ((MmioRead32 (BCM2836_DMA_CS (Channel)) &
+         BCM2836_DMA_CS_WAITING_FOR_WRITES) == 0) {
+      break;
+    }
+  }
+  MmioWrite32 (BCM2836_DMA_CS (Channel), BCM2836_DMA_CS_RESET);
+  MmioWrite32 (BCM2836_DMA_DEBUG (Channel), BCM2836_DMA_DEBUG_ERRORS);
+
+  if (Chan->BufferMapping != NULL) {
+    DmaUnmap (Chan->BufferMapping);
+    Chan->BufferMapping = NULL;
+  }
+}
@@ -0,0 +1,959 @@
+/** @file
+*
+*  Copyright (c), 2017, Andrei Warkentin <andrey.warkentin@gmail.com>
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+*  Code shared by the Arasan and SDHOST drivers: everything that doesn't
+*  touch controller registers beyond polling them.
+*
+**/
+
+#include <Uefi.h>
+#include <Library/ArmGenericTimerCounterLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/IoLib.h>
+#include <Library/MmcHostCommonLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836Gpio.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/RaspberryPiFirmware.h>
+
+//
+// Firmware clock rates kept around until a clock change is signalled.
+//
+#define CLOCK_RATE_CACHE_SIZE     2
+
+typedef struct {
+  UINT32    ClockId;              // 0 when the entry is unused
+  UINT32    Rate;
+} CLOCK_RATE_CACHE_ENTRY;
+
+//
+// SD Status erase fields, 512 bits most significant byte first.
+//
+#define SSR_AU_SIZE(Ssr)          ((Ssr)[10] >> 4)                // bits 431:428
+#define SSR_ERASE_SIZE(Ssr)       (((Ssr)[11] << 8) | (Ssr)[12])  // bits 423:408, in AUs
+#define SSR_ERASE_TIMEOUT(Ssr)    ((Ssr)[13] >> 2)                // bits 407:402, in seconds
+#define SSR_ERASE_OFFSET(Ssr)     ((Ssr)[13] & 0x3)               // bits 401:400, in seconds
+
+//
+// CSD erase fields, with CSD bit 0 in bit 0 of the first word.
+//
+#define CSD_ERASE_BLK_EN(Csd)     (((Csd)[1] >> 14) & 0x1)        // SD, bit 46
+#define CSD_SECTOR_SIZE(Csd)      (((Csd)[1] >> 7) & 0x7F)        // SD, bits 45:39
+#define CSD_ERASE_GRP_SIZE(Csd)   (((Csd)[1] >> 10) & 0x1F)       // MMC, bits 46:42
+#define CSD_ERASE_GRP_MULT(Csd)   (((Csd)[1] >> 5) & 0x1F)        // MMC, bits 41:37
+
+//
+// SCR fields, 64 bits most significant byte first.
+//
+#define SCR_BUS_WIDTH_4           BIT2                            // bit 50, in byte 1
+#define SCR_CMD23_SUPPORT         BIT1                            // bit 33, in byte 3
+
+//
+// Switch status fields, 512 bits most significant byte first.
+//
+#define SWITCH_GROUP1_HS_SUPPORT(Status)  ((Status)[13] & BIT1)   // bit 401
+#define SWITCH_GROUP1_RESULT(Status)      ((Status)[16] & 0xF)    // bits 379:376
+
+//
+// How long to let an erase run, when the card doesn't say (per erase
+// unit) and at least.
+//
+#define ERASE_UNIT_TIMEOUT_US     (250 * 1000)
+#define ERASE_MIN_TIMEOUT_US      (1000 * 1000)
+
+STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL *mFwProtocol;
+STATIC UINT64                         mTimerFrequency;
+
+STATIC CLOCK_RATE_CACHE_ENTRY         mClockRateCache[CLOCK_RATE_CACHE_SIZE];
+STATIC MMC_HOST_CLOCK_CHANGED         mClockChanged;
+STATIC EFI_EVENT                      mClockRateChangedEvent;
+
+STATIC UINT32                         mLastCommand = MMC_HOST_NO_COMMAND;
+
+// Per-command counters, published through RASPBERRY_PI_MMC_STATS_PROTOCOL
+STATIC RASPBERRY_PI_MMC_STATS         mStats;
+// Busy-wait time and register accesses of the operation in flight,
+// folded into its stats on completion
+STATIC UINT64                         mPollTicks;
+STATIC UINT64                         mMmioReads;
+STATIC UINT64                         mMmioWrites;
+STATIC UINT64                         mPioMmioReads;
+STATIC UINT64                         mPioMmioWrites;
+// Data command accounted once its data has moved
+STATIC RASPBERRY_PI_MMC_COMMAND_STATS *mDataStats;
+STATIC UINT64                         mDataStart;
+
+STATIC MMC_HOST_ERASE                 mErase;
+// SSR erase timing: mEraseTimeout seconds for every mEraseSize AUs, plus mEraseOffset
+STATIC UINT32                         mEraseSize;
+STATIC UINT32                         mEraseTimeout;
+STATIC UINT32                         mEraseOffset;
+// Vendor node of the card device path the host builds
+STATIC CONST EFI_GUID                 *mDevicePathGuid;
+// MmcDxe's BlockIo for the card, once EFI_ERASE_BLOCK_PROTOCOL sits next to it
+STATIC EFI_BLOCK_IO_PROTOCOL          *mBlockIo;
+STATIC VOID                           *mBlockIoRegistration;
+STATIC EFI_EVENT                      mBlockIoEvent;
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcHostEraseBlocks (
+  IN     EFI_ERASE_BLOCK_PROTOCOL *This,
+  IN     UINT32                   MediaId,
+  IN     EFI_LBA                  Lba,
+  IN OUT EFI_ERASE_BLOCK_TOKEN    *Token,
+  IN     UINTN                    Size
+  );
+
+STATIC EFI_ERASE_BLOCK_PROTOCOL mEraseBlock = {
+  EFI_ERASE_BLOCK_PROTOCOL_REVISION,
+  1,
+  MmcHostEraseBlocks
+};
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcHostGetStats (
+  IN  RASPBERRY_PI_MMC_STATS_PROTOCOL *This,
+  OUT CONST RASPBERRY_PI_MMC_STATS    **Stats
+  )
+{
+  if (Stats == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *Stats = &mStats;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcHostResetStats (
+  IN  RASPBERRY_PI_MMC_STATS_PROTOCOL *This
+  )
+{
+  ZeroMem (mStats.Commands, sizeof (mStats.Commands));
+  mStats.PioWords = 0;
+  mStats.PioTicks = 0;
+  mStats.PioMmioReads = 0;
+  mStats.PioMmioWrites = 0;
+  mStats.MmioReads = 0;
+  mStats.MmioWrites = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC RASPBERRY_PI_MMC_STATS_PROTOCOL mStatsProtocol = {
+  NULL,
+  MmcHostGetStats,
+  MmcHostResetStats
+};
+
+RASPBERRY_PI_MMC_STATS_PROTOCOL *
+EFIAPI
+MmcHostGetStatsProtocol (
+  VOID
+  )
+{
+  return &mStatsProtocol;
+}
+
+UINT64
+EFIAPI
+MmcHostGetTicks (
+  VOID
+  )
+{
+  return ArmGenericTimerGetSystemCount ();
+}
+
+UINT64
+EFIAPI
+MmcHostTicksToUs (
+  IN  UINT64                Ticks
+  )
+{
+  return DivU64x64Remainder (MultU64x32 (Ticks, 1000000), mTimerFrequency, NULL);
+}
+
+UINT64
+EFIAPI
+MmcHostDeadline (
+  IN  UINT64                TimeoutUs
+  )
+{
+  return ArmGenericTimerGetSystemCount () +
+         DivU64x32 (MultU64x64 (mTimerFrequency, TimeoutUs), 1000000);
+}
+
+BOOLEAN
+EFIAPI
+MmcHostDeadlinePassed (
+  IN  UINT64                Deadline
+  )
+{
+  return ArmGenericTimerGetSystemCount () > Deadline;
+}
+
+VOID
+EFIAPI
+MmcHostAccountPoll (
+  IN  UINT64                Start
+  )
+{
+  mPollTicks += ArmGenericTimerGetSystemCount () - Start;
+}
+
+STATIC
+VOID
+MmcHostCountMmio (
+  IN  UINTN                 Reads,
+  IN  UINTN                 Writes
+  )
+{
+  mMmioReads += Reads;
+  mMmioWrites += Writes;
+  mStats.MmioReads += Reads;
+  mStats.MmioWrites += Writes;
+}
+
+UINT32
+EFIAPI
+MmcHostMmioRead32 (
+  IN  UINTN                 Register
+  )
+{
+  MmcHostCountMmio (1, 0);
+  return MmioRead32 (Register);
+}
+
+VOID
+EFIAPI
+MmcHostMmioWrite32 (
+  IN  UINTN                 Register,
+  IN  UINT32                Value
+  )
+{
+  MmcHostCountMmio (0, 1);
+  MmioWrite32 (Register, Value);
+}
+
+VOID
+EFIAPI
+MmcHostMmioAndThenOr32 (
+  IN  UINTN                 Register,
+  IN  UINT32                AndData,
+  IN  UINT32                OrData
+  )
+{
+  MmcHostCountMmio (1, 1);
+  MmioAndThenOr32 (Register, AndData, OrData);
+}
+
+VOID
+EFIAPI
+MmcHostMmioOr32 (
+  IN  UINTN                 Register,
+  IN  UINT32                OrData
+  )
+{
+  MmcHostCountMmio (1, 1);
+  MmioOr32 (Register, OrData);
+}
+
+VOID
+EFIAPI
+MmcHostMmioAnd32 (
+  IN  UINTN                 Register,
+  IN  UINT32                AndData
+  )
+{
+  MmcHostCountMmio (1, 1);
+  MmioAnd32 (Register, AndData);
+}
+
+EFI_STATUS
+EFIAPI
+MmcHostPollRegister (
+  IN  UINTN                 Register,
+  IN  UINT32                Mask,
+  IN  UINT32                Value,
+  IN  UINT64                TimeoutUs
+  )
+{
+  UINT64      Start;
+  UINT64      Deadline;
+  EFI_STATUS  Status;
+
+  Start = ArmGenericTimerGetSystemCount ();
+  Deadline = MmcHostDeadline (TimeoutUs);
+  Status = EFI_SUCCESS;
+
+  while ((MmcHostMmioRead32 (Register) & Mask) != Value) {
+    if (MmcHostDeadlinePassed (Deadline)) {
+      // One last look, in case we were preempted right before the deadline.
+      if ((MmcHostMmioRead32 (Register) & Mask) != Value) {
+        Status = EFI_TIMEOUT;
+      }
+      break;
+    }
+  }
+
+  MmcHostAccountPoll (Start);
+  return Status;
+}
+
+BOOLEAN
+EFIAPI
+MmcHostIsAppCommand (
+  VOID
+  )
+{
+  return mLastCommand == 55;
+}
+
+UINT32
+EFIAPI
+MmcHostCommandSlot (
+  IN  UINT32                Index
+  )
+{
+  Index &= 0x3F;
+  return MmcHostIsAppCommand () ? MMC_HOST_APP_COMMAND (Index) : Index;
+}
+
+UINT32
+EFIAPI
+MmcHostLastCommand (
+  VOID
+  )
+{
+  return mLastCommand;
+}
+
+VOID
+EFIAPI
+MmcHostSetLastCommand (
+  IN  UINT32                Slot
+  )
+{
+  mLastCommand = Slot;
+}
+
+UINT64
+EFIAPI
+MmcHostStatsStart (
+  VOID
+  )
+{
+  mPollTicks = 0;
+  mMmioReads = 0;
+  mMmioWrites = 0;
+  return ArmGenericTimerGetSystemCount ();
+}
+
+RASPBERRY_PI_MMC_COMMAND_STATS *
+EFIAPI
+MmcHostStatsEntry (
+  IN  UINT32                Slot
+  )
+{
+  ASSERT (Slot < MMC_STATS_NUM_COMMANDS);
+  return &mStats.Commands[Slot % MMC_STATS_NUM_COMMANDS];
+}
+
+VOID
+EFIAPI
+MmcHostStatsRecord (
+  IN  RASPBERRY_PI_MMC_COMMAND_STATS  *Stats,
+  IN  UINT64                          Start,
+  IN  UINTN                           Bytes,
+  IN  EFI_STATUS                      Status
+  )
+{
+  UINT64  Ticks;
+  UINTN   Bucket;
+
+  Ticks = ArmGenericTimerGetSystemCount () - Start;
+  Bucket = 0;
+
+  Stats->Count++;
+  Stats->Ticks += Ticks;
+  Stats->PollTicks += mPollTicks;
+  Stats->MmioReads += mMmioReads;
+  Stats->MmioWrites += mMmioWrites;
+  mPollTicks = 0;
+  mMmioReads = 0;
+  mMmioWrites = 0;
+
+  if (Status == EFI_TIMEOUT) {
+    Stats->Timeouts++;
+  } else if (EFI_ERROR (Status)) {
+    Stats->Errors++;
+  } else {
+    Stats->Bytes += Bytes;
+  }
+
+  if (Ticks > 1) {
+    Bucket = MIN (HighBitSet64 (Ticks), MMC_STATS_HISTOGRAM_BUCKETS - 1);
+  }
+  Stats->Histogram[Bucket]++;
+}
+
+VOID
+EFIAPI
+MmcHostStatsDeferData (
+  IN  RASPBERRY_PI_MMC_COMMAND_STATS  *Stats,
+  IN  UINT64                          Start
+  )
+{
+  mDataStats = Stats;
+  mDataStart = Start;
+}
+
+VOID
+EFIAPI
+MmcHostStatsDataDone (
+  IN  UINTN                 Bytes,
+  IN  EFI_STATUS            Status
+  )
+{
+  if (mDataStats != NULL) {
+    MmcHostStatsRecord (mDataStats, mDataStart, Bytes, Status);
+    mDataStats = NULL;
+  }
+}
+
+RASPBERRY_PI_MMC_COMMAND_STATS *
+EFIAPI
+MmcHostStatsData (
+  VOID
+  )
+{
+  return mDataStats;
+}
+
+UINT64
+EFIAPI
+MmcHostStatsPioStart (
+  VOID
+  )
+{
+  mPioMmioReads = mStats.MmioReads;
+  mPioMmioWrites = mStats.MmioWrites;
+  return ArmGenericTimerGetSystemCount ();
+}
+
+VOID
+EFIAPI
+MmcHostStatsPio (
+  IN  UINTN                 Words,
+  IN  UINT64                Start
+  )
+{
+  mStats.PioWords += Words;
+  mStats.PioTicks += ArmGenericTimerGetSystemCount () - Start;
+  mStats.PioMmioReads += mStats.MmioReads - mPioMmioReads;
+  mStats.PioMmioWrites += mStats.MmioWrites - mPioMmioWrites;
+}
+
+EFI_STATUS
+EFIAPI
+MmcHostGetClockRate (
+  IN  UINT32                ClockId,
+  OUT UINT32                *Rate
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+
+  for (Index = 0; Index < CLOCK_RATE_CACHE_SIZE; Index++) {
+    if (mClockRateCache[Index].ClockId == ClockId) {
+      *Rate = mClockRateCache[Index].Rate;
+      return EFI_SUCCESS;
+    }
+  }
+
+  Status = mFwProtocol->GetClockRate (ClockId, Rate);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < CLOCK_RATE_CACHE_SIZE; Index++) {
+    if (mClockRateCache[Index].ClockId == 0) {
+      mClockRateCache[Index].ClockId = ClockId;
+      mClockRateCache[Index].Rate = *Rate;
+      break;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+MmcHostClockRateChanged (
+  IN  EFI_EVENT             Event,
+  IN  VOID                  *Context
+  )
+{
+  DEBUG ((DEBUG_VERBOSE, "%s: clock rate changed, dropping cached rates\n",
+    mStatsProtocol.ControllerName));
+  ZeroMem (mClockRateCache, sizeof (mClockRateCache));
+
+  if (mClockChanged != NULL) {
+    mClockChanged ();
+  }
+}
+
+UINT32
+EFIAPI
+MmcHostClockDivider (
+  IN  UINT32                BaseHz,
+  IN  UINTN                 TargetHz
+  )
+{
+  ASSERT (TargetHz != 0);
+
+  // Rounding up gives the highest clock that doesn't exceed the target
+  return MAX (1, (UINT32) ((BaseHz + TargetHz - 1) / TargetHz));
+}
+
+VOID
+EFIAPI
+MmcHostDecodeR2 (
+  IN OUT UINT32             *Response,
+  IN     BOOLEAN            ShiftDown
+  )
+{
+  if (ShiftDown) {
+    Response[0] = (Response[0] >> 8) | (Response[1] << 24);
+    Response[1] = (Response[1] >> 8) | (Response[2] << 24);
+    Response[2] = (Response[2] >> 8) | (Response[3] << 24);
+    Response[3] >>= 8;
+  } else {
+    Response[3] = (Response[3] << 8) | (Response[2] >> 24);
+    Response[2] = (Response[2] << 8) | (Response[1] >> 24);
+    Response[1] = (Response[1] << 8) | (Response[0] >> 24);
+    Response[0] <<= 8;
+  }
+}
+
+UINT32
+EFIAPI
+MmcHostTranSpeedToHz (
+  IN  UINT8                 TranSpeed
+  )
+{
+  // Transfer rate unit (bits 2:0) in 100kbit/s and time value (bits 6:3) times 10
+  STATIC CONST UINT32 Units[] = { 100000, 1000000, 10000000, 100000000 };
+  STATIC CONST UINT8 TimeValues[] = {
+    0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
+  };
+  UINT32 Unit = TranSpeed & 0x7;
+  UINT32 TimeValue = TimeValues[(TranSpeed >> 3) & 0xF];
+
+  if (Unit >= ARRAY_SIZE (Units) || TimeValue == 0) {
+    return 0;
+  }
+
+  return Units[Unit] / 10 * TimeValue;
+}
+
+VOID
+EFIAPI
+MmcHostParseScr (
+  IN  CONST UINT8           *Scr,
+  OUT MMC_HOST_SCR          *Info
+  )
+{
+  Info->Cmd23 = (Scr[3] & SCR_CMD23_SUPPORT) != 0;
+  Info->BusWidth4 = (Scr[1] & SCR_BUS_WIDTH_4) != 0;
+}
+
+UINT32
+EFIAPI
+MmcHostSwitchArgument (
+  IN  BOOLEAN               Set
+  )
+{
+  return MMC_HOST_SWITCH_ARGUMENT (Set ? MMC_HOST_SWITCH_MODE_SET : 0,
+                                   MMC_HOST_SWITCH_HIGH_SPEED);
+}
+
+EFI_STATUS
+EFIAPI
+MmcHostCheckSwitchStatus (
+  IN  CONST UINT8           *SwitchStatus,
+  IN  BOOLEAN               Set
+  )
+{
+  if (Set) {
+    return SWITCH_GROUP1_RESULT (SwitchStatus) == MMC_HOST_SWITCH_HIGH_SPEED ?
+           EFI_SUCCESS : EFI_UNSUPPORTED;
+  }
+
+  return SWITCH_GROUP1_HS_SUPPORT (SwitchStatus) ? EFI_SUCCESS : EFI_UNSUPPORTED;
+}
+
+VOID
+EFIAPI
+MmcHostEraseReset (
+  VOID
+  )
+{
+  mEraseBlock.EraseLengthGranularity = 1;
+  mEraseSize = 0;
+  mEraseTimeout = 0;
+  mEraseOffset = 0;
+}
+
+VOID
+EFIAPI
+MmcHostEraseParseCsd (
+  IN  CONST UINT32          *Csd,
+  IN  BOOLEAN               IsMmc
+  )
+{
+  if (IsMmc) {
+    mEraseBlock.EraseLengthGranularity = (CSD_ERASE_GRP_SIZE (Csd) + 1) * (CSD_ERASE_GRP_MULT (Csd) + 1);
+  } else if (CSD_ERASE_BLK_EN (Csd)) {
+    mEraseBlock.EraseLengthGranularity = 1;
+  } else {
+    mEraseBlock.EraseLengthGranularity = CSD_SECTOR_SIZE (Csd) + 1;
+  }
+
+  DEBUG ((DEBUG_VERBOSE, "%s: CSD erase granularity %u blocks\n",
+    mStatsProtocol.ControllerName, mEraseBlock.EraseLengthGranularity));
+}
+
+VOID
+EFIAPI
+MmcHostEraseParseSsr (
+  IN  CONST UINT8           *Ssr
+  )
+{
+  STATIC CONST UINT32 AuBlocks[] = {
+    0, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192,
+    16384, 24576, 32768, 49152, 65536, 131072
+  };
+  UINT32 Au;
+
+  //
+  // The AU is what the card erases (and garbage collects) in one go, so
+  // that is the granularity worth aligning erases to.
+  //
+  Au = AuBlocks[SSR_AU_SIZE (Ssr)];
+  mEraseSize = SSR_ERASE_SIZE (Ssr);
+  mEraseTimeout = SSR_ERASE_TIMEOUT (Ssr);
+  mEraseOffset = SSR_ERASE_OFFSET (Ssr);
+  if (Au != 0) {
+    mEraseBlock.EraseLengthGranularity = Au;
+  }
+
+  DEBUG ((DEBUG_INFO, "%s: SD AU %u blocks, erase timeout %u s per %u AUs + %u s\n",
+    mStatsProtocol.ControllerName, Au, mEraseTimeout, mEraseSize, mEraseOffset));
+}
+
+VOID
+EFIAPI
+MmcHostEraseSetGranularity (
+  IN  UINT32                Blocks
+  )
+{
+  mEraseBlock.EraseLengthGranularity = MAX (1, Blocks);
+}
+
+UINT32
+EFIAPI
+MmcHostEraseGranularity (
+  VOID
+  )
+{
+  return mEraseBlock.EraseLengthGranularity;
+}
+
+UINT64
+EFIAPI
+MmcHostEraseTimeoutUs (
+  IN  UINT64                Blocks
+  )
+{
+  UINT32  Granularity;
+  UINT64  Units;
+  UINT64  TimeoutUs;
+
+  Granularity = mEraseBlock.EraseLengthGranularity;
+  Units = DivU64x32 (Blocks + Granularity - 1, Granularity);
+
+  //
+  // The SSR says how long erasing takes per so many AUs, which is what
+  // the granularity is once the SSR has been read. Otherwise assume a
+  // generous time per erase unit.
+  //
+  if (mEraseSize != 0 && mEraseTimeout != 0) {
+    TimeoutUs = MultU64x32 (DivU64x32 (MultU64x32 (Units, mEraseTimeout) + mEraseSize - 1, mEraseSize) +
+                            mEraseOffset, 1000000);
+  } else {
+    TimeoutUs = MultU64x32 (Units, ERASE_UNIT_TIMEOUT_US);
+  }
+
+  return MAX (TimeoutUs, ERASE_MIN_TIMEOUT_US);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcHostEraseBlocks (
+  IN     EFI_ERASE_BLOCK_PROTOCOL *This,
+  IN     UINT32                   MediaId,
+  IN     EFI_LBA                  Lba,
+  IN OUT EFI_ERASE_BLOCK_TOKEN    *Token,
+  IN     UINTN                    Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_BLOCK_IO_MEDIA  *Media;
+  UINT64              Blocks;
+  EFI_TPL             OldTpl;
+
+  Media = mBlockIo->Media;
+  if (MediaId != Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if (!Media->MediaPresent) {
+    return EFI_NO_MEDIA;
+  }
+
+  if (Media->ReadOnly) {
+    return EFI_WRITE_PROTECTED;
+  }
+
+  if (Size == 0 || Size % Media->BlockSize != 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Blocks = Size / Media->BlockSize;
+  if (Lba > Media->LastBlock || Blocks > Media->LastBlock - Lba + 1) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Keep out of the way of MmcDxe and MmcBlockIo2Dxe, which issue their
+  // commands at TPL_CALLBACK.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  mFwProtocol->NotifyLedActivity ();
+  Status = mErase (Lba, Blocks);
+  gBS->RestoreTPL (OldTpl);
+
+  // Nothing was sent to the card for these
+  if (Status == EFI_NO_MEDIA || Status == EFI_INVALID_PARAMETER || Status == EFI_NOT_READY) {
+    return Status;
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%s: erasing 0x%lx blocks at 0x%lx failed: %r\n",
+      mStatsProtocol.ControllerName, Blocks, Lba, Status));
+    Status = EFI_DEVICE_ERROR;
+  }
+
+  //
+  // Erased blocks read back as all zeroes or all ones. BlockCacheDxe
+  // drops the range when the erase comes through its child; resetting
+  // BlockIo covers anything else holding on to the old contents.
+  //
+  mBlockIo->Reset (mBlockIo, FALSE);
+
+  if (Token != NULL && Token->Event != NULL) {
+    Token->TransactionStatus = Status;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  return Status;
+}
+
+/**
+  Tells MmcDxe's card handle apart from any other BlockIo: its device
+  path is the vendor node the host built and nothing else.
+
+**/
+STATIC
+BOOLEAN
+MmcHostIsCardDevicePath (
+  IN  EFI_DEVICE_PATH_PROTOCOL  *DevicePath
+  )
+{
+  return DevicePathType (DevicePath) == HARDWARE_DEVICE_PATH &&
+         DevicePathSubType (DevicePath) == HW_VENDOR_DP &&
+         DevicePathNodeLength (DevicePath) == sizeof (VENDOR_DEVICE_PATH) &&
+         CompareGuid (&((VENDOR_DEVICE_PATH *) DevicePath)->Guid, mDevicePathGuid) &&
+         IsDevicePathEnd (NextDevicePathNode (DevicePath));
+}
+
+/**
+  MmcDxe owns the card's BlockIo handle, so EFI_ERASE_BLOCK_PROTOCOL is
+  added to it once it shows up.
+
+**/
+STATIC
+VOID
+EFIAPI
+MmcHostOnBlockIoInstall (
+  IN  EFI_EVENT             Event,
+  IN  VOID                  *Context
+  )
+{
+  EFI_STATUS                Status;
+  EFI_HANDLE                Handle;
+  UINTN                     Size;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_BLOCK_IO_PROTOCOL     *BlockIo;
+
+  for (;;) {
+    Size = sizeof (Handle);
+    Status = gBS->LocateHandle (ByRegisterNotify, NULL, mBlockIoRegistration, &Size, &Handle);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    if (mBlockIo != NULL) {
+      continue;
+    }
+
+    Status = gBS->HandleProtocol (Handle, &gEfiDevicePathProtocolGuid, (VOID **) &DevicePath);
+    if (EFI_ERROR (Status) || !MmcHostIsCardDevicePath (DevicePath)) {
+      continue;
+    }
+
+    Status = gBS->HandleProtocol (Handle, &gEfiBlockIoProtocolGuid, (VOID **) &BlockIo);
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    mBlockIo = BlockIo;
+    Status = gBS->InstallProtocolInterface (&Handle, &gEfiEraseBlockProtocolGuid,
+                    EFI_NATIVE_INTERFACE, &mEraseBlock);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%s: failed to install erase support: %r\n",
+        mStatsProtocol.ControllerName, Status));
+      mBlockIo = NULL;
+      continue;
+    }
+
+    DEBUG ((DEBUG_INFO, "%s: erase supported, granularity %u blocks\n",
+      mStatsProtocol.ControllerName, mEraseBlock.EraseLengthGranularity));
+  }
+}
+
+VOID
+EFIAPI
+MmcHostMuxSdSlot (
+  IN  MMC_HOST_CONTROLLER     Controller
+  )
+{
+  UINT32  Function;
+  UINTN   Pin;
+
+  if (Controller == MmcHostControllerSdHost) {
+    Function = BCM2836_GPIO_SD_SLOT_FSEL_SDHOST;
+  } else {
+    Function = BCM2836_GPIO_SD_SLOT_FSEL_ARASAN;
+  }
+
+  for (Pin = BCM2836_GPIO_SD_SLOT_FIRST_PIN; Pin <= BCM2836_GPIO_SD_SLOT_LAST_PIN; Pin++) {
+    MmioAndThenOr32 (BCM2836_GPIO_GPFSEL (Pin),
+      ~((UINT32) BCM2836_GPIO_GPFSEL_MASK << BCM2836_GPIO_GPFSEL_SHIFT (Pin)),
+      Function << BCM2836_GPIO_GPFSEL_SHIFT (Pin));
+  }
+}
+
+EFI_STATUS
+EFIAPI
+MmcHostClaimSdSlot (
+  IN  MMC_HOST_CONTROLLER     Controller
+  )
+{
+  UINT32  Policy;
+
+  Policy = PcdGet32 (PcdSdController);
+  if (Policy == MmcHostControllerProbe) {
+    return EFI_SUCCESS;
+  }
+
+  if (Policy != Controller) {
+    //
+    // The controller left over stays free for other uses, such as the
+    // Arasan one for SDIO Wi-Fi on GPIO 34-39.
+    //
+    DEBUG ((DEBUG_INFO, "%a: SD slot belongs to controller %u, not %u\n",
+      __FUNCTION__, Policy, Controller));
+    return EFI_UNSUPPORTED;
+  }
+
+  MmcHostMuxSdSlot (Controller);
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+MmcHostCommonInit (
+  IN  CONST CHAR16            *ControllerName,
+  IN  CONST EFI_GUID          *DevicePathGuid,
+  IN  MMC_HOST_CLOCK_CHANGED  ClockChanged OPTIONAL,
+  IN  MMC_HOST_ERASE          Erase OPTIONAL
+  )
+{
+  EFI_STATUS Status;
+
+  Status = gBS->LocateProtocol (&gRaspberryPiFirmwareProtocolGuid, NULL,
+                  (VOID **) &mFwProtocol);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mStatsProtocol.ControllerName = ControllerName;
+
+  mTimerFrequency = ArmGenericTimerGetTimerFreq ();
+  ASSERT (mTimerFrequency != 0);
+  mStats.TimerFrequency = mTimerFrequency;
+
+  mClockChanged = ClockChanged;
+  Status = gBS->CreateEventEx (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, MmcHostClockRateChanged,
+                  NULL, &gRaspberryPiClockRateChangedGuid, &mClockRateChangedEvent);
+  ASSERT_EFI_ERROR (Status);
+
+  MmcHostEraseReset ();
+  mErase = Erase;
+  mDevicePathGuid = DevicePathGuid;
+  if (Erase != NULL) {
+    mBlockIoEvent = EfiCreateProtocolNotifyEvent (&gEfiBlockIoProtocolGuid, TPL_CALLBACK,
+                      MmcHostOnBlockIoInstall, NULL, &mBlockIoRegistration);
+    ASSERT (mBlockIoEvent != NULL);
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/** @file
+*
+*  What the EDK2 build generates for ArasanMmcHostDxe.inf, for the host
+*  build: the module's caller ID and its PCDs.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __ARASAN_AUTOGEN_H__
+#define __ARASAN_AUTOGEN_H__
+
+#include <Uefi.h>
+
+// FILE_GUID of ArasanMmcHostDxe.inf
+#define EFI_CALLER_ID_GUID \
+  { 0x100c2cfa, 0xb586, 0x4198, { 0x9b, 0x4c, 0x16, 0x83, 0xd1, 0x95, 0xb1, 0xda } }
+
+extern EFI_GUID gEfiCallerIdGuid;
+
+// RaspberryPiPkg.dec [Guids] the module uses
+extern EFI_GUID gRaspberryPiClockRateChangedGuid;
+extern EFI_GUID gRaspberryPiArasanMmcHostDevicePathGuid;
+
+#define _PCD_GET_MODE_32_PcdArasanDmaChannel      gHostPcdArasanDmaChannel
+#define _PCD_GET_MODE_32_PcdArasanMaxBusWidth     gHostPcdArasanMaxBusWidth
+#define _PCD_GET_MODE_32_PcdSdController          gHostPcdSdController
+
+extern UINT32 gHostPcdArasanDmaChannel;
+extern UINT32 gHostPcdArasanMaxBusWidth;
+extern UINT32 gHostPcdSdController;
+
+#endif /* __ARASAN_AUTOGEN_H__ */
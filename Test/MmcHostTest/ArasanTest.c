@@ -0,0 +1,656 @@
+/** @file
+*
+*  ArasanMmcHostDxe against the SDHCI model, driven the way MmcDxe does.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <stdio.h>
+
+#include <Protocol/EraseBlock.h>
+#include <Protocol/RaspberryPiMmcStats.h>
+
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836Gpio.h>
+#include <IndustryStandard/Bcm2836MMCHS.h>
+
+#include "MmcDxe.h"
+#include "SdhciModel.h"
+
+EFI_GUID gEfiCallerIdGuid = EFI_CALLER_ID_GUID;
+
+EFI_STATUS
+MMCInitialize (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  );
+
+#define TEST_BLOCK_SIZE           SD_CARD_BLOCK_SIZE
+#define TEST_GPIO_ALT3            7
+#define TEST_LARGE_BLOCKS         (9 * 1024 * 2)      // Over BCM2836_DMA_MAX_LENGTH
+
+//
+// An SDHC card the way most are: block addressed, CMD23 capable and
+// switchable to high speed.
+//
+STATIC CONST SD_CARD_CONFIG mSdhcConfig = {
+  20480,                          // Blocks
+  TRUE,                           // HighCapacity
+  TRUE,                           // Cmd23
+  TRUE,                           // HighSpeed
+  100000,                         // ReadAccessNs
+  20000,                          // ProgramNs
+  5000000,                        // EraseNs
+  2,                              // PowerUpPolls
+  9                               // AuCode, 4 MiB
+};
+
+//
+// An old SDSC card: byte addressed, default speed only, and multi-block
+// transfers closed by CMD12.
+//
+STATIC CONST SD_CARD_CONFIG mSdscConfig = {
+  4096,                           // Blocks
+  FALSE,                          // HighCapacity
+  FALSE,                          // Cmd23
+  FALSE,                          // HighSpeed
+  300000,                         // ReadAccessNs
+  50000,                          // ProgramNs
+  10000000,                       // EraseNs
+  5,                              // PowerUpPolls
+  6                               // AuCode, 512 KiB
+};
+
+STATIC SD_CARD                          mCard;
+STATIC SDHCI_MODEL                      mModel;
+STATIC MMC_DXE                          mMmc;
+STATIC EFI_MMC_HOST_PROTOCOL            *mHost;
+STATIC EFI_BLOCK_IO_PROTOCOL            *mBlockIo;
+STATIC RASPBERRY_PI_MMC_STATS_PROTOCOL  *mStats;
+
+STATIC UINT32                           mBuffer[(TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE) / 4 + 1];
+
+//
+// Measuring what an operation costs.
+//
+typedef struct {
+  UINT64                Ns;
+  UINT64                Reads;
+  UINT64                Writes;
+  UINT64                DmaWords;
+  UINT64                PioWords;
+} MEASURE;
+
+STATIC
+VOID
+MeasureStart (
+  OUT MEASURE           *Measure
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+
+  mStats->GetStats (mStats, &Stats);
+  Measure->Ns = HostNowNs ();
+  Measure->Reads = mModel.Region->Reads;
+  Measure->Writes = mModel.Region->Writes;
+  Measure->DmaWords = gHostDma.Words;
+  Measure->PioWords = Stats->PioWords;
+}
+
+STATIC
+VOID
+MeasureReport (
+  IN  CONST MEASURE     *Measure,
+  IN  CONST CHAR8       *What,
+  IN  UINTN             Bytes
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  UINT64                        Ns;
+  UINT64                        Reads;
+  UINT64                        Words;
+  UINT64                        PerWord;
+
+  mStats->GetStats (mStats, &Stats);
+  Ns = HostNowNs () - Measure->Ns;
+  Reads = mModel.Region->Reads - Measure->Reads;
+  Words = Bytes / 4;
+  PerWord = Words != 0 ? Reads * 100 / Words : 0;
+
+  HostReport ("%s: %llu us, %llu MMIO reads, %llu writes, %llu.%02llu reads/word, "
+    "%llu DMA words, %llu PIO words, %llu KiB/s",
+    What,
+    (unsigned long long) (Ns / HOST_NS_PER_US),
+    (unsigned long long) Reads,
+    (unsigned long long) (mModel.Region->Writes - Measure->Writes),
+    (unsigned long long) (PerWord / 100),
+    (unsigned long long) (PerWord % 100),
+    (unsigned long long) (gHostDma.Words - Measure->DmaWords),
+    (unsigned long long) (Stats->PioWords - Measure->PioWords),
+    (unsigned long long) (Ns != 0 ? (UINT64) Bytes * 1000000000ULL / 1024 / Ns : 0));
+}
+
+//
+// Helpers.
+//
+
+STATIC
+UINT8 *
+CardBlock (
+  IN  EFI_LBA           Lba
+  )
+{
+  return mCard.Data + Lba * TEST_BLOCK_SIZE;
+}
+
+STATIC
+VOID
+FillPattern (
+  OUT VOID              *Buffer,
+  IN  UINTN             Length,
+  IN  UINT8             Seed
+  )
+{
+  UINT8 *Bytes = Buffer;
+  UINTN Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    Bytes[Index] = (UINT8) (Seed + Index * 13 + (Index >> 8));
+  }
+}
+
+STATIC
+EFI_STATUS
+ReadBlocks (
+  IN  EFI_LBA           Lba,
+  IN  UINTN             Blocks,
+  OUT VOID              *Buffer
+  )
+{
+  return mBlockIo->ReadBlocks (mBlockIo, mBlockIo->Media->MediaId, Lba,
+                               Blocks * TEST_BLOCK_SIZE, Buffer);
+}
+
+STATIC
+EFI_STATUS
+WriteBlocks (
+  IN  EFI_LBA           Lba,
+  IN  UINTN             Blocks,
+  IN  VOID              *Buffer
+  )
+{
+  return mBlockIo->WriteBlocks (mBlockIo, mBlockIo->Media->MediaId, Lba,
+                                Blocks * TEST_BLOCK_SIZE, Buffer);
+}
+
+//
+// Lets the driver's card detect timer and MmcDxe see the slot change.
+//
+STATIC
+EFI_STATUS
+SetCardInserted (
+  IN  BOOLEAN           Inserted
+  )
+{
+  SdhciModelSetCardInserted (&mModel, Inserted);
+  HostRunTimers (250);
+  return MmcDxeCheckCard (&mMmc);
+}
+
+STATIC
+EFI_STATUS
+SwapCard (
+  IN  CONST SD_CARD_CONFIG *Config
+  )
+{
+  SetCardInserted (FALSE);
+  SdCardInit (&mCard, Config);
+  return SetCardInserted (TRUE);
+}
+
+//
+// Nothing the driver must never do happened.
+//
+STATIC
+VOID
+CheckClean (
+  VOID
+  )
+{
+  CHECK (mModel.Violations == 0);
+  CHECK (mModel.Underruns == 0);
+  CHECK (mModel.Overruns == 0);
+  CHECK (mCard.Violations == 0);
+  CHECK (mCard.IllegalCommands == 0);
+  CHECK (gHostDebug.Asserts == 0);
+}
+
+//
+// The tests.
+//
+
+STATIC
+VOID
+TestInit (
+  VOID
+  )
+{
+  EFI_STATUS    Status;
+  MEASURE       Measure;
+  UINT32        Fsel4;
+  UINT32        Fsel5;
+
+  Status = MMCInitialize (gImageHandle, gST);
+  CHECK_STATUS (Status, EFI_SUCCESS);
+  CHECK_STATUS (HostLocateProtocol (&gEfiMmcHostProtocolGuid, (VOID **) &mHost), EFI_SUCCESS);
+  CHECK_STATUS (HostLocateProtocol (&gRaspberryPiMmcStatsProtocolGuid, (VOID **) &mStats), EFI_SUCCESS);
+  if (mHost == NULL || mStats == NULL) {
+    return;
+  }
+
+  // GPIO 48-53 go to the Arasan controller
+  Fsel4 = HostPeek32 (BCM2836_GPIO_GPFSEL (48));
+  Fsel5 = HostPeek32 (BCM2836_GPIO_GPFSEL (50));
+  CHECK (((Fsel4 >> 24) & 7) == TEST_GPIO_ALT3);
+  CHECK (((Fsel4 >> 27) & 7) == TEST_GPIO_ALT3);
+  CHECK ((Fsel5 & 0xFFF) == 07777);
+
+  MeasureStart (&Measure);
+  Status = MmcDxeStart (&mMmc, mHost);
+  CHECK_STATUS (Status, EFI_SUCCESS);
+  MeasureReport (&Measure, "identification", 0);
+  mBlockIo = &mMmc.BlockIo;
+
+  CHECK (mMmc.Media.MediaPresent);
+  CHECK (mMmc.Media.LastBlock == mSdhcConfig.Blocks - 1);
+  CHECK (!mMmc.Media.ReadOnly);
+  CHECK (CompareGuid (&mMmc.DevicePath.Host.Guid, &gRaspberryPiArasanMmcHostDevicePathGuid));
+  CHECK (mMmc.HighCapacity);
+  CHECK (mMmc.HighSpeed);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mCard.Rca == SD_CARD_RCA);
+  CHECK (mCard.BusWidth == 4);
+  CHECK (mCard.HighSpeedMode);
+  CHECK (SdhciModelClockHz (&mModel) == 50000000);
+  CHECK ((mModel.Hctl & DTW_4_BIT) != 0);
+  CHECK (gHostDebug.Errors == 0);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSingleBlockRead (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd17 = mCard.Commands[17];
+  UINT64        Starts = gHostDma.Starts;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (100, 1, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "1 block DMA read", TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (100), TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.Commands[17] == Cmd17 + 1);
+  CHECK (gHostDma.Starts == Starts + 1);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSingleBlockWrite (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd24 = mCard.Commands[24];
+
+  FillPattern (mBuffer, TEST_BLOCK_SIZE, 0x11);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (200, 1, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "1 block DMA write", TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (200), TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.Commands[24] == Cmd24 + 1);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestMultiBlockRead (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd12 = mCard.Commands[12];
+  UINT64        Cmd23 = mCard.Commands[23];
+  UINT64        Stops = mMmc.StopTransmissions;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (1000, 64, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block DMA read", 64 * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (1000), 64 * TEST_BLOCK_SIZE) == 0);
+
+  // Auto-CMD23 closed it; MmcDxe's CMD12 never reaches the card
+  CHECK (mCard.Commands[23] == Cmd23 + 1);
+  CHECK (mCard.Commands[12] == Cmd12);
+  CHECK (mMmc.StopTransmissions == Stops + 1);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestMultiBlockWrite (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd12 = mCard.Commands[12];
+  UINT64        Written = mCard.BlocksWritten;
+
+  FillPattern (mBuffer, 64 * TEST_BLOCK_SIZE, 0x42);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (3000, 64, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block DMA write", 64 * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (3000), 64 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.BlocksWritten == Written + 64);
+  CHECK (mCard.Commands[12] == Cmd12);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestPioUnaligned (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT8         *Unaligned = (UINT8 *) mBuffer + 1;
+  UINT64        Starts = gHostDma.Starts;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (500, 8, Unaligned), EFI_SUCCESS);
+  MeasureReport (&Measure, "8 block PIO read", 8 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (Unaligned, CardBlock (500), 8 * TEST_BLOCK_SIZE) == 0);
+
+  FillPattern (Unaligned, 8 * TEST_BLOCK_SIZE, 0x77);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (600, 8, Unaligned), EFI_SUCCESS);
+  MeasureReport (&Measure, "8 block PIO write", 8 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (Unaligned, CardBlock (600), 8 * TEST_BLOCK_SIZE) == 0);
+
+  CHECK (gHostDma.Starts == Starts);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestDmaFallback (
+  VOID
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  UINT64                        Retries;
+
+  mStats->GetStats (mStats, &Stats);
+  Retries = Stats->Commands[18].Retries;
+
+  // No control blocks to be had, so the same transfer goes by PIO
+  gHostDma.FailStart = EFI_OUT_OF_RESOURCES;
+  CHECK_STATUS (ReadBlocks (700, 4, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (700), 4 * TEST_BLOCK_SIZE) == 0);
+  CHECK (Stats->Commands[18].Retries == Retries + 1);
+  CHECK (gHostDma.FailStart == EFI_SUCCESS);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestLargeRead (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Starts = gHostDma.Starts;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (0, TEST_LARGE_BLOCKS, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "9 MiB DMA read", TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (0), TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE) == 0);
+
+  // One command, the DMA chained over two starts
+  CHECK (gHostDma.Starts == Starts + 2);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestDmaError (
+  VOID
+  )
+{
+  gHostDma.FailPoll = TRUE;
+  CHECK_STATUS (ReadBlocks (800, 16, mBuffer), EFI_DEVICE_ERROR);
+  CHECK (gHostDma.FailPoll == FALSE);
+
+  // The data line was reset and the card stopped, the next one goes through
+  CHECK_STATUS (ReadBlocks (800, 16, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (800), 16 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mModel.Violations == 0);
+}
+
+STATIC
+VOID
+TestCrcError (
+  VOID
+  )
+{
+  UINT64        Errors = gHostDebug.Errors;
+
+  mCard.CrcErrorBlock = 901;
+  CHECK_STATUS (ReadBlocks (900, 4, mBuffer), EFI_DEVICE_ERROR);
+  CHECK (gHostDebug.Errors > Errors);
+  mCard.CrcErrorBlock = SD_CARD_NO_FAULT;
+
+  CHECK_STATUS (ReadBlocks (900, 4, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (900), 4 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mModel.Violations == 0);
+}
+
+STATIC
+VOID
+TestCommandTimeout (
+  VOID
+  )
+{
+  UINT32        Response[4];
+
+  // The card never answers CMD13
+  mCard.IgnoreCommand = 13;
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_DEVICE_ERROR);
+  mCard.IgnoreCommand = SD_CARD_NO_FAULT;
+
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_SUCCESS);
+  CHECK_STATUS (mHost->ReceiveResponse (mHost, MMC_RESPONSE_TYPE_R1, Response), EFI_SUCCESS);
+  CHECK (((Response[0] >> 9) & 0xF) == SD_STATE_TRAN);
+
+  CHECK_STATUS (ReadBlocks (10, 2, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (10), 2 * TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestCommandLineStuck (
+  VOID
+  )
+{
+  UINT64        Start;
+  UINT64        Ns;
+
+  // CMDI never clears: the driver gives up after its timeout
+  mModel.StuckCmdi = TRUE;
+  Start = HostNowNs ();
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_TIMEOUT);
+  Ns = HostNowNs () - Start;
+  mModel.StuckCmdi = FALSE;
+  HostReport ("gave up after %llu ms", (unsigned long long) (Ns / HOST_NS_PER_MS));
+  CHECK (Ns >= 400 * HOST_NS_PER_MS && Ns < 500 * HOST_NS_PER_MS);
+
+  CHECK_STATUS (ReadBlocks (20, 2, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (20), 2 * TEST_BLOCK_SIZE) == 0);
+}
+
+STATIC
+VOID
+TestErase (
+  VOID
+  )
+{
+  EFI_ERASE_BLOCK_PROTOCOL  *EraseBlock = NULL;
+  MEASURE                   Measure;
+  UINT8                     Zero[TEST_BLOCK_SIZE];
+
+  CHECK_STATUS (gBS->HandleProtocol (mMmc.Handle, &gEfiEraseBlockProtocolGuid,
+                                     (VOID **) &EraseBlock), EFI_SUCCESS);
+  if (EraseBlock == NULL) {
+    return;
+  }
+
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId + 1, 4000, NULL,
+                                         64 * TEST_BLOCK_SIZE), EFI_MEDIA_CHANGED);
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId, mMmc.Media.LastBlock,
+                                         NULL, 2 * TEST_BLOCK_SIZE), EFI_INVALID_PARAMETER);
+  CHECK (mCard.Erases == 0);
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId, 4000, NULL,
+                                         64 * TEST_BLOCK_SIZE), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block erase", 0);
+  CHECK (mCard.Erases == 1);
+  CHECK (HostNowNs () - Measure.Ns >= mSdhcConfig.EraseNs);
+  CHECK (mCard.State == SD_STATE_TRAN);
+
+  ZeroMem (Zero, sizeof (Zero));
+  CHECK_STATUS (ReadBlocks (4063, 1, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, Zero, TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestRemoval (
+  VOID
+  )
+{
+  UINT32        MediaId = mMmc.Media.MediaId;
+
+  CHECK_STATUS (SetCardInserted (FALSE), EFI_SUCCESS);
+  CHECK (!mHost->IsCardPresent (mHost));
+  CHECK (!mMmc.Media.MediaPresent);
+  CHECK_STATUS (ReadBlocks (0, 1, mBuffer), EFI_NO_MEDIA);
+
+  CHECK_STATUS (SetCardInserted (TRUE), EFI_SUCCESS);
+  CHECK (mMmc.Media.MediaPresent);
+  CHECK (mMmc.Media.MediaId != MediaId);
+  CHECK_STATUS (mBlockIo->ReadBlocks (mBlockIo, MediaId, 0, TEST_BLOCK_SIZE, mBuffer),
+                EFI_MEDIA_CHANGED);
+
+  CHECK_STATUS (ReadBlocks (0, 1, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (0), TEST_BLOCK_SIZE) == 0);
+  CHECK (SdhciModelClockHz (&mModel) == 50000000);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSdscCard (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        AutoCmd12s;
+
+  CHECK_STATUS (SwapCard (&mSdscConfig), EFI_SUCCESS);
+  CHECK (!mMmc.HighCapacity);
+  CHECK (!mMmc.HighSpeed);
+  CHECK (mMmc.Media.LastBlock == mSdscConfig.Blocks - 1);
+  CHECK (SdhciModelClockHz (&mModel) == 25000000);
+  CHECK (mCard.BusWidth == 4);
+
+  // Byte addressed, and closed by auto-CMD12 instead of CMD23
+  AutoCmd12s = mModel.AutoCmd12s;
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (10, 32, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "32 block DMA read, SDSC", 32 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (mBuffer, CardBlock (10), 32 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mModel.AutoCmd12s == AutoCmd12s + 1);
+  CHECK (mCard.Commands[23] == 0);
+  CHECK (mCard.Commands[12] == 1);
+
+  // Long writes tell the card how many blocks are coming
+  FillPattern (mBuffer, 128 * TEST_BLOCK_SIZE, 0x5A);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (1024, 128, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "128 block DMA write, SDSC", 128 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (mBuffer, CardBlock (1024), 128 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.PreEraseBlocks == 128);
+  CHECK (mCard.Commands[12] == 2);
+  CHECK (mCard.State == SD_STATE_TRAN);
+
+  CHECK_STATUS (ReadBlocks (3, 1, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (3), TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+
+  // And back, for whatever runs next
+  CHECK_STATUS (SwapCard (&mSdhcConfig), EFI_SUCCESS);
+  CHECK (mMmc.HighSpeed);
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  HostInit ();
+  SdCardInit (&mCard, &mSdhcConfig);
+  SdhciModelInit (&mModel, &mCard);
+
+  HostRunTest ("Arasan.Init", TestInit);
+  if (mBlockIo == NULL) {
+    return HostSummary ();
+  }
+
+  HostRunTest ("Arasan.SingleBlockRead", TestSingleBlockRead);
+  HostRunTest ("Arasan.SingleBlockWrite", TestSingleBlockWrite);
+  HostRunTest ("Arasan.MultiBlockRead", TestMultiBlockRead);
+  HostRunTest ("Arasan.MultiBlockWrite", TestMultiBlockWrite);
+  HostRunTest ("Arasan.PioUnaligned", TestPioUnaligned);
+  HostRunTest ("Arasan.DmaFallback", TestDmaFallback);
+  HostRunTest ("Arasan.LargeRead", TestLargeRead);
+  HostRunTest ("Arasan.DmaError", TestDmaError);
+  HostRunTest ("Arasan.CrcError", TestCrcError);
+  HostRunTest ("Arasan.CommandTimeout", TestCommandTimeout);
+  HostRunTest ("Arasan.CommandLineStuck", TestCommandLineStuck);
+  HostRunTest ("Arasan.Erase", TestErase);
+  HostRunTest ("Arasan.Removal", TestRemoval);
+  HostRunTest ("Arasan.SdscCard", TestSdscCard);
+
+  return HostSummary ();
+}
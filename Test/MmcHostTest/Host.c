@@ -0,0 +1,1046 @@
+/** @file
+*
+*  The simulated platform: clock, MMIO bus, boot services, firmware and
+*  DMA engine, and the test bookkeeping.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Library/ArmGenericTimerCounterLib.h>
+#include <Library/IoLib.h>
+#include <IndustryStandard/Bcm2836.h>
+
+#include <IndustryStandard/Bcm2836Gpio.h>
+
+#include "Host.h"
+
+#define HOST_MAX_REGIONS          8
+#define HOST_MAX_HANDLES          16
+#define HOST_MAX_PROTOCOLS        8
+#define HOST_MAX_EVENTS           32
+#define HOST_MAX_NOTIFIES         8
+#define HOST_NOTIFY_QUEUE         8
+#define HOST_MAX_DREQS            32
+
+//
+// A firmware mailbox round trip.
+//
+#define HOST_MAILBOX_NS           (50 * HOST_NS_PER_US)
+
+typedef struct {
+  EFI_GUID              *Guid[HOST_MAX_PROTOCOLS];
+  VOID                  *Interface[HOST_MAX_PROTOCOLS];
+  UINTN                 Count;
+} HOST_HANDLE;
+
+typedef struct {
+  BOOLEAN               InUse;
+  UINT32                Type;
+  EFI_TPL               Tpl;
+  EFI_EVENT_NOTIFY      Notify;
+  VOID                  *Context;
+  BOOLEAN               InGroup;
+  EFI_GUID              Group;
+  BOOLEAN               Pending;
+  UINT64                PeriodNs;       // 0 for a one-shot timer
+  UINT64                DueNs;          // 0 when the timer is off
+} HOST_EVENT;
+
+typedef struct {
+  EFI_GUID              *Protocol;
+  HOST_EVENT            *Event;
+  EFI_HANDLE            Queue[HOST_NOTIFY_QUEUE];
+  UINTN                 Head;
+  UINTN                 Tail;
+} HOST_NOTIFY;
+
+typedef struct {
+  BOOLEAN               Busy;
+  UINTN                 Dreq;
+  BCM2836_DMA_DIRECTION Direction;
+  UINTN                 FifoAddress;
+  UINT8                 *Buffer;
+  UINTN                 Length;
+  UINTN                 Done;
+} HOST_DMA_CHANNEL;
+
+typedef struct {
+  HOST_DREQ             Asserted;
+  VOID                  *Context;
+} HOST_DREQ_LINE;
+
+STATIC UINT64             mNowNs;
+
+STATIC HOST_MMIO_REGION   mRegions[HOST_MAX_REGIONS];
+STATIC UINTN              mRegionCount;
+
+STATIC HOST_HANDLE        mHandles[HOST_MAX_HANDLES];
+STATIC UINTN              mHandleCount;
+STATIC HOST_EVENT         mEvents[HOST_MAX_EVENTS];
+STATIC HOST_NOTIFY        mNotifies[HOST_MAX_NOTIFIES];
+STATIC UINTN              mNotifyCount;
+STATIC EFI_TPL            mTpl = TPL_APPLICATION;
+
+STATIC HOST_DMA_CHANNEL   mDmaChannels[BCM2836_DMA_NUM_FULL_CHANNELS];
+STATIC HOST_DREQ_LINE     mDreqs[HOST_MAX_DREQS];
+
+STATIC CONST CHAR8        *mTestName;
+STATIC UINTN              mTestFailures;
+STATIC UINTN              mTests;
+STATIC UINTN              mFailedTests;
+
+HOST_DMA                  gHostDma;
+HOST_FIRMWARE             gHostFirmware;
+
+//
+// Simulated time
+//
+
+UINT64
+HostNowNs (
+  VOID
+  )
+{
+  return mNowNs;
+}
+
+VOID
+HostAdvanceNs (
+  IN  UINT64            Ns
+  )
+{
+  mNowNs += Ns;
+}
+
+UINT64
+EFIAPI
+ArmGenericTimerGetSystemCount (
+  VOID
+  )
+{
+  mNowNs += HOST_TIMER_READ_NS;
+  return mNowNs * HOST_TIMER_FREQUENCY / (1000 * HOST_NS_PER_MS);
+}
+
+UINTN
+EFIAPI
+ArmGenericTimerGetTimerFreq (
+  VOID
+  )
+{
+  return HOST_TIMER_FREQUENCY;
+}
+
+//
+// The MMIO bus
+//
+
+HOST_MMIO_REGION *
+HostMapMmio (
+  IN  CONST CHAR8       *Name,
+  IN  UINTN             Base,
+  IN  UINTN             Size,
+  IN  HOST_MMIO_READ    Read,
+  IN  HOST_MMIO_WRITE   Write,
+  IN  VOID              *Context
+  )
+{
+  HOST_MMIO_REGION *Region;
+
+  ASSERT (mRegionCount < HOST_MAX_REGIONS);
+  Region = &mRegions[mRegionCount++];
+  Region->Name = Name;
+  Region->Base = Base;
+  Region->Size = Size;
+  Region->Read = Read;
+  Region->Write = Write;
+  Region->Context = Context;
+  Region->Reads = 0;
+  Region->Writes = 0;
+  return Region;
+}
+
+STATIC
+UINT32
+HostRamRead (
+  IN  VOID              *Context,
+  IN  UINTN             Offset
+  )
+{
+  return ((UINT32 *) Context)[Offset / 4];
+}
+
+STATIC
+VOID
+HostRamWrite (
+  IN  VOID              *Context,
+  IN  UINTN             Offset,
+  IN  UINT32            Value
+  )
+{
+  ((UINT32 *) Context)[Offset / 4] = Value;
+}
+
+HOST_MMIO_REGION *
+HostMapRam (
+  IN  CONST CHAR8       *Name,
+  IN  UINTN             Base,
+  IN  UINTN             Size
+  )
+{
+  return HostMapMmio (Name, Base, Size, HostRamRead, HostRamWrite, AllocateZeroPool (Size));
+}
+
+STATIC
+HOST_MMIO_REGION *
+HostFindRegion (
+  IN  UINTN             Address
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mRegionCount; Index++) {
+    if (Address >= mRegions[Index].Base &&
+        Address - mRegions[Index].Base < mRegions[Index].Size) {
+      return &mRegions[Index];
+    }
+  }
+
+  printf ("Access to unmapped register 0x%lx\n", (UINT64) Address);
+  ASSERT (FALSE);
+  return NULL;
+}
+
+UINT32
+HostPeek32 (
+  IN  UINTN             Address
+  )
+{
+  HOST_MMIO_REGION *Region = HostFindRegion (Address);
+
+  return Region->Read (Region->Context, Address - Region->Base);
+}
+
+UINT32
+EFIAPI
+MmioRead32 (
+  IN  UINTN             Address
+  )
+{
+  HOST_MMIO_REGION *Region = HostFindRegion (Address);
+
+  ASSERT ((Address & 3) == 0);
+  mNowNs += HOST_MMIO_ACCESS_NS;
+  Region->Reads++;
+  return Region->Read (Region->Context, Address - Region->Base);
+}
+
+UINT32
+EFIAPI
+MmioWrite32 (
+  IN  UINTN             Address,
+  IN  UINT32            Value
+  )
+{
+  HOST_MMIO_REGION *Region = HostFindRegion (Address);
+
+  ASSERT ((Address & 3) == 0);
+  mNowNs += HOST_MMIO_ACCESS_NS;
+  Region->Writes++;
+  Region->Write (Region->Context, Address - Region->Base, Value);
+  return Value;
+}
+
+UINT32
+EFIAPI
+MmioOr32 (
+  IN  UINTN             Address,
+  IN  UINT32            OrData
+  )
+{
+  return MmioWrite32 (Address, MmioRead32 (Address) | OrData);
+}
+
+UINT32
+EFIAPI
+MmioAnd32 (
+  IN  UINTN             Address,
+  IN  UINT32            AndData
+  )
+{
+  return MmioWrite32 (Address, MmioRead32 (Address) & AndData);
+}
+
+UINT32
+EFIAPI
+MmioAndThenOr32 (
+  IN  UINTN             Address,
+  IN  UINT32            AndData,
+  IN  UINT32            OrData
+  )
+{
+  return MmioWrite32 (Address, (MmioRead32 (Address) & AndData) | OrData);
+}
+
+//
+// Bcm2836DmaLib. Words only move while the peripheral asserts its DREQ,
+// and only while the CPU polls, which is where the time goes anyway.
+//
+
+VOID
+HostConnectDreq (
+  IN  UINTN             Dreq,
+  IN  HOST_DREQ         Asserted,
+  IN  VOID              *Context
+  )
+{
+  ASSERT (Dreq < HOST_MAX_DREQS);
+  mDreqs[Dreq].Asserted = Asserted;
+  mDreqs[Dreq].Context = Context;
+}
+
+EFI_STATUS
+EFIAPI
+Bcm2836DmaStart (
+  IN  UINTN                 Channel,
+  IN  UINTN                 Dreq,
+  IN  BCM2836_DMA_DIRECTION Direction,
+  IN  UINTN                 FifoAddress,
+  IN  VOID                  *Buffer,
+  IN  UINTN                 Length
+  )
+{
+  HOST_DMA_CHANNEL  *Dma;
+  EFI_STATUS        Status;
+
+  if (Channel >= BCM2836_DMA_NUM_FULL_CHANNELS || Dreq >= HOST_MAX_DREQS ||
+      ((UINTN) Buffer % 4) != 0 || (Length % 4) != 0 || Length == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Length > BCM2836_DMA_MAX_LENGTH) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  Dma = &mDmaChannels[Channel];
+  if (Dma->Busy) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  if (gHostDma.FailStart != EFI_SUCCESS) {
+    Status = gHostDma.FailStart;
+    gHostDma.FailStart = EFI_SUCCESS;
+    return Status;
+  }
+
+  ASSERT (mDreqs[Dreq].Asserted != NULL);
+
+  // Control blocks, cache maintenance and the channel registers.
+  mNowNs += 4 * HOST_MMIO_ACCESS_NS + EFI_SIZE_TO_PAGES (Length) * HOST_NS_PER_US / 4;
+
+  Dma->Busy = TRUE;
+  Dma->Dreq = Dreq;
+  Dma->Direction = Direction;
+  Dma->FifoAddress = FifoAddress;
+  Dma->Buffer = Buffer;
+  Dma->Length = Length;
+  Dma->Done = 0;
+  gHostDma.Starts++;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Bcm2836DmaPoll (
+  IN  UINTN                 Channel
+  )
+{
+  HOST_DMA_CHANNEL  *Dma;
+  HOST_DREQ_LINE    *Line;
+  HOST_MMIO_REGION  *Region;
+  UINT32            Word;
+
+  if (Channel >= BCM2836_DMA_NUM_FULL_CHANNELS || !mDmaChannels[Channel].Busy) {
+    return EFI_NOT_STARTED;
+  }
+
+  Dma = &mDmaChannels[Channel];
+  Line = &mDreqs[Dma->Dreq];
+  Region = HostFindRegion (Dma->FifoAddress);
+
+  // The channel's CS register.
+  mNowNs += HOST_MMIO_ACCESS_NS;
+  gHostDma.Polls++;
+
+  if (gHostDma.FailPoll) {
+    gHostDma.FailPoll = FALSE;
+    Dma->Busy = FALSE;
+    return EFI_DEVICE_ERROR;
+  }
+
+  while (Dma->Done < Dma->Length && Line->Asserted (Line->Context, Dma->Direction)) {
+    if (Dma->Direction == Bcm2836DmaFromDevice) {
+      Word = Region->Read (Region->Context, Dma->FifoAddress - Region->Base);
+      CopyMem (Dma->Buffer + Dma->Done, &Word, sizeof (Word));
+    } else {
+      CopyMem (&Word, Dma->Buffer + Dma->Done, sizeof (Word));
+      Region->Write (Region->Context, Dma->FifoAddress - Region->Base, Word);
+    }
+    Dma->Done += sizeof (Word);
+    gHostDma.Words++;
+    mNowNs += HOST_DMA_WORD_NS;
+  }
+
+  if (Dma->Done < Dma->Length) {
+    return EFI_NOT_READY;
+  }
+
+  Dma->Busy = FALSE;
+  return EFI_SUCCESS;
+}
+
+VOID
+EFIAPI
+Bcm2836DmaAbort (
+  IN  UINTN                 Channel
+  )
+{
+  if (Channel < BCM2836_DMA_NUM_FULL_CHANNELS && mDmaChannels[Channel].Busy) {
+    mDmaChannels[Channel].Busy = FALSE;
+    gHostDma.Aborts++;
+  }
+}
+
+//
+// Events
+//
+
+STATIC
+VOID
+HostDispatch (
+  IN  HOST_EVENT        *Event
+  )
+{
+  EFI_TPL OldTpl;
+
+  if (Event->Tpl <= mTpl) {
+    Event->Pending = TRUE;
+    return;
+  }
+
+  Event->Pending = FALSE;
+  if (Event->Notify != NULL) {
+    OldTpl = mTpl;
+    mTpl = Event->Tpl;
+    Event->Notify (Event, Event->Context);
+    mTpl = OldTpl;
+  }
+}
+
+STATIC
+VOID
+HostDispatchPending (
+  VOID
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (mEvents[Index].InUse && mEvents[Index].Pending && mEvents[Index].Tpl > mTpl) {
+      HostDispatch (&mEvents[Index]);
+    }
+  }
+}
+
+STATIC
+EFI_TPL
+EFIAPI
+HostRaiseTpl (
+  IN  EFI_TPL           NewTpl
+  )
+{
+  EFI_TPL OldTpl = mTpl;
+
+  ASSERT (NewTpl >= OldTpl);
+  mTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+HostRestoreTpl (
+  IN  EFI_TPL           OldTpl
+  )
+{
+  ASSERT (OldTpl <= mTpl);
+  mTpl = OldTpl;
+  HostDispatchPending ();
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEventEx (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  CONST VOID        *NotifyContext,
+  IN  CONST EFI_GUID    *EventGroup,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (!mEvents[Index].InUse) {
+      ZeroMem (&mEvents[Index], sizeof (mEvents[Index]));
+      mEvents[Index].InUse = TRUE;
+      mEvents[Index].Type = Type;
+      mEvents[Index].Tpl = NotifyTpl;
+      mEvents[Index].Notify = NotifyFunction;
+      mEvents[Index].Context = (VOID *) NotifyContext;
+      if (EventGroup != NULL) {
+        mEvents[Index].InGroup = TRUE;
+        CopyGuid (&mEvents[Index].Group, EventGroup);
+      }
+      *Event = &mEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext,
+  OUT EFI_EVENT         *Event
+  )
+{
+  return HostCreateEventEx (Type, NotifyTpl, NotifyFunction, NotifyContext, NULL, Event);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSetTimer (
+  IN  EFI_EVENT         Event,
+  IN  EFI_TIMER_DELAY   Type,
+  IN  UINT64            TriggerTime
+  )
+{
+  HOST_EVENT *Timer = Event;
+
+  ASSERT ((Timer->Type & EVT_TIMER) != 0);
+  Timer->PeriodNs = (Type == TimerPeriodic) ? TriggerTime * 100 : 0;
+  Timer->DueNs = (Type == TimerCancel) ? 0 : mNowNs + MAX (TriggerTime * 100, 1);
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+HostSignalGroup (
+  IN  CONST EFI_GUID    *Group
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (mEvents[Index].InUse && mEvents[Index].InGroup &&
+        CompareGuid (&mEvents[Index].Group, Group)) {
+      HostDispatch (&mEvents[Index]);
+    }
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostSignalEvent (
+  IN  EFI_EVENT         Event
+  )
+{
+  HOST_EVENT *Signalled = Event;
+
+  if (Signalled->InGroup) {
+    HostSignalGroup (&Signalled->Group);
+  } else {
+    HostDispatch (Signalled);
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostCloseEvent (
+  IN  EFI_EVENT         Event
+  )
+{
+  ((HOST_EVENT *) Event)->InUse = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostStall (
+  IN  UINTN             Microseconds
+  )
+{
+  mNowNs += Microseconds * HOST_NS_PER_US;
+  return EFI_SUCCESS;
+}
+
+VOID
+HostRunTimers (
+  IN  UINTN             Ms
+  )
+{
+  HOST_EVENT  *Timer;
+  UINTN       Index;
+
+  mNowNs += Ms * HOST_NS_PER_MS;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    Timer = &mEvents[Index];
+    if (!Timer->InUse || Timer->DueNs == 0 || Timer->DueNs > mNowNs) {
+      continue;
+    }
+
+    if (Timer->PeriodNs != 0) {
+      while (Timer->DueNs <= mNowNs) {
+        Timer->DueNs += Timer->PeriodNs;
+      }
+    } else {
+      Timer->DueNs = 0;
+    }
+    HostDispatch (Timer);
+  }
+}
+
+VOID
+HostExitBootServices (
+  VOID
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (mEvents[Index].InUse && mEvents[Index].Type == EVT_SIGNAL_EXIT_BOOT_SERVICES) {
+      HostDispatch (&mEvents[Index]);
+    }
+  }
+}
+
+//
+// Protocols
+//
+
+STATIC
+EFI_STATUS
+HostAddProtocol (
+  IN OUT EFI_HANDLE     *Handle,
+  IN     EFI_GUID       *Protocol,
+  IN     VOID           *Interface
+  )
+{
+  HOST_HANDLE *Entry;
+  UINTN       Index;
+
+  if (*Handle == NULL) {
+    ASSERT (mHandleCount < HOST_MAX_HANDLES);
+    *Handle = &mHandles[mHandleCount++];
+  }
+
+  Entry = *Handle;
+  for (Index = 0; Index < Entry->Count; Index++) {
+    if (CompareGuid (Entry->Guid[Index], Protocol)) {
+      return EFI_INVALID_PARAMETER;
+    }
+  }
+
+  ASSERT (Entry->Count < HOST_MAX_PROTOCOLS);
+  Entry->Guid[Entry->Count] = Protocol;
+  Entry->Interface[Entry->Count] = Interface;
+  Entry->Count++;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+HostNotifyInstalled (
+  IN  EFI_HANDLE        Handle,
+  IN  EFI_GUID          *Protocol
+  )
+{
+  HOST_NOTIFY *Notify;
+  UINTN       Index;
+
+  for (Index = 0; Index < mNotifyCount; Index++) {
+    Notify = &mNotifies[Index];
+    if (CompareGuid (Notify->Protocol, Protocol)) {
+      ASSERT (Notify->Tail - Notify->Head < HOST_NOTIFY_QUEUE);
+      Notify->Queue[Notify->Tail++ % HOST_NOTIFY_QUEUE] = Handle;
+      HostDispatch (Notify->Event);
+    }
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallProtocolInterface (
+  IN OUT EFI_HANDLE         *Handle,
+  IN     EFI_GUID           *Protocol,
+  IN     EFI_INTERFACE_TYPE InterfaceType,
+  IN     VOID               *Interface
+  )
+{
+  EFI_STATUS Status;
+
+  Status = HostAddProtocol (Handle, Protocol, Interface);
+  if (!EFI_ERROR (Status)) {
+    HostNotifyInstalled (*Handle, Protocol);
+  }
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE     *Handle,
+  ...
+  )
+{
+  EFI_GUID    *Installed[HOST_MAX_PROTOCOLS];
+  UINTN       Count = 0;
+  UINTN       Index;
+  EFI_GUID    *Protocol;
+  EFI_STATUS  Status = EFI_SUCCESS;
+  va_list     Args;
+
+  //
+  // As with the real thing, notifications only go out once everything
+  // is on the handle.
+  //
+  va_start (Args, Handle);
+  while ((Protocol = va_arg (Args, EFI_GUID *)) != NULL) {
+    Status = HostAddProtocol (Handle, Protocol, va_arg (Args, VOID *));
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+    ASSERT (Count < HOST_MAX_PROTOCOLS);
+    Installed[Count++] = Protocol;
+  }
+  va_end (Args);
+
+  for (Index = 0; Index < Count; Index++) {
+    HostNotifyInstalled (*Handle, Installed[Index]);
+  }
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostHandleProtocol (
+  IN  EFI_HANDLE        Handle,
+  IN  EFI_GUID          *Protocol,
+  OUT VOID              **Interface
+  )
+{
+  HOST_HANDLE *Entry = Handle;
+  UINTN       Index;
+
+  for (Index = 0; Index < Entry->Count; Index++) {
+    if (CompareGuid (Entry->Guid[Index], Protocol)) {
+      *Interface = Entry->Interface[Index];
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+HostLocateProtocol (
+  IN  EFI_GUID          *Protocol,
+  OUT VOID              **Interface
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mHandleCount; Index++) {
+    if (!EFI_ERROR (HostHandleProtocol (&mHandles[Index], Protocol, Interface))) {
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostBsLocateProtocol (
+  IN  EFI_GUID          *Protocol,
+  IN  VOID              *Registration,
+  OUT VOID              **Interface
+  )
+{
+  return HostLocateProtocol (Protocol, Interface);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostRegisterProtocolNotify (
+  IN  EFI_GUID          *Protocol,
+  IN  EFI_EVENT         Event,
+  OUT VOID              **Registration
+  )
+{
+  ASSERT (mNotifyCount < HOST_MAX_NOTIFIES);
+  mNotifies[mNotifyCount].Protocol = Protocol;
+  mNotifies[mNotifyCount].Event = Event;
+  *Registration = &mNotifies[mNotifyCount++];
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostLocateHandle (
+  IN     EFI_LOCATE_SEARCH_TYPE SearchType,
+  IN     EFI_GUID               *Protocol,
+  IN     VOID                   *SearchKey,
+  IN OUT UINTN                  *BufferSize,
+  OUT    EFI_HANDLE             *Buffer
+  )
+{
+  HOST_NOTIFY *Notify = SearchKey;
+
+  // Only what protocol notify functions do.
+  ASSERT (SearchType == ByRegisterNotify);
+
+  if (Notify->Head == Notify->Tail) {
+    return EFI_NOT_FOUND;
+  }
+  if (*BufferSize < sizeof (EFI_HANDLE)) {
+    *BufferSize = sizeof (EFI_HANDLE);
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  *Buffer = Notify->Queue[Notify->Head++ % HOST_NOTIFY_QUEUE];
+  *BufferSize = sizeof (EFI_HANDLE);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES mBootServices = {
+  HostRaiseTpl,
+  HostRestoreTpl,
+  HostCreateEvent,
+  HostCreateEventEx,
+  HostSetTimer,
+  HostSignalEvent,
+  HostCloseEvent,
+  HostStall,
+  HostBsLocateProtocol,
+  HostLocateHandle,
+  HostHandleProtocol,
+  HostRegisterProtocolNotify,
+  HostInstallProtocolInterface,
+  HostInstallMultipleProtocolInterfaces
+};
+
+STATIC EFI_SYSTEM_TABLE mSystemTable = {
+  &mBootServices
+};
+
+EFI_HANDLE          gImageHandle;
+EFI_SYSTEM_TABLE    *gST = &mSystemTable;
+EFI_BOOT_SERVICES   *gBS = &mBootServices;
+
+//
+// The firmware protocol. Only what the SD hosts call does anything.
+//
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostGetClockRate (
+  IN  UINT32            ClockId,
+  OUT UINT32            *ClockRate
+  )
+{
+  mNowNs += HOST_MAILBOX_NS;
+  gHostFirmware.ClockQueries++;
+
+  if (ClockId >= HOST_NUM_CLOCKS || gHostFirmware.ClockRate[ClockId] == 0) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  *ClockRate = gHostFirmware.ClockRate[ClockId];
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+EFIAPI
+HostNotifyLedActivity (
+  VOID
+  )
+{
+  gHostFirmware.LedActivity++;
+}
+
+VOID
+HostSetClockRate (
+  IN  UINT32            ClockId,
+  IN  UINT32            Rate
+  )
+{
+  extern EFI_GUID gRaspberryPiClockRateChangedGuid;
+
+  ASSERT (ClockId < HOST_NUM_CLOCKS);
+  mNowNs += HOST_MAILBOX_NS;
+  gHostFirmware.ClockRate[ClockId] = Rate;
+  HostSignalGroup (&gRaspberryPiClockRateChangedGuid);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostFirmwareSetClockRate (
+  IN  UINT32            ClockId,
+  IN  UINT32            ClockRate
+  )
+{
+  if (ClockId >= HOST_NUM_CLOCKS || gHostFirmware.ClockRate[ClockId] == 0) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  HostSetClockRate (ClockId, ClockRate);
+  return EFI_SUCCESS;
+}
+
+STATIC RASPBERRY_PI_FIRMWARE_PROTOCOL mFirmware = {
+  .GetClockRate = HostGetClockRate,
+  .GetMaxClockRate = HostGetClockRate,
+  .GetMinClockRate = HostGetClockRate,
+  .NotifyLedActivity = HostNotifyLedActivity,
+  .SetClockRate = HostFirmwareSetClockRate
+};
+
+VOID
+HostInit (
+  VOID
+  )
+{
+  EFI_HANDLE Handle = NULL;
+
+  // The Pi 3 defaults.
+  gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_EMMC] = 200000000;
+  gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_CORE] = 400000000;
+  gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_ARM] = 1200000000;
+
+  HostAddProtocol (&Handle, &gRaspberryPiFirmwareProtocolGuid, &mFirmware);
+
+  HostMapRam ("GPIO", BCM2836_GPIO_BASE_ADDRESS, 0x100);
+
+  setvbuf (stdout, NULL, _IOLBF, 0);
+}
+
+//
+// Test bookkeeping
+//
+
+VOID
+HostCheck (
+  IN  BOOLEAN           Passed,
+  IN  CONST CHAR8       *Expression,
+  IN  CONST CHAR8       *File,
+  IN  UINTN             Line
+  )
+{
+  if (!Passed) {
+    printf ("    CHECK FAILED %s(%u): %s\n", File, (UINT32) Line, Expression);
+    mTestFailures++;
+  }
+}
+
+VOID
+HostCheckStatus (
+  IN  EFI_STATUS        Status,
+  IN  EFI_STATUS        Expected,
+  IN  CONST CHAR8       *Expression,
+  IN  CONST CHAR8       *File,
+  IN  UINTN             Line
+  )
+{
+  if (Status != Expected) {
+    printf ("    CHECK FAILED %s(%u): %s returned 0x%lx, expected 0x%lx\n",
+      File, (UINT32) Line, Expression, (UINT64) Status, (UINT64) Expected);
+    mTestFailures++;
+  }
+}
+
+VOID
+HostRunTest (
+  IN  CONST CHAR8       *Name,
+  IN  HOST_TEST         Test
+  )
+{
+  mTestName = Name;
+  mTestFailures = 0;
+  mTests++;
+
+  printf ("[ RUN  ] %s\n", Name);
+  Test ();
+  if (mTestFailures != 0) {
+    mFailedTests++;
+    printf ("[ FAIL ] %s\n", Name);
+  } else {
+    printf ("[  OK  ] %s\n", Name);
+  }
+}
+
+VOID
+HostReport (
+  IN  CONST CHAR8       *Format,
+  ...
+  )
+{
+  va_list Args;
+
+  printf ("    ");
+  va_start (Args, Format);
+  vprintf (Format, Args);
+  va_end (Args);
+  printf ("\n");
+}
+
+int
+HostSummary (
+  VOID
+  )
+{
+  printf ("%u tests, %u failed\n", (UINT32) mTests, (UINT32) mFailedTests);
+  return mFailedTests == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+/** @file
+*
+*  Host-side stand-ins for the platform the SD host drivers run on: a
+*  simulated clock, an MMIO bus the register models hang off, the boot
+*  services, the firmware protocol and the DMA engine, plus what the tests
+*  need to check and report.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/Bcm2836DmaLib.h>
+
+#include <Protocol/RaspberryPiFirmware.h>
+
+#include <IndustryStandard/RpiFirmware.h>
+
+//
+// What things cost in simulated time. A CPU access to a peripheral
+// register goes all the way out to the VPU bus and back.
+//
+#define HOST_MMIO_ACCESS_NS       150
+#define HOST_TIMER_READ_NS        10
+#define HOST_DMA_WORD_NS          10
+#define HOST_TIMER_FREQUENCY      19200000
+
+#define HOST_NS_PER_US            1000ULL
+#define HOST_NS_PER_MS            (1000 * HOST_NS_PER_US)
+
+//
+// Simulated time, in nanoseconds since the harness started.
+//
+UINT64
+HostNowNs (
+  VOID
+  );
+
+VOID
+HostAdvanceNs (
+  IN  UINT64            Ns
+  );
+
+//
+// A register block on the simulated bus. Offsets are relative to Base.
+//
+typedef
+UINT32
+(*HOST_MMIO_READ) (
+  IN  VOID              *Context,
+  IN  UINTN             Offset
+  );
+
+typedef
+VOID
+(*HOST_MMIO_WRITE) (
+  IN  VOID              *Context,
+  IN  UINTN             Offset,
+  IN  UINT32            Value
+  );
+
+typedef struct {
+  CONST CHAR8           *Name;
+  UINTN                 Base;
+  UINTN                 Size;
+  HOST_MMIO_READ        Read;
+  HOST_MMIO_WRITE       Write;
+  VOID                  *Context;
+  UINT64                Reads;          // CPU accesses only, DMA is not counted
+  UINT64                Writes;
+} HOST_MMIO_REGION;
+
+HOST_MMIO_REGION *
+HostMapMmio (
+  IN  CONST CHAR8       *Name,
+  IN  UINTN             Base,
+  IN  UINTN             Size,
+  IN  HOST_MMIO_READ    Read,
+  IN  HOST_MMIO_WRITE   Write,
+  IN  VOID              *Context
+  );
+
+//
+// Plain read/write registers, for blocks that only need to hold values.
+//
+HOST_MMIO_REGION *
+HostMapRam (
+  IN  CONST CHAR8       *Name,
+  IN  UINTN             Base,
+  IN  UINTN             Size
+  );
+
+UINT32
+HostPeek32 (
+  IN  UINTN             Address
+  );
+
+//
+// The DMA engine moves words between memory and a peripheral FIFO while
+// the peripheral asserts its DREQ. A model registers the DREQ line.
+//
+typedef
+BOOLEAN
+(*HOST_DREQ) (
+  IN  VOID              *Context,
+  IN  BCM2836_DMA_DIRECTION Direction
+  );
+
+VOID
+HostConnectDreq (
+  IN  UINTN             Dreq,
+  IN  HOST_DREQ         Asserted,
+  IN  VOID              *Context
+  );
+
+typedef struct {
+  EFI_STATUS            FailStart;      // Returned by the next Bcm2836DmaStart
+  BOOLEAN               FailPoll;       // Next busy poll reports an engine error
+  UINT64                Starts;
+  UINT64                Polls;
+  UINT64                Words;
+  UINT64                Aborts;
+} HOST_DMA;
+
+extern HOST_DMA gHostDma;
+
+//
+// The firmware: clock rates as the VPU reports them.
+//
+#define HOST_NUM_CLOCKS           16
+
+typedef struct {
+  UINT32                ClockRate[HOST_NUM_CLOCKS];
+  UINT64                ClockQueries;
+  UINT64                LedActivity;
+} HOST_FIRMWARE;
+
+extern HOST_FIRMWARE gHostFirmware;
+
+//
+// Sets a VPU clock the way the firmware protocol's SetClockRate does,
+// telling the clock rate changed event group about it.
+//
+VOID
+HostSetClockRate (
+  IN  UINT32            ClockId,
+  IN  UINT32            Rate
+  );
+
+//
+// Fires the timer events that are due, after letting Ms go by.
+//
+VOID
+HostRunTimers (
+  IN  UINTN             Ms
+  );
+
+//
+// Signals the exit boot services events.
+//
+VOID
+HostExitBootServices (
+  VOID
+  );
+
+//
+// The protocol database, for the tests to find what drivers installed.
+//
+EFI_STATUS
+HostLocateProtocol (
+  IN  EFI_GUID          *Protocol,
+  OUT VOID              **Interface
+  );
+
+//
+// Counters the tests check nothing unexpected happened against.
+//
+typedef struct {
+  UINT64                Errors;         // DEBUG_ERROR prints
+  UINT64                Asserts;
+} HOST_DEBUG;
+
+extern HOST_DEBUG gHostDebug;
+
+VOID
+HostInit (
+  VOID
+  );
+
+//
+// Test bookkeeping. CHECK failures are counted against the running test
+// and do not stop it.
+//
+#define CHECK(Expression) \
+  HostCheck ((Expression) ? TRUE : FALSE, #Expression, __FILE__, __LINE__)
+
+#define CHECK_STATUS(Expression, Expected) \
+  HostCheckStatus ((Expression), (Expected), #Expression, __FILE__, __LINE__)
+
+VOID
+HostCheck (
+  IN  BOOLEAN           Passed,
+  IN  CONST CHAR8       *Expression,
+  IN  CONST CHAR8       *File,
+  IN  UINTN             Line
+  );
+
+VOID
+HostCheckStatus (
+  IN  EFI_STATUS        Status,
+  IN  EFI_STATUS        Expected,
+  IN  CONST CHAR8       *Expression,
+  IN  CONST CHAR8       *File,
+  IN  UINTN             Line
+  );
+
+typedef
+VOID
+(*HOST_TEST) (
+  VOID
+  );
+
+VOID
+HostRunTest (
+  IN  CONST CHAR8       *Name,
+  IN  HOST_TEST         Test
+  );
+
+//
+// One line of measurements under the running test.
+//
+VOID
+HostReport (
+  IN  CONST CHAR8       *Format,
+  ...
+  );
+
+//
+// Prints the summary, returns the process exit code.
+//
+int
+HostSummary (
+  VOID
+  );
+
+#endif /* __HOST_H__ */
@@ -0,0 +1,530 @@
+/** @file
+*
+*  Host builds of the MdePkg libraries the SD host drivers link against,
+*  the GUIDs they reference and the PCDs of the package.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Library/DevicePathLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/EraseBlock.h>
+#include <Protocol/MmcHost.h>
+#include <Protocol/RaspberryPiMmcStats.h>
+
+#include "Host.h"
+
+EFI_GUID gEfiBlockIoProtocolGuid =
+  { 0x964E5B21, 0x6459, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+EFI_GUID gEfiDevicePathProtocolGuid =
+  { 0x09576E91, 0x6D3F, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+EFI_GUID gEfiEraseBlockProtocolGuid =
+  { 0x95A9A93E, 0xA86E, 0x4926, { 0xAA, 0xEF, 0x99, 0x18, 0xE7, 0x72, 0xD9, 0x87 } };
+EFI_GUID gEfiMmcHostProtocolGuid =
+  { 0x3E591C00, 0x9E4A, 0x11DF, { 0x92, 0x44, 0x00, 0x02, 0xA5, 0xD5, 0xC5, 0x1B } };
+EFI_GUID gRaspberryPiFirmwareProtocolGuid = RASPBERRY_PI_FIRMWARE_PROTOL_GUID;
+EFI_GUID gRaspberryPiMmcStatsProtocolGuid = RASPBERRY_PI_MMC_STATS_PROTOCOL_GUID;
+EFI_GUID gRaspberryPiClockRateChangedGuid =
+  { 0xAA1F8F63, 0x2520, 0x41CA, { 0x98, 0xB3, 0x53, 0xC6, 0x5C, 0x84, 0x9C, 0x45 } };
+EFI_GUID gRaspberryPiArasanMmcHostDevicePathGuid =
+  { 0xB615F1F5, 0x5088, 0x43CD, { 0x80, 0x9C, 0xA1, 0x6E, 0x52, 0x48, 0x7D, 0x00 } };
+EFI_GUID gRaspberryPiSdHostDevicePathGuid =
+  { 0x58ABD787, 0xF64D, 0x4CA2, { 0xA0, 0x34, 0xB9, 0xAC, 0x2D, 0x5A, 0xD0, 0xCF } };
+
+//
+// PCDs, with the defaults of RaspberryPiPkg.dec.
+//
+UINT32 gHostPcdArasanDmaChannel = 4;
+UINT32 gHostPcdArasanMaxBusWidth = 4;
+UINT32 gHostPcdSdHostDmaChannel = 5;
+UINT32 gHostPcdSdHostPioBurstWords = 16;
+UINT32 gHostPcdSdController = 0;
+
+HOST_DEBUG gHostDebug;
+
+//
+// BaseLib
+//
+
+UINT64
+EFIAPI
+MultU64x32 (
+  IN  UINT64  Multiplicand,
+  IN  UINT32  Multiplier
+  )
+{
+  return Multiplicand * Multiplier;
+}
+
+UINT64
+EFIAPI
+MultU64x64 (
+  IN  UINT64  Multiplicand,
+  IN  UINT64  Multiplier
+  )
+{
+  return Multiplicand * Multiplier;
+}
+
+UINT64
+EFIAPI
+DivU64x32 (
+  IN  UINT64  Dividend,
+  IN  UINT32  Divisor
+  )
+{
+  ASSERT (Divisor != 0);
+  return Dividend / Divisor;
+}
+
+UINT32
+EFIAPI
+ModU64x32 (
+  IN  UINT64  Dividend,
+  IN  UINT32  Divisor
+  )
+{
+  ASSERT (Divisor != 0);
+  return (UINT32) (Dividend % Divisor);
+}
+
+UINT64
+EFIAPI
+DivU64x64Remainder (
+  IN  UINT64  Dividend,
+  IN  UINT64  Divisor,
+  OUT UINT64  *Remainder OPTIONAL
+  )
+{
+  ASSERT (Divisor != 0);
+  if (Remainder != NULL) {
+    *Remainder = Dividend % Divisor;
+  }
+  return Dividend / Divisor;
+}
+
+INTN
+EFIAPI
+HighBitSet64 (
+  IN  UINT64  Operand
+  )
+{
+  if (Operand == 0) {
+    return -1;
+  }
+  return 63 - __builtin_clzll (Operand);
+}
+
+VOID
+EFIAPI
+CpuPause (
+  VOID
+  )
+{
+}
+
+VOID
+EFIAPI
+MemoryFence (
+  VOID
+  )
+{
+}
+
+//
+// BaseMemoryLib
+//
+
+VOID *
+EFIAPI
+CopyMem (
+  OUT VOID        *Destination,
+  IN  CONST VOID  *Source,
+  IN  UINTN       Length
+  )
+{
+  return memmove (Destination, Source, Length);
+}
+
+VOID *
+EFIAPI
+SetMem (
+  OUT VOID    *Buffer,
+  IN  UINTN   Length,
+  IN  UINT8   Value
+  )
+{
+  return memset (Buffer, Value, Length);
+}
+
+VOID *
+EFIAPI
+ZeroMem (
+  OUT VOID    *Buffer,
+  IN  UINTN   Length
+  )
+{
+  return memset (Buffer, 0, Length);
+}
+
+INTN
+EFIAPI
+CompareMem (
+  IN  CONST VOID  *DestinationBuffer,
+  IN  CONST VOID  *SourceBuffer,
+  IN  UINTN       Length
+  )
+{
+  return memcmp (DestinationBuffer, SourceBuffer, Length);
+}
+
+BOOLEAN
+EFIAPI
+CompareGuid (
+  IN  CONST EFI_GUID  *Guid1,
+  IN  CONST EFI_GUID  *Guid2
+  )
+{
+  return memcmp (Guid1, Guid2, sizeof (EFI_GUID)) == 0;
+}
+
+EFI_GUID *
+EFIAPI
+CopyGuid (
+  OUT EFI_GUID        *DestinationGuid,
+  IN  CONST EFI_GUID  *SourceGuid
+  )
+{
+  return memcpy (DestinationGuid, SourceGuid, sizeof (EFI_GUID));
+}
+
+//
+// MemoryAllocationLib
+//
+
+VOID *
+EFIAPI
+AllocatePool (
+  IN  UINTN   AllocationSize
+  )
+{
+  return malloc (AllocationSize);
+}
+
+VOID *
+EFIAPI
+AllocateZeroPool (
+  IN  UINTN   AllocationSize
+  )
+{
+  return calloc (1, AllocationSize);
+}
+
+VOID
+EFIAPI
+FreePool (
+  IN  VOID    *Buffer
+  )
+{
+  free (Buffer);
+}
+
+//
+// DevicePathLib
+//
+
+UINT8
+EFIAPI
+DevicePathType (
+  IN  CONST VOID  *Node
+  )
+{
+  return ((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->Type;
+}
+
+UINT8
+EFIAPI
+DevicePathSubType (
+  IN  CONST VOID  *Node
+  )
+{
+  return ((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->SubType;
+}
+
+UINTN
+EFIAPI
+DevicePathNodeLength (
+  IN  CONST VOID  *Node
+  )
+{
+  CONST EFI_DEVICE_PATH_PROTOCOL *Path = Node;
+
+  return Path->Length[0] | (Path->Length[1] << 8);
+}
+
+BOOLEAN
+EFIAPI
+IsDevicePathEnd (
+  IN  CONST VOID  *Node
+  )
+{
+  return DevicePathType (Node) == END_DEVICE_PATH_TYPE &&
+         DevicePathSubType (Node) == END_ENTIRE_DEVICE_PATH_SUBTYPE;
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+NextDevicePathNode (
+  IN  CONST VOID  *Node
+  )
+{
+  return (EFI_DEVICE_PATH_PROTOCOL *) ((CONST UINT8 *) Node + DevicePathNodeLength (Node));
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+CreateDeviceNode (
+  IN  UINT8   NodeType,
+  IN  UINT8   NodeSubType,
+  IN  UINT16  NodeLength
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL *Node;
+
+  if (NodeLength < sizeof (EFI_DEVICE_PATH_PROTOCOL)) {
+    return NULL;
+  }
+
+  Node = AllocateZeroPool (NodeLength);
+  if (Node != NULL) {
+    Node->Type = NodeType;
+    Node->SubType = NodeSubType;
+    Node->Length[0] = (UINT8) NodeLength;
+    Node->Length[1] = (UINT8) (NodeLength >> 8);
+  }
+  return Node;
+}
+
+//
+// UefiLib
+//
+
+EFI_EVENT
+EFIAPI
+EfiCreateProtocolNotifyEvent (
+  IN  EFI_GUID          *ProtocolGuid,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT VOID              **Registration
+  )
+{
+  EFI_STATUS  Status;
+  EFI_EVENT   Event;
+
+  Status = gBS->CreateEvent (EVT_NOTIFY_SIGNAL, NotifyTpl, NotifyFunction,
+                  NotifyContext, &Event);
+  ASSERT_EFI_ERROR (Status);
+
+  Status = gBS->RegisterProtocolNotify (ProtocolGuid, Event, Registration);
+  ASSERT_EFI_ERROR (Status);
+
+  // Kick the event, for protocols installed before the registration.
+  gBS->SignalEvent (Event);
+  return Event;
+}
+
+//
+// DebugLib. The EDK2 format strings differ from printf: %a is an ASCII
+// string, %s a CHAR16 one, %r an EFI_STATUS, and the integer conversions
+// take 32 bits unless prefixed with l.
+//
+
+STATIC CONST CHAR8 *
+HostStatusString (
+  IN  EFI_STATUS  Status
+  )
+{
+  STATIC CONST CHAR8 *Errors[] = {
+    "Success", "Load Error", "Invalid Parameter", "Unsupported",
+    "Bad Buffer Size", "Buffer Too Small", "Not Ready", "Device Error",
+    "Write Protected", "Out of Resources", "Volume Corrupt", "Volume Full",
+    "No Media", "Media changed", "Not Found", "Access Denied",
+    "No Response", "No mapping", "Time out", "Not started",
+    "Already started", "Aborted"
+  };
+  UINTN Code = Status & ~ENCODE_ERROR (0);
+
+  if (Status == EFI_SUCCESS) {
+    return Errors[0];
+  }
+  if (EFI_ERROR (Status) && Code < ARRAY_SIZE (Errors)) {
+    return Errors[Code];
+  }
+  return "Unknown";
+}
+
+STATIC
+VOID
+HostFormat (
+  OUT CHAR8         *Buffer,
+  IN  UINTN         Size,
+  IN  CONST CHAR8   *Format,
+  IN  va_list       Args
+  )
+{
+  CHAR8       Spec[16];
+  CHAR8       *Out = Buffer;
+  CHAR8       *End = Buffer + Size - 1;
+  UINTN       SpecLength;
+  BOOLEAN     Long;
+  INTN        Written;
+  CONST CHAR16 *Wide;
+
+  while (*Format != '\0' && Out < End) {
+    if (*Format != '%') {
+      *Out++ = *Format++;
+      continue;
+    }
+
+    //
+    // Flags, width and precision carry over to printf as they are.
+    //
+    Spec[0] = '%';
+    SpecLength = 1;
+    Format++;
+    while ((*Format == '-' || *Format == '.' || (*Format >= '0' && *Format <= '9')) &&
+           SpecLength < sizeof (Spec) - 4) {
+      Spec[SpecLength++] = *Format++;
+    }
+    Long = FALSE;
+    while (*Format == 'l' || *Format == 'L') {
+      Long = TRUE;
+      Format++;
+    }
+
+    Written = 0;
+    switch (*Format) {
+    case 'a':
+      Spec[SpecLength++] = 's';
+      Spec[SpecLength] = '\0';
+      Written = snprintf (Out, End - Out + 1, Spec, va_arg (Args, CONST CHAR8 *));
+      break;
+    case 's':
+    case 'S':
+      Wide = va_arg (Args, CONST CHAR16 *);
+      while (Wide != NULL && *Wide != 0 && Out + Written < End) {
+        Out[Written++] = (CHAR8) *Wide++;
+      }
+      break;
+    case 'r':
+      Spec[SpecLength++] = 's';
+      Spec[SpecLength] = '\0';
+      Written = snprintf (Out, End - Out + 1, Spec, HostStatusString (va_arg (Args, EFI_STATUS)));
+      break;
+    case 'c':
+      Out[Written++] = (CHAR8) va_arg (Args, int);
+      break;
+    case 'p':
+      Written = snprintf (Out, End - Out + 1, "%p", va_arg (Args, VOID *));
+      break;
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (Long) {
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = 'l';
+      }
+      Spec[SpecLength++] = *Format == 'i' ? 'd' : *Format;
+      Spec[SpecLength] = '\0';
+      if (Long) {
+        Written = snprintf (Out, End - Out + 1, Spec, va_arg (Args, UINT64));
+      } else {
+        Written = snprintf (Out, End - Out + 1, Spec, va_arg (Args, UINT32));
+      }
+      break;
+    case '%':
+      Out[Written++] = '%';
+      break;
+    default:
+      Out[Written++] = '?';
+      break;
+    }
+
+    if (*Format != '\0') {
+      Format++;
+    }
+    Out += MIN ((UINTN) MAX (Written, 0), (UINTN) (End - Out));
+  }
+
+  *Out = '\0';
+}
+
+VOID
+EFIAPI
+DebugPrint (
+  IN  UINTN         ErrorLevel,
+  IN  CONST CHAR8   *Format,
+  ...
+  )
+{
+  STATIC INTN   Level = -1;
+  CHAR8         Buffer[512];
+  CONST CHAR8   *Env;
+  va_list       Args;
+
+  if (Level < 0) {
+    Env = getenv ("HOST_DEBUG");
+    Level = Env != NULL ? atoi (Env) : 0;
+  }
+
+  if (ErrorLevel & DEBUG_ERROR) {
+    gHostDebug.Errors++;
+  }
+
+  //
+  // HOST_DEBUG=1 shows errors and info, 2 everything.
+  //
+  if (Level == 0 || (Level == 1 && (ErrorLevel & (DEBUG_ERROR | DEBUG_INFO | DEBUG_WARN)) == 0)) {
+    return;
+  }
+
+  va_start (Args, Format);
+  HostFormat (Buffer, sizeof (Buffer), Format, Args);
+  va_end (Args);
+
+  printf ("      | %s", Buffer);
+  if (Buffer[0] == '\0' || Buffer[strlen (Buffer) - 1] != '\n') {
+    printf ("\n");
+  }
+}
+
+VOID
+EFIAPI
+DebugAssert (
+  IN  CONST CHAR8   *FileName,
+  IN  UINTN         LineNumber,
+  IN  CONST CHAR8   *Description
+  )
+{
+  gHostDebug.Asserts++;
+  printf ("ASSERT %s(%u): %s\n", FileName, (UINT32) LineNumber, Description);
+  fflush (stdout);
+  abort ();
+}
@@ -0,0 +1,21 @@
+/** @file
+*
+*  Host build of ArmGenericTimerCounterLib, counting simulated time.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __ARM_GENERIC_TIMER_COUNTER_LIB_H__
+#define __ARM_GENERIC_TIMER_COUNTER_LIB_H__
+
+UINT64 EFIAPI ArmGenericTimerGetSystemCount (VOID);
+UINTN  EFIAPI ArmGenericTimerGetTimerFreq (VOID);
+
+#endif
@@ -0,0 +1,28 @@
+/** @file
+*
+*  Host build of the BaseLib functions the SD hosts use.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BASE_LIB__
+#define __BASE_LIB__
+
+UINT64 EFIAPI MultU64x32 (IN UINT64 Multiplicand, IN UINT32 Multiplier);
+UINT64 EFIAPI MultU64x64 (IN UINT64 Multiplicand, IN UINT64 Multiplier);
+UINT64 EFIAPI DivU64x32 (IN UINT64 Dividend, IN UINT32 Divisor);
+UINT32 EFIAPI ModU64x32 (IN UINT64 Dividend, IN UINT32 Divisor);
+UINT64 EFIAPI DivU64x64Remainder (IN UINT64 Dividend, IN UINT64 Divisor,
+                OUT UINT64 *Remainder OPTIONAL);
+INTN   EFIAPI HighBitSet64 (IN UINT64 Operand);
+VOID   EFIAPI CpuPause (VOID);
+VOID   EFIAPI MemoryFence (VOID);
+
+#endif
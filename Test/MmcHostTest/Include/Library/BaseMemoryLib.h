@@ -0,0 +1,26 @@
+/** @file
+*
+*  Host build of BaseMemoryLib.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __BASE_MEMORY_LIB__
+#define __BASE_MEMORY_LIB__
+
+VOID *    EFIAPI CopyMem (OUT VOID *Destination, IN CONST VOID *Source, IN UINTN Length);
+VOID *    EFIAPI SetMem (OUT VOID *Buffer, IN UINTN Length, IN UINT8 Value);
+VOID *    EFIAPI ZeroMem (OUT VOID *Buffer, IN UINTN Length);
+INTN      EFIAPI CompareMem (IN CONST VOID *DestinationBuffer, IN CONST VOID *SourceBuffer,
+                   IN UINTN Length);
+BOOLEAN   EFIAPI CompareGuid (IN CONST EFI_GUID *Guid1, IN CONST EFI_GUID *Guid2);
+EFI_GUID *EFIAPI CopyGuid (OUT EFI_GUID *DestinationGuid, IN CONST EFI_GUID *SourceGuid);
+
+#endif
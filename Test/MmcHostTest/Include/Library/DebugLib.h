@@ -0,0 +1,56 @@
+/** @file
+*
+*  Host build of DebugLib. DEBUG () goes to stdout when HOST_DEBUG is set
+*  in the environment; a failed ASSERT () fails the test run.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __DEBUG_LIB_H__
+#define __DEBUG_LIB_H__
+
+#define DEBUG_INIT      0x00000001
+#define DEBUG_WARN      0x00000002
+#define DEBUG_INFO      0x00000040
+#define DEBUG_VERBOSE   0x00400000
+#define DEBUG_ERROR     0x80000000
+
+VOID
+EFIAPI
+DebugPrint (
+  IN  UINTN         ErrorLevel,
+  IN  CONST CHAR8   *Format,
+  ...
+  );
+
+VOID
+EFIAPI
+DebugAssert (
+  IN  CONST CHAR8   *FileName,
+  IN  UINTN         LineNumber,
+  IN  CONST CHAR8   *Description
+  );
+
+#define DEBUG(Expression)         \
+  do {                            \
+    DebugPrint Expression;        \
+  } while (FALSE)
+
+#define ASSERT(Expression)        \
+  do {                            \
+    if (!(Expression)) {          \
+      DebugAssert (__FILE__, __LINE__, #Expression); \
+    }                             \
+  } while (FALSE)
+
+#define ASSERT_EFI_ERROR(StatusParameter) \
+  ASSERT (!EFI_ERROR (StatusParameter))
+
+#endif
@@ -0,0 +1,28 @@
+/** @file
+*
+*  Host build of the DevicePathLib node helpers.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __DEVICE_PATH_LIB_H__
+#define __DEVICE_PATH_LIB_H__
+
+#include <Protocol/DevicePath.h>
+
+UINT8   EFIAPI DevicePathType (IN CONST VOID *Node);
+UINT8   EFIAPI DevicePathSubType (IN CONST VOID *Node);
+UINTN   EFIAPI DevicePathNodeLength (IN CONST VOID *Node);
+BOOLEAN EFIAPI IsDevicePathEnd (IN CONST VOID *Node);
+EFI_DEVICE_PATH_PROTOCOL * EFIAPI NextDevicePathNode (IN CONST VOID *Node);
+EFI_DEVICE_PATH_PROTOCOL * EFIAPI CreateDeviceNode (IN UINT8 NodeType, IN UINT8 NodeSubType,
+                                     IN UINT16 NodeLength);
+
+#endif
@@ -0,0 +1,26 @@
+/** @file
+*
+*  Host build of DmaLib. The SD hosts include it, mapping goes through
+*  Bcm2836DmaLib, which the harness replaces.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __DMA_LIB_H__
+#define __DMA_LIB_H__
+
+typedef enum {
+  MapOperationBusMasterRead,
+  MapOperationBusMasterWrite,
+  MapOperationBusMasterCommonBuffer,
+  MapOperationMaximum
+} DMA_MAP_OPERATION;
+
+#endif
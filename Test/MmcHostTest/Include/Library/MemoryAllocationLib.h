@@ -0,0 +1,22 @@
+/** @file
+*
+*  Host build of MemoryAllocationLib, on top of the C heap.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __MEMORY_ALLOCATION_LIB_H__
+#define __MEMORY_ALLOCATION_LIB_H__
+
+VOID * EFIAPI AllocatePool (IN UINTN AllocationSize);
+VOID * EFIAPI AllocateZeroPool (IN UINTN AllocationSize);
+VOID   EFIAPI FreePool (IN VOID *Buffer);
+
+#endif
@@ -0,0 +1,22 @@
+/** @file
+*
+*  Host build of PcdLib. As with the EDK2 AutoGen, each module's AutoGen.h
+*  maps its PCDs, here onto variables the tests may change.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __PCD_LIB_H__
+#define __PCD_LIB_H__
+
+#define PcdGet32(TokenName)         _PCD_GET_MODE_32_##TokenName
+#define FixedPcdGet32(TokenName)    _PCD_VALUE_##TokenName
+
+#endif
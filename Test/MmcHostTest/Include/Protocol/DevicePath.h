@@ -0,0 +1,42 @@
+/** @file
+*
+*  Host build of the device path protocol: the nodes the SD hosts build.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __DEVICE_PATH_H__
+#define __DEVICE_PATH_H__
+
+#pragma pack(1)
+
+typedef struct {
+  UINT8   Type;
+  UINT8   SubType;
+  UINT8   Length[2];
+} EFI_DEVICE_PATH_PROTOCOL;
+
+typedef EFI_DEVICE_PATH_PROTOCOL  EFI_DEVICE_PATH;
+
+typedef struct {
+  EFI_DEVICE_PATH_PROTOCOL  Header;
+  EFI_GUID                  Guid;
+} VENDOR_DEVICE_PATH;
+
+#pragma pack()
+
+#define HARDWARE_DEVICE_PATH            0x01
+#define HW_VENDOR_DP                    0x04
+#define END_DEVICE_PATH_TYPE            0x7f
+#define END_ENTIRE_DEVICE_PATH_SUBTYPE  0xFF
+
+extern EFI_GUID gEfiDevicePathProtocolGuid;
+
+#endif
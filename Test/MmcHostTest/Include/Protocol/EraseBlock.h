@@ -0,0 +1,45 @@
+/** @file
+*
+*  Host build of EFI_ERASE_BLOCK_PROTOCOL.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __EFI_ERASE_BLOCK_PROTOCOL_H__
+#define __EFI_ERASE_BLOCK_PROTOCOL_H__
+
+#define EFI_ERASE_BLOCK_PROTOCOL_REVISION ((2 << 16) | (60))
+
+typedef struct _EFI_ERASE_BLOCK_PROTOCOL EFI_ERASE_BLOCK_PROTOCOL;
+
+typedef struct {
+  EFI_EVENT   Event;
+  EFI_STATUS  TransactionStatus;
+} EFI_ERASE_BLOCK_TOKEN;
+
+typedef
+EFI_STATUS
+(EFIAPI *EFI_BLOCK_ERASE) (
+  IN     EFI_ERASE_BLOCK_PROTOCOL *This,
+  IN     UINT32                   MediaId,
+  IN     EFI_LBA                  LBA,
+  IN OUT EFI_ERASE_BLOCK_TOKEN    *Token,
+  IN     UINTN                    Size
+  );
+
+struct _EFI_ERASE_BLOCK_PROTOCOL {
+  UINT64            Revision;
+  UINT32            EraseLengthGranularity;
+  EFI_BLOCK_ERASE   EraseBlocks;
+};
+
+extern EFI_GUID gEfiEraseBlockProtocolGuid;
+
+#endif
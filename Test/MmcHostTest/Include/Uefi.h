@@ -0,0 +1,216 @@
+/** @file
+*
+*  Host build of the UEFI base types, enough of them to compile the SD
+*  host drivers and MmcHostCommonLib with the system compiler.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __UEFI_H__
+#define __UEFI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef int8_t    INT8;
+typedef int16_t   INT16;
+typedef int32_t   INT32;
+typedef int64_t   INT64;
+typedef uintptr_t UINTN;
+typedef intptr_t  INTN;
+typedef UINT8     BOOLEAN;
+typedef char      CHAR8;
+typedef UINT16    CHAR16;         // Built with -fshort-wchar, so L"" matches
+
+#define VOID      void
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+#define STATIC    static
+#define CONST     const
+#define TRUE      ((BOOLEAN)1)
+#define FALSE     ((BOOLEAN)0)
+
+typedef UINTN     EFI_STATUS;
+typedef UINTN     RETURN_STATUS;
+typedef VOID      *EFI_HANDLE;
+typedef VOID      *EFI_EVENT;
+typedef UINTN     EFI_TPL;
+typedef UINT64    EFI_LBA;
+typedef UINT64    EFI_PHYSICAL_ADDRESS;
+
+typedef struct {
+  UINT32  Data1;
+  UINT16  Data2;
+  UINT16  Data3;
+  UINT8   Data4[8];
+} EFI_GUID;
+
+typedef struct _LIST_ENTRY LIST_ENTRY;
+struct _LIST_ENTRY {
+  LIST_ENTRY  *ForwardLink;
+  LIST_ENTRY  *BackLink;
+};
+
+#define BIT0      0x00000001
+#define BIT1      0x00000002
+#define BIT2      0x00000004
+#define BIT3      0x00000008
+#define BIT4      0x00000010
+#define BIT5      0x00000020
+#define BIT6      0x00000040
+#define BIT7      0x00000080
+#define BIT8      0x00000100
+#define BIT9      0x00000200
+#define BIT10     0x00000400
+#define BIT11     0x00000800
+#define BIT12     0x00001000
+#define BIT13     0x00002000
+#define BIT14     0x00004000
+#define BIT15     0x00008000
+#define BIT16     0x00010000
+#define BIT17     0x00020000
+#define BIT18     0x00040000
+#define BIT19     0x00080000
+#define BIT20     0x00100000
+#define BIT21     0x00200000
+#define BIT22     0x00400000
+#define BIT23     0x00800000
+#define BIT24     0x01000000
+#define BIT25     0x02000000
+#define BIT26     0x04000000
+#define BIT27     0x08000000
+#define BIT28     0x10000000
+#define BIT29     0x20000000
+#define BIT30     0x40000000
+#define BIT31     0x80000000
+
+#define SIZE_1KB    0x00000400
+#define SIZE_4KB    0x00001000
+#define SIZE_64KB   0x00010000
+#define SIZE_128KB  0x00020000
+#define SIZE_1MB    0x00100000
+
+#define MAX_UINT32  ((UINT32)0xFFFFFFFF)
+#define MAX_UINT64  ((UINT64)0xFFFFFFFFFFFFFFFFULL)
+
+#define MIN(a, b)   (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)   (((a) > (b)) ? (a) : (b))
+#define ARRAY_SIZE(Array)   (sizeof (Array) / sizeof ((Array)[0]))
+
+#define BASE_CR(Record, TYPE, Field) \
+  ((TYPE *) ((CHAR8 *) (Record) - offsetof (TYPE, Field)))
+#define CR(Record, TYPE, Field, Signature)  BASE_CR (Record, TYPE, Field)
+#define SIGNATURE_16(A, B)        ((A) | ((B) << 8))
+#define SIGNATURE_32(A, B, C, D)  (SIGNATURE_16 (A, B) | (SIGNATURE_16 (C, D) << 16))
+
+#define EFI_PAGE_SIZE             SIZE_4KB
+#define EFI_SIZE_TO_PAGES(Size)   (((Size) + EFI_PAGE_SIZE - 1) / EFI_PAGE_SIZE)
+
+#define ENCODE_ERROR(Code)        ((EFI_STATUS) (((UINTN) 1 << (sizeof (UINTN) * 8 - 1)) | (Code)))
+#define EFI_ERROR(Status)         (((INTN) (EFI_STATUS) (Status)) < 0)
+
+#define EFI_SUCCESS               0
+#define EFI_LOAD_ERROR            ENCODE_ERROR (1)
+#define EFI_INVALID_PARAMETER     ENCODE_ERROR (2)
+#define EFI_UNSUPPORTED           ENCODE_ERROR (3)
+#define EFI_BAD_BUFFER_SIZE       ENCODE_ERROR (4)
+#define EFI_BUFFER_TOO_SMALL      ENCODE_ERROR (5)
+#define EFI_NOT_READY             ENCODE_ERROR (6)
+#define EFI_DEVICE_ERROR          ENCODE_ERROR (7)
+#define EFI_WRITE_PROTECTED       ENCODE_ERROR (8)
+#define EFI_OUT_OF_RESOURCES      ENCODE_ERROR (9)
+#define EFI_NO_MEDIA              ENCODE_ERROR (12)
+#define EFI_MEDIA_CHANGED         ENCODE_ERROR (13)
+#define EFI_NOT_FOUND             ENCODE_ERROR (14)
+#define EFI_ACCESS_DENIED         ENCODE_ERROR (15)
+#define EFI_NO_RESPONSE           ENCODE_ERROR (16)
+#define EFI_TIMEOUT               ENCODE_ERROR (18)
+#define EFI_NOT_STARTED           ENCODE_ERROR (19)
+#define EFI_ALREADY_STARTED       ENCODE_ERROR (20)
+#define EFI_ABORTED               ENCODE_ERROR (21)
+
+#define TPL_APPLICATION           4
+#define TPL_CALLBACK              8
+#define TPL_NOTIFY                16
+#define TPL_HIGH_LEVEL            31
+
+#define EVT_TIMER                         0x80000000
+#define EVT_NOTIFY_WAIT                   0x00000100
+#define EVT_NOTIFY_SIGNAL                 0x00000200
+#define EVT_SIGNAL_EXIT_BOOT_SERVICES     0x00000201
+
+typedef enum {
+  TimerCancel,
+  TimerPeriodic,
+  TimerRelative
+} EFI_TIMER_DELAY;
+
+typedef enum {
+  EFI_NATIVE_INTERFACE
+} EFI_INTERFACE_TYPE;
+
+typedef enum {
+  AllHandles,
+  ByRegisterNotify,
+  ByProtocol
+} EFI_LOCATE_SEARCH_TYPE;
+
+typedef
+VOID
+(EFIAPI *EFI_EVENT_NOTIFY) (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  );
+
+#include <Protocol/DevicePath.h>
+
+//
+// Only the boot services the code under test calls.
+//
+typedef struct {
+  EFI_TPL     (EFIAPI *RaiseTPL) (IN EFI_TPL NewTpl);
+  VOID        (EFIAPI *RestoreTPL) (IN EFI_TPL OldTpl);
+  EFI_STATUS  (EFIAPI *CreateEvent) (IN UINT32 Type, IN EFI_TPL NotifyTpl,
+                IN EFI_EVENT_NOTIFY NotifyFunction, IN VOID *NotifyContext,
+                OUT EFI_EVENT *Event);
+  EFI_STATUS  (EFIAPI *CreateEventEx) (IN UINT32 Type, IN EFI_TPL NotifyTpl,
+                IN EFI_EVENT_NOTIFY NotifyFunction, IN CONST VOID *NotifyContext,
+                IN CONST EFI_GUID *EventGroup, OUT EFI_EVENT *Event);
+  EFI_STATUS  (EFIAPI *SetTimer) (IN EFI_EVENT Event, IN EFI_TIMER_DELAY Type,
+                IN UINT64 TriggerTime);
+  EFI_STATUS  (EFIAPI *SignalEvent) (IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *CloseEvent) (IN EFI_EVENT Event);
+  EFI_STATUS  (EFIAPI *Stall) (IN UINTN Microseconds);
+  EFI_STATUS  (EFIAPI *LocateProtocol) (IN EFI_GUID *Protocol, IN VOID *Registration,
+                OUT VOID **Interface);
+  EFI_STATUS  (EFIAPI *LocateHandle) (IN EFI_LOCATE_SEARCH_TYPE SearchType,
+                IN EFI_GUID *Protocol, IN VOID *SearchKey, IN OUT UINTN *BufferSize,
+                OUT EFI_HANDLE *Buffer);
+  EFI_STATUS  (EFIAPI *HandleProtocol) (IN EFI_HANDLE Handle, IN EFI_GUID *Protocol,
+                OUT VOID **Interface);
+  EFI_STATUS  (EFIAPI *RegisterProtocolNotify) (IN EFI_GUID *Protocol,
+                IN EFI_EVENT Event, OUT VOID **Registration);
+  EFI_STATUS  (EFIAPI *InstallProtocolInterface) (IN OUT EFI_HANDLE *Handle,
+                IN EFI_GUID *Protocol, IN EFI_INTERFACE_TYPE InterfaceType,
+                IN VOID *Interface);
+  EFI_STATUS  (EFIAPI *InstallMultipleProtocolInterfaces) (IN OUT EFI_HANDLE *Handle, ...);
+} EFI_BOOT_SERVICES;
+
+typedef struct {
+  EFI_BOOT_SERVICES   *BootServices;
+} EFI_SYSTEM_TABLE;
+
+#endif /* __UEFI_H__ */
@@ -0,0 +1,491 @@
+/** @file
+*
+*  The MmcDxe stand-in.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include "MmcDxe.h"
+
+#define MMC_DXE_BLOCK_SIZE        512
+#define MMC_DXE_MAX_BLOCKS        0xFFFF
+#define MMC_DXE_STATUS_POLLS      100000
+#define MMC_DXE_OCR_POLLS         1000
+
+#define MMC_DXE_CMD8_ARG          0x1AA
+#define MMC_DXE_ACMD41_ARG        0x00FF8000
+#define MMC_DXE_ACMD41_HCS        BIT30
+#define MMC_DXE_OCR_POWER_UP      BIT31
+#define MMC_DXE_OCR_CCS           BIT30
+#define MMC_DXE_R1_READY          BIT8
+#define MMC_DXE_R1_STATE(R1)      (((R1) >> 9) & 0xF)
+#define MMC_DXE_STATE_TRAN        4
+#define MMC_DXE_SWITCH_CHECK      0x00FFFFF1
+#define MMC_DXE_SWITCH_SET        0x80FFFFF1
+#define MMC_DXE_ACMD6_4BIT        2
+
+#define MMC_DXE_FROM_BLOCK_IO(a)  BASE_CR (a, MMC_DXE, BlockIo)
+
+//
+// Bits Hi:Lo of a register read back with ReceiveResponse.
+//
+STATIC
+UINT32
+MmcDxeBits (
+  IN  CONST UINT32      *Register,
+  IN  UINTN             Hi,
+  IN  UINTN             Lo
+  )
+{
+  UINT32  Value = 0;
+  UINTN   Bit;
+
+  for (Bit = Hi + 1; Bit-- > Lo; ) {
+    Value = (Value << 1) | ((Register[Bit / 32] >> (Bit % 32)) & 1);
+  }
+  return Value;
+}
+
+STATIC
+EFI_STATUS
+MmcDxeCommand (
+  IN  MMC_DXE           *Mmc,
+  IN  MMC_CMD           Cmd,
+  IN  UINT32            Argument,
+  IN  MMC_RESPONSE_TYPE Type,
+  OUT UINT32            *Response OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Ignored[4];
+
+  Mmc->SendCommands++;
+  Status = Mmc->MmcHost->SendCommand (Mmc->MmcHost, Cmd, Argument);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return Mmc->MmcHost->ReceiveResponse (Mmc->MmcHost, Type, Response != NULL ? Response : Ignored);
+}
+
+STATIC
+EFI_STATUS
+MmcDxeWaitReady (
+  IN  MMC_DXE           *Mmc
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Response[4];
+  UINTN       Polls;
+
+  Response[0] = 0;
+  for (Polls = 0; Polls < MMC_DXE_STATUS_POLLS; Polls++) {
+    Status = MmcDxeCommand (Mmc, MMC_CMD13, Mmc->Rca << 16, MMC_RESPONSE_TYPE_R1, Response);
+    if (!EFI_ERROR (Status) &&
+        ((Response[0] & MMC_DXE_R1_READY) != 0 || MMC_DXE_R1_STATE (Response[0]) == MMC_DXE_STATE_TRAN)) {
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+MmcDxeStopTransmission (
+  IN  MMC_DXE           *Mmc
+  )
+{
+  Mmc->StopTransmissions++;
+  return MmcDxeCommand (Mmc, MMC_CMD12, Mmc->Rca << 16, MMC_RESPONSE_TYPE_R1b, NULL);
+}
+
+STATIC
+EFI_STATUS
+MmcDxeIdentify (
+  IN OUT MMC_DXE        *Mmc
+  )
+{
+  EFI_MMC_HOST_PROTOCOL *Host = Mmc->MmcHost;
+  EFI_STATUS            Status;
+  UINT32                Response[4];
+  UINT32                Argument;
+  UINT32                Speed;
+  UINT32                Width;
+  UINT32                SwitchStatus[16];
+  UINTN                 Polls;
+
+  Mmc->Rca = 0;
+  Mmc->HighSpeed = FALSE;
+
+  Status = Host->NotifyState (Host, MmcHwInitializationState);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  if (!Host->IsCardPresent (Host)) {
+    return EFI_NO_MEDIA;
+  }
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD0, 0, MMC_RESPONSE_TYPE_R1, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Host->NotifyState (Host, MmcIdleState);
+
+  // SDIO only, so expected to go unanswered
+  MmcDxeCommand (Mmc, MMC_CMD5, 0, MMC_RESPONSE_TYPE_R1, NULL);
+
+  Argument = MMC_DXE_ACMD41_ARG;
+  Status = MmcDxeCommand (Mmc, MMC_CMD8, MMC_DXE_CMD8_ARG, MMC_RESPONSE_TYPE_R7, Response);
+  if (!EFI_ERROR (Status) && (Response[0] & 0xFFF) == MMC_DXE_CMD8_ARG) {
+    Argument |= MMC_DXE_ACMD41_HCS;
+  }
+
+  for (Polls = 0; Polls < MMC_DXE_OCR_POLLS; Polls++) {
+    Status = MmcDxeCommand (Mmc, MMC_CMD55, 0, MMC_RESPONSE_TYPE_R1, NULL);
+    if (!EFI_ERROR (Status)) {
+      Status = MmcDxeCommand (Mmc, MMC_ACMD41, Argument, MMC_RESPONSE_TYPE_OCR, Response);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if ((Response[0] & MMC_DXE_OCR_POWER_UP) != 0) {
+      break;
+    }
+    gBS->Stall (1000);
+  }
+  if (Polls == MMC_DXE_OCR_POLLS) {
+    return EFI_TIMEOUT;
+  }
+  Mmc->HighCapacity = (Response[0] & MMC_DXE_OCR_CCS) != 0;
+  Host->NotifyState (Host, MmcReadyState);
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD2, 0, MMC_RESPONSE_TYPE_CID, Response);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Host->NotifyState (Host, MmcIdentificationState);
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD3, 0, MMC_RESPONSE_TYPE_RCA, Response);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Mmc->Rca = Response[0] >> 16;
+  Status = Host->NotifyState (Host, MmcStandByState);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD9, Mmc->Rca << 16, MMC_RESPONSE_TYPE_CSD, Mmc->Csd);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD7, Mmc->Rca << 16, MMC_RESPONSE_TYPE_R1b, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Host->NotifyState (Host, MmcTransferState);
+
+  Status = MmcDxeCommand (Mmc, MMC_CMD55, Mmc->Rca << 16, MMC_RESPONSE_TYPE_R1, NULL);
+  if (!EFI_ERROR (Status)) {
+    Status = MmcDxeCommand (Mmc, MMC_ACMD51, 0, MMC_RESPONSE_TYPE_R1, NULL);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = Host->ReadBlockData (Host, 0, sizeof (Mmc->Scr), (UINT32 *) Mmc->Scr);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Speed = 25000000;
+  if ((Mmc->Scr[0] & 0xF) >= 1) {
+    Status = MmcDxeCommand (Mmc, MMC_CMD6, MMC_DXE_SWITCH_CHECK, MMC_RESPONSE_TYPE_R1, NULL);
+    if (!EFI_ERROR (Status)) {
+      Status = Host->ReadBlockData (Host, 0, sizeof (SwitchStatus), SwitchStatus);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    if ((((UINT8 *) SwitchStatus)[13] & BIT1) != 0) {
+      Status = MmcDxeCommand (Mmc, MMC_CMD6, MMC_DXE_SWITCH_SET, MMC_RESPONSE_TYPE_R1, NULL);
+      if (!EFI_ERROR (Status)) {
+        Status = Host->ReadBlockData (Host, 0, sizeof (SwitchStatus), SwitchStatus);
+      }
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      if ((((UINT8 *) SwitchStatus)[16] & 0xF) == 1) {
+        Mmc->HighSpeed = TRUE;
+        Speed = 50000000;
+      }
+    }
+  }
+
+  Width = 1;
+  if ((Mmc->Scr[1] & BIT2) != 0) {
+    Status = MmcDxeCommand (Mmc, MMC_CMD55, Mmc->Rca << 16, MMC_RESPONSE_TYPE_R1, NULL);
+    if (!EFI_ERROR (Status)) {
+      Status = MmcDxeCommand (Mmc, MMC_CMD6, MMC_DXE_ACMD6_4BIT, MMC_RESPONSE_TYPE_R1, NULL);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Width = 4;
+  }
+
+  if (Host->SetIos != NULL) {
+    Status = Host->SetIos (Host, Speed, Width, EMMCBACKWARD);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  // By the card type, as MmcDxe does, not by CSD_STRUCTURE
+  if (Mmc->HighCapacity) {
+    Mmc->Media.LastBlock = ((UINT64) MmcDxeBits (Mmc->Csd, 69, 48) + 1) * 1024 - 1;
+  } else {
+    Mmc->Media.LastBlock = ((UINT64) MmcDxeBits (Mmc->Csd, 73, 62) + 1) *
+                           (1 << (MmcDxeBits (Mmc->Csd, 49, 47) + 2)) *
+                           (1 << MmcDxeBits (Mmc->Csd, 83, 80)) / MMC_DXE_BLOCK_SIZE - 1;
+  }
+  Mmc->Media.ReadOnly = Host->IsReadOnly (Host);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+MmcDxeTransfer (
+  IN  MMC_DXE           *Mmc,
+  IN  BOOLEAN           Write,
+  IN  EFI_LBA           Lba,
+  IN  UINTN             Size,
+  IN  VOID              *Buffer
+  )
+{
+  EFI_MMC_HOST_PROTOCOL *Host = Mmc->MmcHost;
+  EFI_STATUS            Status;
+  UINTN                 Blocks = Size / MMC_DXE_BLOCK_SIZE;
+  UINT32                Argument;
+  MMC_CMD               Cmd;
+
+  if (Write) {
+    Cmd = Blocks > 1 ? MMC_CMD25 : MMC_CMD24;
+  } else {
+    Cmd = Blocks > 1 ? MMC_CMD18 : MMC_CMD17;
+  }
+  Argument = Mmc->HighCapacity ? (UINT32) Lba : (UINT32) Lba * MMC_DXE_BLOCK_SIZE;
+
+  Status = MmcDxeCommand (Mmc, Cmd, Argument, MMC_RESPONSE_TYPE_R1, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Write) {
+    Status = Host->WriteBlockData (Host, Lba, Size, Buffer);
+  } else {
+    Status = Host->ReadBlockData (Host, Lba, Size, Buffer);
+  }
+  if (EFI_ERROR (Status)) {
+    MmcDxeStopTransmission (Mmc);
+    return Status;
+  }
+
+  Status = MmcDxeWaitReady (Mmc);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Blocks > 1) {
+    Status = MmcDxeStopTransmission (Mmc);
+  }
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+MmcDxeIoBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  BOOLEAN               Write,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 Size,
+  IN  VOID                  *Buffer
+  )
+{
+  MMC_DXE     *Mmc = MMC_DXE_FROM_BLOCK_IO (This);
+  EFI_STATUS  Status;
+  UINTN       Chunk;
+
+  if (!Mmc->MmcHost->IsCardPresent (Mmc->MmcHost)) {
+    return EFI_NO_MEDIA;
+  }
+  if (MediaId != This->Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+  if (Size == 0) {
+    return EFI_SUCCESS;
+  }
+  if (Size % MMC_DXE_BLOCK_SIZE != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  if (Lba + Size / MMC_DXE_BLOCK_SIZE - 1 > This->Media->LastBlock) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Write && This->Media->ReadOnly) {
+    return EFI_WRITE_PROTECTED;
+  }
+
+  Status = MmcDxeWaitReady (Mmc);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  while (Size > 0) {
+    Chunk = MIN (Size, MMC_DXE_MAX_BLOCKS * MMC_DXE_BLOCK_SIZE);
+    Status = MmcDxeTransfer (Mmc, Write, Lba, Chunk, Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Lba += Chunk / MMC_DXE_BLOCK_SIZE;
+    Buffer = (UINT8 *) Buffer + Chunk;
+    Size -= Chunk;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcDxeReadBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  return MmcDxeIoBlocks (This, FALSE, MediaId, Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcDxeWriteBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  UINT32                MediaId,
+  IN  EFI_LBA               Lba,
+  IN  UINTN                 BufferSize,
+  IN  VOID                  *Buffer
+  )
+{
+  return MmcDxeIoBlocks (This, TRUE, MediaId, Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcDxeReset (
+  IN  EFI_BLOCK_IO_PROTOCOL *This,
+  IN  BOOLEAN               ExtendedVerification
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MmcDxeFlush (
+  IN  EFI_BLOCK_IO_PROTOCOL *This
+  )
+{
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MmcDxeStart (
+  OUT MMC_DXE               *Mmc,
+  IN  EFI_MMC_HOST_PROTOCOL *MmcHost
+  )
+{
+  EFI_STATUS                Status;
+  EFI_DEVICE_PATH_PROTOCOL  *Node;
+
+  ZeroMem (Mmc, sizeof (*Mmc));
+  Mmc->MmcHost = MmcHost;
+
+  Mmc->Media.RemovableMedia = TRUE;
+  Mmc->Media.BlockSize = MMC_DXE_BLOCK_SIZE;
+  Mmc->Media.IoAlign = 4;
+  Mmc->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION;
+  Mmc->BlockIo.Media = &Mmc->Media;
+  Mmc->BlockIo.Reset = MmcDxeReset;
+  Mmc->BlockIo.ReadBlocks = MmcDxeReadBlocks;
+  Mmc->BlockIo.WriteBlocks = MmcDxeWriteBlocks;
+  Mmc->BlockIo.FlushBlocks = MmcDxeFlush;
+
+  Status = MmcHost->BuildDevicePath (MmcHost, &Node);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  CopyMem (&Mmc->DevicePath.Host, Node, sizeof (Mmc->DevicePath.Host));
+  FreePool (Node);
+  Mmc->DevicePath.End.Type = END_DEVICE_PATH_TYPE;
+  Mmc->DevicePath.End.SubType = END_ENTIRE_DEVICE_PATH_SUBTYPE;
+  Mmc->DevicePath.End.Length[0] = sizeof (EFI_DEVICE_PATH_PROTOCOL);
+  Mmc->DevicePath.End.Length[1] = 0;
+
+  Status = MmcDxeIdentify (Mmc);
+  Mmc->Media.MediaPresent = !EFI_ERROR (Status);
+  if (EFI_ERROR (Status) && Status != EFI_NO_MEDIA) {
+    return Status;
+  }
+
+  return gBS->InstallMultipleProtocolInterfaces (&Mmc->Handle,
+                &gEfiBlockIoProtocolGuid, &Mmc->BlockIo,
+                &gEfiDevicePathProtocolGuid, &Mmc->DevicePath,
+                NULL);
+}
+
+EFI_STATUS
+MmcDxeCheckCard (
+  IN OUT MMC_DXE            *Mmc
+  )
+{
+  EFI_STATUS  Status = EFI_SUCCESS;
+  BOOLEAN     Present;
+
+  Present = Mmc->MmcHost->IsCardPresent (Mmc->MmcHost);
+  if (Present == Mmc->Media.MediaPresent) {
+    return EFI_SUCCESS;
+  }
+
+  Mmc->Media.MediaId++;
+  if (Present) {
+    Status = MmcDxeIdentify (Mmc);
+    Present = !EFI_ERROR (Status);
+  }
+  Mmc->Media.MediaPresent = Present;
+  return Status;
+}
+
+EFI_STATUS
+MmcDxeReidentify (
+  IN OUT MMC_DXE            *Mmc
+  )
+{
+  EFI_STATUS  Status;
+
+  Mmc->Media.MediaId++;
+  Status = MmcDxeIdentify (Mmc);
+  Mmc->Media.MediaPresent = !EFI_ERROR (Status);
+  return Status;
+}
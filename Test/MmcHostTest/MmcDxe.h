@@ -0,0 +1,78 @@
+/** @file
+*
+*  Just enough of EmbeddedPkg's MmcDxe to drive a host driver the way it
+*  does: SD card identification, the block transfer command sequence
+*  with its CMD13 and CMD12 around it, and the card's BlockIo handle.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __MMC_DXE_H__
+#define __MMC_DXE_H__
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/MmcHost.h>
+
+#include "Host.h"
+
+typedef struct {
+  VENDOR_DEVICE_PATH        Host;
+  EFI_DEVICE_PATH_PROTOCOL  End;
+} MMC_DXE_DEVICE_PATH;
+
+typedef struct {
+  EFI_MMC_HOST_PROTOCOL     *MmcHost;
+  EFI_HANDLE                Handle;
+  EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_BLOCK_IO_MEDIA        Media;
+  MMC_DXE_DEVICE_PATH       DevicePath;
+
+  UINT32                    Rca;
+  BOOLEAN                   HighCapacity;
+  UINT32                    Csd[4];
+  UINT8                     Scr[8];
+  BOOLEAN                   HighSpeed;
+
+  //
+  // Host protocol calls, for the tests to check the command sequence.
+  //
+  UINT64                    SendCommands;
+  UINT64                    StopTransmissions;
+} MMC_DXE;
+
+//
+// Identifies the card behind MmcHost and installs BlockIo for it.
+//
+EFI_STATUS
+MmcDxeStart (
+  OUT MMC_DXE               *Mmc,
+  IN  EFI_MMC_HOST_PROTOCOL *MmcHost
+  );
+
+//
+// What MmcDxe's card detect timer does: follows the host's idea of
+// whether a card is in, identifying a new one.
+//
+EFI_STATUS
+MmcDxeCheckCard (
+  IN OUT MMC_DXE            *Mmc
+  );
+
+//
+// For a host with no card detect, a card swapped behind its back: the
+// card is identified again, under a new MediaId.
+//
+EFI_STATUS
+MmcDxeReidentify (
+  IN OUT MMC_DXE            *Mmc
+  );
+
+#endif /* __MMC_DXE_H__ */
@@ -0,0 +1,603 @@
+/** @file
+*
+*  The SD card model.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include "SdCard.h"
+
+#define SD_IDENT_CLOCK_HZ         (400 * 1000)
+#define SD_DEFAULT_CLOCK_HZ       (25 * 1000 * 1000)
+#define SD_HIGH_SPEED_CLOCK_HZ    (50 * 1000 * 1000)
+
+#define SD_CMD8_PATTERN_MASK      0xFFF
+#define SD_ACMD41_HCS             BIT30
+#define SD_SWITCH_MODE_SET        BIT31
+
+//
+// Sets bits Hi:Lo of a 128-bit register, bit 0 in bit 0 of Register[0].
+//
+STATIC
+VOID
+SdSetBits (
+  IN OUT UINT32         *Register,
+  IN     UINTN          Hi,
+  IN     UINTN          Lo,
+  IN     UINT32         Value
+  )
+{
+  UINTN Bit;
+
+  for (Bit = Lo; Bit <= Hi; Bit++) {
+    if ((Value >> (Bit - Lo)) & 1) {
+      Register[Bit / 32] |= 1U << (Bit % 32);
+    } else {
+      Register[Bit / 32] &= ~(1U << (Bit % 32));
+    }
+  }
+}
+
+STATIC
+VOID
+SdBuildCid (
+  IN  SD_CARD           *Card,
+  OUT UINT32            *Cid
+  )
+{
+  ZeroMem (Cid, 16);
+  SdSetBits (Cid, 127, 120, 0x03);        // MID
+  SdSetBits (Cid, 119, 104, 0x5344);      // OID "SD"
+  SdSetBits (Cid, 103, 72, 0x484F5354);   // PNM "HOST"
+  SdSetBits (Cid, 71, 64, 0x01);
+  SdSetBits (Cid, 63, 56, 0x10);          // PRV
+  SdSetBits (Cid, 55, 24, 0xCAFE0001);    // PSN
+  SdSetBits (Cid, 19, 8, 0x1A2);          // MDT
+  SdSetBits (Cid, 0, 0, 1);
+}
+
+STATIC
+VOID
+SdBuildCsd (
+  IN  SD_CARD           *Card,
+  OUT UINT32            *Csd
+  )
+{
+  UINT32 Units;
+  UINT32 Mult;
+
+  ZeroMem (Csd, 16);
+  SdSetBits (Csd, 119, 112, 0x0E);        // TAAC
+  SdSetBits (Csd, 103, 96, 0x32);         // TRAN_SPEED, 25 MHz
+  SdSetBits (Csd, 95, 84, 0x5B5);         // CCC
+  SdSetBits (Csd, 83, 80, 9);             // READ_BL_LEN
+  SdSetBits (Csd, 46, 46, 1);             // ERASE_BLK_EN
+  SdSetBits (Csd, 45, 39, 0x7F);          // SECTOR_SIZE
+  SdSetBits (Csd, 25, 22, 9);             // WRITE_BL_LEN
+  SdSetBits (Csd, 0, 0, 1);
+
+  if (Card->Config.HighCapacity) {
+    SdSetBits (Csd, 127, 126, 1);
+    SdSetBits (Csd, 69, 48, Card->Config.Blocks / 1024 - 1);
+  } else {
+    // Blocks = (C_SIZE + 1) << (C_SIZE_MULT + 2)
+    for (Mult = 7; Mult > 0 && (Card->Config.Blocks >> (Mult + 2)) == 0; Mult--) {
+    }
+    Units = Card->Config.Blocks >> (Mult + 2);
+    SdSetBits (Csd, 73, 62, Units - 1);
+    SdSetBits (Csd, 49, 47, Mult);
+  }
+}
+
+STATIC
+VOID
+SdBuildScr (
+  IN  SD_CARD           *Card,
+  OUT UINT8             *Scr
+  )
+{
+  ZeroMem (Scr, 8);
+  Scr[0] = 0x02;                          // SCR 1.0, SD_SPEC 2.00
+  Scr[1] = 0x05;                          // 1 and 4-bit bus
+  Scr[2] = 0x80;                          // SD_SPEC3
+  if (Card->Config.Cmd23) {
+    Scr[3] = BIT1;
+  }
+}
+
+STATIC
+VOID
+SdBuildSsr (
+  IN  SD_CARD           *Card,
+  OUT UINT8             *Ssr
+  )
+{
+  ZeroMem (Ssr, 64);
+  Ssr[0] = Card->BusWidth == 4 ? 0x80 : 0x00;
+  Ssr[10] = (UINT8) (Card->Config.AuCode << 4);
+  Ssr[11] = 0x00;                         // ERASE_SIZE, one AU
+  Ssr[12] = 0x01;
+  Ssr[13] = (1 << 2) | 1;                 // ERASE_TIMEOUT 1 s, ERASE_OFFSET 1 s
+}
+
+STATIC
+VOID
+SdBuildSwitchStatus (
+  IN  SD_CARD           *Card,
+  IN  UINT32            Argument,
+  OUT UINT8             *Status
+  )
+{
+  UINT32 Function = Argument & 0xF;
+
+  ZeroMem (Status, 64);
+  Status[1] = 100;                        // Max current, mA
+  Status[13] = BIT0 | (Card->Config.HighSpeed ? BIT1 : 0);
+
+  if (Function == 0xF) {
+    Function = Card->HighSpeedMode ? 1 : 0;
+  } else if (Function > 1 || (Function == 1 && !Card->Config.HighSpeed)) {
+    Function = 0xF;
+  }
+  Status[16] = (UINT8) Function;
+
+  if ((Argument & SD_SWITCH_MODE_SET) != 0 && Function != 0xF) {
+    Card->HighSpeedMode = (Function == 1);
+  }
+}
+
+VOID
+SdCardPowerCycle (
+  IN OUT SD_CARD        *Card
+  )
+{
+  Card->State = SD_STATE_IDLE;
+  Card->AppCmd = FALSE;
+  Card->PowerUpPolls = Card->Config.PowerUpPolls;
+  Card->PoweredUp = FALSE;
+  Card->Ccs = FALSE;
+  Card->Rca = 0;
+  Card->BusWidth = 1;
+  Card->HighSpeedMode = FALSE;
+  Card->PendingErrors = 0;
+  Card->BusyUntilNs = 0;
+  Card->PresetBlocks = 0;
+}
+
+VOID
+SdCardInit (
+  OUT SD_CARD               *Card,
+  IN  CONST SD_CARD_CONFIG  *Config
+  )
+{
+  UINTN Index;
+
+  if (Card->Data != NULL) {
+    FreePool (Card->Data);
+  }
+
+  ZeroMem (Card, sizeof (*Card));
+  Card->Config = *Config;
+  Card->Data = AllocatePool ((UINTN) Config->Blocks * SD_CARD_BLOCK_SIZE);
+  ASSERT (Card->Data != NULL);
+
+  // Something other than zeroes, so reads that move nothing show.
+  for (Index = 0; Index < (UINTN) Config->Blocks * SD_CARD_BLOCK_SIZE; Index++) {
+    Card->Data[Index] = (UINT8) (Index * 7 + (Index >> 9));
+  }
+
+  Card->CrcErrorBlock = SD_CARD_NO_FAULT;
+  Card->IgnoreCommand = SD_CARD_NO_FAULT;
+  SdCardPowerCycle (Card);
+}
+
+//
+// The card finishes programming on its own.
+//
+STATIC
+VOID
+SdCardSettle (
+  IN OUT SD_CARD        *Card
+  )
+{
+  if (Card->State == SD_STATE_PRG && HostNowNs () >= Card->BusyUntilNs) {
+    Card->State = SD_STATE_TRAN;
+  }
+}
+
+STATIC
+UINT32
+SdCardStatus (
+  IN OUT SD_CARD        *Card,
+  IN     UINT32         State
+  )
+{
+  UINT32 Status;
+
+  Status = Card->PendingErrors | SD_R1_STATE (State);
+  if (State != SD_STATE_PRG) {
+    Status |= SD_R1_READY_FOR_DATA;
+  }
+  if (Card->AppCmd) {
+    Status |= SD_R1_APP_CMD;
+  }
+
+  Card->PendingErrors = 0;
+  return Status;
+}
+
+//
+// Whether the command is allowed in the state the card is in.
+//
+STATIC
+BOOLEAN
+SdCardLegal (
+  IN  SD_CARD           *Card,
+  IN  UINT32            Slot
+  )
+{
+  UINT32 State = Card->State;
+
+  switch (Slot) {
+  case 0:
+  case 13:
+  case 55:
+    return State != SD_STATE_IDLE || Slot != 13;
+  case 8:
+    return State == SD_STATE_IDLE;
+  case 64 + 41:
+    return State == SD_STATE_IDLE || State == SD_STATE_READY;
+  case 2:
+    return State == SD_STATE_READY;
+  case 3:
+    return State == SD_STATE_IDENT || State == SD_STATE_STBY;
+  case 7:
+    return State == SD_STATE_STBY || State == SD_STATE_TRAN;
+  case 9:
+    return State == SD_STATE_STBY;
+  case 12:
+    return State == SD_STATE_DATA || State == SD_STATE_RCV;
+  case 6:
+  case 16:
+  case 17:
+  case 18:
+  case 23:
+  case 24:
+  case 25:
+  case 32:
+  case 33:
+  case 38:
+  case 64 + 6:
+  case 64 + 13:
+  case 64 + 23:
+  case 64 + 51:
+    return State == SD_STATE_TRAN;
+  default:
+    return FALSE;
+  }
+}
+
+//
+// The block a read or write command addresses.
+//
+STATIC
+UINT32
+SdCardBlock (
+  IN  SD_CARD           *Card,
+  IN  UINT32            Argument
+  )
+{
+  return Card->Config.HighCapacity ? Argument : Argument / SD_CARD_BLOCK_SIZE;
+}
+
+SD_CARD_RESPONSE
+SdCardCommand (
+  IN OUT SD_CARD        *Card,
+  IN     UINT32         Index,
+  IN     UINT32         Argument,
+  IN     UINT32         ClockHz,
+  OUT    UINT32         *Response
+  )
+{
+  UINT32            Slot;
+  UINT32            State;
+  UINT32            MaxClockHz;
+  BOOLEAN           AppCmd;
+  SD_CARD_RESPONSE  Kind;
+
+  SdCardSettle (Card);
+
+  Slot = Card->AppCmd ? 64 + Index : Index;
+  AppCmd = Card->AppCmd;
+  State = Card->State;
+  Card->Commands[Slot % 128]++;
+
+  if (State <= SD_STATE_IDENT) {
+    MaxClockHz = SD_IDENT_CLOCK_HZ;
+  } else if (Card->HighSpeedMode) {
+    MaxClockHz = SD_HIGH_SPEED_CLOCK_HZ;
+  } else {
+    MaxClockHz = SD_DEFAULT_CLOCK_HZ;
+  }
+  if (ClockHz > MaxClockHz) {
+    DEBUG ((DEBUG_ERROR, "SdCard: CMD%u at %u Hz in state %u\n", Index, ClockHz, State));
+    Card->Violations++;
+  }
+
+  if (Index == Card->IgnoreCommand) {
+    return SdNoResponse;
+  }
+
+  // CMD1 and CMD5 are for (e)MMC and SDIO, an SD memory card stays quiet.
+  if (Index == 1 || Index == 5) {
+    return SdNoResponse;
+  }
+
+  // ACMDs that don't exist are taken as the plain command.
+  if (AppCmd && Slot != 64 + 6 && Slot != 64 + 13 && Slot != 64 + 23 &&
+      Slot != 64 + 41 && Slot != 64 + 51) {
+    Slot = Index;
+  }
+
+  if (!SdCardLegal (Card, Slot)) {
+    DEBUG ((DEBUG_INFO, "SdCard: illegal %aCMD%u in state %u\n", AppCmd ? "A" : "", Index, State));
+    Card->IllegalCommands++;
+    Card->PendingErrors |= SD_R1_ILLEGAL_COMMAND;
+    Card->AppCmd = FALSE;
+    return SdNoResponse;
+  }
+
+  Card->AppCmd = (Slot == 55);
+  Kind = SdResponse48;
+  Response[0] = SdCardStatus (Card, State);
+
+  switch (Slot) {
+  case 0:
+    SdCardPowerCycle (Card);
+    return SdNoResponse;
+
+  case 2:
+    SdBuildCid (Card, Response);
+    Card->State = SD_STATE_IDENT;
+    Kind = SdResponse136;
+    break;
+
+  case 3:
+    Card->Rca = SD_CARD_RCA;
+    Card->State = SD_STATE_STBY;
+    Response[0] = (Card->Rca << 16) | (Response[0] & 0x1FFF);
+    break;
+
+  case 6:
+    SdBuildSwitchStatus (Card, Argument, Card->Register);
+    Card->RegisterLength = 64;
+    Card->State = SD_STATE_DATA;
+    break;
+
+  case 7:
+    if ((Argument >> 16) == Card->Rca) {
+      Card->State = SD_STATE_TRAN;
+    } else {
+      Card->State = SD_STATE_STBY;
+      return SdNoResponse;
+    }
+    break;
+
+  case 8:
+    Response[0] = Argument & SD_CMD8_PATTERN_MASK;
+    break;
+
+  case 9:
+    if ((Argument >> 16) != Card->Rca) {
+      return SdNoResponse;
+    }
+    SdBuildCsd (Card, Response);
+    Kind = SdResponse136;
+    break;
+
+  case 12:
+    if (State == SD_STATE_RCV) {
+      Card->State = SD_STATE_PRG;
+    } else {
+      Card->State = SD_STATE_TRAN;
+    }
+    Card->PresetBlocks = 0;
+    break;
+
+  case 13:
+  case 55:
+    if ((Argument >> 16) != Card->Rca && State > SD_STATE_IDENT) {
+      return SdNoResponse;
+    }
+    break;
+
+  case 16:
+    if (Argument != SD_CARD_BLOCK_SIZE) {
+      Card->PendingErrors |= BIT29;       // BLOCK_LEN_ERROR
+    }
+    break;
+
+  case 17:
+  case 18:
+  case 24:
+  case 25:
+    Card->Address = SdCardBlock (Card, Argument);
+    if (Card->Address >= Card->Config.Blocks) {
+      Response[0] |= SD_R1_OUT_OF_RANGE;
+      Card->PresetBlocks = 0;
+      break;
+    }
+    if (Slot == 17 || Slot == 24) {
+      Card->Blocks = 1;
+    } else if (Card->PresetBlocks != 0) {
+      Card->Blocks = Card->PresetBlocks;
+    } else {
+      Card->Blocks = MAX_UINT32;
+    }
+    Card->PresetBlocks = 0;
+    Card->RegisterLength = 0;
+    Card->State = (Slot == 17 || Slot == 18) ? SD_STATE_DATA : SD_STATE_RCV;
+    break;
+
+  case 23:
+    Card->PresetBlocks = Argument;
+    break;
+
+  case 32:
+    Card->EraseStart = SdCardBlock (Card, Argument);
+    break;
+
+  case 33:
+    Card->EraseEnd = SdCardBlock (Card, Argument);
+    break;
+
+  case 38:
+    if (Card->EraseEnd < Card->EraseStart || Card->EraseEnd >= Card->Config.Blocks) {
+      Card->PendingErrors |= BIT28;       // ERASE_SEQ_ERROR
+      break;
+    }
+    SetMem (Card->Data + (UINTN) Card->EraseStart * SD_CARD_BLOCK_SIZE,
+      (UINTN) (Card->EraseEnd - Card->EraseStart + 1) * SD_CARD_BLOCK_SIZE, 0);
+    Card->Erases++;
+    Card->State = SD_STATE_PRG;
+    Card->BusyUntilNs = HostNowNs () + Card->Config.EraseNs;
+    break;
+
+  case 64 + 6:
+    Card->BusWidth = ((Argument & 3) == 2) ? 4 : 1;
+    break;
+
+  case 64 + 13:
+    SdBuildSsr (Card, Card->Register);
+    Card->RegisterLength = 64;
+    Card->State = SD_STATE_DATA;
+    break;
+
+  case 64 + 23:
+    Card->PreEraseBlocks = Argument & 0x7FFFFF;
+    break;
+
+  case 64 + 41:
+    Response[0] = SD_OCR_VOLTAGE_WINDOW;
+    if ((Argument & SD_OCR_VOLTAGE_WINDOW) == 0) {
+      // Inquiry only
+      break;
+    }
+    Card->State = SD_STATE_READY;
+    if (!Card->PoweredUp) {
+      if (Card->PowerUpPolls > 0) {
+        Card->PowerUpPolls--;
+        Card->State = SD_STATE_IDLE;
+        break;
+      }
+      Card->PoweredUp = TRUE;
+      Card->Ccs = (Argument & SD_ACMD41_HCS) != 0;
+    }
+    Response[0] |= SD_OCR_POWER_UP;
+    if (Card->Config.HighCapacity && Card->Ccs) {
+      Response[0] |= SD_OCR_CCS;
+    }
+    break;
+
+  case 64 + 51:
+    SdBuildScr (Card, Card->Register);
+    Card->RegisterLength = 8;
+    Card->State = SD_STATE_DATA;
+    break;
+  }
+
+  return Kind;
+}
+
+SD_CARD_DATA
+SdCardReadData (
+  IN OUT SD_CARD        *Card,
+  OUT    UINT8          *Buffer,
+  IN     UINTN          Length,
+  IN     UINT32         BusWidth
+  )
+{
+  UINT32 Block;
+
+  if (Card->State != SD_STATE_DATA) {
+    return SdDataNone;
+  }
+
+  if (Card->RegisterLength != 0) {
+    ASSERT (Length <= Card->RegisterLength);
+    CopyMem (Buffer, Card->Register, Length);
+    Card->RegisterLength = 0;
+    Card->State = SD_STATE_TRAN;
+    return SdDataOk;
+  }
+
+  ASSERT (Length == SD_CARD_BLOCK_SIZE);
+  if (Card->Blocks == 0) {
+    return SdDataNone;
+  }
+
+  Block = Card->Address;
+  if (Block >= Card->Config.Blocks) {
+    Card->PendingErrors |= SD_R1_OUT_OF_RANGE;
+    return SdDataNone;
+  }
+
+  CopyMem (Buffer, Card->Data + (UINTN) Block * SD_CARD_BLOCK_SIZE, Length);
+  Card->Address++;
+  Card->BlocksRead++;
+  if (Card->Blocks != MAX_UINT32 && --Card->Blocks == 0) {
+    Card->State = SD_STATE_TRAN;
+  }
+
+  if (BusWidth != Card->BusWidth) {
+    Card->Violations++;
+    DEBUG ((DEBUG_ERROR, "SdCard: %u-bit read from a %u-bit card\n", BusWidth, Card->BusWidth));
+    return SdDataCrcError;
+  }
+  if (Block == Card->CrcErrorBlock) {
+    Buffer[0] ^= 0xFF;
+    return SdDataCrcError;
+  }
+  return SdDataOk;
+}
+
+SD_CARD_DATA
+SdCardWriteData (
+  IN OUT SD_CARD        *Card,
+  IN     CONST UINT8    *Buffer,
+  IN     UINTN          Length,
+  IN     UINT32         BusWidth,
+  IN     UINT64         AtNs
+  )
+{
+  ASSERT (Length == SD_CARD_BLOCK_SIZE);
+
+  if (Card->State != SD_STATE_RCV || Card->Blocks == 0) {
+    return SdDataNone;
+  }
+  if (Card->Address >= Card->Config.Blocks) {
+    Card->PendingErrors |= SD_R1_OUT_OF_RANGE;
+    return SdDataNone;
+  }
+  if (BusWidth != Card->BusWidth) {
+    Card->Violations++;
+    DEBUG ((DEBUG_ERROR, "SdCard: %u-bit write to a %u-bit card\n", BusWidth, Card->BusWidth));
+    return SdDataCrcError;
+  }
+
+  CopyMem (Card->Data + (UINTN) Card->Address * SD_CARD_BLOCK_SIZE, Buffer, Length);
+  Card->Address++;
+  Card->BlocksWritten++;
+  Card->BusyUntilNs = AtNs + Card->Config.ProgramNs;
+  if (Card->Blocks != MAX_UINT32 && --Card->Blocks == 0) {
+    Card->State = SD_STATE_PRG;
+  }
+  return SdDataOk;
+}
@@ -0,0 +1,171 @@
+/** @file
+*
+*  An SD card on the other end of the bus, as far as the host drivers
+*  can tell: the card state machine, its registers and its blocks. Both
+*  controller models drive it.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __SD_CARD_H__
+#define __SD_CARD_H__
+
+#include "Host.h"
+
+#define SD_CARD_BLOCK_SIZE        512
+#define SD_CARD_RCA               0x1234
+#define SD_CARD_NO_FAULT          MAX_UINT32
+
+//
+// Card states, as in the R1 CURRENT_STATE field.
+//
+#define SD_STATE_IDLE             0
+#define SD_STATE_READY            1
+#define SD_STATE_IDENT            2
+#define SD_STATE_STBY             3
+#define SD_STATE_TRAN             4
+#define SD_STATE_DATA             5
+#define SD_STATE_RCV              6
+#define SD_STATE_PRG              7
+
+//
+// R1 card status bits.
+//
+#define SD_R1_OUT_OF_RANGE        BIT31
+#define SD_R1_ILLEGAL_COMMAND     BIT22
+#define SD_R1_STATE(State)        ((State) << 9)
+#define SD_R1_READY_FOR_DATA      BIT8
+#define SD_R1_APP_CMD             BIT5
+
+#define SD_OCR_POWER_UP           BIT31
+#define SD_OCR_CCS                BIT30
+#define SD_OCR_VOLTAGE_WINDOW     0x00FF8000
+
+typedef struct {
+  UINT32                Blocks;         // A multiple of 1024
+  BOOLEAN               HighCapacity;   // SDHC: block addressed, CSD version 2
+  BOOLEAN               Cmd23;          // SCR says SET_BLOCK_COUNT is supported
+  BOOLEAN               HighSpeed;      // CMD6 can switch to 50 MHz
+  UINT32                ReadAccessNs;   // Command to first read block
+  UINT32                ProgramNs;      // Busy after each written block
+  UINT32                EraseNs;        // Busy after CMD38
+  UINT32                PowerUpPolls;   // ACMD41s answered busy
+  UINT8                 AuCode;         // SSR AU_SIZE
+} SD_CARD_CONFIG;
+
+typedef enum {
+  SdNoResponse,
+  SdResponse48,
+  SdResponse136
+} SD_CARD_RESPONSE;
+
+typedef enum {
+  SdDataOk,
+  SdDataCrcError,                       // Sent, but garbled
+  SdDataNone                            // The card sends (or takes) nothing
+} SD_CARD_DATA;
+
+typedef struct {
+  SD_CARD_CONFIG        Config;
+  UINT8                 *Data;
+
+  UINT32                State;
+  BOOLEAN               AppCmd;         // The last command was CMD55
+  UINT32                PowerUpPolls;
+  BOOLEAN               PoweredUp;
+  BOOLEAN               Ccs;            // Host said it takes high capacity
+  UINT32                Rca;
+  UINT32                BusWidth;
+  BOOLEAN               HighSpeedMode;
+  UINT32                PendingErrors;  // Reported with the next R1
+  UINT64                BusyUntilNs;
+
+  //
+  // The transfer the card is in. Blocks is the number still to go for a
+  // CMD23 preset transfer, MAX_UINT32 for one closed by CMD12.
+  //
+  UINT32                Address;        // Next block
+  UINT32                Blocks;
+  UINT8                 Register[64];   // SCR, SSR or switch status
+  UINT32                RegisterLength;
+  UINT32                PresetBlocks;   // From CMD23, 0 if none
+  UINT32                EraseStart;
+  UINT32                EraseEnd;
+
+  //
+  // Faults to inject.
+  //
+  UINT32                CrcErrorBlock;  // Sent garbled when read
+  UINT32                IgnoreCommand;  // Index never answered
+
+  //
+  // What happened.
+  //
+  UINT64                Commands[128];  // CMDn at n, ACMDn at 64 + n
+  UINT64                IllegalCommands;
+  UINT64                Violations;     // Clock or bus width wrong for the card
+  UINT64                BlocksRead;
+  UINT64                BlocksWritten;
+  UINT64                Erases;
+  UINT32                PreEraseBlocks; // Last ACMD23
+} SD_CARD;
+
+VOID
+SdCardInit (
+  OUT SD_CARD               *Card,
+  IN  CONST SD_CARD_CONFIG  *Config
+  );
+
+//
+// The card was pulled and put back in: back to idle, data kept.
+//
+VOID
+SdCardPowerCycle (
+  IN OUT SD_CARD        *Card
+  );
+
+//
+// A command on the CMD line. Response gets the R1/R3/R6/R7 word in
+// Response[0], or the 128 bits of an R2 least significant word first.
+//
+SD_CARD_RESPONSE
+SdCardCommand (
+  IN OUT SD_CARD        *Card,
+  IN     UINT32         Index,
+  IN     UINT32         Argument,
+  IN     UINT32         ClockHz,
+  OUT    UINT32         *Response
+  );
+
+//
+// The next data block the card sends, Length bytes.
+//
+SD_CARD_DATA
+SdCardReadData (
+  IN OUT SD_CARD        *Card,
+  OUT    UINT8          *Buffer,
+  IN     UINTN          Length,
+  IN     UINT32         BusWidth
+  );
+
+//
+// A written block that is through on the bus at AtNs. The card is busy
+// programming it until Card->BusyUntilNs.
+//
+SD_CARD_DATA
+SdCardWriteData (
+  IN OUT SD_CARD        *Card,
+  IN     CONST UINT8    *Buffer,
+  IN     UINTN          Length,
+  IN     UINT32         BusWidth,
+  IN     UINT64         AtNs
+  );
+
+#endif /* __SD_CARD_H__ */
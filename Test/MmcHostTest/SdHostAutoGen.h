@@ -0,0 +1,39 @@
+/** @file
+*
+*  What the EDK2 build generates for SdHostDxe.inf, for the host build:
+*  the module's caller ID and its PCDs.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __SDHOST_AUTOGEN_H__
+#define __SDHOST_AUTOGEN_H__
+
+#include <Uefi.h>
+
+// FILE_GUID of SdHostDxe.inf
+#define EFI_CALLER_ID_GUID \
+  { 0x58abd787, 0xf64d, 0x4ca2, { 0xa0, 0x34, 0xb9, 0xac, 0x2d, 0x5a, 0xd0, 0xcf } }
+
+extern EFI_GUID gEfiCallerIdGuid;
+
+// RaspberryPiPkg.dec [Guids] the module uses
+extern EFI_GUID gRaspberryPiClockRateChangedGuid;
+extern EFI_GUID gRaspberryPiSdHostDevicePathGuid;
+
+#define _PCD_GET_MODE_32_PcdSdHostDmaChannel      gHostPcdSdHostDmaChannel
+#define _PCD_GET_MODE_32_PcdSdHostPioBurstWords   gHostPcdSdHostPioBurstWords
+#define _PCD_GET_MODE_32_PcdSdController          gHostPcdSdController
+
+extern UINT32 gHostPcdSdHostDmaChannel;
+extern UINT32 gHostPcdSdHostPioBurstWords;
+extern UINT32 gHostPcdSdController;
+
+#endif /* __SDHOST_AUTOGEN_H__ */
@@ -0,0 +1,601 @@
+/** @file
+*
+*  The SDHOST controller model. As with the SDHCI one, the SD bus is
+*  caught up with on every register access, from the simulated time.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836Dma.h>
+#include <IndustryStandard/Bcm2836SdHost.h>
+
+#include "SdHostModel.h"
+
+#define SDHOST_OFFSET(Register)   ((Register) - SDHOST_BASE_ADDRESS)
+#define SDHOST_SIZE               0x100
+
+#define SDHOST_CMD_INDEX_MASK     0x3F
+
+// Bus clocks around a command and its response, as for SDHCI
+#define SDHOST_CMD_CLOCKS         (48 + 2 + 8)
+#define SDHOST_NO_RESPONSE_CLOCKS 64
+// CRC, end and start bits, and the CRC status of a write, between blocks
+#define SDHOST_BLOCK_CLOCKS       (16 + 2 + 8)
+// NWR, the clocks between a write command's response and its first block
+#define SDHOST_WRITE_START_CLOCKS 2
+
+//
+// EDM FSM states the header has no names for.
+//
+#define SDHOST_FSM_READDATA       0x2
+#define SDHOST_FSM_WRITEDATA      0x3
+
+#define SDHOST_EDM_THRESHOLDS     (SDHOST_EDM_READ_THRESHOLD (SDHOST_EDM_THRESHOLD_MASK) | \
+                                   SDHOST_EDM_WRITE_THRESHOLD (SDHOST_EDM_THRESHOLD_MASK))
+
+UINT32
+SdHostModelClockHz (
+  IN  SDHOST_MODEL      *Model
+  )
+{
+  if ((Model->Vdd & SDHOST_VDD_POWER_ON) == 0) {
+    return 0;
+  }
+
+  // fSDCLK = fcore / (CDIV + 2)
+  return gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_CORE] / ((Model->Cdiv & SDHOST_CDIV_MAX) + 2);
+}
+
+STATIC
+UINT64
+SdHostClocksToNs (
+  IN  SDHOST_MODEL      *Model,
+  IN  UINT64            Clocks
+  )
+{
+  UINT32 Hz = SdHostModelClockHz (Model);
+
+  ASSERT (Hz != 0);
+  return (Clocks * 1000000000ULL + Hz - 1) / Hz;
+}
+
+STATIC
+UINT32
+SdHostBusWidth (
+  IN  SDHOST_MODEL      *Model
+  )
+{
+  return (Model->Hcfg & SDHOST_HCFG_WIDE_EXT_BUS) != 0 ? 4 : 1;
+}
+
+STATIC
+BOOLEAN
+SdHostFsmIdle (
+  IN  SDHOST_MODEL      *Model
+  )
+{
+  return Model->Fsm == SDHOST_EDM_FSM_IDENTMODE || Model->Fsm == SDHOST_EDM_FSM_DATAMODE;
+}
+
+STATIC
+VOID
+SdHostStopData (
+  IN OUT SDHOST_MODEL   *Model
+  )
+{
+  Model->Reading = FALSE;
+  Model->Writing = FALSE;
+  Model->BlocksLeft = 0;
+  Model->BlockWord = 0;
+  Model->Stalled = FALSE;
+  Model->FaultNs = SDHOST_MODEL_NEVER;
+  Model->FaultStatus = 0;
+  Model->FsmNs = SDHOST_MODEL_NEVER;
+}
+
+STATIC
+VOID
+SdHostFault (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT64         AtNs,
+  IN     UINT32         Status
+  )
+{
+  if (Model->FaultNs == SDHOST_MODEL_NEVER) {
+    Model->FaultNs = AtNs;
+    Model->FaultStatus = Status;
+  }
+}
+
+STATIC
+VOID
+SdHostFifoPush (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT32         Word
+  )
+{
+  ASSERT (Model->FifoCount < SDHOST_MODEL_FIFO_WORDS);
+  Model->Fifo[(Model->FifoHead + Model->FifoCount) % SDHOST_MODEL_FIFO_WORDS] = Word;
+  Model->FifoCount++;
+}
+
+STATIC
+UINT32
+SdHostFifoPop (
+  IN OUT SDHOST_MODEL   *Model
+  )
+{
+  UINT32 Word;
+
+  ASSERT (Model->FifoCount > 0);
+  Word = Model->Fifo[Model->FifoHead];
+  Model->FifoHead = (Model->FifoHead + 1) % SDHOST_MODEL_FIFO_WORDS;
+  Model->FifoCount--;
+  return Word;
+}
+
+//
+// Words the card sent since the last access go into the FIFO, until it
+// is full and the clock stops.
+//
+STATIC
+VOID
+SdHostSyncRead (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT64         Now
+  )
+{
+  SD_CARD_DATA  Data;
+  UINT32        Word;
+
+  while (Model->BlocksLeft > 0 && Model->FaultNs == SDHOST_MODEL_NEVER &&
+         Model->NextWordNs <= Now) {
+    if (Model->FifoCount == SDHOST_MODEL_FIFO_WORDS) {
+      Model->Stalled = TRUE;
+      break;
+    }
+
+    if (Model->BlockWord == 0) {
+      Data = SdCardReadData (Model->Card, Model->Block, Model->BlockSize, SdHostBusWidth (Model));
+      if (Data == SdDataNone) {
+        SdHostFault (Model, Model->NextWordNs + SdHostClocksToNs (Model, Model->Tout),
+          SDHOST_HSTS_REW_TIME_OUT);
+        break;
+      }
+      if (Data == SdDataCrcError) {
+        SdHostFault (Model, Model->NextWordNs + (Model->BlockSize / 4) * Model->WordNs,
+          SDHOST_HSTS_CRC16_ERROR);
+        break;
+      }
+    }
+
+    CopyMem (&Word, &Model->Block[Model->BlockWord * 4], sizeof (Word));
+    SdHostFifoPush (Model, Word);
+    Model->BlockWord++;
+
+    if (Model->BlockWord * 4 < Model->BlockSize) {
+      Model->NextWordNs += Model->WordNs;
+      continue;
+    }
+
+    Model->BlockWord = 0;
+    Model->BlocksLeft--;
+    Model->Hsts |= SDHOST_HSTS_BLOCK_IRPT;
+    Model->NextWordNs += Model->BlockGapNs + Model->WordNs;
+    if (Model->BlocksLeft == 0) {
+      // The host stops the clock and waits for CMD12 or to be told to move on
+      Model->Fsm = SDHOST_EDM_FSM_READWAIT;
+    }
+  }
+}
+
+//
+// Words from the FIFO go out on the bus, a block at a time to the card,
+// which may then keep the bus busy while it programs.
+//
+STATIC
+VOID
+SdHostSyncWrite (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT64         Now
+  )
+{
+  SD_CARD_DATA  Data;
+  UINT32        Word;
+  UINT64        End;
+
+  while (Model->BlocksLeft > 0 && Model->FaultNs == SDHOST_MODEL_NEVER &&
+         Model->NextWordNs <= Now) {
+    if (Model->FifoCount == 0) {
+      Model->Stalled = TRUE;
+      break;
+    }
+
+    Word = SdHostFifoPop (Model);
+    CopyMem (&Model->Block[Model->BlockWord * 4], &Word, sizeof (Word));
+    Model->BlockWord++;
+
+    if (Model->BlockWord * 4 < Model->BlockSize) {
+      Model->NextWordNs += Model->WordNs;
+      continue;
+    }
+
+    End = Model->NextWordNs + Model->BlockGapNs;
+    Data = SdCardWriteData (Model->Card, Model->Block, Model->BlockSize, SdHostBusWidth (Model), End);
+    if (Data != SdDataOk) {
+      SdHostFault (Model, End, Data == SdDataNone ?
+        SDHOST_HSTS_REW_TIME_OUT : SDHOST_HSTS_CRC16_ERROR);
+      break;
+    }
+
+    Model->BlockWord = 0;
+    Model->BlocksLeft--;
+    Model->Hsts |= SDHOST_HSTS_BLOCK_IRPT;
+    End = MAX (End, Model->Card->BusyUntilNs);
+    Model->NextWordNs = End + Model->WordNs;
+    if (Model->BlocksLeft == 0) {
+      Model->Fsm = SDHOST_EDM_FSM_WRITEWAIT2;
+      Model->FsmNext = SDHOST_EDM_FSM_WRITESTART1;
+      Model->FsmNs = End;
+    }
+  }
+}
+
+STATIC
+VOID
+SdHostSync (
+  IN OUT SDHOST_MODEL   *Model
+  )
+{
+  UINT64 Now = HostNowNs ();
+
+  if (Model->CmdDoneNs <= Now) {
+    Model->CmdDoneNs = SDHOST_MODEL_NEVER;
+    Model->Cmd &= ~SDHOST_CMD_NEW_FLAG;
+    if (Model->CmdFail != 0) {
+      Model->Cmd |= SDHOST_CMD_FAIL_FLAG;
+      Model->Hsts |= Model->CmdFail;
+      Model->CmdFail = 0;
+    } else {
+      CopyMem (Model->Rsp, Model->CmdRsp, sizeof (Model->Rsp));
+    }
+  }
+
+  if (Model->Reading) {
+    SdHostSyncRead (Model, Now);
+  }
+  if (Model->Writing) {
+    SdHostSyncWrite (Model, Now);
+  }
+
+  if (Model->FsmNs <= Now) {
+    Model->Fsm = Model->FsmNext;
+    Model->FsmNs = SDHOST_MODEL_NEVER;
+  }
+
+  if (Model->FaultNs <= Now) {
+    Model->Hsts |= Model->FaultStatus;
+    SdHostStopData (Model);
+    Model->Fsm = SDHOST_EDM_FSM_DATAMODE;
+  }
+}
+
+STATIC
+VOID
+SdHostCommand (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT32         Value
+  )
+{
+  UINT32            Index = Value & SDHOST_CMD_INDEX_MASK;
+  BOOLEAN           IsData = (Value & (SDHOST_CMD_READ_CMD | SDHOST_CMD_WRITE_CMD)) != 0;
+  UINT64            Now = HostNowNs ();
+  UINT32            Hz;
+  UINT32            Response[4];
+  SD_CARD_RESPONSE  Kind;
+
+  if ((Value & SDHOST_CMD_NEW_FLAG) == 0) {
+    // Only clears the register
+    Model->Cmd = Value;
+    return;
+  }
+
+  Model->Commands++;
+  if (Model->CmdDoneNs != SDHOST_MODEL_NEVER) {
+    DEBUG ((DEBUG_ERROR, "SdHostModel: CMD%u issued with NEW set\n", Index));
+    Model->Violations++;
+    return;
+  }
+
+  Model->Cmd = Value & ~SDHOST_CMD_FAIL_FLAG;
+  Model->CmdFail = 0;
+
+  Hz = SdHostModelClockHz (Model);
+  if (Hz == 0) {
+    DEBUG ((DEBUG_ERROR, "SdHostModel: CMD%u issued with the card powered off\n", Index));
+    Model->Violations++;
+    Model->CmdDoneNs = Now + 10 * HOST_NS_PER_US;
+    Model->CmdFail = SDHOST_HSTS_CMD_TIME_OUT;
+    return;
+  }
+
+  if (IsData && !SdHostFsmIdle (Model)) {
+    DEBUG ((DEBUG_ERROR, "SdHostModel: data CMD%u issued in FSM state 0x%x\n", Index, Model->Fsm));
+    Model->Violations++;
+  }
+  if (IsData && Model->FifoCount != 0) {
+    DEBUG ((DEBUG_ERROR, "SdHostModel: data CMD%u issued with %u stale words in the FIFO\n",
+      Index, (UINT32) Model->FifoCount));
+    Model->Violations++;
+  }
+
+  Kind = SdCardCommand (Model->Card, Index, Model->Arg, Hz, Response);
+  if (Kind == SdNoResponse) {
+    if ((Value & SDHOST_CMD_RESPONSE_CMD_NO_RESP) != 0) {
+      Model->CmdDoneNs = Now + SdHostClocksToNs (Model, SDHOST_CMD_CLOCKS);
+    } else {
+      Model->CmdDoneNs = Now + SdHostClocksToNs (Model, SDHOST_CMD_CLOCKS + SDHOST_NO_RESPONSE_CLOCKS);
+      Model->CmdFail = SDHOST_HSTS_CMD_TIME_OUT;
+    }
+    return;
+  }
+
+  if (Kind == SdResponse136) {
+    // Held a byte higher than the SDHCI registers hold it, the top byte lost
+    Model->CmdRsp[3] = (Response[3] << 8) | (Response[2] >> 24);
+    Model->CmdRsp[2] = (Response[2] << 8) | (Response[1] >> 24);
+    Model->CmdRsp[1] = (Response[1] << 8) | (Response[0] >> 24);
+    Model->CmdRsp[0] = Response[0] << 8;
+    Model->CmdDoneNs = Now + SdHostClocksToNs (Model, SDHOST_CMD_CLOCKS + 136);
+  } else {
+    ZeroMem (Model->CmdRsp, sizeof (Model->CmdRsp));
+    Model->CmdRsp[0] = Response[0];
+    Model->CmdDoneNs = Now + SdHostClocksToNs (Model, SDHOST_CMD_CLOCKS + 48);
+  }
+
+  if (Index == 12) {
+    // Stopping a read early is what CMD12 is for, losing written data is not
+    if (Model->Writing && (Model->BlocksLeft != 0 || Model->FifoCount != 0)) {
+      DEBUG ((DEBUG_ERROR, "SdHostModel: CMD12 with %u blocks still to write\n", Model->BlocksLeft));
+      Model->Violations++;
+    }
+    SdHostStopData (Model);
+    Model->Fsm = SDHOST_EDM_FSM_DATAMODE;
+  }
+
+  // NEW stays set until the card lets go of DAT0
+  if ((Value & SDHOST_CMD_BUSY_CMD) != 0 && Model->Card->State == SD_STATE_PRG) {
+    Model->CmdDoneNs = MAX (Model->CmdDoneNs, Model->Card->BusyUntilNs);
+  }
+
+  if (!IsData) {
+    return;
+  }
+
+  Model->BlockSize = Model->Hbct;
+  Model->Blocks = Model->Hblc;
+  ASSERT (Model->BlockSize != 0 && Model->BlockSize <= SD_CARD_BLOCK_SIZE &&
+          Model->BlockSize % 4 == 0 && Model->Blocks != 0);
+
+  SdHostStopData (Model);
+  Model->BlocksLeft = Model->Blocks;
+  Model->WordNs = SdHostClocksToNs (Model, 32 / SdHostBusWidth (Model));
+  Model->BlockGapNs = SdHostClocksToNs (Model, SDHOST_BLOCK_CLOCKS);
+  if ((Value & SDHOST_CMD_READ_CMD) != 0) {
+    Model->Reading = TRUE;
+    Model->Fsm = SDHOST_FSM_READDATA;
+    Model->NextWordNs = Model->CmdDoneNs + Model->Card->Config.ReadAccessNs + Model->WordNs;
+  } else {
+    Model->Writing = TRUE;
+    Model->Fsm = SDHOST_FSM_WRITEDATA;
+    Model->NextWordNs = Model->CmdDoneNs + SdHostClocksToNs (Model, SDHOST_WRITE_START_CLOCKS) +
+                        Model->WordNs;
+  }
+}
+
+STATIC
+UINT32
+SdHostReadData (
+  IN OUT SDHOST_MODEL   *Model
+  )
+{
+  if (!Model->Reading || Model->FifoCount == 0) {
+    Model->Underruns++;
+    Model->Violations++;
+    return 0;
+  }
+
+  if (Model->Stalled) {
+    Model->Stalled = FALSE;
+    Model->NextWordNs = MAX (Model->NextWordNs, HostNowNs () + Model->WordNs);
+  }
+
+  Model->DataWords++;
+  return SdHostFifoPop (Model);
+}
+
+STATIC
+VOID
+SdHostWriteData (
+  IN OUT SDHOST_MODEL   *Model,
+  IN     UINT32         Word
+  )
+{
+  if (!Model->Writing || Model->FifoCount == SDHOST_MODEL_FIFO_WORDS ||
+      Model->FifoCount >= Model->BlocksLeft * (Model->BlockSize / 4) - Model->BlockWord) {
+    Model->Overruns++;
+    Model->Violations++;
+    return;
+  }
+
+  if (Model->Stalled) {
+    Model->Stalled = FALSE;
+    Model->NextWordNs = MAX (Model->NextWordNs, HostNowNs () + Model->WordNs);
+  }
+
+  Model->DataWords++;
+  SdHostFifoPush (Model, Word);
+}
+
+STATIC
+UINT32
+SdHostRead (
+  IN  VOID              *Context,
+  IN  UINTN             Offset
+  )
+{
+  SDHOST_MODEL  *Model = Context;
+
+  SdHostSync (Model);
+
+  switch (Offset) {
+  case SDHOST_OFFSET (SDHOST_CMD):
+    return Model->Cmd;
+  case SDHOST_OFFSET (SDHOST_ARG):
+    return Model->Arg;
+  case SDHOST_OFFSET (SDHOST_TOUT):
+    return Model->Tout;
+  case SDHOST_OFFSET (SDHOST_CDIV):
+    return Model->Cdiv;
+  case SDHOST_OFFSET (SDHOST_RSP0):
+  case SDHOST_OFFSET (SDHOST_RSP1):
+  case SDHOST_OFFSET (SDHOST_RSP2):
+  case SDHOST_OFFSET (SDHOST_RSP3):
+    return Model->Rsp[(Offset - SDHOST_OFFSET (SDHOST_RSP0)) / 4];
+  case SDHOST_OFFSET (SDHOST_HSTS):
+    return Model->Hsts | (Model->FifoCount != 0 ? SDHOST_HSTS_DATA_FLAG : 0);
+  case SDHOST_OFFSET (SDHOST_VDD):
+    return Model->Vdd;
+  case SDHOST_OFFSET (SDHOST_EDM):
+    return (Model->Edm & SDHOST_EDM_THRESHOLDS) | ((UINT32) Model->FifoCount << 4) | Model->Fsm;
+  case SDHOST_OFFSET (SDHOST_HCFG):
+    return Model->Hcfg;
+  case SDHOST_OFFSET (SDHOST_HBCT):
+    return Model->Hbct;
+  case SDHOST_OFFSET (SDHOST_DATA):
+    return SdHostReadData (Model);
+  case SDHOST_OFFSET (SDHOST_HBLC):
+    return Model->Hblc;
+  default:
+    return 0;
+  }
+}
+
+STATIC
+VOID
+SdHostWrite (
+  IN  VOID              *Context,
+  IN  UINTN             Offset,
+  IN  UINT32            Value
+  )
+{
+  SDHOST_MODEL  *Model = Context;
+
+  SdHostSync (Model);
+
+  switch (Offset) {
+  case SDHOST_OFFSET (SDHOST_CMD):
+    SdHostCommand (Model, Value);
+    break;
+  case SDHOST_OFFSET (SDHOST_ARG):
+    Model->Arg = Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_TOUT):
+    Model->Tout = Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_CDIV):
+    Model->Cdiv = Value & SDHOST_CDIV_MAX;
+    break;
+  case SDHOST_OFFSET (SDHOST_HSTS):
+    Model->Hsts &= ~Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_VDD):
+    if ((Value & SDHOST_VDD_POWER_ON) != 0 && (Model->Vdd & SDHOST_VDD_POWER_ON) == 0) {
+      SdCardPowerCycle (Model->Card);
+    }
+    Model->Vdd = Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_EDM):
+    Model->Edm = Value & SDHOST_EDM_THRESHOLDS;
+    if ((Value & SDHOST_EDM_FIFO_CLEAR) != 0) {
+      Model->FifoHead = 0;
+      Model->FifoCount = 0;
+    }
+    if ((Value & SDHOST_EDM_FORCE_DATA_MODE) != 0) {
+      Model->Fsm = SDHOST_EDM_FSM_DATAMODE;
+      Model->FsmNs = SDHOST_MODEL_NEVER;
+    }
+    break;
+  case SDHOST_OFFSET (SDHOST_HCFG):
+    Model->Hcfg = Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_HBCT):
+    Model->Hbct = Value;
+    break;
+  case SDHOST_OFFSET (SDHOST_DATA):
+    SdHostWriteData (Model, Value);
+    break;
+  case SDHOST_OFFSET (SDHOST_HBLC):
+    Model->Hblc = Value;
+    break;
+  default:
+    break;
+  }
+}
+
+//
+// DREQ goes up for a read once the FIFO holds the read threshold, and
+// for a write while it has room for the write threshold. For the tail
+// of a multi-block read, with fewer words left than the threshold, it
+// never does.
+//
+STATIC
+BOOLEAN
+SdHostDreq (
+  IN  VOID                  *Context,
+  IN  BCM2836_DMA_DIRECTION Direction
+  )
+{
+  SDHOST_MODEL  *Model = Context;
+  UINT32        Threshold;
+
+  SdHostSync (Model);
+
+  if (Direction == Bcm2836DmaFromDevice) {
+    if (!Model->Reading || Model->FifoCount == 0) {
+      return FALSE;
+    }
+    Threshold = (Model->Edm >> SDHOST_EDM_READ_THRESHOLD_SHIFT) & SDHOST_EDM_THRESHOLD_MASK;
+    return Model->FifoCount >= Threshold || (Model->Blocks == 1 && Model->BlocksLeft == 0);
+  }
+
+  if (!Model->Writing) {
+    return FALSE;
+  }
+  Threshold = (Model->Edm >> SDHOST_EDM_WRITE_THRESHOLD_SHIFT) & SDHOST_EDM_THRESHOLD_MASK;
+  return SDHOST_MODEL_FIFO_WORDS - Model->FifoCount >= MAX (Threshold, 1);
+}
+
+VOID
+SdHostModelInit (
+  OUT SDHOST_MODEL      *Model,
+  IN  SD_CARD           *Card
+  )
+{
+  ZeroMem (Model, sizeof (*Model));
+  Model->Card = Card;
+  Model->CmdDoneNs = SDHOST_MODEL_NEVER;
+  Model->Fsm = SDHOST_EDM_FSM_IDENTMODE;
+  SdHostStopData (Model);
+
+  Model->Region = HostMapMmio ("SdHost", SDHOST_BASE_ADDRESS, SDHOST_SIZE, SdHostRead, SdHostWrite, Model);
+  HostConnectDreq (BCM2836_DMA_DREQ_SDHOST, SdHostDreq, Model);
+}
@@ -0,0 +1,101 @@
+/** @file
+*
+*  The BCM2835 SDHOST controller, from the register side: CMD with its
+*  NEW and FAIL flags, HSTS, the EDM data state machine and FIFO level,
+*  the 16 word data FIFO with the DREQ thresholds, and the SD clock
+*  CDIV derives from the core clock.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __SDHOST_MODEL_H__
+#define __SDHOST_MODEL_H__
+
+#include "SdCard.h"
+
+#define SDHOST_MODEL_FIFO_WORDS   16
+#define SDHOST_MODEL_NEVER        MAX_UINT64
+
+typedef struct {
+  SD_CARD               *Card;
+  HOST_MMIO_REGION      *Region;
+
+  //
+  // Registers.
+  //
+  UINT32                Cmd;
+  UINT32                Arg;
+  UINT32                Tout;
+  UINT32                Cdiv;
+  UINT32                Rsp[4];
+  UINT32                Hsts;
+  UINT32                Vdd;
+  UINT32                Edm;            // The thresholds, FSM and level are kept apart
+  UINT32                Hcfg;
+  UINT32                Hbct;
+  UINT32                Hblc;
+
+  //
+  // The command in flight: NEW clears at CmdDoneNs, with FAIL and the
+  // HSTS bits in CmdFail if it failed.
+  //
+  UINT64                CmdDoneNs;
+  UINT32                CmdFail;
+  UINT32                CmdRsp[4];
+
+  //
+  // The data transfer, a word at a time. The SD clock stops while the
+  // FIFO is full on a read or empty on a write.
+  //
+  BOOLEAN               Reading;
+  BOOLEAN               Writing;
+  UINT32                BlockSize;
+  UINT32                Blocks;
+  UINT32                BlocksLeft;     // Still to move on the bus
+  UINT8                 Block[SD_CARD_BLOCK_SIZE];
+  UINT32                BlockWord;      // Words of it through the bus
+  UINT32                Fifo[SDHOST_MODEL_FIFO_WORDS];
+  UINTN                 FifoHead;
+  UINTN                 FifoCount;
+  UINT64                WordNs;
+  UINT64                BlockGapNs;
+  UINT64                NextWordNs;     // The next word is through the bus then
+  BOOLEAN               Stalled;
+  UINT32                Fsm;
+  UINT32                FsmNext;        // Where the FSM goes at FsmNs
+  UINT64                FsmNs;
+  UINT64                FaultNs;        // The HSTS bits in FaultStatus latch then
+  UINT32                FaultStatus;
+
+  //
+  // What happened.
+  //
+  UINT64                Commands;
+  UINT64                Violations;     // Things the driver must never do
+  UINT64                Underruns;
+  UINT64                Overruns;
+  UINT64                DataWords;      // Through the FIFO, by the CPU or DMA
+} SDHOST_MODEL;
+
+VOID
+SdHostModelInit (
+  OUT SDHOST_MODEL      *Model,
+  IN  SD_CARD           *Card
+  );
+
+//
+// The SD clock the controller puts out now, 0 if the card has no power.
+//
+UINT32
+SdHostModelClockHz (
+  IN  SDHOST_MODEL      *Model
+  );
+
+#endif /* __SDHOST_MODEL_H__ */
@@ -0,0 +1,735 @@
+/** @file
+*
+*  SdHostDxe against the SDHOST model, driven the way MmcDxe does.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <stdio.h>
+
+#include <Library/MmcHostCommonLib.h>
+#include <Protocol/EraseBlock.h>
+#include <Protocol/RaspberryPiMmcStats.h>
+
+#include <IndustryStandard/Bcm2836.h>
+#include <IndustryStandard/Bcm2836Gpio.h>
+#include <IndustryStandard/Bcm2836SdHost.h>
+
+#include "MmcDxe.h"
+#include "SdHostModel.h"
+
+EFI_GUID gEfiCallerIdGuid = EFI_CALLER_ID_GUID;
+
+EFI_STATUS
+SdHostInitialize (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  );
+
+#define TEST_BLOCK_SIZE           SD_CARD_BLOCK_SIZE
+#define TEST_GPIO_ALT0            4
+#define TEST_LARGE_BLOCKS         (9 * 1024 * 2)      // Over BCM2836_DMA_MAX_LENGTH
+#define TEST_PIO_BLOCKS           8
+
+//
+// An SDHC card the way most are: block addressed, CMD23 capable and
+// switchable to high speed.
+//
+STATIC CONST SD_CARD_CONFIG mSdhcConfig = {
+  20480,                          // Blocks
+  TRUE,                           // HighCapacity
+  TRUE,                           // Cmd23
+  TRUE,                           // HighSpeed
+  100000,                         // ReadAccessNs
+  20000,                          // ProgramNs
+  5000000,                        // EraseNs
+  2,                              // PowerUpPolls
+  9                               // AuCode, 4 MiB
+};
+
+//
+// An old SDSC card: byte addressed, default speed only, and multi-block
+// transfers closed by CMD12.
+//
+STATIC CONST SD_CARD_CONFIG mSdscConfig = {
+  4096,                           // Blocks
+  FALSE,                          // HighCapacity
+  FALSE,                          // Cmd23
+  FALSE,                          // HighSpeed
+  300000,                         // ReadAccessNs
+  50000,                          // ProgramNs
+  10000000,                       // EraseNs
+  5,                              // PowerUpPolls
+  6                               // AuCode, 512 KiB
+};
+
+STATIC SD_CARD                          mCard;
+STATIC SDHOST_MODEL                     mModel;
+STATIC MMC_DXE                          mMmc;
+STATIC EFI_MMC_HOST_PROTOCOL            *mHost;
+STATIC EFI_BLOCK_IO_PROTOCOL            *mBlockIo;
+STATIC RASPBERRY_PI_MMC_STATS_PROTOCOL  *mStats;
+
+STATIC UINT32                           mBuffer[(TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE) / 4 + 1];
+
+//
+// Measuring what an operation costs.
+//
+typedef struct {
+  UINT64                Ns;
+  UINT64                Reads;
+  UINT64                Writes;
+  UINT64                DmaWords;
+  UINT64                PioWords;
+} MEASURE;
+
+STATIC
+VOID
+MeasureStart (
+  OUT MEASURE           *Measure
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+
+  mStats->GetStats (mStats, &Stats);
+  Measure->Ns = HostNowNs ();
+  Measure->Reads = mModel.Region->Reads;
+  Measure->Writes = mModel.Region->Writes;
+  Measure->DmaWords = gHostDma.Words;
+  Measure->PioWords = Stats->PioWords;
+}
+
+//
+// Returns the MMIO reads per word moved, in hundredths.
+//
+STATIC
+UINT64
+MeasureReport (
+  IN  CONST MEASURE     *Measure,
+  IN  CONST CHAR8       *What,
+  IN  UINTN             Bytes
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  UINT64                        Ns;
+  UINT64                        Reads;
+  UINT64                        Words;
+  UINT64                        PerWord;
+
+  mStats->GetStats (mStats, &Stats);
+  Ns = HostNowNs () - Measure->Ns;
+  Reads = mModel.Region->Reads - Measure->Reads;
+  Words = Bytes / 4;
+  PerWord = Words != 0 ? Reads * 100 / Words : 0;
+
+  HostReport ("%s: %llu us, %llu MMIO reads, %llu writes, %llu.%02llu reads/word, "
+    "%llu DMA words, %llu PIO words, %llu KiB/s",
+    What,
+    (unsigned long long) (Ns / HOST_NS_PER_US),
+    (unsigned long long) Reads,
+    (unsigned long long) (mModel.Region->Writes - Measure->Writes),
+    (unsigned long long) (PerWord / 100),
+    (unsigned long long) (PerWord % 100),
+    (unsigned long long) (gHostDma.Words - Measure->DmaWords),
+    (unsigned long long) (Stats->PioWords - Measure->PioWords),
+    (unsigned long long) (Ns != 0 ? (UINT64) Bytes * 1000000000ULL / 1024 / Ns : 0));
+
+  return PerWord;
+}
+
+//
+// Helpers.
+//
+
+STATIC
+UINT8 *
+CardBlock (
+  IN  EFI_LBA           Lba
+  )
+{
+  return mCard.Data + Lba * TEST_BLOCK_SIZE;
+}
+
+STATIC
+VOID
+FillPattern (
+  OUT VOID              *Buffer,
+  IN  UINTN             Length,
+  IN  UINT8             Seed
+  )
+{
+  UINT8 *Bytes = Buffer;
+  UINTN Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    Bytes[Index] = (UINT8) (Seed + Index * 13 + (Index >> 8));
+  }
+}
+
+STATIC
+EFI_STATUS
+ReadBlocks (
+  IN  EFI_LBA           Lba,
+  IN  UINTN             Blocks,
+  OUT VOID              *Buffer
+  )
+{
+  return mBlockIo->ReadBlocks (mBlockIo, mBlockIo->Media->MediaId, Lba,
+                               Blocks * TEST_BLOCK_SIZE, Buffer);
+}
+
+STATIC
+EFI_STATUS
+WriteBlocks (
+  IN  EFI_LBA           Lba,
+  IN  UINTN             Blocks,
+  IN  VOID              *Buffer
+  )
+{
+  return mBlockIo->WriteBlocks (mBlockIo, mBlockIo->Media->MediaId, Lba,
+                                Blocks * TEST_BLOCK_SIZE, Buffer);
+}
+
+//
+// SDHOST has no card detect, so MmcDxe is told about the new card.
+//
+STATIC
+EFI_STATUS
+SwapCard (
+  IN  CONST SD_CARD_CONFIG *Config
+  )
+{
+  SdCardInit (&mCard, Config);
+  return MmcDxeReidentify (&mMmc);
+}
+
+//
+// Nothing the driver must never do happened.
+//
+STATIC
+VOID
+CheckClean (
+  VOID
+  )
+{
+  CHECK (mModel.Violations == 0);
+  CHECK (mModel.Underruns == 0);
+  CHECK (mModel.Overruns == 0);
+  CHECK (mModel.FifoCount == 0);
+  CHECK (mCard.Violations == 0);
+  CHECK (mCard.IllegalCommands == 0);
+  CHECK (gHostDebug.Asserts == 0);
+}
+
+//
+// The tests.
+//
+
+STATIC
+VOID
+TestInit (
+  VOID
+  )
+{
+  EFI_STATUS    Status;
+  MEASURE       Measure;
+  UINT32        Fsel4;
+  UINT32        Fsel5;
+
+  Status = SdHostInitialize (gImageHandle, gST);
+  CHECK_STATUS (Status, EFI_SUCCESS);
+  CHECK_STATUS (HostLocateProtocol (&gEfiMmcHostProtocolGuid, (VOID **) &mHost), EFI_SUCCESS);
+  CHECK_STATUS (HostLocateProtocol (&gRaspberryPiMmcStatsProtocolGuid, (VOID **) &mStats), EFI_SUCCESS);
+  if (mHost == NULL || mStats == NULL) {
+    return;
+  }
+
+  // GPIO 48-53 go to SDHOST
+  Fsel4 = HostPeek32 (BCM2836_GPIO_GPFSEL (48));
+  Fsel5 = HostPeek32 (BCM2836_GPIO_GPFSEL (50));
+  CHECK (((Fsel4 >> 24) & 7) == TEST_GPIO_ALT0);
+  CHECK (((Fsel4 >> 27) & 7) == TEST_GPIO_ALT0);
+  CHECK ((Fsel5 & 0xFFF) == 04444);
+
+  MeasureStart (&Measure);
+  Status = MmcDxeStart (&mMmc, mHost);
+  CHECK_STATUS (Status, EFI_SUCCESS);
+  MeasureReport (&Measure, "identification", 0);
+  mBlockIo = &mMmc.BlockIo;
+
+  CHECK (mMmc.Media.MediaPresent);
+  CHECK (mMmc.Media.LastBlock == mSdhcConfig.Blocks - 1);
+  CHECK (CompareGuid (&mMmc.DevicePath.Host.Guid, &gRaspberryPiSdHostDevicePathGuid));
+  CHECK (mMmc.HighCapacity);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mCard.Rca == SD_CARD_RCA);
+  CHECK (mCard.BusWidth == 4);
+  CHECK (mCard.HighSpeedMode);
+  CHECK (SdHostModelClockHz (&mModel) == 50000000);
+  CHECK ((mModel.Hcfg & SDHOST_HCFG_WIDE_EXT_BUS) != 0);
+  CHECK (((mModel.Edm >> SDHOST_EDM_READ_THRESHOLD_SHIFT) & SDHOST_EDM_THRESHOLD_MASK) == 4);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSingleBlockRead (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd17 = mCard.Commands[17];
+  UINT64        Starts = gHostDma.Starts;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (100, 1, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "1 block DMA read", TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (100), TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.Commands[17] == Cmd17 + 1);
+  CHECK (gHostDma.Starts == Starts + 1);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mModel.Fsm == SDHOST_EDM_FSM_DATAMODE);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSingleBlockWrite (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd24 = mCard.Commands[24];
+
+  FillPattern (mBuffer, TEST_BLOCK_SIZE, 0x11);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (200, 1, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "1 block DMA write", TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (200), TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.Commands[24] == Cmd24 + 1);
+  CHECK (mModel.Fsm == SDHOST_EDM_FSM_DATAMODE);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestMultiBlockRead (
+  VOID
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  MEASURE                       Measure;
+  UINT64                        Cmd12 = mCard.Commands[12];
+  UINT64                        Cmd23 = mCard.Commands[23];
+  UINT64                        DmaWords = gHostDma.Words;
+  UINT64                        PioWords;
+
+  mStats->GetStats (mStats, &Stats);
+  PioWords = Stats->PioWords;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (1000, 64, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block DMA read", 64 * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (1000), 64 * TEST_BLOCK_SIZE) == 0);
+
+  // The tail under the read threshold, which raises no DREQ, by hand
+  CHECK (gHostDma.Words - DmaWords == 64 * TEST_BLOCK_SIZE / 4 - 3);
+  CHECK (Stats->PioWords - PioWords == 3);
+
+  // CMD23 closed it; MmcDxe's CMD12 never reaches the card
+  CHECK (mCard.Commands[23] == Cmd23 + 1);
+  CHECK (mCard.Commands[12] == Cmd12);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestMultiBlockWrite (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd12 = mCard.Commands[12];
+  UINT64        Written = mCard.BlocksWritten;
+
+  FillPattern (mBuffer, 64 * TEST_BLOCK_SIZE, 0x42);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (3000, 64, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block DMA write", 64 * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (3000), 64 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.BlocksWritten == Written + 64);
+  CHECK (mCard.Commands[12] == Cmd12);
+  CheckClean ();
+}
+
+//
+// Unaligned buffers go through the FIFO by hand, a burst per EDM level
+// read: the longer the burst, the fewer register reads per word.
+//
+STATIC
+VOID
+TestPioBurst (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT8         *Unaligned = (UINT8 *) mBuffer + 1;
+  UINT64        Starts = gHostDma.Starts;
+  UINT32        Burst = gHostPcdSdHostPioBurstWords;
+  UINT64        Burst16;
+  UINT64        Burst1;
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (500, TEST_PIO_BLOCKS, Unaligned), EFI_SUCCESS);
+  Burst16 = MeasureReport (&Measure, "8 block PIO read, 16 word bursts", TEST_PIO_BLOCKS * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (Unaligned, CardBlock (500), TEST_PIO_BLOCKS * TEST_BLOCK_SIZE) == 0);
+
+  gHostPcdSdHostPioBurstWords = 1;
+  SetMem (mBuffer, TEST_PIO_BLOCKS * TEST_BLOCK_SIZE + 4, 0);
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (500, TEST_PIO_BLOCKS, Unaligned), EFI_SUCCESS);
+  Burst1 = MeasureReport (&Measure, "8 block PIO read, 1 word bursts", TEST_PIO_BLOCKS * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (Unaligned, CardBlock (500), TEST_PIO_BLOCKS * TEST_BLOCK_SIZE) == 0);
+  gHostPcdSdHostPioBurstWords = Burst;
+
+  CHECK (Burst16 < Burst1);
+
+  FillPattern (Unaligned, TEST_PIO_BLOCKS * TEST_BLOCK_SIZE, 0x77);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (600, TEST_PIO_BLOCKS, Unaligned), EFI_SUCCESS);
+  MeasureReport (&Measure, "8 block PIO write", TEST_PIO_BLOCKS * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (Unaligned, CardBlock (600), TEST_PIO_BLOCKS * TEST_BLOCK_SIZE) == 0);
+
+  CHECK (gHostDma.Starts == Starts);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestDmaFallback (
+  VOID
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  UINT64                        Retries;
+
+  mStats->GetStats (mStats, &Stats);
+  Retries = Stats->Commands[18].Retries;
+
+  // No control blocks to be had, so the same transfer goes by PIO
+  gHostDma.FailStart = EFI_OUT_OF_RESOURCES;
+  CHECK_STATUS (ReadBlocks (700, 4, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (700), 4 * TEST_BLOCK_SIZE) == 0);
+  CHECK (Stats->Commands[18].Retries == Retries + 1);
+  CHECK (gHostDma.FailStart == EFI_SUCCESS);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestLargeRead (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Starts = gHostDma.Starts;
+  UINT64        Cmd18 = mCard.Commands[18];
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (0, TEST_LARGE_BLOCKS, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "9 MiB DMA read", TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE);
+
+  CHECK (CompareMem (mBuffer, CardBlock (0), TEST_LARGE_BLOCKS * TEST_BLOCK_SIZE) == 0);
+
+  // One command, the DMA chained over two starts
+  CHECK (mCard.Commands[18] == Cmd18 + 1);
+  CHECK (gHostDma.Starts == Starts + 2);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestDmaError (
+  VOID
+  )
+{
+  gHostDma.FailPoll = TRUE;
+  CHECK_STATUS (ReadBlocks (800, 16, mBuffer), EFI_DEVICE_ERROR);
+  CHECK (gHostDma.FailPoll == FALSE);
+  CHECK (mCard.IllegalCommands == 0);
+
+  // The card was stopped, the next one goes through
+  CHECK_STATUS (ReadBlocks (800, 16, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (800), 16 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mModel.Violations == 0);
+}
+
+STATIC
+VOID
+TestCrcError (
+  VOID
+  )
+{
+  UINT64        Errors = gHostDebug.Errors;
+
+  mCard.CrcErrorBlock = 901;
+  CHECK_STATUS (ReadBlocks (900, 4, mBuffer), EFI_DEVICE_ERROR);
+  CHECK (gHostDebug.Errors > Errors);
+  CHECK (mCard.IllegalCommands == 0);
+  CHECK ((mModel.Hsts & SDHOST_HSTS_ERROR) == 0);
+  mCard.CrcErrorBlock = SD_CARD_NO_FAULT;
+
+  CHECK_STATUS (ReadBlocks (900, 4, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (900), 4 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (mModel.Violations == 0);
+}
+
+STATIC
+VOID
+TestCommandTimeout (
+  VOID
+  )
+{
+  CONST RASPBERRY_PI_MMC_STATS *Stats;
+  UINT32                        Response[4];
+  UINT64                        Retries;
+  UINT64                        Cmd13 = mCard.Commands[13];
+  UINT64                        Start;
+
+  mStats->GetStats (mStats, &Stats);
+  Retries = Stats->Commands[13].Retries;
+
+  // The card never answers CMD13: FAIL every time, and out of tries
+  mCard.IgnoreCommand = 13;
+  Start = HostNowNs ();
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_TIMEOUT);
+  HostReport ("gave up after %llu us", (unsigned long long) ((HostNowNs () - Start) / HOST_NS_PER_US));
+  mCard.IgnoreCommand = SD_CARD_NO_FAULT;
+  CHECK (mCard.Commands[13] == Cmd13 + 3);
+  CHECK (Stats->Commands[13].Retries == Retries + 3);
+
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_SUCCESS);
+  CHECK_STATUS (mHost->ReceiveResponse (mHost, MMC_RESPONSE_TYPE_R1, Response), EFI_SUCCESS);
+  CHECK (((Response[0] >> 9) & 0xF) == SD_STATE_TRAN);
+
+  CHECK_STATUS (ReadBlocks (10, 2, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (10), 2 * TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestErase (
+  VOID
+  )
+{
+  EFI_ERASE_BLOCK_PROTOCOL  *EraseBlock = NULL;
+  MEASURE                   Measure;
+  UINT8                     Zero[TEST_BLOCK_SIZE];
+  UINT64                    Cmd17;
+
+  CHECK_STATUS (gBS->HandleProtocol (mMmc.Handle, &gEfiEraseBlockProtocolGuid,
+                                     (VOID **) &EraseBlock), EFI_SUCCESS);
+  if (EraseBlock == NULL) {
+    return;
+  }
+
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId + 1, 4000, NULL,
+                                         64 * TEST_BLOCK_SIZE), EFI_MEDIA_CHANGED);
+
+  // Not in the middle of a data command, which never reaches the card
+  Cmd17 = mCard.Commands[17];
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD17, 0), EFI_SUCCESS);
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId, 4000, NULL,
+                                         64 * TEST_BLOCK_SIZE), EFI_NOT_READY);
+  CHECK_STATUS (mHost->SendCommand (mHost, MMC_CMD13, SD_CARD_RCA << 16), EFI_SUCCESS);
+  CHECK (mCard.Commands[17] == Cmd17);
+  CHECK (mCard.Erases == 0);
+
+  MeasureStart (&Measure);
+  CHECK_STATUS (EraseBlock->EraseBlocks (EraseBlock, mMmc.Media.MediaId, 4000, NULL,
+                                         64 * TEST_BLOCK_SIZE), EFI_SUCCESS);
+  MeasureReport (&Measure, "64 block erase", 0);
+  CHECK (mCard.Erases == 1);
+  CHECK (HostNowNs () - Measure.Ns >= mSdhcConfig.EraseNs);
+  CHECK (mCard.State == SD_STATE_TRAN);
+
+  ZeroMem (Zero, sizeof (Zero));
+  CHECK_STATUS (ReadBlocks (4063, 1, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, Zero, TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+}
+
+STATIC
+VOID
+TestSdscCard (
+  VOID
+  )
+{
+  MEASURE       Measure;
+  UINT64        Cmd23;
+
+  CHECK_STATUS (SwapCard (&mSdscConfig), EFI_SUCCESS);
+  CHECK (!mMmc.HighCapacity);
+  CHECK (!mCard.HighSpeedMode);
+  CHECK (mMmc.Media.LastBlock == mSdscConfig.Blocks - 1);
+  CHECK (mCard.BusWidth == 4);
+
+  // TRAN_SPEED 0x32 is 25MHz, which CDIV rounds down to from the core clock
+  HostReport ("default speed SD clock %u Hz", SdHostModelClockHz (&mModel));
+  CHECK (SdHostModelClockHz (&mModel) <= 25000000);
+  CHECK (SdHostModelClockHz (&mModel) >= 20000000);
+
+  // Byte addressed, and closed by CMD12 instead of CMD23
+  Cmd23 = mCard.Commands[23];
+  MeasureStart (&Measure);
+  CHECK_STATUS (ReadBlocks (10, 32, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "32 block DMA read, SDSC", 32 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (mBuffer, CardBlock (10), 32 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.Commands[23] == Cmd23);
+  CHECK (mCard.Commands[12] == 1);
+
+  // Long writes tell the card how many blocks are coming
+  FillPattern (mBuffer, 128 * TEST_BLOCK_SIZE, 0x5A);
+  MeasureStart (&Measure);
+  CHECK_STATUS (WriteBlocks (1024, 128, mBuffer), EFI_SUCCESS);
+  MeasureReport (&Measure, "128 block DMA write, SDSC", 128 * TEST_BLOCK_SIZE);
+  CHECK (CompareMem (mBuffer, CardBlock (1024), 128 * TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.PreEraseBlocks == 128);
+  CHECK (mCard.Commands[12] == 2);
+
+  // The card programs the last block after CMD12, and is back for more
+  CHECK_STATUS (ReadBlocks (3, 1, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (3), TEST_BLOCK_SIZE) == 0);
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CheckClean ();
+
+  // And back, for whatever runs next
+  CHECK_STATUS (SwapCard (&mSdhcConfig), EFI_SUCCESS);
+  CHECK (mCard.HighSpeedMode);
+  CHECK (SdHostModelClockHz (&mModel) == 50000000);
+}
+
+//
+// An open-ended write is all on the card by the time WriteBlockData
+// returns, so a CMD12 sent straight after, without the CMD13 poll
+// MmcDxe puts in between, does not cut its last block short.
+//
+STATIC
+VOID
+TestStopRightAfterWrite (
+  VOID
+  )
+{
+  EFI_MMC_HOST_PROTOCOL *Host = mMmc.MmcHost;
+  UINT32                Response[4];
+  UINTN                 Polls;
+
+  CHECK_STATUS (SwapCard (&mSdscConfig), EFI_SUCCESS);
+
+  FillPattern (mBuffer, 8 * TEST_BLOCK_SIZE, 0x77);
+  CHECK_STATUS (Host->SendCommand (Host, MMC_CMD25, 2048 * TEST_BLOCK_SIZE), EFI_SUCCESS);
+  CHECK_STATUS (Host->ReceiveResponse (Host, MMC_RESPONSE_TYPE_R1, Response), EFI_SUCCESS);
+  CHECK_STATUS (Host->WriteBlockData (Host, 2048, 8 * TEST_BLOCK_SIZE, mBuffer), EFI_SUCCESS);
+  CHECK (mModel.FifoCount == 0);
+  CHECK_STATUS (Host->SendCommand (Host, MMC_CMD12, mMmc.Rca << 16), EFI_SUCCESS);
+  CHECK_STATUS (Host->ReceiveResponse (Host, MMC_RESPONSE_TYPE_R1b, Response), EFI_SUCCESS);
+
+  for (Polls = 0; Polls < 1000 && mCard.State != SD_STATE_TRAN; Polls++) {
+    CHECK_STATUS (Host->SendCommand (Host, MMC_CMD13, mMmc.Rca << 16), EFI_SUCCESS);
+    CHECK_STATUS (Host->ReceiveResponse (Host, MMC_RESPONSE_TYPE_R1, Response), EFI_SUCCESS);
+  }
+  CHECK (mCard.State == SD_STATE_TRAN);
+  CHECK (CompareMem (mBuffer, CardBlock (2048), 8 * TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+
+  CHECK_STATUS (SwapCard (&mSdhcConfig), EFI_SUCCESS);
+}
+
+//
+// A core clock change made through the firmware protocol reaches the
+// host through the clock change event: CDIV follows it right away, and
+// the rate stays cached until the next change.
+//
+STATIC
+VOID
+TestCoreClockChanged (
+  VOID
+  )
+{
+  RASPBERRY_PI_FIRMWARE_PROTOCOL  *Fw;
+  UINT32                          CoreHz = gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_CORE];
+  UINT64                          Queries;
+
+  CHECK_STATUS (HostLocateProtocol (&gRaspberryPiFirmwareProtocolGuid, (VOID **) &Fw), EFI_SUCCESS);
+
+  CHECK_STATUS (Fw->SetClockRate (RPI_FW_CLOCK_RATE_CORE, 250000000), EFI_SUCCESS);
+  CHECK (SdHostModelClockHz (&mModel) == 50000000);
+  CHECK (mModel.Cdiv == 3);
+
+  CHECK_STATUS (ReadBlocks (1000, 16, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (1000), 16 * TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+
+  // Card initialisation programs the clock again, from the cached rate
+  Queries = gHostFirmware.ClockQueries;
+  CHECK_STATUS (MmcDxeReidentify (&mMmc), EFI_SUCCESS);
+  CHECK (gHostFirmware.ClockQueries == Queries);
+  CHECK (mModel.Cdiv == 3);
+
+  CHECK_STATUS (Fw->SetClockRate (RPI_FW_CLOCK_RATE_CORE, CoreHz), EFI_SUCCESS);
+  CHECK (SdHostModelClockHz (&mModel) == 50000000);
+  CHECK (mModel.Cdiv == 6);
+
+  CHECK_STATUS (ReadBlocks (1000, 16, mBuffer), EFI_SUCCESS);
+  CHECK (CompareMem (mBuffer, CardBlock (1000), 16 * TEST_BLOCK_SIZE) == 0);
+  CheckClean ();
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  HostInit ();
+  gHostPcdSdController = MmcHostControllerSdHost;
+  SdCardInit (&mCard, &mSdhcConfig);
+  SdHostModelInit (&mModel, &mCard);
+
+  HostRunTest ("SdHost.Init", TestInit);
+  if (mBlockIo == NULL) {
+    return HostSummary ();
+  }
+
+  HostRunTest ("SdHost.SingleBlockRead", TestSingleBlockRead);
+  HostRunTest ("SdHost.SingleBlockWrite", TestSingleBlockWrite);
+  HostRunTest ("SdHost.MultiBlockRead", TestMultiBlockRead);
+  HostRunTest ("SdHost.MultiBlockWrite", TestMultiBlockWrite);
+  HostRunTest ("SdHost.PioBurst", TestPioBurst);
+  HostRunTest ("SdHost.DmaFallback", TestDmaFallback);
+  HostRunTest ("SdHost.LargeRead", TestLargeRead);
+  HostRunTest ("SdHost.DmaError", TestDmaError);
+  HostRunTest ("SdHost.CrcError", TestCrcError);
+  HostRunTest ("SdHost.CommandTimeout", TestCommandTimeout);
+  HostRunTest ("SdHost.Erase", TestErase);
+  HostRunTest ("SdHost.SdscCard", TestSdscCard);
+  HostRunTest ("SdHost.StopRightAfterWrite", TestStopRightAfterWrite);
+  HostRunTest ("SdHost.CoreClockChanged", TestCoreClockChanged);
+
+  return HostSummary ();
+}
@@ -0,0 +1,696 @@
+/** @file
+*
+*  The Arasan SDHCI controller model. Nothing runs on its own: whatever
+*  the SD bus did since the last register access is worked out on the
+*  next one, from the simulated time.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#include <IndustryStandard/Bcm2836Dma.h>
+#include <IndustryStandard/Bcm2836MMCHS.h>
+
+#include "SdhciModel.h"
+
+#define SDHCI_OFFSET(Register)    ((Register) - MMCHS1BASE)
+#define SDHCI_SIZE                0x100
+
+//
+// SD bus clocks taken by a command with its response, beyond the
+// response bits: the command itself, NCR and NRC.
+//
+#define SDHCI_CMD_CLOCKS          (48 + 2 + 8)
+#define SDHCI_NO_RESPONSE_CLOCKS  64
+// CRC, start, end bits and the CRC status a block is framed with
+#define SDHCI_BLOCK_CLOCKS        (16 + 2 + 8)
+
+#define SDHCI_REV_3_00            0x99020000
+
+#define SDHCI_CMD_ERRORS          (CTO | CCRC_EN | CEB_EN | CIE_EN)
+#define SDHCI_DATA_ERRORS         (DTO | DCRC | DEB)
+
+STATIC
+VOID
+SdhciLatch (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT32         Status
+  )
+{
+  Model->IntStat |= Status & Model->Ie;
+}
+
+UINT32
+SdhciModelClockHz (
+  IN  SDHCI_MODEL       *Model
+  )
+{
+  UINT32 Base;
+  UINT32 Divisor;
+
+  if ((Model->Sysctl & (ICE | CEN)) != (ICE | CEN)) {
+    return 0;
+  }
+
+  Base = gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_EMMC];
+  Divisor = ((Model->Sysctl >> 8) & 0xFF) | (((Model->Sysctl >> 6) & 0x3) << 8);
+  return Divisor == 0 ? Base : Base / (2 * Divisor);
+}
+
+STATIC
+UINT64
+SdhciClocksToNs (
+  IN  SDHCI_MODEL       *Model,
+  IN  UINT64            Clocks
+  )
+{
+  UINT32 Hz = SdhciModelClockHz (Model);
+
+  ASSERT (Hz != 0);
+  return (Clocks * 1000000000ULL + Hz - 1) / Hz;
+}
+
+STATIC
+UINT32
+SdhciBusWidth (
+  IN  SDHCI_MODEL       *Model
+  )
+{
+  return (Model->Hctl & DTW_4_BIT) != 0 ? 4 : 1;
+}
+
+//
+// DTO_VAL counts TMCLK * 2^(13 + n), TMCLK being the base clock here.
+//
+STATIC
+UINT64
+SdhciDataTimeoutNs (
+  IN  SDHCI_MODEL       *Model
+  )
+{
+  UINT32 Exponent = 13 + ((Model->Sysctl & DTO_MASK) >> 16);
+
+  return (1ULL << Exponent) * 1000000000ULL / gHostFirmware.ClockRate[RPI_FW_CLOCK_RATE_EMMC];
+}
+
+STATIC
+VOID
+SdhciResetCmd (
+  IN OUT SDHCI_MODEL    *Model
+  )
+{
+  Model->CmdDoneNs = SDHCI_NEVER;
+  Model->CmdStatus = 0;
+  Model->IntStat &= ~(CC | SDHCI_CMD_ERRORS);
+}
+
+STATIC
+VOID
+SdhciResetData (
+  IN OUT SDHCI_MODEL    *Model
+  )
+{
+  Model->Reading = FALSE;
+  Model->Writing = FALSE;
+  Model->DataBusy = FALSE;
+  Model->TcNs = SDHCI_NEVER;
+  Model->FaultNs = SDHCI_NEVER;
+  Model->FifoHead = 0;
+  Model->FifoCount = 0;
+  Model->WordIndex = 0;
+  Model->HeadAnnounced = FALSE;
+  Model->BlocksLeft = 0;
+  Model->IntStat &= ~(TC | BWR | BRR | SDHCI_DATA_ERRORS);
+}
+
+//
+// The last block is through: the host sends CMD12 itself if asked to,
+// and TC latches once the card is done.
+//
+STATIC
+VOID
+SdhciFinishData (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT64         EndNs
+  )
+{
+  UINT32 Response[4];
+
+  if (Model->AutoCmd12) {
+    if (SdCardCommand (Model->Card, 12, 0, SdhciModelClockHz (Model), Response) == SdNoResponse) {
+      Response[0] = 0;
+    }
+    Model->Rsp[3] = Response[0];
+    Model->AutoCmd12s++;
+    EndNs += SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + 48);
+  }
+
+  if (Model->Writing) {
+    EndNs = MAX (EndNs, Model->Card->BusyUntilNs);
+  }
+
+  Model->TcNs = EndNs;
+}
+
+STATIC
+VOID
+SdhciFault (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT64         AtNs,
+  IN     UINT32         Status
+  )
+{
+  if (Model->FaultNs == SDHCI_NEVER) {
+    Model->FaultNs = AtNs;
+    Model->FaultStatus = Status;
+  }
+}
+
+//
+// Catches up with the SD bus.
+//
+STATIC
+VOID
+SdhciSync (
+  IN OUT SDHCI_MODEL    *Model
+  )
+{
+  UINT64        Now = HostNowNs ();
+  UINTN         Slot;
+  SD_CARD_DATA  Data;
+
+  if (Model->CmdDoneNs <= Now) {
+    Model->CmdDoneNs = SDHCI_NEVER;
+    if ((Model->CmdStatus & CC) != 0) {
+      CopyMem (Model->Rsp, Model->CmdRsp, sizeof (Model->Rsp));
+    }
+    SdhciLatch (Model, Model->CmdStatus);
+  }
+
+  if (Model->Reading) {
+    while (Model->BlocksLeft > 0 && Model->FifoCount < SDHCI_FIFO_BLOCKS &&
+           Model->NextBlockNs <= Now && Model->FaultNs == SDHCI_NEVER) {
+      Slot = (Model->FifoHead + Model->FifoCount) % SDHCI_FIFO_BLOCKS;
+      Data = SdCardReadData (Model->Card, Model->Fifo[Slot], Model->BlockSize, SdhciBusWidth (Model));
+      if (Data == SdDataNone || !Model->CardInserted) {
+        SdhciFault (Model, Model->NextBlockNs + SdhciDataTimeoutNs (Model), DTO);
+        break;
+      }
+      if (Data == SdDataCrcError) {
+        SdhciFault (Model, Model->NextBlockNs, DCRC);
+        break;
+      }
+
+      Model->FifoReadyNs[Slot] = Model->NextBlockNs;
+      Model->FifoCount++;
+      Model->BlocksLeft--;
+      if (Model->FifoCount < SDHCI_FIFO_BLOCKS) {
+        Model->NextBlockNs += Model->BlockBusNs;
+      } else {
+        // Both buffers full: the host stops the clock until one drains.
+        Model->NextBlockNs = SDHCI_NEVER;
+      }
+    }
+
+    if (Model->FifoCount > 0 && !Model->HeadAnnounced &&
+        Model->FifoReadyNs[Model->FifoHead] <= Now) {
+      SdhciLatch (Model, BRR);
+      Model->HeadAnnounced = TRUE;
+    }
+  }
+
+  if (Model->Writing && Model->BlocksLeft > 0 && Model->WordIndex == 0 && !Model->HeadAnnounced) {
+    for (Slot = 0; Slot < SDHCI_FIFO_BLOCKS; Slot++) {
+      if (Model->FifoReadyNs[Slot] <= Now) {
+        SdhciLatch (Model, BWR);
+        Model->HeadAnnounced = TRUE;
+        break;
+      }
+    }
+  }
+
+  if (Model->FaultNs <= Now) {
+    SdhciLatch (Model, Model->FaultStatus);
+    Model->FaultNs = SDHCI_NEVER;
+    Model->FaultStatus = 0;
+    Model->BlocksLeft = 0;
+  }
+
+  if (Model->TcNs <= Now) {
+    Model->TcNs = SDHCI_NEVER;
+    Model->DataBusy = FALSE;
+    Model->Reading = FALSE;
+    Model->Writing = FALSE;
+    SdhciLatch (Model, TC);
+  }
+}
+
+STATIC
+VOID
+SdhciCommand (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT32         Cmd
+  )
+{
+  UINT32            Index = CMD_INDEX (Cmd);
+  UINT32            Type = Cmd & RSP_TYPE_MASK;
+  UINT32            Hz;
+  UINT32            Response[4];
+  UINT32            Blocks;
+  UINT64            Start = HostNowNs ();
+  SD_CARD_RESPONSE  Kind;
+
+  Model->Cmd = Cmd;
+  Model->Commands++;
+
+  if (Model->CmdDoneNs != SDHCI_NEVER || Model->StuckCmdi) {
+    DEBUG ((DEBUG_ERROR, "Sdhci: CMD%u issued with CMDI set\n", Index));
+    Model->Violations++;
+    return;
+  }
+  if (Model->DataBusy && Index != 12) {
+    DEBUG ((DEBUG_ERROR, "Sdhci: CMD%u issued with DATI set\n", Index));
+    Model->Violations++;
+    return;
+  }
+
+  Hz = SdhciModelClockHz (Model);
+  if (Hz == 0) {
+    // Nothing goes out, CMDI stays set until the command line is reset.
+    DEBUG ((DEBUG_ERROR, "Sdhci: CMD%u issued with the SD clock off\n", Index));
+    Model->Violations++;
+    Model->CmdDoneNs = SDHCI_NEVER - 1;
+    Model->CmdStatus = 0;
+    return;
+  }
+
+  if (!Model->CardInserted) {
+    Model->CmdDoneNs = Start + SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + SDHCI_NO_RESPONSE_CLOCKS);
+    Model->CmdStatus = CTO;
+    return;
+  }
+
+  if ((Cmd & ACEN_MASK) == ACEN_ACMD23) {
+    Model->AutoCmd23s++;
+    SdCardCommand (Model->Card, 23, Model->Arg2, Hz, Response);
+    Model->Rsp[3] = Response[0];
+    Start += SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + 48);
+  }
+
+  Kind = SdCardCommand (Model->Card, Index, Model->Arg, Hz, Response);
+
+  if (Kind == SdNoResponse) {
+    if (Type == 0) {
+      Model->CmdDoneNs = Start + SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS);
+      Model->CmdStatus = CC;
+      CopyMem (Model->CmdRsp, Model->Rsp, sizeof (Model->Rsp));
+    } else {
+      Model->CmdDoneNs = Start + SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + SDHCI_NO_RESPONSE_CLOCKS);
+      Model->CmdStatus = CTO;
+    }
+    return;
+  }
+
+  CopyMem (Model->CmdRsp, Model->Rsp, sizeof (Model->Rsp));
+  if (Kind == SdResponse136) {
+    // The CRC is left out, so the registers hold the response a byte lower.
+    Model->CmdRsp[0] = (Response[0] >> 8) | (Response[1] << 24);
+    Model->CmdRsp[1] = (Response[1] >> 8) | (Response[2] << 24);
+    Model->CmdRsp[2] = (Response[2] >> 8) | (Response[3] << 24);
+    Model->CmdRsp[3] = Response[3] >> 8;
+    Model->CmdDoneNs = Start + SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + 136);
+  } else {
+    Model->CmdRsp[0] = Response[0];
+    Model->CmdDoneNs = Start + SdhciClocksToNs (Model, SDHCI_CMD_CLOCKS + 48);
+  }
+  Model->CmdStatus = CC;
+
+  if (Index == 12) {
+    // Stops whatever transfer the host had going
+    SdhciResetData (Model);
+  }
+
+  if ((Cmd & DP_ENABLE) == 0) {
+    if (Type == RSP_TYPE_48BUSY) {
+      Model->DataBusy = TRUE;
+      Model->TcNs = Model->CmdDoneNs;
+      if (Model->Card->State == SD_STATE_PRG) {
+        Model->TcNs = MAX (Model->TcNs, Model->Card->BusyUntilNs);
+      }
+    }
+    return;
+  }
+
+  Model->BlockSize = Model->Blk & 0xFFF;
+  Blocks = (Cmd & BCE_ENABLE) != 0 ? Model->Blk >> BLOCK_COUNT_SHIFT : 1;
+  ASSERT (Model->BlockSize != 0 && Model->BlockSize <= SD_CARD_BLOCK_SIZE && Blocks != 0);
+
+  SdhciResetData (Model);
+  Model->DataBusy = TRUE;
+  Model->Reading = (Cmd & DDIR_READ) != 0;
+  Model->Writing = !Model->Reading;
+  Model->BlocksLeft = Blocks;
+  Model->AutoCmd12 = (Cmd & ACEN_MASK) == ACEN_ACMD12;
+  Model->BlockBusNs = SdhciClocksToNs (Model,
+                        Model->BlockSize * 8 / SdhciBusWidth (Model) + SDHCI_BLOCK_CLOCKS);
+
+  if (Model->Reading) {
+    Model->NextBlockNs = Model->CmdDoneNs + Model->Card->Config.ReadAccessNs + Model->BlockBusNs;
+  } else {
+    Model->FifoReadyNs[0] = Model->CmdDoneNs;
+    Model->FifoReadyNs[1] = Model->CmdDoneNs;
+    Model->BusFreeNs = Model->CmdDoneNs;
+  }
+}
+
+STATIC
+UINT32
+SdhciReadData (
+  IN OUT SDHCI_MODEL    *Model
+  )
+{
+  UINT32  Word;
+  UINTN   Head = Model->FifoHead;
+
+  if (!Model->Reading || Model->FifoCount == 0 || Model->FifoReadyNs[Head] > HostNowNs ()) {
+    Model->Underruns++;
+    Model->Violations++;
+    return 0;
+  }
+
+  CopyMem (&Word, &Model->Fifo[Head][Model->WordIndex * 4], sizeof (Word));
+  Model->WordIndex++;
+
+  if (Model->WordIndex * 4 == Model->BlockSize) {
+    Model->FifoHead = (Head + 1) % SDHCI_FIFO_BLOCKS;
+    Model->FifoCount--;
+    Model->WordIndex = 0;
+    Model->HeadAnnounced = FALSE;
+
+    if (Model->BlocksLeft > 0 && Model->NextBlockNs == SDHCI_NEVER) {
+      Model->NextBlockNs = HostNowNs () + Model->BlockBusNs;
+    }
+    if (Model->BlocksLeft == 0 && Model->FifoCount == 0 && Model->FaultNs == SDHCI_NEVER &&
+        Model->TcNs == SDHCI_NEVER) {
+      SdhciFinishData (Model, HostNowNs ());
+    }
+  }
+
+  return Word;
+}
+
+STATIC
+VOID
+SdhciWriteData (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT32         Word
+  )
+{
+  UINT64        Now = HostNowNs ();
+  UINT64        Start;
+  UINT64        End;
+  UINTN         Slot;
+  SD_CARD_DATA  Data;
+
+  if (!Model->Writing || Model->BlocksLeft == 0) {
+    Model->Overruns++;
+    Model->Violations++;
+    return;
+  }
+
+  if (Model->WordIndex == 0) {
+    for (Slot = 0; Slot < SDHCI_FIFO_BLOCKS; Slot++) {
+      if (Model->FifoReadyNs[Slot] <= Now) {
+        break;
+      }
+    }
+    if (Slot == SDHCI_FIFO_BLOCKS) {
+      Model->Overruns++;
+      Model->Violations++;
+      return;
+    }
+    Model->FifoHead = Slot;
+    // Taken until the block is through on the bus
+    Model->FifoReadyNs[Slot] = SDHCI_NEVER;
+  }
+
+  Slot = Model->FifoHead;
+  CopyMem (&Model->Fifo[Slot][Model->WordIndex * 4], &Word, sizeof (Word));
+  Model->WordIndex++;
+
+  if (Model->WordIndex * 4 < Model->BlockSize) {
+    return;
+  }
+
+  Start = MAX (Now, Model->BusFreeNs);
+  Start = MAX (Start, Model->Card->BusyUntilNs);
+  End = Start + Model->BlockBusNs;
+
+  Data = SdDataNone;
+  if (Model->CardInserted) {
+    Data = SdCardWriteData (Model->Card, Model->Fifo[Slot], Model->BlockSize, SdhciBusWidth (Model), End);
+  }
+  if (Data != SdDataOk) {
+    // No CRC status token back, or a bad one
+    SdhciFault (Model, End, DCRC);
+  }
+
+  Model->FifoReadyNs[Slot] = End;
+  Model->BusFreeNs = End;
+  Model->BlocksLeft--;
+  Model->WordIndex = 0;
+  Model->HeadAnnounced = FALSE;
+
+  if (Model->BlocksLeft == 0 && Model->FaultNs == SDHCI_NEVER) {
+    SdhciFinishData (Model, End);
+  }
+}
+
+STATIC
+VOID
+SdhciSysctl (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     UINT32         Value
+  )
+{
+  if ((Value & SRA) != 0) {
+    SdhciResetCmd (Model);
+    SdhciResetData (Model);
+    Model->Blk = 0;
+    Model->Arg = 0;
+    Model->Arg2 = 0;
+    Model->Cmd = 0;
+    Model->Hctl = 0;
+    Model->Ie = 0;
+    Model->IntStat = 0;
+    Model->Ac12 = 0;
+    Value = 0;
+  }
+  if ((Value & SRC) != 0) {
+    SdhciResetCmd (Model);
+  }
+  if ((Value & SRD) != 0) {
+    SdhciResetData (Model);
+  }
+
+  // The resets are done at once, and the internal clock is stable at once.
+  Model->Sysctl = Value & ~(SRA | SRC | SRD | ICS);
+}
+
+STATIC
+UINT32
+SdhciRead (
+  IN  VOID              *Context,
+  IN  UINTN             Offset
+  )
+{
+  SDHCI_MODEL *Model = Context;
+  UINT32      Value;
+
+  SdhciSync (Model);
+
+  switch (Offset) {
+  case SDHCI_OFFSET (MMCHS_ARG2):
+    return Model->Arg2;
+  case SDHCI_OFFSET (MMCHS_BLK):
+    return Model->Blk;
+  case SDHCI_OFFSET (MMCHS_ARG):
+    return Model->Arg;
+  case SDHCI_OFFSET (MMCHS_CMD):
+    return Model->Cmd;
+  case SDHCI_OFFSET (MMCHS_RSP10):
+  case SDHCI_OFFSET (MMCHS_RSP32):
+  case SDHCI_OFFSET (MMCHS_RSP54):
+  case SDHCI_OFFSET (MMCHS_RSP76):
+    return Model->Rsp[(Offset - SDHCI_OFFSET (MMCHS_RSP10)) / 4];
+  case SDHCI_OFFSET (MMCHS_DATA):
+    return SdhciReadData (Model);
+  case SDHCI_OFFSET (MMCHS_PRES_STATE):
+    Value = 0;
+    if (Model->CmdDoneNs != SDHCI_NEVER || Model->StuckCmdi) {
+      Value |= CMDI_NOT_ALLOWED;
+    }
+    if (Model->DataBusy) {
+      Value |= DATI_NOT_ALLOWED;
+    }
+    if (Model->CardInserted) {
+      Value |= CARD_INSERTED;
+    }
+    if (!Model->WriteProtected) {
+      Value |= WRITE_PROTECT_OFF;
+    }
+    return Value;
+  case SDHCI_OFFSET (MMCHS_HCTL):
+    return Model->Hctl;
+  case SDHCI_OFFSET (MMCHS_SYSCTL):
+    return Model->Sysctl | ((Model->Sysctl & ICE) != 0 ? ICS : 0);
+  case SDHCI_OFFSET (MMCHS_INT_STAT):
+    Value = Model->IntStat;
+    if ((Value & 0xFFFF0000) != 0) {
+      Value |= ERRI;
+    }
+    return Value;
+  case SDHCI_OFFSET (MMCHS_IE):
+    return Model->Ie;
+  case SDHCI_OFFSET (MMCHS_AC12):
+    return Model->Ac12;
+  case SDHCI_OFFSET (MMCHS_CAPA):
+    return VS30;
+  case SDHCI_OFFSET (MMCHS_CAPA2):
+    return Model->Capa2;
+  case SDHCI_OFFSET (MMCHS_REV):
+    return Model->Rev;
+  default:
+    return 0;
+  }
+}
+
+STATIC
+VOID
+SdhciWrite (
+  IN  VOID              *Context,
+  IN  UINTN             Offset,
+  IN  UINT32            Value
+  )
+{
+  SDHCI_MODEL *Model = Context;
+  UINT32      Enabled;
+
+  SdhciSync (Model);
+
+  switch (Offset) {
+  case SDHCI_OFFSET (MMCHS_ARG2):
+    Model->Arg2 = Value;
+    break;
+  case SDHCI_OFFSET (MMCHS_BLK):
+    Model->Blk = Value;
+    break;
+  case SDHCI_OFFSET (MMCHS_ARG):
+    Model->Arg = Value;
+    break;
+  case SDHCI_OFFSET (MMCHS_CMD):
+    SdhciCommand (Model, Value);
+    break;
+  case SDHCI_OFFSET (MMCHS_DATA):
+    SdhciWriteData (Model, Value);
+    break;
+  case SDHCI_OFFSET (MMCHS_HCTL):
+    Model->Hctl = Value;
+    break;
+  case SDHCI_OFFSET (MMCHS_SYSCTL):
+    SdhciSysctl (Model, Value);
+    break;
+  case SDHCI_OFFSET (MMCHS_INT_STAT):
+    Model->IntStat &= ~Value;
+    break;
+  case SDHCI_OFFSET (MMCHS_IE):
+    //
+    // A card already in when its status gets enabled shows up as an
+    // insertion, which is what the driver's card detect goes by.
+    //
+    Enabled = Value & ~Model->Ie;
+    Model->Ie = Value;
+    if ((Enabled & CARD_INS) != 0 && Model->CardInserted) {
+      SdhciLatch (Model, CARD_INS);
+    }
+    break;
+  case SDHCI_OFFSET (MMCHS_AC12):
+    Model->Ac12 = Value;
+    break;
+  default:
+    break;
+  }
+}
+
+STATIC
+BOOLEAN
+SdhciDreq (
+  IN  VOID                  *Context,
+  IN  BCM2836_DMA_DIRECTION Direction
+  )
+{
+  SDHCI_MODEL *Model = Context;
+  UINTN       Slot;
+
+  SdhciSync (Model);
+
+  if (Direction == Bcm2836DmaFromDevice) {
+    return Model->Reading && Model->FifoCount > 0 &&
+           Model->FifoReadyNs[Model->FifoHead] <= HostNowNs ();
+  }
+
+  if (!Model->Writing || Model->BlocksLeft == 0) {
+    return FALSE;
+  }
+  if (Model->WordIndex != 0) {
+    return TRUE;
+  }
+  for (Slot = 0; Slot < SDHCI_FIFO_BLOCKS; Slot++) {
+    if (Model->FifoReadyNs[Slot] <= HostNowNs ()) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+VOID
+SdhciModelInit (
+  OUT SDHCI_MODEL       *Model,
+  IN  SD_CARD           *Card
+  )
+{
+  ZeroMem (Model, sizeof (*Model));
+  Model->Card = Card;
+  Model->Rev = SDHCI_REV_3_00;
+  Model->CardInserted = TRUE;
+  Model->CmdDoneNs = SDHCI_NEVER;
+  SdhciResetData (Model);
+
+  Model->Region = HostMapMmio ("Arasan", MMCHS1BASE, SDHCI_SIZE, SdhciRead, SdhciWrite, Model);
+  HostConnectDreq (BCM2836_DMA_DREQ_EMMC, SdhciDreq, Model);
+}
+
+VOID
+SdhciModelSetCardInserted (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     BOOLEAN        Inserted
+  )
+{
+  if (Inserted == Model->CardInserted) {
+    return;
+  }
+
+  Model->CardInserted = Inserted;
+  if (Inserted) {
+    SdCardPowerCycle (Model->Card);
+    SdhciLatch (Model, CARD_INS);
+  } else {
+    SdhciLatch (Model, CARD_REM);
+  }
+}
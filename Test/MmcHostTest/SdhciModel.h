@@ -0,0 +1,116 @@
+/** @file
+*
+*  The Arasan SDHCI controller of the BCM2837, from the register side:
+*  command and data timing on the SD bus, the two block data buffer,
+*  the interrupt status latches, the soft resets and the DREQ to the DMA
+*  engine.
+*
+*  This program and the accompanying materials
+*  are licensed and made available under the terms and conditions of the BSD License
+*  which accompanies this distribution.  The full text of the license may be found at
+*  http://opensource.org/licenses/bsd-license.php
+*
+*  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+*
+**/
+
+#ifndef __SDHCI_MODEL_H__
+#define __SDHCI_MODEL_H__
+
+#include "SdCard.h"
+
+#define SDHCI_FIFO_BLOCKS         2
+#define SDHCI_NEVER               MAX_UINT64
+
+typedef struct {
+  SD_CARD               *Card;
+  HOST_MMIO_REGION      *Region;
+
+  //
+  // Registers that only hold what was written.
+  //
+  UINT32                Arg2;
+  UINT32                Blk;
+  UINT32                Arg;
+  UINT32                Cmd;
+  UINT32                Rsp[4];
+  UINT32                Hctl;
+  UINT32                Sysctl;
+  UINT32                IntStat;
+  UINT32                Ie;
+  UINT32                Ac12;
+  UINT32                Rev;
+  UINT32                Capa2;
+
+  BOOLEAN               CardInserted;
+  BOOLEAN               WriteProtected;
+
+  //
+  // The command in flight, complete at CmdDoneNs. R1b busy and the data
+  // transfer hold DATI until TcNs, when TC latches.
+  //
+  UINT64                CmdDoneNs;
+  UINT32                CmdStatus;
+  UINT32                CmdRsp[4];
+  BOOLEAN               DataBusy;
+  UINT64                TcNs;
+
+  //
+  // The data transfer.
+  //
+  BOOLEAN               Reading;
+  BOOLEAN               Writing;
+  UINT32                BlockSize;
+  UINT32                BlocksLeft;     // Still to move on the bus
+  BOOLEAN               AutoCmd12;
+  UINT64                BlockBusNs;
+
+  UINT8                 Fifo[SDHCI_FIFO_BLOCKS][SD_CARD_BLOCK_SIZE];
+  UINT64                FifoReadyNs[SDHCI_FIFO_BLOCKS]; // Read: block in; write: slot free
+  UINTN                 FifoHead;
+  UINTN                 FifoCount;
+  UINTN                 WordIndex;      // Into the block the CPU is on
+  BOOLEAN               HeadAnnounced;  // BRR/BWR latched for it
+  UINT64                NextBlockNs;    // Read: the next block is in then
+  UINT64                BusFreeNs;      // Write: the last block is through then
+  UINT64                FaultNs;        // DCRC or DTO latches then
+  UINT32                FaultStatus;
+
+  //
+  // Faults to inject.
+  //
+  BOOLEAN               StuckCmdi;
+
+  //
+  // What happened.
+  //
+  UINT64                Commands;
+  UINT64                Violations;     // Things the driver must never do
+  UINT64                Underruns;
+  UINT64                Overruns;
+  UINT64                AutoCmd12s;
+  UINT64                AutoCmd23s;
+} SDHCI_MODEL;
+
+VOID
+SdhciModelInit (
+  OUT SDHCI_MODEL       *Model,
+  IN  SD_CARD           *Card
+  );
+
+VOID
+SdhciModelSetCardInserted (
+  IN OUT SDHCI_MODEL    *Model,
+  IN     BOOLEAN        Inserted
+  );
+
+//
+// The SD clock the controller puts out now, 0 if it's stopped.
+//
+UINT32
+SdhciModelClockHz (
+  IN  SDHCI_MODEL       *Model
+  );
+
+#endif /* __SDHCI_MODEL_H__ */